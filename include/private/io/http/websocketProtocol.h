@@ -0,0 +1,112 @@
+#ifndef SP2_PRIVATE_IO_HTTP_WEBSOCKET_PROTOCOL_H
+#define SP2_PRIVATE_IO_HTTP_WEBSOCKET_PROTOCOL_H
+
+#include <sp2/nonCopyable.h>
+#include <sp2/io/dataBuffer.h>
+#include <string>
+
+#include "miniz.h"
+
+namespace sp {
+namespace io {
+namespace http {
+namespace websocket {
+    static constexpr int fin_mask = 0x80;
+    static constexpr int rsv1_mask = 0x40;
+    static constexpr int rsv_mask = 0x70;
+    static constexpr int opcode_mask = 0x0f;
+
+    static constexpr int mask_mask = 0x80;
+    static constexpr int payload_length_mask = 0x7f;
+    static constexpr int payload_length_16bit = 126;
+    static constexpr int payload_length_64bit = 127;
+
+    static constexpr int opcode_continuation = 0x00;
+    static constexpr int opcode_text = 0x01;
+    static constexpr int opcode_binary = 0x02;
+    static constexpr int opcode_close = 0x08;
+    static constexpr int opcode_ping = 0x09;
+    static constexpr int opcode_pong = 0x0a;
+
+    //Smaller messages are not worth compressing.
+    static constexpr size_t min_compress_size = 64;
+    //Messages that are not streamed are collected in memory, larger messages close the connection.
+    static constexpr size_t max_message_size = 64 * 1024 * 1024;
+
+/** Compression for the permessage-deflate extension (RFC 7692).
+    Every message is compressed on its own (no context takeover), so a compressed frame can be send to multiple connections.
+ */
+class Deflater : NonCopyable
+{
+public:
+    Deflater();
+    ~Deflater();
+
+    //Returns false when the compressed data is not smaller, then the message should be send uncompressed.
+    bool compress(const void* data, size_t size, std::string& output);
+private:
+    mz_stream stream;
+};
+
+//Decompression for the permessage-deflate extension. Keeps the window between messages, so it works with and without context takeover.
+class Inflater : NonCopyable
+{
+public:
+    Inflater();
+    ~Inflater();
+
+    bool add(const uint8_t* data, size_t size, std::string& output);
+    //Add the end of message marker that is stripped by the sender.
+    bool finishMessage(std::string& output);
+private:
+    mz_stream stream;
+};
+
+/** Incremental websocket frame parser.
+    Data frames are handed out as soon as part of their payload is received, so large messages do not need to be buffered as a whole.
+ */
+class FrameReader : NonCopyable
+{
+public:
+    enum class Result
+    {
+        NeedMoreData,
+        Data,       //Part of a message is added to the output. message_end is set on the last part.
+        Control,    //A control frame, in control_opcode and control_payload.
+        Error
+    };
+
+    void enableDeflate() { deflate = true; }
+    //Parse from buffer[offset] till buffer[size], offset is moved past the data that is used.
+    //Data is unmasked in place.
+    Result next(uint8_t* buffer, size_t size, size_t& offset, std::string& output);
+
+    bool isBinary() const { return message_opcode == opcode_binary; }
+    bool message_end = false;
+    int control_opcode = 0;
+    std::string control_payload;
+private:
+    bool deflate = false;
+    Inflater inflater;
+
+    bool in_frame = false;
+    int frame_opcode = 0;
+    bool frame_fin = false;
+    uint64_t frame_remaining = 0;
+    uint8_t frame_mask[4] = {0, 0, 0, 0};
+    size_t frame_mask_offset = 0;
+
+    bool in_message = false;
+    int message_opcode = 0;
+    bool message_compressed = false;
+};
+
+//Build a complete, unmasked frame. The message is compressed when a deflater is given and this makes it smaller.
+void buildFrame(io::DataBuffer& frame, int opcode, const void* data, size_t size, Deflater* deflater);
+
+}//namespace websocket
+}//namespace http
+}//namespace io
+}//namespace sp
+
+#endif//SP2_PRIVATE_IO_HTTP_WEBSOCKET_PROTOCOL_H
@@ -18,15 +18,23 @@ public:
     static constexpr uint8_t set_client_id = 0x02;
     //When the game speed changes, we need to update this to the clients. As this is an engine global, we have a special handling for this.
     static constexpr uint8_t change_game_speed = 0x03;
+    //Table of the class names the server uses, send after the client id. Varint count, followed by the names.
+    //The position of a name in this table is the class id used in create_object packets.
+    static constexpr uint8_t class_table = 0x04;
+    //Send when a joining client got all existing objects. Until then the client is still synchronizing.
+    static constexpr uint8_t synchronized = 0x05;
     
-    //Create a new object, gives the typeid, and all the members to set.
+    //Create new objects. One or more entries of varint object id, varint class id and varint parent id.
+    //Objects in a single packet are created in order, so a parent can be in the same packet as its children.
     static constexpr uint8_t create_object = 0x10;
-    //Update members of an object
+    //Update members of an object. Varint object id, followed by the varint link index and data of each member.
     static constexpr uint8_t update_object = 0x11;
-    //Delete a specific object
+    //Delete a specific object, by varint object id.
     static constexpr uint8_t delete_object = 0x12;
+    //Changed members of all objects in a single frame, see SnapshotWriter for the format.
+    static constexpr uint8_t snapshot = 0x13;
 
-    //Scenes should already exist on the client, this packet is to link an multiplayer ID to a scene.
+    //Scenes should already exist on the client, this packet is to link an multiplayer ID (varint) to a scene.
     static constexpr uint8_t setup_scene = 0x20;
 
     //Packet send from the client to the server to indicate the client wants to call a function on the server.
@@ -40,6 +48,15 @@ public:
     
     //Magic value to identify a SP2 server/client.
     static constexpr uint64_t magic_sp2_value = 0x33a7a0651d1394b1;
+
+    //UDP connect request, a raw datagram outside of the UdpConnection: this magic value followed by a cookie string.
+    //The client sends it with an empty cookie. The server replies with the same datagram containing a cookie for the address of the client,
+    //  without storing anything. The server only creates the client when a request with a valid cookie is received,
+    //  so spoofed source addresses cannot make the server allocate clients.
+    //Requests are padded with zeros to at least udp_connect_request_size bytes, which is more then the size of a reply,
+    //  so spoofed requests cannot be used to send more data to someone else. Shorter requests are ignored.
+    static constexpr uint32_t udp_connect_magic = 0x9e37c0de;
+    static constexpr size_t udp_connect_request_size = 64;
 };
 
 };//namespace multiplayer
@@ -4,9 +4,13 @@
 #include <sp2/pointer.h>
 #include <sp2/string.h>
 #include <sp2/assert.h>
+#include <sp2/threading/workerPool.h>
+#include <memory>
+#include <vector>
 
 namespace sp {
 
+class Scene;
 class Engine : public AutoPointerObject
 {
 public:
@@ -16,9 +20,19 @@ public:
     class UpdateTiming
     {
     public:
+        class SceneTiming
+        {
+        public:
+            string name;
+            float fixed_update;
+            float dynamic_update;
+        };
+
         float fixed_update;
         float dynamic_update;
         float render;
+        //Time spend in each scene, summed over all fixed updates of this frame.
+        std::vector<SceneTiming> scenes;
     } last_update_timing;
 
     Engine();
@@ -36,6 +50,12 @@ public:
     bool getPause();
     void shutdown();
 
+    //Update scenes that are marked as independent on the given amount of worker threads.
+    // Setting this to 0 (the default) updates all scenes serially on the main thread.
+    // Otherwise the other scenes are updated first on the main thread, and then the independent scenes in parallel.
+    void setSceneUpdateThreads(int thread_count);
+    int getSceneUpdateThreads();
+
     // Check if we are currently calling onUpdateFixed.
     bool isInFixedUpdate() { return in_fixed_update; }
 
@@ -70,6 +90,10 @@ private:
     float current_fps = 0.0;
     bool initialized = false;
     bool shutdown_flag = false;
+
+    std::unique_ptr<threading::WorkerPool> scene_update_pool;
+
+    void updateScenes(UpdateTiming& timing, float UpdateTiming::SceneTiming::*timing_field, const std::function<void(Scene* scene)>& function);
 };
 
 }//namespace sp
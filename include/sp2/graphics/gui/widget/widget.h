@@ -22,6 +22,8 @@ public:
     Widget(P<Widget> parent);
     virtual ~Widget();
 
+    Handle<Widget> getHandle() { return this; }
+
     class LayoutInfo
     {
     public:
@@ -173,12 +175,14 @@ private:
     class AutoReloadData
     {
     public:
-        std::chrono::system_clock::time_point last_modify_time;
+        int watch_id;
         string resource_name;
         string root_id;
         P<Widget> widget;
     };
     std::vector<AutoReloadData> auto_reload;
+
+    void autoReload(const string& resource_name, const string& root_id);
 #endif
 
     friend class GraphicsLayer;
@@ -3,6 +3,7 @@
 
 #include <sp2/nonCopyable.h>
 #include <sp2/math/vector.h>
+#include <sp2/math/aabb.h>
 #include <sp2/string.h>
 #include <memory>
 
@@ -49,11 +50,15 @@ public:
     ~MeshData();
     
     void render();
+    //Render multiple instances at once, needs instancing support from OpenGL, see isOpenGLInstancingSupported()
+    void renderInstanced(int instance_count);
     void update(Vertices&& vertices, Indices&& indices);
 
     int getRevision() { return revision; }
     const Vertices& getVertices() { return vertices; }
     const Indices& getIndices() { return indices; }
+    //Local bounding box of all vertices, calculated when requested after the mesh has changed.
+    const AABB3f& getBounds();
     
     static std::shared_ptr<MeshData> create(Vertices&& vertices, Indices&& indices, Type type=Type::Static);
     static std::shared_ptr<MeshData> createQuad(Vector2f size, Vector2f uv0=Vector2f(0, 0), Vector2f uv1=Vector2f(1, 1));
@@ -66,10 +71,13 @@ private:
     unsigned int indices_vbo;
 
     bool dirty;
+    bool bounds_dirty;
     int revision;
+    AABB3f bounds;
     Type type;
 
     MeshData(Type type);
+    bool bindBuffers();
 };
 
 }//namespace sp
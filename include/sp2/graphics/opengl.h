@@ -12,6 +12,8 @@
 
 namespace sp {
 void initOpenGL();
+//True when glDrawElementsInstanced and glVertexAttribDivisor are available.
+bool isOpenGLInstancingSupported();
 }//namespace sp
 
 
@@ -66,6 +68,7 @@ template<typename A1, typename... ARGS> string traceOpenGLCallParams(const A1& a
 #define glDisableVertexAttribArray(...) do { glDisableVertexAttribArray(__VA_ARGS__); sp::traceOpenGLCall("glDisableVertexAttribArray", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glDrawArrays(...) do { glDrawArrays(__VA_ARGS__); sp::traceOpenGLCall("glDrawArrays", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glDrawElements(...) do { glDrawElements(__VA_ARGS__); sp::traceOpenGLCall("glDrawElements", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
+#define glDrawElementsInstanced(...) do { glDrawElementsInstanced(__VA_ARGS__); sp::traceOpenGLCall("glDrawElementsInstanced", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glEnable(...) do { glEnable(__VA_ARGS__); sp::traceOpenGLCall("glEnable", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glEnableVertexAttribArray(...) do { glEnableVertexAttribArray(__VA_ARGS__); sp::traceOpenGLCall("glEnableVertexAttribArray", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glFinish(...) do { glFinish(__VA_ARGS__); sp::traceOpenGLCall("glFinish", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
@@ -154,6 +157,7 @@ template<typename A1, typename... ARGS> string traceOpenGLCallParams(const A1& a
 #define glVertexAttrib4f(...) do { glVertexAttrib4f(__VA_ARGS__); sp::traceOpenGLCall("glVertexAttrib4f", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glVertexAttrib4fv(...) do { glVertexAttrib4fv(__VA_ARGS__); sp::traceOpenGLCall("glVertexAttrib4fv", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glVertexAttribPointer(...) do { glVertexAttribPointer(__VA_ARGS__); sp::traceOpenGLCall("glVertexAttribPointer", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
+#define glVertexAttribDivisor(...) do { glVertexAttribDivisor(__VA_ARGS__); sp::traceOpenGLCall("glVertexAttribDivisor", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 #define glViewport(...) do { glViewport(__VA_ARGS__); sp::traceOpenGLCall("glViewport", __FILE__, __PRETTY_FUNCTION__, __LINE__, sp::traceOpenGLCallParams(__VA_ARGS__)); } while(0)
 
 #endif//SP2_ENABLE_OPENGL_TRACING
@@ -23,6 +23,10 @@ extern "C" {
 #endif
 #define GL_DEPTH_STENCIL_ATTACHMENT 0x821A
 
+//Instanced rendering. These are optional, and will be nullptr if the driver does not support instancing.
+extern void (GL_APIENTRY * glDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount);
+extern void (GL_APIENTRY * glVertexAttribDivisor)(GLuint index, GLuint divisor);
+
 #ifdef __cplusplus
 }//extern "C"
 #endif
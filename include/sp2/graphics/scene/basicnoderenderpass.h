@@ -5,7 +5,9 @@
 #include <sp2/graphics/scene/renderqueue.h>
 #include <sp2/math/ray.h>
 #include <sp2/pointerList.h>
+#include <sp2/attributes.h>
 #include <list>
+#include <vector>
 
 namespace sp {
 class Scene;
@@ -28,19 +30,37 @@ public:
     virtual void onTextInput(TextInputEvent e) override;
     
     void addCamera(P<Camera> camera);
+    //Only submit nodes that have render bounds inside the view frustum of the camera. Disabled by default.
+    //When enabled, only nodes with a mesh and a render type are passed to addNodeToRenderQueue,
+    //  and code that changes render_data needs to call Node::markRenderDataDirty.
+    //Nodes can opt out by returning infinite bounds from Node::getRenderBounds.
+    void setFrustumCulling(bool enabled) { frustum_culling = enabled; }
+
+    class Statistics
+    {
+    public:
+        int submitted = 0;
+        int culled = 0;
+    };
+    //Statistics of the last render call, only filled when frustum culling is enabled.
+    const Statistics& getStatistics() const { return statistics; }
 protected:
-    virtual void addNodeToRenderQueue(RenderQueue& queue, P<Node>& node);
+    virtual void addNodeToRenderQueue(RenderQueue& queue, Node* node);
+    //Old signature, kept for one release. It is final, so an override of it fails to compile instead of never being called.
+    SP2_DEPRECATED("Use addNodeToRenderQueue(RenderQueue&, Node*)") virtual void addNodeToRenderQueue(RenderQueue& queue, P<Node>& node) final;
 
     PList<Camera> cameras;
 private:
     std::map<int, P<Scene>> pointer_scene;
     std::map<int, P<Camera>> pointer_camera;
     P<Scene> focus_scene;
+    bool frustum_culling = false;
+    Statistics statistics;
+    std::vector<Node*> visible_nodes;
     
     bool privateOnPointerMove(P<Scene> scene, P<Camera> camera, Vector2d position, int id);
     bool privateOnPointerDown(P<Scene> scene, P<Camera> camera, io::Pointer::Button button, Vector2d position, int id);
     void renderScene(RenderQueue& queue, P<Scene> scene, P<Camera> camera);
-    void recursiveNodeRender(RenderQueue& queue, P<Node> node);
 };
 
 }//namespace sp
@@ -9,14 +9,50 @@
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+#include <stdint.h>
 
 
 namespace sp {
 
 class Camera;
+/** Collects everything that needs to be rendered in a frame, and renders it in an optimal order.
+
+    Render items added between two camera changes or function calls are sorted on a 64 bit key,
+    which is build from the order, type, shader, texture, mesh and depth of the item.
+    Items only store raw pointers, the caller needs to keep meshes, shaders and textures alive till render() is called.
+
+    After sorting, runs of items with the same type, shader, mesh, texture and scale are grouped into batches.
+    If the shader has an "a_instance_matrix" attribute and OpenGL supports instancing, a batch is rendered with a single
+    instanced draw, with the transform and color of each item in the a_instance_matrix and a_instance_color attributes.
+ */
 class RenderQueue
 {
 public:
+    //Counters of the last rendered frame, to see how much GL work is saved by sorting and state caching.
+    class Statistics
+    {
+    public:
+        int draws = 0;
+        int state_changes = 0;          //Shader binds, blend function, depth mask and texture binds.
+        int state_changes_skipped = 0;
+        int uniform_uploads = 0;
+        int uniform_uploads_skipped = 0;
+        int instanced_draws = 0;
+    };
+
+    //Run of sorted items that share all render state, and can be drawn with a single instanced draw.
+    class Batch
+    {
+    public:
+        RenderData::Type type;
+        Shader* shader;
+        MeshData* mesh;
+        Texture* texture;
+        Vector3f scale;
+        uint32_t start; //Index of the first item in the sorted items.
+        uint32_t count;
+    };
+
     RenderQueue();
 
     void setTargetAspectSize(float aspect_ratio);
@@ -26,50 +62,118 @@ public:
     void add(std::function<void()> function);
     void add(const Matrix4x4f& transform, const RenderData& data);
     void render();
+
+    Statistics getStatistics();
+    //Batches of the items that are added and sorted so far, before render() is called. For tests and debugging.
+    const std::vector<Batch>& getBatches() const { return frame.batches; }
 private:
-    class Item
+    class Command
     {
     public:
         enum class Type
         {
             CameraProjection,
             CameraTransform,
-            RenderItem,
+            RenderItems,
             FunctionCall,
         };
-    
-        Item(Type type, const Matrix4x4f& transform)
-        : type(type), transform(transform)
-        {
-        }
 
-        Item(const Matrix4x4f& transform, const RenderData& data)
-        : type(Type::RenderItem), transform(transform), data(data)
+        Command(Type type, const Matrix4x4f& transform)
+        : type(type), transform(transform)
         {
         }
 
-        Item(std::function<void()> function)
-        : type(Type::FunctionCall), function(function)
+        Command(uint32_t start, uint32_t end)
+        : type(Type::RenderItems), start(start), end(end)
         {
         }
 
-        bool operator<(const Item& other) const
+        Command(std::function<void()>&& function)
+        : type(Type::FunctionCall), function(std::move(function))
         {
-            return data < other.data;
         }
 
         Type type;
         Matrix4x4f transform;
-        RenderData data;
+        //Range in the batches for RenderItems
+        uint32_t start;
+        uint32_t end;
         std::function<void()> function;
     };
 
-    void render(std::vector<Item>& list);
+    //Everything that is needed to draw a single item, without anything that needs to be reference counted.
+    class DrawRecord
+    {
+    public:
+        Matrix4x4f transform;
+        RenderData::Type type;
+        Shader* shader;
+        MeshData* mesh;
+        Texture* texture;
+        Color color;
+        Vector3f scale;
+    };
+
+    class SortEntry
+    {
+    public:
+        uint64_t key;
+        uint32_t index;
+    };
+
+    class Frame
+    {
+    public:
+        std::vector<Command> commands;
+        std::vector<DrawRecord> draw_records;
+        std::vector<SortEntry> sort_entries;
+        std::vector<Batch> batches;
+#ifdef SP2_USE_RENDER_THREAD
+        //Meshes are kept alive till the render thread is done with them.
+        std::vector<std::shared_ptr<MeshData>> meshes;
+#endif
+
+        void clear();
+    };
+
+    //GL state as last set by the render queue. Reset on every function call, as those can change any GL state.
+    class StateCache
+    {
+    public:
+        enum class Blend
+        {
+            Unknown,
+            Alpha,
+            Additive
+        };
+
+        Blend blend = Blend::Unknown;
+        int depth_mask = -1;
+        Texture* texture = nullptr;
+    };
+
+    void sortPendingItems();
+    uint64_t buildSortKey(const Matrix4x4f& transform, const RenderData& data);
+    void render(Frame& frame);
+    void buildBatches(uint32_t start, uint32_t end);
+    void renderBatches(Frame& frame, uint32_t start, uint32_t end);
+    void renderInstanced(Frame& frame, const Batch& batch);
+    void setBlend(StateCache::Blend blend);
+    void setDepthMask(bool enabled);
+    template<typename T> void setUniform(Shader* shader, Shader::Uniform uniform, const T& value);
 
     Matrix4x4f camera_projection;
     Matrix4x4f camera_transform;
-    std::vector<Item> render_list;
-    int render_list_sort_start;
+    bool force_camera_matrix_update;
+    StateCache state;
+    Statistics statistics;
+    Statistics last_statistics;
+    Matrix4x4f sort_camera_transform;
+    unsigned int instance_buffer;
+    std::vector<float> instance_data;
+    Frame frame;
+    uint32_t sort_start;
+    std::vector<SortEntry> sort_buffer;
     
     float target_aspect_ratio;
     float aspect_ratio;
@@ -81,7 +185,7 @@ private:
     std::mutex render_mutex;
     std::condition_variable render_trigger;
     bool render_data_ready;
-    std::vector<Item> ready_render_list;
+    Frame ready_frame;
 #endif
 };
 
@@ -6,6 +6,8 @@
 #include <sp2/math/matrix4x4.h>
 #include <sp2/graphics/color.h>
 #include <sp2/nonCopyable.h>
+#include <mutex>
+#include <atomic>
 
 namespace sp {
 
@@ -14,6 +16,19 @@ class Texture;
 class Shader : public NonCopyable
 {
 public:    
+    //Uniforms that are used for every draw. Their locations are resolved when the shader is linked,
+    //and the last uploaded value is remembered so uploads of unchanged values can be skipped.
+    enum class Uniform
+    {
+        ProjectionMatrix,
+        CameraMatrix,
+        ObjectMatrix,
+        ObjectScale,
+        Color,
+        TextureMap,
+        Count
+    };
+
     bool bind();
     void setUniform(const string& s, const Matrix4x4f& matrix);
     void setUniform(const string& s, const Vector2f& v);
@@ -22,23 +37,56 @@ public:
     void setUniform(const string& s, float v);
     void setUniform(const string& s, Texture* v);
 
+    bool hasUniform(Uniform uniform) const { return uniform_slots[int(uniform)].location != -1; }
+    //Returns true if the value was uploaded, false if the shader does not have this uniform or already has this value.
+    bool setUniform(Uniform uniform, const Matrix4x4f& matrix);
+    bool setUniform(Uniform uniform, const Vector3f& v);
+    bool setUniform(Uniform uniform, const Color& v);
+    bool setUniform(Uniform uniform, int v);
+
 private:
+    class UniformSlot
+    {
+    public:
+        int location = -1;
+        bool valid = false;
+        float value[16];
+
+        //Store a new value, returns false if the value is the same as the stored value.
+        bool update(const void* data, size_t size);
+    };
+
+
     Shader(const string& name);
     Shader(const string& name, string&& vertex_shader, string&& fragment_shader);
     ~Shader();
     
+    //Load the shader code again, after the resource changed. Only stores the new code,
+    //the program is replaced on the next bind, as that is where the GL calls can be done.
+    void reload();
+    void applyReload();
     unsigned int compileShader(const char* code, int type);
     int getUniformLocation(const string& s);
+    void invalidateUniformSlot(int location);
 
     unsigned int program;
-    int vertex_attribute;
-    int normal_attribute;
-    int uv_attribute;
+    int vertex_attribute = -1;
+    int normal_attribute = -1;
+    int uv_attribute = -1;
+    int instance_matrix_attribute = -1;
+    int instance_color_attribute = -1;
     std::map<string, int> uniform_mapping;
+    UniformSlot uniform_slots[int(Uniform::Count)];
 
     string name;
     string vertex_shader;
     string fragment_shader;
+    std::mutex reload_mutex;
+    std::atomic<bool> reload_pending{false};
+    string reload_vertex_shader;
+    string reload_fragment_shader;
+    //Small persistent number, used by the RenderQueue to group items with the same shader.
+    uint32_t sort_id;
 public:
     static Shader* get(const string& name);
     static void unbind();
@@ -46,8 +94,10 @@ public:
 private:
     static std::map<string, Shader*> cached_shaders;
     static Shader* bound_shader;
+    static inline std::atomic<uint32_t> next_sort_id{0};
     
     friend class MeshData;
+    friend class RenderQueue;
 };
 
 }//namespace sp
@@ -73,8 +73,7 @@ private:
         
         std::map<string, Animation> animations;
 #ifdef DEBUG
-        string resource_name;
-        std::chrono::system_clock::time_point resource_update_time;
+        //Increased on each load, so SpriteAnimations notice a reload.
         int revision;
 #endif
 
@@ -92,6 +91,7 @@ private:
     bool flip;
 #ifdef DEBUG
     int revision;
+    string animation_key;
 #endif
 public:
     static std::unique_ptr<Animation> load(const string& resource_name);
@@ -6,6 +6,7 @@
 #include <sp2/graphics/image.h>
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 
 namespace sp {
@@ -23,13 +24,20 @@ public:
     const string& getName() { return name; }
 protected:
     Texture(Type type, const string& name)
-    : type(type), name(name), revision(0) {}
+    : type(type), name(name), revision(0), sort_id(++next_sort_id) {}
     virtual ~Texture() {}
 
     Type type;
     string name;
     int revision;
     bool smooth = false;
+private:
+    //Small persistent number, used by the RenderQueue to group items with the same texture. 0 is used for no texture.
+    uint32_t sort_id;
+
+    static inline std::atomic<uint32_t> next_sort_id{0};
+
+    friend class RenderQueue;
 };
 
 class OpenGLTexture : public Texture
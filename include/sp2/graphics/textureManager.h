@@ -11,6 +11,7 @@ class TextureManager : public io::LazyLoader<Texture*>
 {
 public:
     TextureManager();
+    ~TextureManager();
 
     void setFallbackColors(sp::Color primary_color, sp::Color secondary_color);
     void setDefaultSmoothFiltering(bool enabled);
@@ -18,6 +19,7 @@ public:
     
     //In case a texture is changed on disk, you can call this function to forcefully reload the texture.
     //Note that the loading still happens in the background, and the old texture will be shown till load is done.
+    //In debug builds this is done automatically when the ResourceWatcher reports a change.
     void forceRefresh(const string& name);
 protected:
     virtual Texture* prepare(const string& name) override;
@@ -27,6 +29,8 @@ private:
     sp::Color fallback_secondary_color;
     
     bool default_smooth;
+    //Resource watches from prepare, removed again on destruction as the callbacks use this manager.
+    std::vector<int> watch_ids;
 };
 extern TextureManager texture_manager;
 
@@ -0,0 +1,211 @@
+#ifndef SP2_HANDLE_H
+#define SP2_HANDLE_H
+
+#include <sp2/nonCopyable.h>
+#include <sp2/assert.h>
+#include <type_traits>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+namespace sp {
+
+/** Slot table that maps handles to objects, one table exists for every ROOT type.
+
+    Slots are stored in fixed size chunks that are allocated once and never moved, so looking up a handle does not need a lock.
+    Every time an object is removed the generation of its slot is increased, which invalidates all handles to it.
+    add and remove are serialized by a mutex, get can be called from any thread at the same time.
+    The object pointer and generation are atomics: writes are release, reads are acquire.
+    get reads the generation again after the object, so a slot that got reused during the lookup is never returned.
+ */
+template<class ROOT> class HandleTable
+{
+public:
+    static constexpr uint32_t chunk_size = 4096;
+    static constexpr uint32_t max_chunks = 4096;
+
+    static void add(ROOT* object, uint32_t& index, uint32_t& generation)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_count > 0)
+        {
+            index = free_start;
+            free_start = getSlot(index).next_free;
+            free_count--;
+        }
+        else
+        {
+            index = used_count++;
+            if (index % chunk_size == 0)
+            {
+                sp2assert(index / chunk_size < max_chunks, "More then 16 million live objects of a single handle type.");
+                chunks[index / chunk_size].store(new Slot[chunk_size](), std::memory_order_release);
+            }
+        }
+        Slot& slot = getSlot(index);
+        uint32_t slot_generation = slot.generation.load(std::memory_order_relaxed);
+        if (slot_generation == 0)
+        {
+            slot_generation = 1;
+            slot.generation.store(slot_generation, std::memory_order_release);
+        }
+        slot.object.store(object, std::memory_order_release);
+        generation = slot_generation;
+    }
+
+    static void remove(uint32_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot& slot = getSlot(index);
+        slot.object.store(nullptr, std::memory_order_release);
+        slot.generation.store(slot.generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        slot.next_free = free_start;
+        free_start = index;
+        free_count++;
+    }
+
+    static ROOT* get(uint32_t index, uint32_t generation)
+    {
+        if (generation == 0)
+            return nullptr;
+        Slot* chunk = chunks[index / chunk_size].load(std::memory_order_acquire);
+        if (!chunk)
+            return nullptr;
+        Slot& slot = chunk[index % chunk_size];
+        if (slot.generation.load(std::memory_order_acquire) != generation)
+            return nullptr;
+        ROOT* object = slot.object.load(std::memory_order_acquire);
+        //If the object was removed and the slot reused between the two reads, the generation has changed.
+        if (slot.generation.load(std::memory_order_acquire) != generation)
+            return nullptr;
+        return object;
+    }
+private:
+    class Slot
+    {
+    public:
+        std::atomic<ROOT*> object;
+        std::atomic<uint32_t> generation;
+        uint32_t next_free;
+    };
+
+    static Slot& getSlot(uint32_t index)
+    {
+        return chunks[index / chunk_size].load(std::memory_order_relaxed)[index % chunk_size];
+    }
+
+    static inline std::atomic<Slot*> chunks[max_chunks];
+    static inline uint32_t used_count = 0;
+    static inline uint32_t free_start = 0;
+    static inline uint32_t free_count = 0;
+    static inline std::mutex mutex;
+};
+
+/** Registers an object in the HandleTable for its lifetime. Objects that can hand out handles have this as member.
+ */
+template<class ROOT> class HandleRegistration : NonCopyable
+{
+public:
+    HandleRegistration(ROOT* object)
+    {
+        HandleTable<ROOT>::add(object, index, generation);
+    }
+
+    ~HandleRegistration()
+    {
+        HandleTable<ROOT>::remove(index);
+    }
+
+    uint32_t index;
+    uint32_t generation;
+};
+
+/** Non owning, generational handle to an object.
+
+    A \ref sp::Handle<T> is an alternative to \ref sp::P<T> for places where references are copied a lot.
+    Copying a handle and checking if the object still exists are O(1) and never write to the object,
+    while a \ref sp::P<T> links itself into the object on every copy.
+    The downside is that every access does a lookup in the slot table of the type.
+
+    T needs to have a HandleRoot type and a HandleRegistration<HandleRoot> member named handle_registration,
+    which is the case for sp::Node (and thus all widgets) and sp::Scene.
+
+    Example:
+    \code
+    sp::Handle<sp::Node> handle = node->getHandle();
+    node.destroy();
+    if (handle) LOG(Error, "This will never happen");
+    \endcode
+ */
+template<class T> class Handle
+{
+public:
+    Handle()
+    : index(0), generation(0)
+    {
+    }
+
+    Handle(T* object)
+    : index(0), generation(0)
+    {
+        if (object)
+        {
+            typedef typename T::HandleRoot Root;
+            index = static_cast<Root*>(object)->handle_registration.index;
+            generation = static_cast<Root*>(object)->handle_registration.generation;
+        }
+    }
+
+    template<class T2, class = typename std::enable_if<std::is_base_of<T, T2>::value>::type> Handle(const Handle<T2>& other)
+    : index(other.index), generation(other.generation)
+    {
+    }
+
+    T* operator->() const
+    {
+        return lookup();
+    }
+
+    T* operator*() const
+    {
+        return lookup();
+    }
+
+    explicit operator bool() const
+    {
+        return lookup() != nullptr;
+    }
+
+    //Delete the object this handle refers to, if it still exists.
+    void destroy()
+    {
+        delete **this;
+    }
+
+    bool operator==(const Handle<T>& other) const
+    {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const Handle<T>& other) const
+    {
+        return index != other.index || generation != other.generation;
+    }
+
+private:
+    uint32_t index;
+    uint32_t generation;
+
+    //Resolved on use instead of at class level, so handles to incomplete types can be declared.
+    T* lookup() const
+    {
+        typedef typename T::HandleRoot Root;
+        return static_cast<T*>(HandleTable<Root>::get(index, generation));
+    }
+
+    template<class T2> friend class Handle;
+};
+
+}//namespace sp
+
+#endif//SP2_HANDLE_H
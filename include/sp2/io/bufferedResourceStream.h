@@ -0,0 +1,40 @@
+#ifndef SP2_IO_BUFFERED_RESOURCE_STREAM_H
+#define SP2_IO_BUFFERED_RESOURCE_STREAM_H
+
+#include <sp2/io/resourceProvider.h>
+#include <vector>
+
+namespace sp {
+namespace io {
+
+/** Reads the wrapped stream in large blocks, so small reads and readLine do not go to the provider for every byte.
+    ResourceProvider::get wraps all streams that do not have a contiguous view with this.
+ */
+class BufferedResourceStream : public ResourceStream
+{
+public:
+    //The buffer is never larger than the wrapped stream.
+    BufferedResourceStream(ResourceStreamPtr stream, size_t buffer_size=64 * 1024);
+
+    virtual int64_t read(void* data, int64_t size) override;
+    virtual int64_t seek(int64_t position) override;
+    virtual int64_t tell() override;
+    virtual int64_t getSize() override;
+
+    virtual string readLine() override;
+private:
+    //Read the next block into the buffer, returns false at the end of the stream.
+    bool fill();
+
+    ResourceStreamPtr stream;
+    std::vector<uint8_t> buffer;
+    //Position in the wrapped stream of the start of the buffer.
+    int64_t buffer_position;
+    size_t buffer_offset = 0;
+    size_t buffer_used = 0;
+};
+
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_BUFFERED_RESOURCE_STREAM_H
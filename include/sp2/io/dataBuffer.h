@@ -4,6 +4,7 @@
 #include <sp2/string.h>
 #include <sp2/math/vector.h>
 #include <string.h>
+#include <algorithm>
 
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
 #  define IF_LITTLE_ENDIAN(x) do { x; } while(0)
@@ -163,6 +164,18 @@ public:
         memcpy(&buffer[idx], other.buffer.data(), other.buffer.size());
     }
     
+    //Variable length encoding, 7 bits per byte with the high bit set when more bytes follow.
+    //Small values like ids and indices take 1 or 2 bytes instead of 8.
+    void writeVarint(uint64_t i)
+    {
+        while(i >= 0x80)
+        {
+            buffer.push_back(uint8_t(i) | 0x80);
+            i >>= 7;
+        }
+        buffer.push_back(uint8_t(i));
+    }
+
     template<typename T, typename... ARGS> void read(T& value, ARGS&... args)
     {
         read(value);
@@ -273,6 +286,30 @@ public:
     template<class T, class=typename std::enable_if<std::is_enum<T>::value>::type>
     void read(T& enum_value) { uint16_t v=0; read(v); enum_value = T(v); }
 
+    void readVarint(uint64_t& i)
+    {
+        i = 0;
+        for(int shift=0; shift<64 && read_index < buffer.size(); shift+=7)
+        {
+            uint8_t b = buffer[read_index++];
+            i |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return;
+        }
+    }
+
+    void readRaw(void* ptr, size_t size)
+    {
+        if (read_index + size > buffer.size()) { memset(ptr, 0, size); read_index = buffer.size(); return; }
+        memcpy(ptr, &buffer[read_index], size);
+        read_index += size;
+    }
+
+    void skip(size_t size)
+    {
+        read_index = std::min(read_index + size, buffer.size());
+    }
+
     size_t available()
     {
         return buffer.size() - read_index;
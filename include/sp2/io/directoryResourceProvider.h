@@ -2,23 +2,45 @@
 #define SP2_IO_DIRECTORYRESOURCEPROVIDER_H
 
 #include <sp2/io/resourceProvider.h>
+#include <map>
+#include <mutex>
+#include <condition_variable>
 
 namespace sp {
 namespace io {
 
+/** Resources from a directory on disk.
+    On platforms with inotify, a background thread indexes all files below the directory, and keeps the index up to date.
+    Searches use the index, and wait for it when it is still being built. Single files are always opened from the disk,
+    so files written right before they are opened are found even when the index did not see them yet.
+    The same thread reports changed files to the ResourceWatcher, for files that changed after the index was built.
+    Without an index the ResourceWatcher polls for changes instead.
+ */
 class DirectoryResourceProvider : public ResourceProvider
 {
 public:
     DirectoryResourceProvider(const string& base_path, int priority=0);
+    virtual ~DirectoryResourceProvider();
     
     virtual ResourceStreamPtr getStream(const string& filename) override;
     virtual std::chrono::system_clock::time_point getResourceModifyTime(const string& filename) override;
     virtual std::vector<string> findResources(const string& search_pattern) override;
+    virtual bool notifiesResourceChanges(const string& filename) override;
 
 private:
     string base_path;
-    
-    void findResources(std::vector<string>& found_files, const string& path, const string& search_pattern);
+
+    class Watcher;
+    std::unique_ptr<Watcher> watcher;
+    std::mutex index_mutex;
+    std::condition_variable index_condition;
+    bool indexing = false;
+    bool indexed = false;
+    //Relative path of each file and directory, with true for directories.
+    std::map<string, bool> index;
+    std::unordered_map<string, std::vector<string>> find_cache;
+
+    void findResources(std::vector<string>& found_files, const string& path, const SearchPattern& search_pattern);
 };
 
 }//namespace io
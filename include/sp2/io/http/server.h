@@ -5,7 +5,13 @@
 #include <sp2/updatable.h>
 #include <sp2/io/network/tcpListener.h>
 #include <sp2/io/network/tcpSocket.h>
+#include <sp2/threading/workerPool.h>
+#include <sp2/threading/lockFreeQueue.h>
 #include <list>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <stdio.h>
 #include <thread>
 #include <mutex>
 #include <chrono>
@@ -17,6 +23,10 @@ namespace io {
 namespace http {
 
 class WebsocketHandler;
+namespace websocket {
+class Deflater;
+class FrameReader;
+}//namespace websocket
 /**
     Basic HTTP webserver.
     Runs a single threaded webserver which can handle:
@@ -24,6 +34,14 @@ class WebsocketHandler;
         * APIs
         * Websockets
     Protocol and file handling is done on a separate thread, while URL handlers and Websocket handlers are processed on the main thread.
+    URL handlers that do not need access to the engine can run on a pool of worker threads instead, see setWorkerCount.
+    Connections are kept alive, and multiple requests send after each other on a connection are answered in order.
+
+    Static files support ETag validation, single byte ranges and gzip encoding.
+    Small files are kept in memory, and text files among them are compressed once. A "file.gz" next to a file is used as its compressed version.
+    Larger files are send with sendfile() where available, without reading them in.
+
+    Websockets support the permessage-deflate extension. Broadcasts build the frame once and share it between the connections.
  */
 class Server : public Updatable
 {
@@ -37,15 +55,27 @@ public:
         std::unordered_map<string, string> headers;
     };
 
+    enum class HandlerThread
+    {
+        Main,   //Run on the main thread, during the update of the server. The handler can access the engine and game state.
+        Worker  //Run on a worker thread, as soon as the request arrives. The handler needs to be thread safe.
+    };
+
     Server(int port_nr=80);
     ~Server();
+
+    //Start a pool of worker threads for URL handlers added with HandlerThread::Worker. Without workers, these handlers run on the main thread.
+    //At most max_pending_requests requests wait for a worker, further requests are answered with "503 Service Unavailable".
+    void setWorkerCount(int count, int max_pending_requests=256);
     
     //Set the path on the filesystem where statics files are read from.
     //  Note: This does not use the ResourceProvider system.
     void setStaticFilePath(const string& static_file_path);
+    //Set the amount of memory used to keep small static files in memory, 0 disables caching.
+    void setStaticFileCacheSize(size_t bytes);
     //Add a callback function to handle a specific URL request.
     // The URL should be prefixed with a "/", the return value of the callback is send back as data to the browser.
-    void addURLHandler(const string& url, std::function<string(const Request&)> func);
+    void addURLHandler(const string& url, std::function<string(const Request&)> func, HandlerThread thread=HandlerThread::Main);
     //Add a simple websocket handler, this handler will process any websocket message from any websocket connected to a specific URL.
     //  No distinction or state between connections is made.
     //  URLs should start with a "/"
@@ -60,22 +90,65 @@ public:
 private:
     string static_file_path;
 
+    //Static files up to this size are kept in memory, with the least recently used ones removed first.
+    static constexpr size_t max_cached_file_size = 64 * 1024;
+    class CachedFile
+    {
+    public:
+        string path;
+        size_t size;
+        int64_t modified_time;
+        string data;
+        //Empty when there is no compressed version.
+        string gzip_data;
+    };
+    std::list<CachedFile> static_file_cache;
+    std::unordered_map<string, std::list<CachedFile>::iterator> static_file_cache_index;
+    size_t static_file_cache_size = 0;
+    size_t static_file_cache_limit = 16 * 1024 * 1024;
+
+    //Returns nullptr if the file could not be read or does not fit in the cache.
+    CachedFile* getCachedFile(const string& path, size_t size, int64_t modified_time);
+
     void handlerThread();
     virtual void onUpdate(float delta) override;
 
     std::thread handler_thread;
     std::recursive_mutex mutex;
-    std::map<string, std::function<string(const Request&)>> http_handlers;
+    class URLHandler
+    {
+    public:
+        std::function<string(const Request&)> func;
+        HandlerThread thread;
+    };
+    std::map<string, URLHandler> http_handlers;
     std::map<string, std::function<void(const string& data)>> simple_websocket_handlers;
     std::map<string, std::function<sp::P<WebsocketHandler>()>> advanced_websocket_handlers;
 
     sp::io::network::TcpListener listen_socket;
+    //Messages are compressed without context takeover, so the same compressed frame can go to every connection.
+    std::unique_ptr<websocket::Deflater> websocket_deflater;
+
+    //Request for a handler on the main thread, handed over from the handler thread.
+    class MainThreadRequest
+    {
+    public:
+        uint64_t connection_id;
+        uint64_t reply_index;
+        Request request;
+    };
+    threading::LockFreeQueue<MainThreadRequest> main_thread_requests{1024};
+    std::unique_ptr<threading::WorkerPool> worker_pool;
+    std::atomic<int> pending_worker_requests{0};
+    int max_pending_worker_requests = 0;
+    uint64_t next_connection_id = 1;
     
     class Connection : sp::NonCopyable
     {
     public:
-        Connection(Server& server);
+        Connection(Server& server, uint64_t id);
         
+        uint64_t id;
         bool remove;
 
         sp::io::network::TcpSocket socket;
@@ -83,19 +156,58 @@ private:
         string buffer;
         Server& server;
         
+        //Request that opened the websocket.
         Request request;
-        bool request_pending = false;
         bool websocket_connected = false;
-        string websocket_received_fragment;
-        std::vector<string> websocket_received_pending;
+        bool websocket_deflate = false;
+        std::unique_ptr<websocket::FrameReader> websocket_reader;
+        //Message that is being received, unless it is streamed.
+        string websocket_message;
+        bool websocket_in_message = false;
+        bool websocket_streaming = false;
+        class WebsocketMessage
+        {
+        public:
+            string data;
+            //Part of a streamed binary message, last is set on the final part.
+            bool part;
+            bool last;
+        };
+        std::vector<WebsocketMessage> websocket_received_pending;
         sp::P<WebsocketHandler> websocket_handler;
 
+        //Replies are send in the order of the requests, also when a later request is finished first.
+        class Reply
+        {
+        public:
+            bool ready = false;
+            string data;
+            //Part of a file to send after the data.
+            std::unique_ptr<FILE, int(*)(FILE*)> file{nullptr, fclose};
+            size_t file_offset = 0;
+            size_t file_size = 0;
+        };
+        std::deque<Reply> replies;
+        uint64_t first_reply_index = 0;
+
         bool processIncommingData();
+        //Parse a complete request from the buffer, returns false if there is no complete request yet.
+        bool parseHttpRequest(Request& request, bool& error);
+        bool processWebsocketData();
         bool handleTimeout();
         void handleRequest(const Request& request);
-        void startHttpReply(int reply_code, const string& mimetype="");
-        void httpChunk(const string& data);
-        void sendWebsocketTextPacket(const string& data);
+        void handleStaticFile(const Request& request, uint64_t reply_index);
+        uint64_t reserveReply();
+        void setReply(uint64_t index, string&& data);
+        void setReply(uint64_t index, Reply&& reply);
+        void sendWebsocketPacket(int opcode, const string& data);
+        void sendWebsocketFrame(const std::shared_ptr<const io::DataBuffer>& frame);
+
+        static void startHttpReply(string& reply, int reply_code, const string& mimetype="");
+        static void startFileReply(string& reply, int reply_code, const string& mimetype, const string& headers, size_t content_length);
+        static void httpChunk(string& reply, const string& data);
+        static string handlerReply(const string& data);
+        static string errorReply(int reply_code, const string& message);
         
         enum class State
         {
@@ -105,6 +217,7 @@ private:
     };
     
     std::list<Connection> connections;
+    std::unordered_map<uint64_t, Connection*> connection_by_id;
     
     friend class WebsocketHandler;
 };
@@ -114,11 +227,19 @@ class WebsocketHandler : public AutoPointerObject
 public:
     virtual void onConnect() = 0;
     virtual void onMessage(const string& message) = 0;
+    //Called instead of onMessage for binary messages when streaming is enabled, with the data as it is received.
+    virtual void onBinaryMessagePart(const string& data, bool last) {}
     virtual void onDisconnect() = 0;
     
     void send(const string& message);
+    void sendBinary(const string& message);
+protected:
+    //Stream binary messages in parts, instead of collecting the whole message in memory first.
+    //  Messages that arrived before the handler was created are not streamed.
+    void setStreamBinaryMessages(bool enabled) { stream_binary_messages = enabled; }
 private:
     Server::Connection* connection = nullptr;
+    bool stream_binary_messages = false;
     
     friend class Server;
 };
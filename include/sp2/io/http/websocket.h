@@ -4,12 +4,20 @@
 #include <sp2/nonCopyable.h>
 #include <sp2/io/network/tcpSocket.h>
 #include <unordered_map>
+#include <memory>
 
 
 namespace sp {
 namespace io {
 namespace http {
+namespace websocket {
+class Deflater;
+class FrameReader;
+}//namespace websocket
 
+/** Websocket client connection.
+    Offers the permessage-deflate extension, and uses it when the server accepts it.
+ */
 class Websocket : public sp::NonCopyable
 {
 public:
@@ -46,6 +54,8 @@ public:
     bool receive(io::DataBuffer& data_buffer);
 private:
     void updateReceiveBuffer();
+    //Strings are send as text messages, data buffers as binary messages.
+    void sendMessage(uint8_t opcode, const void* data, size_t size);
 
     enum class State
     {
@@ -60,7 +70,12 @@ private:
     string websock_key;
     sp::io::network::TcpSocket socket;
     std::vector<uint8_t> buffer;
-    std::vector<uint8_t> received_fragment;
+    //Start of the data in the buffer that is not parsed yet.
+    size_t buffer_offset = 0;
+    std::string received_message;
+    std::unique_ptr<websocket::FrameReader> reader;
+    //Set when permessage-deflate is accepted by the server.
+    std::unique_ptr<websocket::Deflater> deflater;
     std::unordered_map<string, string> headers;
 #endif
 };
@@ -3,62 +3,190 @@
 
 #include <sp2/io/resourceProvider.h>
 #include <sp2/logging.h>
-#include <sp2/threading/queue.h>
-#include <thread>
+#include <functional>
+#include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace sp {
+class Engine;
 namespace io {
 
+/** Runs the background loads of all LazyLoaders on a set of loader threads.
+    Loads that are needed right now go before prefetch loads, and loads can be grouped to wait for them on a loading screen.
+ */
 class LazyLoaderManager
 {
+public:
+    enum class Priority
+    {
+        Visible,    //Needed right now, for example a texture that is on screen.
+        Prefetch    //Needed later, only loaded when there are no visible loads waiting.
+    };
+
+    class Stats
+    {
+    public:
+        int count = 0;
+        //In seconds.
+        double total_time = 0.0;
+        double max_time = 0.0;
+    };
+
+    //Set the number of loader threads, by default one for each core besides the main thread.
+    //Threads that are running already are not stopped.
+    static void setThreadCount(int count);
+    //Stop and join the loader threads, after their current load. Loads that did not start yet stay queued,
+    //  and threads are started again by the next load. Called on exit.
+    static void shutdown();
+    //Loads that are started after this call belong to the given group, until the group is changed again. The default group is 0.
+    static void setGroup(int group);
+    //Number of loads of a group that are waiting or running, to show the progress of a loading screen.
+    static int getPendingCount(int group);
+    //Block until all loads of a group are finished, and run their completion callbacks.
+    static void waitForGroup(int group);
+    //Load counts and times, per type of loader.
+    static std::unordered_map<string, Stats> getStats();
 private:
-    static std::thread* thread;
-    static sp::threading::Queue<std::function<void()>> queue;
-    static void addWork(std::function<void()> f);
-    
+    //Loads of the same owner and name never run at the same time, they run in the order they are added.
+    static uint64_t addWork(const void* owner, const string& name, const string& type, Priority priority, std::function<void()> func, std::function<void(uint64_t id)> done);
+    //Returns false if the job already started, or is finished.
+    static bool cancel(uint64_t id);
+    static void setPriority(uint64_t id, Priority priority);
+    //Run the completion callbacks of the finished jobs, called by the engine every update.
+    static void update();
+    static void workerThread();
+
     template<class T> friend class LazyLoader;
+    friend class ::sp::Engine;
 };
 
 template<class T> class LazyLoader : NonCopyable
 {
 public:
-    T get(const string& name)
+    //The type name is used for the statistics of the LazyLoaderManager.
+    LazyLoader(const string& type_name="resource")
+    : type_name(type_name)
+    {
+    }
+
+    T get(const string& name, LazyLoaderManager::Priority priority=LazyLoaderManager::Priority::Visible)
     {
         auto it = cached_items.find(name);
         if (it != cached_items.end())
         {
+            if (cancelled_items.erase(name))
+            {
+                addToWorkqueue(it->second, name, priority);
+            }
+            else if (priority == LazyLoaderManager::Priority::Visible)
+            {
+                auto p = pending_items.find(name);
+                if (p != pending_items.end())
+                    LazyLoaderManager::setPriority(p->second.job_id, priority);
+            }
             return it->second;
         }
-        
+
         T ptr = prepare(name);
         cached_items[name] = ptr;
-        addToWorkqueue(ptr, name);
+        addToWorkqueue(ptr, name, priority);
         return ptr;
     }
 
+    //Start loading a resource that is not needed yet, after the resources that are needed right now.
+    T prefetch(const string& name)
+    {
+        return get(name, LazyLoaderManager::Priority::Prefetch);
+    }
+
+    //Call a function on the main thread when a resource is loaded. Directly when it is loaded already.
+    void onLoaded(const string& name, std::function<void(T)> callback)
+    {
+        T ptr = get(name);
+        auto it = pending_items.find(name);
+        if (it == pending_items.end())
+            callback(ptr);
+        else
+            it->second.callbacks.push_back(callback);
+    }
+
+    //Cancel the load of a resource that is not needed anymore, if it has not started yet.
+    //The resource stays in the cache, and is loaded on the next get. Callbacks for it are dropped.
+    void cancel(const string& name)
+    {
+        auto it = pending_items.find(name);
+        if (it == pending_items.end())
+            return;
+        if (LazyLoaderManager::cancel(it->second.job_id))
+        {
+            pending_items.erase(it);
+            cancelled_items.insert(name);
+        }
+    }
+
 protected:
-    void addToWorkqueue(T ptr, const string& name)
+    void addToWorkqueue(T ptr, const string& name, LazyLoaderManager::Priority priority=LazyLoaderManager::Priority::Visible)
     {
+        //A new load replaces a load of the same resource that did not start yet, as its result would be stale.
+        //A load that is running already cannot be stopped. The manager runs the new load after it, so the new result wins,
+        //  and its completion is dropped in finishLoad, as the job id of the pending item acts as the token of the latest load.
+        std::vector<std::function<void(T)>> callbacks;
+        auto it = pending_items.find(name);
+        if (it != pending_items.end())
+        {
+            LazyLoaderManager::cancel(it->second.job_id);
+            callbacks = std::move(it->second.callbacks);
+            pending_items.erase(it);
+        }
+
         io::ResourceStreamPtr stream;
         stream = io::ResourceProvider::get(name);
         if (stream)
         {
-            LazyLoaderManager::addWork([this, ptr, stream]()
+            uint64_t id = LazyLoaderManager::addWork(this, name, type_name, priority, [this, ptr, stream]()
             {
                 this->backgroundLoader(ptr, stream);
+            }, [this, ptr, name](uint64_t job_id)
+            {
+                this->finishLoad(ptr, name, job_id);
             });
+            pending_items[name] = {id, std::move(callbacks)};
         }
         else
         {
             LOG(Warning, "Failed to load", name);
+            for(auto& callback : callbacks)
+                callback(ptr);
         }
     }
 
     virtual T prepare(const string& name) = 0;
     virtual void backgroundLoader(T ptr, io::ResourceStreamPtr stream) = 0;
 private:
+    class PendingItem
+    {
+    public:
+        uint64_t job_id;
+        std::vector<std::function<void(T)>> callbacks;
+    };
+
+    string type_name;
     std::unordered_map<string, T> cached_items;
+    //Pending loads and cancelled loads are only used from the main thread.
+    std::unordered_map<string, PendingItem> pending_items;
+    std::unordered_set<string> cancelled_items;
+
+    void finishLoad(T ptr, const string& name, uint64_t job_id)
+    {
+        auto it = pending_items.find(name);
+        if (it == pending_items.end() || it->second.job_id != job_id)
+            return;
+        std::vector<std::function<void(T)>> callbacks = std::move(it->second.callbacks);
+        pending_items.erase(it);
+        for(auto& callback : callbacks)
+            callback(ptr);
+    }
 };
 
 }//namespace io
@@ -3,15 +3,32 @@
 
 #include <sp2/io/network/socketBase.h>
 
+#include <vector>
+
 namespace sp {
 namespace io {
 namespace network {
 
+/** Wait for activity on a set of sockets.
+    Uses epoll on Linux, and poll on other platforms. Adding and removing sockets does not depend on the amount of sockets,
+    and after wait() only the sockets that are ready are in the ready list.
+    Sockets need to stay at the same address while they are added, as the ready list points to them.
+    Sockets that close themselves, like a TcpSocket that sees the connection closed, still need to be removed.
 
+    In edge triggered mode, a socket is only reported again after new data arrived,
+    so all available data needs to be read from non-blocking sockets after it is reported ready.
+    Edge triggered mode is only supported with epoll, on other platforms it behaves the same as level triggered.
+ */
 class Selector
 {
 public:
-    Selector();
+    enum class Trigger
+    {
+        Level,
+        Edge
+    };
+
+    Selector(Trigger trigger=Trigger::Level);
     Selector(const Selector& other);
     ~Selector();
 
@@ -19,8 +36,13 @@ public:
     
     void add(SocketBase& socket);
     void remove(SocketBase& socket);
+    //Also wait for the socket to become writable, for sockets that have data queued that could not be send yet.
+    void setWriteInterest(SocketBase& socket, bool enabled);
     void wait(int timeout_ms);
+    //Sockets that are readable or writable after the last wait.
+    const std::vector<SocketBase*>& getReady() const;
     bool isReady(SocketBase& socket);
+    bool isWritable(SocketBase& socket);
 
 private:
     class SelectorData;
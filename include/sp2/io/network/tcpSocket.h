@@ -5,6 +5,10 @@
 #include <sp2/io/network/socketBase.h>
 #include <sp2/io/dataBuffer.h>
 
+#include <deque>
+#include <memory>
+#include <stdio.h>
+
 
 namespace sp {
 namespace io {
@@ -25,21 +29,64 @@ public:
     void close();
 
     bool isConnected();
+    //Disable the delay of small sends (Nagle's algorithm), for request/reply protocols where every reply is send as soon as it is ready.
+    void setNoDelay(bool enabled);
 
     void send(const void* data, size_t size);
     size_t receive(void* data, size_t size);
 
+    //Send part of a file. Uses sendfile() where available, so the data is not copied through user space.
+    void sendFile(FILE* file, size_t offset, size_t size);
+
     void send(const io::DataBuffer& buffer);
+    //Send a packet that is shared between sockets, like a broadcast to all clients. Large packets are referenced instead of copied.
+    void send(const std::shared_ptr<const io::DataBuffer>& buffer);
+    //Send shared data as is, without the packet size, for sending the same data in another protocol to many sockets.
+    void sendRaw(const std::shared_ptr<const io::DataBuffer>& buffer);
     bool receive(io::DataBuffer& buffer);
 
+    //With batching enabled, sends are only queued, and all queued data is written with a single call on flush().
+    void setSendBatching(bool enabled) { send_batching = enabled; }
+    //Write out queued data. Returns true if data is still left in the queue, as the socket would block.
+    bool flush();
+    //Number of system calls done to send data, for profiling.
+    size_t getSendCallCount() const { return send_call_count; }
+    //Receiving a packet larger then this closes the connection, so a peer cannot make us allocate unlimited memory.
+    void setMaxPacketSize(size_t size) { max_packet_size = size; }
+
 private:
-    bool sendSendQueue();
+    class SendChunk
+    {
+    public:
+        //Data is in the send buffer if this is not set.
+        std::shared_ptr<const io::DataBuffer> shared;
+        size_t start;
+        size_t size;
+    };
+
+    void queueCopy(const void* data, size_t size);
+    void queueShared(const std::shared_ptr<const io::DataBuffer>& buffer);
+    void consumeSendQueue(size_t size);
+    //Single receive call on the socket. Returns 0 if no data is available.
+    size_t readSocket(void* data, size_t size);
     
     void* ssl_handle;
 
-    std::string send_queue;
+    //Outgoing data, small pieces are copied after each other in the send buffer, large shared packets are referenced.
+    std::deque<SendChunk> send_queue;
+    std::vector<uint8_t> send_buffer;
+    bool send_batching = false;
+    size_t send_call_count = 0;
+    //Incomming data is read in large blocks into the receive buffer, and packets are taken from it without further receive calls.
+    //The data between receive_start and receive_end is not handed out yet.
     std::vector<uint8_t> receive_buffer;
-    size_t received_size;
+    size_t receive_start = 0;
+    size_t receive_end = 0;
+    //A packet that does not fit in the receive buffer is received directly into its own buffer.
+    std::vector<uint8_t> large_packet;
+    size_t large_packet_received = 0;
+    bool large_packet_pending = false;
+    size_t max_packet_size = 64 * 1024 * 1024;
     
     friend class TcpListener;
 };
@@ -21,7 +21,11 @@ public:
     virtual int64_t tell() = 0;
     virtual int64_t getSize() = 0;
 
-    string readLine();
+    //Returns the whole contents of the stream, getSize() bytes, if the stream has them in memory already. Else nullptr.
+    //  Streams that have no view are buffered by the ResourceProvider.
+    virtual const uint8_t* getContiguousView() { return nullptr; }
+
+    virtual string readLine();
     string readAll();
 
     // Optional stream flags. Generally set by extra parameters on the filename.
@@ -42,9 +46,13 @@ public:
     virtual ResourceStreamPtr getStream(const string& filename) = 0;
     virtual std::chrono::system_clock::time_point getResourceModifyTime(const string& filename) { return std::chrono::system_clock::time_point(); }
     virtual std::vector<string> findResources(const string& search_pattern) = 0;
+    //True if changes to this resource are reported to the ResourceWatcher by the provider itself.
+    //  Else the ResourceWatcher polls the modify time of the resource when it is watched.
+    virtual bool notifiesResourceChanges(const string& filename) { return false; }
 
     static ResourceStreamPtr get(string filename);
     static std::chrono::system_clock::time_point getModifyTime(const string& filename);
+    static bool notifiesChanges(const string& filename);
     static std::vector<string> find(const string& search_pattern);
 
     //Create the default resource providers.
@@ -54,6 +62,19 @@ public:
     //  And for android it will create a AndroidAssetResourceProvider that reads from android assets.
     static void createDefault();
 protected:
+    //A search pattern split on the wildcards once, to match it against a lot of names.
+    class SearchPattern
+    {
+    public:
+        SearchPattern(const string& search_pattern);
+
+        bool match(const string& name) const;
+        //The part before the first wildcard, every match starts with this.
+        const string& prefix() const { return parts[0]; }
+    private:
+        std::vector<string> parts;
+    };
+
     bool searchMatch(const string& name, const string& search_pattern);
 
 private:
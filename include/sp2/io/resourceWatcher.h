@@ -0,0 +1,38 @@
+#ifndef SP2_IO_RESOURCE_WATCHER_H
+#define SP2_IO_RESOURCE_WATCHER_H
+
+#include <sp2/string.h>
+#include <chrono>
+#include <functional>
+
+namespace sp {
+namespace io {
+
+/** Tells interested code when a resource changed, so it can be reloaded.
+    Resource providers report changes as they happen, the DirectoryResourceProvider does this with inotify.
+    For watched resources of which the provider does not report changes, the modify time is polled at a low rate.
+    The callbacks run on the main thread, once a resource has not changed for a short while.
+    So an editor that saves a file in a few steps only causes a single reload.
+ */
+class ResourceWatcher
+{
+public:
+    //Call the callback each time the resource changes. Flags after a '#' in the name are ignored.
+    //Returns an id for unwatch.
+    static int watch(const string& resource_name, std::function<void()> callback);
+    static void unwatch(int id);
+    //Time a resource needs to be unchanged before the callbacks are called. Default is 100ms.
+    static void setCoalesceDelay(std::chrono::milliseconds delay);
+    //Time between polls of the modify time of resources that are not reported by their provider. Default is 1 second.
+    static void setPollInterval(std::chrono::milliseconds interval);
+
+    //Report that a resource changed, can be called from any thread.
+    static void notify(const string& resource_name);
+    //Call the callbacks for the changes that are old enough. Called by the engine every update.
+    static void update();
+};
+
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_RESOURCE_WATCHER_H
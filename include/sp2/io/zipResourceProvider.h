@@ -2,10 +2,19 @@
 #define SP2_IO_ZIPRESOURCEPROVIDER_H
 
 #include <sp2/io/resourceProvider.h>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
 
 namespace sp {
 namespace io {
 
+class ZipMapping;
+/** Resources from a zip file, like a zip that is appended to the executable.
+    The zip file is mapped in memory once. Stored files are read directly from the mapping,
+    small deflated files are kept decompressed in a cache, and larger deflated files can be seeked without inflating from the start.
+ */
 class ZipResourceProvider : public ResourceProvider
 {
 public:
@@ -15,8 +24,11 @@ public:
     virtual std::chrono::system_clock::time_point getResourceModifyTime(const string& filename) override;
     virtual std::vector<string> findResources(const string& search_pattern) override;
 
+    //Set the amount of memory used to keep small deflated files decompressed, 0 disables the cache.
+    void setCacheSize(size_t bytes);
 private:
     string zip_filename;
+    std::shared_ptr<ZipMapping> mapping;
     
     class ZipInfo
     {
@@ -27,6 +39,22 @@ private:
         uint64_t uncompressed_size;
     };
     std::unordered_map<string, ZipInfo> contents;
+
+    //Deflated files up to this size are cached, with the least recently used ones removed first.
+    static constexpr uint64_t max_cached_file_size = 256 * 1024;
+    class CachedFile
+    {
+    public:
+        string name;
+        std::shared_ptr<const std::vector<uint8_t>> data;
+    };
+    std::mutex cache_mutex;
+    std::list<CachedFile> cache;
+    std::unordered_map<string, std::list<CachedFile>::iterator> cache_index;
+    size_t cache_size = 0;
+    size_t cache_limit = 8 * 1024 * 1024;
+
+    std::shared_ptr<const std::vector<uint8_t>> getCachedFile(const string& filename, const ZipInfo& info);
 };
 
 }//namespace io
@@ -0,0 +1,113 @@
+#ifndef SP2_MATH_AABB_H
+#define SP2_MATH_AABB_H
+
+#include <sp2/math/vector.h>
+#include <sp2/math/matrix4x4.h>
+#include <algorithm>
+#include <limits>
+
+namespace sp {
+
+/** Axis aligned bounding box.
+    A default constructed box is empty, growing it to include a point makes it valid.
+ */
+template<typename T> class AABB
+{
+public:
+    AABB()
+    : min(std::numeric_limits<T>::max(), std::numeric_limits<T>::max(), std::numeric_limits<T>::max())
+    , max(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest())
+    {
+    }
+
+    AABB(Vector3<T> min, Vector3<T> max) : min(min), max(max) {}
+
+    //Box that contains everything, for objects that should never be culled.
+    static AABB infinite()
+    {
+        return AABB(Vector3<T>(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest()),
+            Vector3<T>(std::numeric_limits<T>::max(), std::numeric_limits<T>::max(), std::numeric_limits<T>::max()));
+    }
+
+    bool isEmpty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    bool isInfinite() const
+    {
+        return min.x == std::numeric_limits<T>::lowest() || max.x == std::numeric_limits<T>::max();
+    }
+
+    Vector3<T> center() const
+    {
+        return (min + max) / T(2);
+    }
+
+    Vector3<T> size() const
+    {
+        return max - min;
+    }
+
+    bool contains(const AABB<T>& other) const
+    {
+        return other.min.x >= min.x && other.min.y >= min.y && other.min.z >= min.z
+            && other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+    }
+
+    bool overlaps(const AABB<T>& other) const
+    {
+        return min.x <= other.max.x && other.min.x <= max.x
+            && min.y <= other.max.y && other.min.y <= max.y
+            && min.z <= other.max.z && other.min.z <= max.z;
+    }
+
+    void growToInclude(const Vector3<T>& p)
+    {
+        min.x = std::min(min.x, p.x); min.y = std::min(min.y, p.y); min.z = std::min(min.z, p.z);
+        max.x = std::max(max.x, p.x); max.y = std::max(max.y, p.y); max.z = std::max(max.z, p.z);
+    }
+
+    void growToInclude(const AABB<T>& other)
+    {
+        growToInclude(other.min);
+        growToInclude(other.max);
+    }
+
+    AABB<T> merged(const AABB<T>& other) const
+    {
+        AABB<T> result = *this;
+        result.growToInclude(other);
+        return result;
+    }
+
+    AABB<T> expanded(T margin) const
+    {
+        return AABB<T>(min - Vector3<T>(margin, margin, margin), max + Vector3<T>(margin, margin, margin));
+    }
+
+    //Bounding box of this box after transforming it with the matrix.
+    AABB<T> transformed(const Matrix4x4<T>& m) const
+    {
+        if (isEmpty() || isInfinite())
+            return *this;
+        Vector3<T> c = m * center();
+        Vector3<T> e = size() / T(2);
+        const T* d = m.data;
+        Vector3<T> extent(
+            std::abs(d[0]) * e.x + std::abs(d[4]) * e.y + std::abs(d[8]) * e.z,
+            std::abs(d[1]) * e.x + std::abs(d[5]) * e.y + std::abs(d[9]) * e.z,
+            std::abs(d[2]) * e.x + std::abs(d[6]) * e.y + std::abs(d[10]) * e.z);
+        return AABB<T>(c - extent, c + extent);
+    }
+
+    Vector3<T> min;
+    Vector3<T> max;
+};
+
+typedef AABB<float> AABB3f;
+typedef AABB<double> AABB3d;
+
+}//namespace sp
+
+#endif//SP2_MATH_AABB_H
@@ -0,0 +1,68 @@
+#ifndef SP2_MATH_FRUSTUM_H
+#define SP2_MATH_FRUSTUM_H
+
+#include <sp2/math/plane.h>
+#include <sp2/math/aabb.h>
+#include <sp2/math/matrix4x4.h>
+
+namespace sp {
+
+/** View frustum, as the 6 planes of a projection * camera matrix. Plane normals point inwards.
+ */
+template<typename T> class Frustum
+{
+public:
+    enum class Result
+    {
+        Outside,
+        Intersects,
+        Inside
+    };
+
+    Frustum() {}
+
+    Frustum(const Matrix4x4<T>& view_projection)
+    {
+        const T* d = view_projection.data;
+        //Row r of the matrix is d[r], d[r + 4], d[r + 8], d[r + 12]
+        for(int n=0; n<3; n++)
+        {
+            setPlane(n * 2, d[3] + d[n], d[7] + d[n + 4], d[11] + d[n + 8], d[15] + d[n + 12]);
+            setPlane(n * 2 + 1, d[3] - d[n], d[7] - d[n + 4], d[11] - d[n + 8], d[15] - d[n + 12]);
+        }
+    }
+
+    Result check(const AABB<T>& box) const
+    {
+        if (box.isInfinite())
+            return Result::Intersects;
+        Result result = Result::Inside;
+        for(const auto& plane : planes)
+        {
+            //Corner of the box furthest along the plane normal, and the one furthest against it.
+            Vector3<T> positive(plane.normal.x >= 0 ? box.max.x : box.min.x, plane.normal.y >= 0 ? box.max.y : box.min.y, plane.normal.z >= 0 ? box.max.z : box.min.z);
+            if (plane.normal.dot(positive) < plane.distance)
+                return Result::Outside;
+            Vector3<T> negative(plane.normal.x >= 0 ? box.min.x : box.max.x, plane.normal.y >= 0 ? box.min.y : box.max.y, plane.normal.z >= 0 ? box.min.z : box.max.z);
+            if (plane.normal.dot(negative) < plane.distance)
+                result = Result::Intersects;
+        }
+        return result;
+    }
+
+    Plane3<T> planes[6];
+private:
+    void setPlane(int index, T a, T b, T c, T d)
+    {
+        //Plane equation is a*x + b*y + c*z + d >= 0 for points inside.
+        planes[index].normal = Vector3<T>(a, b, c);
+        planes[index].distance = -d;
+    }
+};
+
+typedef Frustum<float> Frustumf;
+typedef Frustum<double> Frustumd;
+
+}//namespace sp
+
+#endif//SP2_MATH_FRUSTUM_H
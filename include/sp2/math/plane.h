@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <sp2/math/vector.h>
+#include <sp2/math/ray.h>
 
 namespace sp {
 
@@ -2,6 +2,7 @@
 #define SP2_MULTIPLAYER_BASE_H
 
 #include <sp2/pointer.h>
+#include <sp2/handle.h>
 #include <unordered_map>
 
 namespace sp {
@@ -30,8 +31,8 @@ protected:
     void addNode(P<Node> node);    
     void cleanDeletedNodes();
     
-    std::unordered_map<uint64_t, P<Node>>::iterator nodeBegin();
-    std::unordered_map<uint64_t, P<Node>>::iterator nodeEnd();
+    std::unordered_map<uint64_t, Handle<Node>>::iterator nodeBegin();
+    std::unordered_map<uint64_t, Handle<Node>>::iterator nodeEnd();
     
     float network_delay = 0.0;
 private:
@@ -39,7 +40,8 @@ private:
     //Called when a node that was added is deleted now and removed from the registry.
     virtual void onDeleted(uint64_t id);
     
-    std::unordered_map<uint64_t, P<Node>> node_by_id;
+    //Handles instead of P<Node>, so iterating and looking up nodes does not write to the nodes.
+    std::unordered_map<uint64_t, Handle<Node>> node_by_id;
 };
 
 }//namespace multiplayer
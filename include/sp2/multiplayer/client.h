@@ -4,12 +4,18 @@
 #include <sp2/string.h>
 #include <sp2/updatable.h>
 #include <sp2/multiplayer/base.h>
+#include <sp2/multiplayer/registry.h>
+#include <sp2/multiplayer/udpConnection.h>
 #include <sp2/io/dataBuffer.h>
 #include <sp2/io/network/tcpSocket.h>
+#include <sp2/io/network/udpSocket.h>
 #include <sp2/io/http/websocket.h>
 
 
 #include <list>
+#include <vector>
+#include <memory>
+#include <chrono>
 
 namespace sp {
 class Engine;
@@ -32,6 +38,8 @@ public:
 
     // Connect directly to a server with a tcp IP connection.
     bool connect(const string& hostname, int port_nr);
+    // Connect directly to a server with UDP, the server needs to use Server::listenUdp.
+    bool connectUdp(const string& hostname, int port_nr);
     // Connect to a server by using a switchboard.
     // The hotname and port_nr are the hostname and port of the switchboard server.
     // The given key is the game key given to the server that we want to connect to,
@@ -44,9 +52,20 @@ public:
 private:
     io::network::TcpSocket socket;
     io::http::Websocket websocket;
+    io::network::UdpSocket udp_socket;
+    std::unique_ptr<UdpConnection> udp;
+    std::chrono::steady_clock::time_point udp_start_time;
+    //Udp connect request state, the request is repeated till the server replies over the connection.
+    std::function<void(const io::DataBuffer& datagram)> udp_send;
+    bool udp_connected = false;
+    string udp_cookie;
+    float udp_last_connect_request = -1000.0f;
     std::list<io::DataBuffer> send_queue;
     State state = State::Disconnected;
     uint32_t client_id = 0;
+    //Class table of the server, indexed by the class id in create packets. The create function is nullptr for classes this client does not know.
+    std::vector<string> class_names;
+    std::vector<ClassEntry::create_object_function_t> class_create_functions;
     string game_name;
     uint32_t game_version;
 
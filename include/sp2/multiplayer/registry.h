@@ -4,6 +4,7 @@
 #include <sp2/string.h>
 #include <sp2/pointer.h>
 
+#include <vector>
 #include <typeindex>
 #include <unordered_map>
 
@@ -35,6 +36,10 @@ private:
     
     static std::unordered_map<std::type_index, string> type_to_name_mapping;
     static std::unordered_map<string, create_object_function_t> name_to_create_mapping;
+    //Registered class names, sorted. The index in this list is the class id that is used on the network.
+    //The server sends this table to each client, so the ids do not have to match between builds.
+    static std::vector<string> class_names;
+    static std::unordered_map<std::type_index, uint32_t> type_to_id_mapping;
     
     friend class ::sp::Engine;
     friend class Server;
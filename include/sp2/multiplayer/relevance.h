@@ -0,0 +1,96 @@
+#ifndef SP2_MULTIPLAYER_RELEVANCE_H
+#define SP2_MULTIPLAYER_RELEVANCE_H
+
+#include <sp2/nonCopyable.h>
+#include <sp2/pointer.h>
+#include <sp2/string.h>
+#include <sp2/math/vector.h>
+
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace sp {
+class Node;
+namespace multiplayer {
+
+/** Decides which nodes are replicated to which client, set with Server::setRelevancePolicy.
+
+    Nodes are only created on a client while they are relevant for it, and their parent exists on the client.
+    When a node stops being relevant, it is deleted on the client, together with all its children.
+    The server does not check every node every tick, so relevance changes can be picked up a few ticks later.
+
+    A client that joins gets the existing nodes over a number of ticks, with the nodes with the lowest priority value first.
+ */
+class RelevancePolicy : NonCopyable
+{
+public:
+    virtual ~RelevancePolicy() = default;
+
+    //Called once per server tick, before any isRelevant call of that tick.
+    virtual void update() {}
+    virtual bool isRelevant(uint32_t client_id, Node& node) = 0;
+    //Order in which the nodes are send to a joining client, lower values first. By default all nodes are equal, and send in tree order.
+    virtual double getPriority(uint32_t client_id, Node& node) { return 0.0; }
+};
+
+/** Relevance by a custom function.
+ */
+class PredicateRelevance : public RelevancePolicy
+{
+public:
+    PredicateRelevance(std::function<bool(uint32_t client_id, Node& node)> predicate);
+
+    virtual bool isRelevant(uint32_t client_id, Node& node) override;
+private:
+    std::function<bool(uint32_t client_id, Node& node)> predicate;
+};
+
+/** Relevance by scene. Clients only get the nodes of the scenes that are set for them.
+ */
+class SceneRelevance : public RelevancePolicy
+{
+public:
+    void setClientScenes(uint32_t client_id, const std::unordered_set<string>& scene_names);
+
+    virtual bool isRelevant(uint32_t client_id, Node& node) override;
+private:
+    std::unordered_map<uint32_t, std::unordered_set<string>> client_scenes;
+};
+
+/** Relevance by distance to a node owned by the client, like the player avatar.
+    The world is divided in a grid of cells, and nodes in the cells around the cell of the client node are relevant.
+
+    Nodes in other scenes then the client node, and all nodes for clients that do not have a client node yet, are relevant.
+    Joining clients get the nodes closest to their client node first.
+ */
+class GridRelevance : public RelevancePolicy
+{
+public:
+    //With a view distance of 1, the cell of the client node and the 26 (3D) cells around it are relevant.
+    GridRelevance(double cell_size, int view_distance=1);
+
+    void setClientNode(uint32_t client_id, P<Node> node);
+
+    virtual void update() override;
+    virtual bool isRelevant(uint32_t client_id, Node& node) override;
+    virtual double getPriority(uint32_t client_id, Node& node) override;
+private:
+    class ClientView
+    {
+    public:
+        P<Node> node;
+        Vector3i cell;
+    };
+
+    double cell_size;
+    int view_distance;
+    std::unordered_map<uint32_t, ClientView> clients;
+
+    Vector3i toCell(const Vector3d& position) const;
+};
+
+}//namespace multiplayer
+}//namespace sp
+
+#endif//SP2_MULTIPLAYER_RELEVANCE_H
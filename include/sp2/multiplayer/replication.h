@@ -19,6 +19,9 @@ public:
     virtual void initialSend(Base& registry, io::DataBuffer& packet) { send(registry, packet); }
     virtual void send(Base& registry, io::DataBuffer& packet) = 0;
     virtual void receive(Base& registry, io::DataBuffer& packet) = 0;
+    //Encoding used in snapshot frames. Links can use a more compact or quantized encoding here.
+    virtual void sendSnapshot(Base& registry, io::DataBuffer& packet) { send(registry, packet); }
+    virtual void receiveSnapshot(Base& registry, io::DataBuffer& packet) { receive(registry, packet); }
 };
 
 template<typename T> class ReplicationLink : public ReplicationLinkBase
@@ -92,6 +95,18 @@ public:
         packet.read(id);
         object = registry.getNode(id);
     }
+
+    virtual void sendSnapshot(Base& registry, io::DataBuffer& packet) override
+    {
+        packet.writeVarint(object ? object->multiplayer.getId() : 0);
+    }
+
+    virtual void receiveSnapshot(Base& registry, io::DataBuffer& packet) override
+    {
+        uint64_t id = 0;
+        packet.readVarint(id);
+        object = registry.getNode(id);
+    }
 private:
     P<T>& object;
     uint64_t previous_id;
@@ -134,6 +149,9 @@ public:
     virtual void initialSend(Base& registry, io::DataBuffer& packet) override;
     virtual void send(Base& registry, io::DataBuffer& packet) override;
     virtual void receive(Base& registry, io::DataBuffer& packet) override;
+    //Snapshots send single precision positions and velocities, and the rotation as 3 quantized components.
+    virtual void sendSnapshot(Base& registry, io::DataBuffer& packet) override;
+    virtual void receiveSnapshot(Base& registry, io::DataBuffer& packet) override;
 
 private:
     Node& node;
@@ -143,6 +161,8 @@ private:
     Vector3d last_position;
     Vector3d last_velocity;
     Quaterniond last_rotation;
+
+    void apply(Base& registry, Vector3d position, Vector3d velocity, Quaterniond rotation, Vector3d angular_velocity);
 };
 
 class ReplicationCallInfoBase
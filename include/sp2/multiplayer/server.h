@@ -3,13 +3,23 @@
 
 #include <sp2/updatable.h>
 #include <sp2/scene/node.h>
+#include <sp2/multiplayer/snapshot.h>
+#include <sp2/multiplayer/relevance.h>
+#include <sp2/multiplayer/udpConnection.h>
 
 #include <sp2/io/dataBuffer.h>
 #include <sp2/io/network/tcpListener.h>
 #include <sp2/io/network/tcpSocket.h>
+#include <sp2/io/network/udpSocket.h>
 #include <sp2/io/http/websocket.h>
 
 #include <list>
+#include <deque>
+#include <queue>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <unordered_set>
 #include <unordered_map>
 
 namespace sp {
@@ -22,9 +32,21 @@ public:
     ~Server();
 
     bool listen(int port_nr);
+    //Also accept clients over UDP on the given port. Snapshot frames are send unreliable to these clients, all other packets reliable.
+    bool listenUdp(int port_nr);
     bool listenOnSwitchboard(const string& hostname, int port, const string& server_name, bool list_as_public_server);
 
     virtual uint32_t getClientId() override;
+
+    //Send all changed members of a tick as a single snapshot frame per client, instead of a packet per object. Enabled by default.
+    void setSnapshotReplication(bool enabled) { snapshot_replication = enabled; }
+    //Only replicate the nodes that are relevant for a client to that client. Without a policy, every client gets every node.
+    void setRelevancePolicy(std::unique_ptr<RelevancePolicy> policy) { relevance_policy = std::move(policy); }
+    //Existing nodes are checked for relevance once every this amount of ticks, spread out over the ticks. New nodes are always checked directly.
+    void setRelevanceInterval(int ticks) { relevance_interval = std::max(1, ticks); }
+    //A joining client gets the existing nodes over multiple ticks, with about this amount of bytes per tick.
+    //The nodes are send in order of the priority of the relevance policy, parents always before their children.
+    void setCatchUpBudget(size_t bytes_per_tick) { catch_up_budget = std::max(size_t(1), bytes_per_tick); }
 private:
     class ClientInfo
     {
@@ -39,17 +61,67 @@ private:
             CatchingUp,
             Connected
         } state;
+        //Ids of the nodes that are created on this client, only used with a relevance policy or while catching up.
+        std::unordered_set<uint64_t> known_nodes;
+        class CatchUpEntry
+        {
+        public:
+            double priority;
+            uint64_t order;
+            uint64_t id;
+
+            //The queue takes the largest entry first, so the lowest priority value, and the oldest entry for equal priorities, is the largest.
+            bool operator<(const CatchUpEntry& other) const
+            {
+                if (priority != other.priority)
+                    return priority > other.priority;
+                return order > other.order;
+            }
+        };
+        //Nodes that still need to be send to the client while it is catching up.
+        std::priority_queue<CatchUpEntry> catch_up_queue;
+        uint64_t next_catch_up_order = 0;
+
+        //Connection for clients connected with UDP, with the "address:port" of the client.
+        std::unique_ptr<UdpConnection> udp;
+        string udp_peer;
+        class SentFrame
+        {
+        public:
+            uint32_t tag;
+            std::shared_ptr<const std::vector<uint64_t>> ids;
+        };
+        //Snapshot frames that are send unreliable, so the state of their nodes can be send again when a frame is lost.
+        std::deque<SentFrame> udp_frames;
+        uint32_t next_frame_tag = 1;
         
         void send(const io::DataBuffer& packet)
         {
             socket.send(packet);
             websocket.send(packet);
+            if (udp)
+                udp->send(packet, UdpConnection::Channel::Reliable);
+        }
+
+        //Send a packet that is send to multiple clients, so the socket can reference it instead of making a copy.
+        void send(const std::shared_ptr<const io::DataBuffer>& packet)
+        {
+            socket.send(packet);
+            websocket.send(*packet);
+            if (udp)
+                udp->send(*packet, UdpConnection::Channel::Reliable);
+        }
+
+        bool receive(io::DataBuffer& packet)
+        {
+            return socket.receive(packet) || websocket.receive(packet) || (udp && udp->receive(packet));
         }
 
         void close()
         {
             socket.close();
             websocket.close();
+            udp = nullptr;
         }
     };
     int local_port = 0;
@@ -68,14 +140,29 @@ private:
     PList<Node> new_nodes;
     
     float ping_delay;
+    bool snapshot_replication = true;
+    SnapshotWriter snapshot_writer;
+    io::DataBuffer client_frame;
+    std::unique_ptr<RelevancePolicy> relevance_policy;
+    int relevance_interval = 10;
+    int relevance_tick = 0;
+    size_t catch_up_budget = 32 * 1024;
 
     std::list<ClientInfo> clients;
     
     io::network::TcpListener new_connection_listener;
+    io::network::UdpSocket udp_socket;
+    std::unordered_map<string, ClientInfo*> udp_clients;
+    //Random secret to generate the cookies of udp connect requests.
+    string udp_cookie_secret;
+    std::chrono::steady_clock::time_point start_time;
     io::http::Websocket switchboard_connection;
     
     void recursiveAddNewNodes(P<Node> node);
-    void recursiveSendCreate(ClientInfo& client, P<Node> node);
+    //Add a node to the nodes that still need to be send to a client that is catching up.
+    void queueCatchUp(ClientInfo& client, P<Node> node);
+    //Send the next nodes, with their state, to a client that is catching up, within the catch up budget.
+    void sendCatchUp(ClientInfo& client);
     //Add a new object to be replicated. Only put it in a list, we will process it later, as it still might be under construction.
     void addNewObject(P<Node> node);
     
@@ -83,7 +170,26 @@ private:
     virtual void onDeleted(uint64_t id) override;
     
     void buildCreatePacket(io::DataBuffer& packet, P<Node> node);
+    //Add a single node to a create_object packet.
+    void writeCreateEntry(io::DataBuffer& packet, P<Node> node);
     void sendToAllConnectedClients(const io::DataBuffer& packet);
+    void sendSnapshotFrame(ClientInfo& client, const std::shared_ptr<const io::DataBuffer>& frame, const std::shared_ptr<const std::vector<uint64_t>>& ids);
+    //Send the full state of the nodes of snapshot frames that got lost on the way to an UDP client.
+    void resendLostFrames(ClientInfo& client);
+    void receiveUdp(float now);
+    //Cookie that a client at the given "address:port" has to echo to connect with udp, for a period of time.
+    string getUdpCookie(const string& peer, int period);
+    //Send a packet about a node to all clients that have this node created.
+    void sendToRelevantClients(uint64_t id, const io::DataBuffer& packet);
+    //Check if a node is created on a client.
+    bool isKnown(ClientInfo& client, uint64_t id);
+
+    bool isRelevant(ClientInfo& client, P<Node> node);
+    void updateRelevance();
+    //Create a node on a client that did not have it yet, including the current state.
+    void sendCreateWithState(ClientInfo& client, P<Node> node);
+    //Remove a node, and all its children, from the known nodes of a client.
+    void forgetNode(ClientInfo& client, P<Node> node);
 
     friend class Node::Multiplayer;
 };
@@ -0,0 +1,91 @@
+#ifndef SP2_MULTIPLAYER_SNAPSHOT_H
+#define SP2_MULTIPLAYER_SNAPSHOT_H
+
+#include <sp2/multiplayer/replication.h>
+#include <sp2/io/dataBuffer.h>
+
+#include <vector>
+#include <unordered_set>
+
+namespace sp {
+namespace multiplayer {
+
+/** Builds a snapshot frame: all changed replication links of all nodes in a single packet.
+
+    Every node in the frame is an entry of:
+    * varint object id
+    * varint payload size, shifted left by one. The lowest bit is set for the full state of a node, like the initial state of new nodes.
+    * bitmask of the links that follow, one bit per replication link of the node.
+    * the link data, in the compact encoding of ReplicationLinkBase::sendSnapshot.
+    The payload size allows the receiver to skip entries for nodes it does not know.
+ */
+class SnapshotWriter
+{
+public:
+    //Start a new frame with the given packet id.
+    void begin(uint8_t packet_id);
+
+    //Add the links of a node that changed since the previous tick. Returns false if nothing changed, in which case nothing is added.
+    //Calls isChanged on every link, so this should be called once per node per tick.
+    bool addChanged(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links, float delta);
+    //Add all links of a node, for nodes that are new on the receiving side.
+    void addInitial(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links);
+    //Add the current value of all links of a node, to recover from a lost frame.
+    void addFull(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links);
+
+    int getEntryCount() const { return int(entries.size()); }
+    void getEntryIds(std::vector<uint64_t>& ids) const;
+    const io::DataBuffer& getPacket() const { return packet; }
+    //Build a frame with only the entries of the given objects, for clients that only know part of the objects.
+    //Returns false if none of the entries are for these objects.
+    bool buildFiltered(io::DataBuffer& target, const std::unordered_set<uint64_t>& ids) const;
+private:
+    class Entry
+    {
+    public:
+        uint64_t id;
+        size_t start;
+        size_t size;
+    };
+
+    io::DataBuffer packet;
+    io::DataBuffer payload;
+    std::vector<uint8_t> mask;
+    std::vector<Entry> entries;
+
+    void addEntry(uint64_t id, bool initial);
+};
+
+/** Reads the entries of a snapshot frame. The packet id needs to be read already.
+    Example:
+    \code
+    SnapshotReader reader(packet);
+    uint64_t id;
+    while(reader.next(id))
+    {
+        P<Node> node = getNode(id);
+        if (node)
+            reader.apply(*this, node->multiplayer.replication_links);
+    }
+    \endcode
+ */
+class SnapshotReader
+{
+public:
+    SnapshotReader(io::DataBuffer& packet);
+
+    //Go to the next entry, skipping the rest of the current one. Returns false at the end of the frame.
+    bool next(uint64_t& id);
+    //Apply the current entry to the links of a node.
+    void apply(Base& registry, const std::vector<ReplicationLinkBase*>& links);
+private:
+    io::DataBuffer& packet;
+    //Bytes available in the packet at the end of the current entry.
+    size_t entry_end = 0;
+    bool initial = false;
+};
+
+}//namespace multiplayer
+}//namespace sp
+
+#endif//SP2_MULTIPLAYER_SNAPSHOT_H
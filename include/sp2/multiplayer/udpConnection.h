@@ -0,0 +1,203 @@
+#ifndef SP2_MULTIPLAYER_UDP_CONNECTION_H
+#define SP2_MULTIPLAYER_UDP_CONNECTION_H
+
+#include <sp2/nonCopyable.h>
+#include <sp2/io/dataBuffer.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <list>
+#include <random>
+
+namespace sp {
+namespace multiplayer {
+
+/** Reliability layer for a connection over unreliable datagrams (UDP), with one peer.
+
+    Messages are send on one of two channels:
+    * Unreliable: sequenced, messages can get lost, and messages older then an already delivered message are dropped.
+      A tag can be given with each message, which is reported back by getLostTag when the message did not arrive,
+      or when it arrived after a newer message and was dropped.
+    * Reliable: every message arrives, in the order it was send.
+    An unreliable message is never delivered before the reliable messages that where send before it,
+    so an update for an object cannot overtake the creation of that object.
+    Messages larger then a datagram are split in fragments, up to max_message_size.
+
+    The memory used for incomplete messages is limited. Reliable messages are only send up to a window ahead of
+    the oldest message that is not acknowledged, with a limited number of split messages in that window.
+    A peer that sends beyond these limits is misbehaving, and the connection is closed.
+
+    Every datagram acknowledges the last 65 datagrams received from the peer.
+    This is used for resending reliable messages, the round trip time estimate and the send rate.
+    Dropped outdated unreliable messages are reported separately, so they do not count as packet loss.
+    The send rate is halved on packet loss, and slowly increased again while there is no loss.
+
+    The connection does not own a socket. Incoming datagrams are given to it with onDatagram,
+    and update() calls the output function for every datagram to send.
+ */
+class UdpConnection : NonCopyable
+{
+public:
+    enum class Channel
+    {
+        Unreliable,
+        Reliable
+    };
+
+    UdpConnection(std::function<void(const io::DataBuffer& datagram)> output);
+
+    void send(const io::DataBuffer& message, Channel channel, uint32_t tag=0);
+    //Get the next received message, if any.
+    bool receive(io::DataBuffer& message);
+    //Get the tag of an unreliable message that got lost, if any.
+    bool getLostTag(uint32_t& tag);
+
+    //Process an incoming datagram. Returns false if this is not a valid datagram.
+    bool onDatagram(const void* data, size_t size, float now);
+    //Send out datagrams for queued messages, resends and acknowledgements. Call this every tick.
+    void update(float now);
+
+    //Simulate a bad network on outgoing datagrams, for testing. Loss is a fraction from 0.0 to 1.0, latency in seconds.
+    void setSimulation(float loss, float latency, float jitter=0.0f);
+
+    //No datagram from the peer for this amount of seconds, or the connection was closed.
+    bool isTimedOut(float now) const { return closed || now - last_receive_time > timeout; }
+    //The peer send datagrams beyond the receive limits, nothing is send or received anymore.
+    bool isClosed() const { return closed; }
+    float getRoundTripTime() const { return round_trip_time; }
+    //Allowed send rate in bytes per second.
+    float getSendRate() const { return send_rate; }
+    //Estimated fraction of datagrams that get lost.
+    float getPacketLoss() const { return packet_loss; }
+    int getPendingReliableCount() const { return int(reliable_in_flight.size()); }
+
+    static constexpr size_t max_datagram_size = 1200;
+    static constexpr size_t max_message_size = 1024 * 1024;
+    static constexpr float timeout = 10.0f;
+private:
+    class Fragment
+    {
+    public:
+        bool reliable;
+        uint16_t id;
+        uint16_t index;
+        uint16_t count;
+        //Unreliable only: the id of the next reliable message at the moment this message was send.
+        uint16_t reliable_barrier;
+        uint32_t tag;
+        std::vector<uint8_t> data;
+        float last_send_time;
+    };
+    class SentDatagram
+    {
+    public:
+        uint16_t sequence;
+        bool pending = false;
+        float send_time;
+        std::vector<uint32_t> reliable_keys;
+        std::vector<uint32_t> tags;
+    };
+    class Assembly
+    {
+    public:
+        std::vector<std::vector<uint8_t>> parts;
+        std::vector<bool> have;
+        size_t received = 0;
+
+        bool add(uint16_t index, uint16_t count, std::vector<uint8_t>&& data);
+        bool isComplete() const { return received > 0 && received == parts.size(); }
+        std::vector<uint8_t> combine();
+    };
+    class HeldMessage
+    {
+    public:
+        uint16_t id;
+        uint16_t reliable_barrier;
+        std::vector<uint8_t> data;
+    };
+    class DelayedDatagram
+    {
+    public:
+        float time;
+        io::DataBuffer datagram;
+    };
+
+    std::function<void(const io::DataBuffer& datagram)> output;
+
+    //Sending side.
+    uint16_t next_sequence = 0;
+    uint16_t next_reliable_id = 0;
+    uint16_t next_unreliable_id = 0;
+    std::unordered_map<uint32_t, Fragment> reliable_in_flight;
+    std::deque<uint32_t> reliable_order;
+    //Next reliable message that was never send, and the split messages send since the oldest unacknowledged message.
+    uint16_t next_start_reliable_id = 0;
+    std::deque<uint16_t> started_split_reliable;
+    std::deque<Fragment> unreliable_queue;
+    std::vector<SentDatagram> sent_datagrams;
+    std::deque<uint32_t> lost_tags;
+    //Id and tag of recently send unreliable messages with a tag, to report the tag when the peer drops the message.
+    std::deque<std::pair<uint16_t, uint32_t>> unreliable_tags;
+    float last_send_time = -1000.0f;
+
+    //Receiving side.
+    bool closed = false;
+    bool received_any = false;
+    bool ack_pending = false;
+    uint16_t remote_sequence = 0;
+    uint64_t remote_ack_bits = 0;
+    uint16_t next_deliver_reliable_id = 0;
+    std::unordered_map<uint16_t, Assembly> reliable_assembly;
+    size_t reliable_split_assemblies = 0;
+    bool delivered_unreliable = false;
+    uint16_t last_unreliable_id = 0;
+    std::unordered_map<uint16_t, Assembly> unreliable_assembly;
+    //Unreliable messages waiting for reliable messages that where send before them, in id order.
+    std::deque<HeldMessage> held_unreliable;
+    size_t held_unreliable_size = 0;
+    //Ids of outdated unreliable messages that where dropped, to report to the peer.
+    std::deque<uint16_t> dropped_unreliable;
+    std::deque<std::vector<uint8_t>> received_messages;
+    float last_receive_time = -1.0f;
+
+    //Statistics and congestion control.
+    float round_trip_time = 0.1f;
+    bool has_round_trip_sample = false;
+    float send_rate = 256 * 1024;
+    float send_budget = 0.0f;
+    float last_update_time = -1.0f;
+    float last_rate_decrease_time = 0.0f;
+    float packet_loss = 0.0f;
+
+    //Network simulation.
+    float simulate_loss = 0.0f;
+    float simulate_latency = 0.0f;
+    float simulate_jitter = 0.0f;
+    std::list<DelayedDatagram> delayed_datagrams;
+    std::mt19937 simulate_random;
+
+    float getResendDelay() const;
+    void queueFragments(const io::DataBuffer& message, bool reliable, uint16_t id, uint32_t tag);
+    //Returns true if the datagram contained any messages.
+    bool sendDatagram(float now, bool force);
+    //Check if the reliable message with this id can be send without exceeding the receive limits of the peer.
+    bool canStartReliable(const Fragment& fragment);
+    void transmit(const io::DataBuffer& datagram, float now);
+    void processAck(uint16_t ack, uint64_t ack_bits, float now);
+    void onAcked(SentDatagram& record, float now);
+    void onLost(SentDatagram& record, float now);
+    //Returns false for a malformed fragment, or one beyond the receive limits.
+    bool receiveFragment(io::DataBuffer& datagram);
+    void close();
+    void onDropped(uint16_t id);
+    void dropUnreliable(uint16_t id);
+    void holdUnreliable(uint16_t id, uint16_t reliable_barrier, std::vector<uint8_t>&& data);
+    void deliverHeldUnreliable();
+};
+
+}//namespace multiplayer
+}//namespace sp
+
+#endif//SP2_MULTIPLAYER_UDP_CONNECTION_H
@@ -14,6 +14,10 @@ namespace sp {
     This means a AutoPointerObject can be safely deleted without leaving any dangling pointers.
     
     Most SeriousProton2 objects are a subclass AutoPointerObject.
+
+    Pointers and lists link themselves into the object they point to, without any locking.
+    So all \ref sp::P<T> and \ref sp::PList<T> that point to the same object need to be used from one thread at a time.
+    Independent scenes can be updated in parallel, as long as they only point to their own objects.
  */
 class AutoPointerObject : NonCopyable
 {
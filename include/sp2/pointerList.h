@@ -14,6 +14,18 @@ class _PListEntry;
 class _PListIteratorBase;
 class _PListReverseIteratorBase;
 
+/** Statistics of the allocator used for the entries of all \ref sp::PList<T> objects.
+ */
+class PListStatistics
+{
+public:
+    size_t live_entries;        //Entries currently in use by a list.
+    size_t peak_live_entries;   //Highest amount of entries that where in use at the same time. Sampled when threads refill their free list.
+    size_t slabs;               //Amount of slabs allocated, entries are allocated in slabs and never released.
+    size_t allocated_entries;   //Total amount of entries in all slabs.
+};
+PListStatistics getPListStatistics();
+
 class _PListBase : NonCopyable
 {
 public:
@@ -3,8 +3,10 @@
 
 #include <sp2/math/matrix4x4.h>
 #include <sp2/math/quaternion.h>
+#include <sp2/math/aabb.h>
 #include <sp2/script/bindingObject.h>
 #include <sp2/pointerList.h>
+#include <sp2/handle.h>
 #include <sp2/graphics/scene/renderdata.h>
 #include <sp2/graphics/animation.h>
 #include <sp2/multiplayer/replication.h>
@@ -44,9 +46,13 @@ class RenderData;
 class Node : public script::BindingObject
 {
 public:
+    typedef Node HandleRoot;
+
     Node(P<Node> parent);
     virtual ~Node();
 
+    Handle<Node> getHandle() { return this; }
+
     P<Node> getParent() const;
     P<Scene> getScene() const;
     const PList<Node>& getChildren();
@@ -82,9 +88,18 @@ public:
     Vector3d getLinearVelocity3D() const;
     Vector3d getAngularVelocity3D() const;
     
-    const Matrix4x4f& getGlobalTransform() const { return global_transform; }
+    //The global transform is calculated on demand, changes to the position or rotation only mark it as outdated.
+    const Matrix4x4f& getGlobalTransform() const { if (global_transform_dirty) updateGlobalTransform(); return global_transform; }
     const Matrix4x4f& getLocalTransform() const { return local_transform; }
 
+    //Local bounding box of what this node renders, used for view frustum culling.
+    //By default the bounds of the render_data mesh, multiplied by the render_data scale. Return AABB3f::infinite() to never be culled.
+    //Re-evaluated when the transform changes, or after markRenderDataDirty.
+    virtual AABB3f getRenderBounds();
+    //Call after changing the mesh, type or scale of render_data, or updating the mesh in place,
+    //  so frustum culling picks up the new render bounds.
+    void markRenderDataDirty();
+
     //Set or replace the current collision shape on this body.
     //If you want to shape change, you do not need to call removeCollisionShape() before calling setCollisionShape (doing so will reset the velocity)
     void setCollisionShape(const collision::Shape& shape);
@@ -202,26 +217,34 @@ public:
 private:
     Node(Scene* scene);
 
+    HandleRegistration<Node> handle_registration;
     P<Scene> scene;
     P<Node> parent;
     PList<Node> children;
     void* collision_body = nullptr;
+    int flat_index = -1;
+    int visibility_proxy = -1;
+    //Index in the visibility update queue of the scene, or -1 when not queued.
+    int visibility_update_index = -1;
     
     Vector3d translation;
     Quaterniond rotation;
     
-    Matrix4x4f global_transform;
+    mutable Matrix4x4f global_transform;
+    mutable bool global_transform_dirty = false;
     Matrix4x4f local_transform;
 
     std::unique_ptr<Animation> animation;
     
     void updateLocalTransform();
-    void updateGlobalTransform();
+    void updateGlobalTransform() const;
+    void markGlobalTransformDirty();
     
     void modifyPositionByPhysics(sp::Vector2d position, double rotation);
     void modifyPositionByPhysics(sp::Vector3d position, Quaterniond rotation);
 
     friend class Scene;
+    template<class T> friend class Handle;
     friend class collision::Shape;
     friend class collision::Backend;
     friend class collision::Joint2D;
@@ -172,6 +172,8 @@ public:
     void emit(const Parameters& parameters);
     
     virtual void onUpdate(float delta) override;
+    //Particles with a global origin are not positioned by this node, so those never get culled.
+    virtual AABB3f getRenderBounds() override;
 
     bool auto_destroy = false;
 
@@ -183,6 +185,7 @@ private:
     Parameters spawn_max;
 
     std::vector<Parameters> particles;
+    float max_particle_size = 0.0f;
     std::vector<std::unique_ptr<Effector>> effectors;
 };
 
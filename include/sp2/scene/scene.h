@@ -3,6 +3,7 @@
 
 #include <sp2/pointer.h>
 #include <sp2/pointerList.h>
+#include <sp2/handle.h>
 #include <sp2/string.h>
 #include <sp2/math/vector.h>
 #include <sp2/math/ray.h>
@@ -11,8 +12,10 @@
 #include <sp2/io/textinput.h>
 #include <sp2/script/bindingObject.h>
 #include <sp2/collision/backend.h>
+#include <sp2/scene/visibilityTree.h>
 
 #include <unordered_map>
+#include <vector>
 
 
 namespace sp {
@@ -26,9 +29,13 @@ class Camera;
 class Scene : public script::BindingObject
 {
 public:
+    typedef Scene HandleRoot;
+
     Scene(const string& scene_name, int priority=0);
     virtual ~Scene();
 
+    Handle<Scene> getHandle() { return this; }
+
     P<Node> getRoot() { return root; }
     P<Camera> getCamera() { return camera; }
     void setDefaultCamera(P<Camera> camera);
@@ -37,6 +44,10 @@ public:
     void disable() { setEnabled(false); }
     void setEnabled(bool enabled);
     bool isEnabled() { return enabled; }
+    //Mark this scene as independent. An independent scene does not access nodes or state of other scenes during its (fixed)update.
+    // When the engine has scene update threads enabled, independent scenes are updated in parallel on worker threads.
+    void setIndependent(bool independent) { this->independent = independent; }
+    bool isIndependent() { return independent; }
     void fixedUpdate();
     void postFixedUpdate(float delta);
     void update(float delta);
@@ -75,22 +86,59 @@ public:
     
     string getName() const { return scene_name; }
     int getPriority() const { return priority; }
+
+    //Get all nodes of this scene in depth first order, starting with the root node.
+    //The list is only rebuild when the node hierarchy changes. Nodes destroyed while iterating this list are replaced by nullptr.
+    const std::vector<Node*>& getNodesDepthFirst();
+    //Calculate all outdated node global transforms in hierarchy order, so every transform is calculated only once.
+    //Called by render passes before submitting nodes, as rendering needs the global transform of every node.
+    void updateGlobalTransforms();
+    //Bring the visibility tree up to date with the render bounds of all nodes. Call after updateGlobalTransforms.
+    //Only nodes that reported a transform or render data change since the last call are updated, see Node::markRenderDataDirty.
+    //Changes are only tracked after the first call, so scenes that are never culled do not keep a queue of changes.
+    void updateVisibility();
+    //Get all renderable nodes that are possibly visible in the frustum, in depth first order.
+    //Nodes with infinite render bounds are always returned.
+    void queryVisibleNodes(const Frustumf& frustum, std::vector<Node*>& result) const;
+    //Amount of renderable nodes known by the visibility tree, including nodes with infinite bounds.
+    int getVisibilityNodeCount() const { return visibility_tree.size() + int(unbounded_nodes.size()); }
     
     friend class collision::Shape;
     friend class collision::Joint2D;
     friend class CollisionRenderPass;
     friend class Node;
+    template<class T> friend class Handle;
 private:
+    HandleRegistration<Scene> handle_registration;
     string scene_name;
     
     P<Node> root;
     P<Camera> camera;
     collision::Backend* collision_backend = nullptr;
     bool enabled;
+    bool independent = false;
     int priority;
 
-    void updateNode(float delta, P<Node> node);
-    void fixedUpdateNode(P<Node> node);
+    std::vector<Node*> flat_nodes;
+    bool flat_nodes_dirty = true;
+    int flat_nodes_iterating = 0;
+
+    void updateFlatNodes();
+    void addToFlatNodes(Node* node);
+    void removeFromFlatNodes(Node* node);
+
+    static constexpr int unbounded_visibility_proxy = -2;
+    VisibilityTree visibility_tree;
+    std::vector<Node*> unbounded_nodes;
+    //Nodes of which the render bounds need to be updated in the visibility tree. Removed nodes are replaced by nullptr,
+    //which are compacted away when the flat node list is rebuild.
+    std::vector<Node*> visibility_updates;
+    bool visibility_used = false;
+
+    void queueVisibilityUpdate(Node* node);
+    void queueVisibilityUpdates(Node* node);
+    void updateNodeVisibility(Node* node);
+    void removeFromVisibility(Node* node);
 
     static std::unordered_map<string, P<Scene>> scene_mapping;
 
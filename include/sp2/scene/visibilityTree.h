@@ -0,0 +1,62 @@
+#ifndef SP2_SCENE_VISIBILITY_TREE_H
+#define SP2_SCENE_VISIBILITY_TREE_H
+
+#include <sp2/math/aabb.h>
+#include <sp2/math/frustum.h>
+#include <sp2/nonCopyable.h>
+#include <vector>
+
+namespace sp {
+
+class Node;
+/** Dynamic bounding volume hierarchy of nodes, used by the Scene for view frustum culling.
+
+    Leaves store slightly enlarged bounds, so small movements do not change the tree.
+    The tree is kept balanced with rotations, so queries stay O(log n) while nodes move around.
+ */
+class VisibilityTree : NonCopyable
+{
+public:
+    //Add a node with world space bounds, returns the proxy id that is used to update or remove it.
+    int add(Node* node, const AABB3f& bounds);
+    void remove(int proxy);
+    //Update the bounds of a proxy, returns true if the tree needed to change.
+    bool update(int proxy, const AABB3f& bounds);
+
+    //Add all nodes that are possibly visible in the frustum to the result.
+    void query(const Frustumf& frustum, std::vector<Node*>& result) const;
+
+    int size() const { return proxy_count; }
+    //Height of the tree, 0 for an empty tree. For tests and debugging.
+    int getHeight() const { return root == -1 ? 0 : tree_nodes[root].height + 1; }
+private:
+    class TreeNode
+    {
+    public:
+        AABB3f bounds;
+        int parent;
+        int child[2];
+        int height; //0 for leaves, -1 for free entries.
+        Node* node;
+
+        bool isLeaf() const { return child[0] == -1; }
+    };
+
+    std::vector<TreeNode> tree_nodes;
+    int root = -1;
+    int free_list = -1;
+    int proxy_count = 0;
+
+    int allocate();
+    void release(int index);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int balance(int index);
+    void replaceChild(int parent, int old_child, int new_child);
+    void collect(int index, std::vector<Node*>& result) const;
+};
+
+}//namespace sp
+
+#endif//SP2_SCENE_VISIBILITY_TREE_H
@@ -52,6 +52,9 @@ public:
 
     Result<Variant> load(const string& resource_name);
     Result<Variant> load(io::ResourceStreamPtr resource);
+    //Run script resources again when they change on disk, for scripts that are loaded with load(resource_name) after this is enabled.
+    //Reloading redefines the functions of the script. Errors are logged.
+    void setAutoReload(bool enabled);
     Result<Variant> run(const string& code);
     Result<CoroutinePtr> runCoroutine(const string& code);
 
@@ -111,6 +114,9 @@ private:
     Result<Variant> _run(const string& code, const string& name);
 
     AllocInfo alloc_info;
+    bool auto_reload = false;
+    //Watch id of each resource that is reloaded on changes.
+    std::unordered_map<string, int> auto_reload_watches;
 
     friend class Coroutine;
     friend class Callback;
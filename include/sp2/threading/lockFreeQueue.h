@@ -0,0 +1,59 @@
+#ifndef SP2_THREADING_LOCK_FREE_QUEUE_H
+#define SP2_THREADING_LOCK_FREE_QUEUE_H
+
+#include <sp2/nonCopyable.h>
+#include <atomic>
+#include <vector>
+
+namespace sp {
+namespace threading {
+
+/** Fixed size queue to hand over items from one thread to another without locking.
+    Only a single thread can put items in the queue, and only a single thread can take them out.
+ */
+template<class T> class LockFreeQueue : NonCopyable
+{
+public:
+    LockFreeQueue(size_t capacity)
+    {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    //Returns false when the queue is full.
+    bool put(T&& item)
+    {
+        size_t index = write_index.load(std::memory_order_relaxed);
+        if (index - read_index.load(std::memory_order_acquire) == items.size())
+            return false;
+        items[index & mask] = std::move(item);
+        write_index.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Returns false when the queue is empty.
+    bool get(T& item)
+    {
+        size_t index = read_index.load(std::memory_order_relaxed);
+        if (index == write_index.load(std::memory_order_acquire))
+            return false;
+        item = std::move(items[index & mask]);
+        read_index.store(index + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    std::vector<T> items;
+    size_t mask;
+    //On separate cache lines, as each index is written by a different thread.
+    alignas(64) std::atomic<size_t> write_index{0};
+    alignas(64) std::atomic<size_t> read_index{0};
+};
+
+}//namespace threading
+}//namespace sp
+
+
+#endif//SP2_THREADING_LOCK_FREE_QUEUE_H
@@ -0,0 +1,47 @@
+#ifndef SP2_THREADING_WORKER_POOL_H
+#define SP2_THREADING_WORKER_POOL_H
+
+#include <sp2/nonCopyable.h>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace sp {
+namespace threading {
+
+/** Fixed size set of worker threads that execute jobs in the order they are added.
+
+    Jobs are added with add(), and wait() blocks until all jobs that have been added are finished.
+    This makes it usable as a fork/join barrier, for example to update independent scenes in parallel.
+ */
+class WorkerPool : NonCopyable
+{
+public:
+    WorkerPool(int thread_count);
+    ~WorkerPool();
+
+    void add(std::function<void()> job);
+    //Wait till all jobs that are added are finished.
+    void wait();
+
+    int getThreadCount() const { return int(threads.size()); }
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable job_condition;
+    std::condition_variable done_condition;
+    int pending_jobs = 0;
+    bool stopping = false;
+
+    void workerThread();
+};
+
+}//namespace threading
+}//namespace sp
+
+
+#endif//SP2_THREADING_WORKER_POOL_H
@@ -40,6 +40,8 @@ public:
     void setPosition(Vector2f position, int monitor_number=0);
     Vector2i getSize();
     static int getMonitorCount();
+    //Draw and state change counters of the last rendered frame.
+    RenderQueue::Statistics getRenderStatistics();
 
     void addLayer(P<GraphicsLayer> layer);
 
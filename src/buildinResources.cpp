@@ -35,6 +35,42 @@ void main()
     if (gl_FragColor.a == 0.0)
         discard;
 }
+)EOS"},
+
+    {"basic_instanced.shader", R"EOS(
+[VERTEX]
+attribute vec3 a_vertex;
+attribute vec3 a_normal;
+attribute vec2 a_uv;
+attribute mat4 a_instance_matrix;
+attribute vec4 a_instance_color;
+
+uniform mat4 projection_matrix;
+uniform mat4 camera_matrix;
+uniform vec3 object_scale;
+
+varying vec2 v_uv;
+varying vec4 v_color;
+
+void main()
+{
+    gl_Position = projection_matrix * camera_matrix * a_instance_matrix * vec4(a_vertex.xyz * object_scale, 1.0);
+    v_uv = a_uv.xy;
+    v_color = a_instance_color;
+}
+
+[FRAGMENT]
+uniform sampler2D texture_map;
+
+varying vec2 v_uv;
+varying vec4 v_color;
+
+void main()
+{
+    gl_FragColor = texture2D(texture_map, v_uv) * v_color;
+    if (gl_FragColor.a == 0.0)
+        discard;
+}
 )EOS"},
 
     {"color_by_normal.shader", R"EOS(
@@ -10,6 +10,8 @@
 #include <sp2/multiplayer/client.h>
 #include <sp2/multiplayer/registry.h>
 #include <sp2/io/keybinding.h>
+#include <sp2/io/lazyLoader.h>
+#include <sp2/io/resourceWatcher.h>
 
 #include <SDL.h>
 #ifdef __EMSCRIPTEN__
@@ -59,7 +61,7 @@ Engine::Engine()
     maximum_frame_time = 0.5f;
     minimum_frame_time = 0.001f;
     fixed_update_accumulator = 0.0;
-    last_update_timing = {0};
+    last_update_timing = {};
 
     in_fixed_update = false;
     update_delta = 0.0f;
@@ -81,6 +83,8 @@ Engine::Engine()
 
 Engine::~Engine()
 {
+    //Stop the loader threads while the loaders that they use still exist.
+    io::LazyLoaderManager::shutdown();
 }
 
 void Engine::initialize()
@@ -240,7 +244,7 @@ void Engine::processEvents()
 
 void Engine::update(float time_delta)
 {
-    UpdateTiming timing;
+    UpdateTiming timing{};
     Clock timing_clock;
 
     time_delta *= game_speed;
@@ -264,27 +268,25 @@ void Engine::update(float time_delta)
     while(fixed_update_accumulator > fixed_update_delta)
     {
         fixed_update_accumulator -= fixed_update_delta;
-        for(P<Scene> scene : Scene::all())
+        updateScenes(timing, &UpdateTiming::SceneTiming::fixed_update, [](Scene* scene)
         {
-            if (scene->isEnabled())
-            {
-                scene->fixedUpdate();
-            }
-        }
+            scene->fixedUpdate();
+        });
         io::Keybinding::allPostFixedUpdate();
     }
     in_fixed_update = false;
-    for(P<Scene> scene : Scene::all())
+    float accumulator = fixed_update_accumulator;
+    updateScenes(timing, &UpdateTiming::SceneTiming::fixed_update, [accumulator](Scene* scene)
     {
-        if (scene->isEnabled())
-            scene->postFixedUpdate(fixed_update_accumulator);
-    }
+        scene->postFixedUpdate(accumulator);
+    });
     timing.fixed_update = timing_clock.restart();
-    for(P<Scene> scene : Scene::all())
+    updateScenes(timing, &UpdateTiming::SceneTiming::dynamic_update, [time_delta](Scene* scene)
     {
-        if (scene->isEnabled())
-            scene->update(time_delta);
-    }
+        scene->update(time_delta);
+    });
+    io::LazyLoaderManager::update();
+    io::ResourceWatcher::update();
     for(P<Updatable> updatable : Updatable::updatables)
     {
         updatable->onUpdate(time_delta);
@@ -311,6 +313,71 @@ void Engine::update(float time_delta)
     last_update_timing = timing;
 }
 
+void Engine::updateScenes(UpdateTiming& timing, float UpdateTiming::SceneTiming::*timing_field, const std::function<void(Scene* scene)>& function)
+{
+    //First collect the scenes and their timing entries, so the timing list is not modified while workers are running.
+    std::vector<std::pair<P<Scene>, size_t>> scenes;
+    for(P<Scene> scene : Scene::all())
+    {
+        if (!scene->isEnabled())
+            continue;
+        size_t index = 0;
+        while(index < timing.scenes.size() && timing.scenes[index].name != scene->getName())
+            index++;
+        if (index == timing.scenes.size())
+            timing.scenes.push_back({scene->getName(), 0.0f, 0.0f});
+        scenes.emplace_back(scene, index);
+    }
+
+    //Serial scenes run first on the main thread. They can disable or destroy other scenes, so check again before running each.
+    for(auto& entry : scenes)
+    {
+        if (!entry.first || !entry.first->isEnabled())
+            continue;
+        if (scene_update_pool && entry.first->isIndependent())
+            continue;
+        Clock clock;
+        function(*entry.first);
+        timing.scenes[entry.second].*timing_field += clock.getElapsedTime();
+    }
+    if (!scene_update_pool)
+        return;
+    //Independent scenes run in parallel after that, while the main thread waits, so nothing can destroy them during their update.
+    //The P<Scene> of every task stays in the scenes list till after wait(). Tasks get the raw pointer,
+    //  as copying a P<Scene> on a worker thread would modify the link list of the scene from multiple threads.
+    for(auto& entry : scenes)
+    {
+        if (!entry.first || !entry.first->isEnabled() || !entry.first->isIndependent())
+            continue;
+        Scene* scene = *entry.first;
+        float* time = &(timing.scenes[entry.second].*timing_field);
+        scene_update_pool->add([scene, time, &function]()
+        {
+            Clock clock;
+            function(scene);
+            *time += clock.getElapsedTime();
+        });
+    }
+    scene_update_pool->wait();
+}
+
+void Engine::setSceneUpdateThreads(int thread_count)
+{
+#ifndef __EMSCRIPTEN__
+    if (thread_count > 0)
+        scene_update_pool = std::make_unique<threading::WorkerPool>(thread_count);
+    else
+        scene_update_pool = nullptr;
+#endif//!__EMSCRIPTEN__
+}
+
+int Engine::getSceneUpdateThreads()
+{
+    if (scene_update_pool)
+        return scene_update_pool->getThreadCount();
+    return 0;
+}
+
 void Engine::setGameSpeed(float speed)
 {
     game_speed = std::max(0.0f, speed);
@@ -123,6 +123,7 @@ void Image::updateRenderData()
     {
         render_data.mesh = nullptr;
     }
+    markRenderDataDirty();
 }
 
 }//namespace gui
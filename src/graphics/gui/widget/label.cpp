@@ -100,6 +100,7 @@ void Label::updateRenderData()
                 layout.size = sp::Vector2d(prepared.getUsedAreaSize());
         }
         render_data.mesh = prepared.create();
+        markRenderDataDirty();
         render_data.texture = t.font->getTexture(64);
         texture_revision = render_data.texture->getRevision();
     }
@@ -102,6 +102,7 @@ void Listbox::updateRenderData()
                 node->setPosition(sp::Vector2d(0, y));
             }
             node->render_data.mesh = text.create();
+            node->markRenderDataDirty();
             node->render_data.color = ft.color;
             node->render_data.texture = ft.font->getTexture(32);
             index += 1;
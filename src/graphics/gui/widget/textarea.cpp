@@ -89,6 +89,7 @@ void TextArea::updateRenderData()
                 data.position.y += vertical_scroll->getValue();
         }
         render_data.mesh = result.create();
+        markRenderDataDirty();
         render_data.texture = t.font->getTexture(64);
         texture_revision = render_data.texture->getRevision();
 
@@ -150,6 +151,7 @@ void TextArea::updateRenderData()
             }
             cursor_widget->render_data.shader = Shader::get("internal:color.shader");
             cursor_widget->render_data.mesh = mb.create();
+            cursor_widget->markRenderDataDirty();
             cursor_widget->render_data.color = t.color;
             if (selection_start != selection_end)
                 cursor_widget->render_data.color.a = 0.5;
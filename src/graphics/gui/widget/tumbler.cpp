@@ -86,6 +86,7 @@ void Tumbler::updateRenderData()
             {
                 node->render_data.mesh = nullptr;
             }
+            node->markRenderDataDirty();
             node->render_data.texture = ft.font->getTexture(32);
             offset += row_height;
         }
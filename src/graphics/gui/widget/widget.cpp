@@ -3,6 +3,7 @@
 #include <sp2/graphics/gui/layout/layout.h>
 #include <sp2/graphics/gui/theme.h>
 #include <sp2/graphics/gui/loader.h>
+#include <sp2/io/resourceWatcher.h>
 #include <sp2/graphics/textureManager.h>
 #include <sp2/graphics/fontManager.h>
 #include <sp2/audio/sound.h>
@@ -35,6 +36,10 @@ Widget::~Widget()
 {
     if (layout_manager)
         delete layout_manager;
+#ifdef DEBUG
+    for(auto& data : auto_reload)
+        io::ResourceWatcher::unwatch(data.watch_id);
+#endif
 }
 
 void Widget::loadThemeStyle(const string& name)
@@ -140,6 +145,7 @@ void Widget::setSize(Vector2d v)
 static void recursiveSetRenderType(P<Widget> widget, RenderData::Type type)
 {
     widget->render_data.type = type;
+    widget->markRenderDataDirty();
     for(P<Widget> w : widget->getChildren())
     {
         if (!w)
@@ -398,30 +404,32 @@ P<Widget> Widget::getWidgetWithID(const string& id)
 void Widget::setupAutoReload(P<Widget> widget, const string& resource_name, const string& root_id)
 {
     AutoReloadData data;
-    data.last_modify_time = io::ResourceProvider::getModifyTime(resource_name);
     data.resource_name = resource_name;
     data.root_id = root_id;
     data.widget = widget;
+    //The watch is removed in the destructor, so the callback never runs for a destroyed widget.
+    data.watch_id = io::ResourceWatcher::watch(resource_name, [this, resource_name, root_id]()
+    {
+        autoReload(resource_name, root_id);
+    });
     auto_reload.push_back(data);
 }
-#endif
 
-void Widget::updateLayout(Vector2d position, Vector2d size)
+void Widget::autoReload(const string& resource_name, const string& root_id)
 {
-#ifdef DEBUG
     for(auto& data : auto_reload)
     {
-        std::chrono::system_clock::time_point modify_time = io::ResourceProvider::getModifyTime(data.resource_name);
-        if (modify_time == data.last_modify_time)
+        if (data.resource_name != resource_name || data.root_id != root_id)
             continue;
         LOG(Info, "Reloading:", data.resource_name, data.root_id);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
         data.widget.destroy();
         data.widget = sp::gui::Loader::load(data.resource_name, data.root_id, this);
-        if (data.widget)
-            data.last_modify_time = modify_time;
     }
+}
 #endif
+
+void Widget::updateLayout(Vector2d position, Vector2d size)
+{
     if (layout_manager || !getChildren().empty())
     {
         if (!layout_manager)
@@ -553,6 +561,7 @@ void Widget::updateRenderDataToThemeImage(Rect2f rect, Rect2f clip, int flags)
     {
         render_data.mesh = nullptr;
     }
+    markRenderDataDirty();
 }
 
 }//namespace gui
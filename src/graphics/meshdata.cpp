@@ -16,6 +16,7 @@ MeshData::MeshData(Type type)
     vertices_vbo = NO_BUFFER;
     indices_vbo = NO_BUFFER;
     dirty = true;
+    bounds_dirty = true;
     revision = 0;
 }
 
@@ -36,8 +37,22 @@ MeshData::~MeshData()
 
 void MeshData::render()
 {
-    if (vertices.size() < 1)
+    if (!bindBuffers())
         return;
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, nullptr);
+}
+
+void MeshData::renderInstanced(int instance_count)
+{
+    if (!bindBuffers())
+        return;
+    glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, nullptr, instance_count);
+}
+
+bool MeshData::bindBuffers()
+{
+    if (vertices.size() < 1)
+        return false;
     if (vertices_vbo == NO_BUFFER)
     {
         glGenBuffers(1, &vertices_vbo);
@@ -66,8 +81,7 @@ void MeshData::render()
         if (Shader::bound_shader->uv_attribute != -1)
             glVertexAttribPointer(Shader::bound_shader->uv_attribute, 2, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, uv));
     }
-
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, nullptr);
+    return true;
 }
 
 void MeshData::update(Vertices&& vertices, Indices&& indices)
@@ -75,9 +89,22 @@ void MeshData::update(Vertices&& vertices, Indices&& indices)
     this->vertices = std::move(vertices);
     this->indices = std::move(indices);
     dirty = true;
+    bounds_dirty = true;
     revision++;
 }
 
+const AABB3f& MeshData::getBounds()
+{
+    if (bounds_dirty)
+    {
+        bounds = AABB3f();
+        for(const Vertex& vertex : vertices)
+            bounds.growToInclude(vertex.position);
+        bounds_dirty = false;
+    }
+    return bounds;
+}
+
 std::shared_ptr<MeshData> MeshData::create(Vertices&& vertices, Indices&& indices, Type type)
 {
     return std::make_shared<MeshData>(std::forward<Vertices>(vertices), std::forward<Indices>(indices), type);
@@ -1,6 +1,8 @@
 #include <sp2/graphics/opengl.h>
 #include <sp2/logging.h>
 #include <SDL_video.h>
+#include <string.h>
+#include <stdlib.h>
 
 static bool init_done = false;
 
@@ -150,6 +152,9 @@ void (GL_APIENTRY * glVertexAttribPointer)(GLuint indx, GLint size, GLenum type,
 void (GL_APIENTRY * glViewport)(GLint x, GLint y, GLsizei width, GLsizei height);
 #endif//SP2_GRAPHICS_OPENGLES2_H
 
+void (GL_APIENTRY * glDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount);
+void (GL_APIENTRY * glVertexAttribDivisor)(GLuint index, GLuint divisor);
+
 namespace sp {
 
 void initOpenGL()
@@ -305,10 +310,43 @@ void initOpenGL()
     if ((glViewport = reinterpret_cast<decltype(glViewport)>(SDL_GL_GetProcAddress("glViewport"))) == nullptr) { LOG(Error, "Failed to find opengl function: glViewport"); failure = true; }
 #endif//SP2_GRAPHICS_OPENGLES2_H
 
+    //Optional instancing functions, core in OpenGL 3.3 and OpenGLES 3.0, else available trough an extension.
+    //Function lookup does not fail on some platforms for unsupported functions, so the version and extensions are checked first.
+    const GLubyte* version_string = glGetString ? glGetString(GL_VERSION) : nullptr;
+    const GLubyte* extensions = glGetString ? glGetString(GL_EXTENSIONS) : nullptr;
+    string version = version_string ? reinterpret_cast<const char*>(version_string) : "";
+    bool instancing_core;
+    if (version.startswith("OpenGL ES "))
+        instancing_core = atof(version.substr(10).c_str()) >= 3.0;
+    else
+        instancing_core = atof(version.c_str()) >= 3.3;
+    bool instancing_extension = extensions && strstr(reinterpret_cast<const char*>(extensions), "_instanced_arrays");
+    if (instancing_core || instancing_extension)
+    {
+        for(const char* suffix : {"", "ARB", "EXT", "ANGLE"})
+        {
+            glDrawElementsInstanced = reinterpret_cast<decltype(glDrawElementsInstanced)>(SDL_GL_GetProcAddress((string("glDrawElementsInstanced") + suffix).c_str()));
+            glVertexAttribDivisor = reinterpret_cast<decltype(glVertexAttribDivisor)>(SDL_GL_GetProcAddress((string("glVertexAttribDivisor") + suffix).c_str()));
+            if (glDrawElementsInstanced && glVertexAttribDivisor)
+                break;
+        }
+    }
+    if (!isOpenGLInstancingSupported())
+    {
+        glDrawElementsInstanced = nullptr;
+        glVertexAttribDivisor = nullptr;
+        LOG(Info, "No support for instanced rendering, rendering items one by one.");
+    }
+
     if (failure)
         exit(1);
 }
 
+bool isOpenGLInstancingSupported()
+{
+    return glDrawElementsInstanced != nullptr && glVertexAttribDivisor != nullptr;
+}
+
 }//namespace sp
 
 
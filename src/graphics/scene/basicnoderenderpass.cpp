@@ -26,6 +26,7 @@ void BasicNodeRenderPass::addCamera(P<Camera> camera)
 
 void BasicNodeRenderPass::render(RenderQueue& queue)
 {
+    statistics = Statistics();
     if (!cameras.empty())
     {
         for(P<Camera> camera : cameras)
@@ -160,24 +161,38 @@ void BasicNodeRenderPass::renderScene(RenderQueue& queue, P<Scene> scene, P<Came
 
     if (scene->isEnabled() && camera)
     {
+        scene->updateGlobalTransforms();
         queue.setCamera(camera);
-        recursiveNodeRender(queue, scene->getRoot());
+        if (frustum_culling)
+        {
+            scene->updateVisibility();
+            scene->queryVisibleNodes(Frustumf(camera->getProjectionMatrix() * camera->getGlobalTransform().inverse()), visible_nodes);
+            for(Node* node : visible_nodes)
+                addNodeToRenderQueue(queue, node);
+            statistics.submitted += int(visible_nodes.size());
+            statistics.culled += scene->getVisibilityNodeCount() - int(visible_nodes.size());
+        }
+        else
+        {
+            const std::vector<Node*>& nodes = scene->getNodesDepthFirst();
+            for(size_t index=0; index<nodes.size(); index++)
+            {
+                if (nodes[index])
+                    addNodeToRenderQueue(queue, nodes[index]);
+            }
+        }
     }
 }
 
-void BasicNodeRenderPass::recursiveNodeRender(RenderQueue& queue, P<Node> node)
+void BasicNodeRenderPass::addNodeToRenderQueue(RenderQueue& queue, Node* node)
 {
-    addNodeToRenderQueue(queue, node);
-    for(P<Node> child : node->getChildren())
-    {
-        recursiveNodeRender(queue, child);
-    }
+    if (node->render_data.type != sp::RenderData::Type::None && node->render_data.mesh)
+        queue.add(node->getGlobalTransform(), node->render_data);
 }
 
 void BasicNodeRenderPass::addNodeToRenderQueue(RenderQueue& queue, P<Node>& node)
 {
-    if (node->render_data.type != sp::RenderData::Type::None && node->render_data.mesh)
-        queue.add(node->getGlobalTransform(), node->render_data);
+    addNodeToRenderQueue(queue, *node);
 }
 
 }//namespace sp
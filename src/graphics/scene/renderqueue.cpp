@@ -5,14 +5,20 @@
 #include <sp2/graphics/shader.h>
 #include <sp2/graphics/opengl.h>
 #include <sp2/scene/camera.h>
+#include <algorithm>
+#include <string.h>
 
 
 namespace sp {
 
+//Below this amount of items a comparison sort is faster then setting up the radix sort histograms.
+static constexpr uint32_t radix_sort_threshold = 64;
+
 RenderQueue::RenderQueue()
 {
-    render_list.clear();
-    render_list_sort_start = 0;
+    sort_start = 0;
+    instance_buffer = 0;
+    sort_camera_transform = Matrix4x4f::identity();
     
 #ifdef SP2_USE_RENDER_THREAD
     render_data_ready = false;
@@ -39,42 +45,169 @@ void RenderQueue::setCamera(P<Camera> camera)
 
 void RenderQueue::setCamera(const Matrix4x4f& camera_projection, const Matrix4x4f& camera_transform)
 {
-    std::sort(render_list.begin() + render_list_sort_start, render_list.end());
-    render_list.emplace_back(Item::Type::CameraProjection, camera_projection);
-    render_list.emplace_back(Item::Type::CameraTransform, camera_transform);
-    render_list_sort_start = render_list.size();
+    sortPendingItems();
+    frame.commands.emplace_back(Command::Type::CameraProjection, camera_projection);
+    frame.commands.emplace_back(Command::Type::CameraTransform, camera_transform);
+    sort_camera_transform = camera_transform;
 }
 
 void RenderQueue::add(std::function<void()> function)
 {
-    std::sort(render_list.begin() + render_list_sort_start, render_list.end());
-    render_list.emplace_back(function);
-    render_list_sort_start = render_list.size();
+    sortPendingItems();
+    frame.commands.emplace_back(std::move(function));
 }
 
 void RenderQueue::add(const Matrix4x4f& transform, const RenderData& data)
 {
     if (!data.shader)
         return;
-    render_list.emplace_back(transform, data);
+    SortEntry entry;
+    entry.key = buildSortKey(transform, data);
+    entry.index = frame.draw_records.size();
+    frame.sort_entries.push_back(entry);
+
+    frame.draw_records.emplace_back();
+    DrawRecord& record = frame.draw_records.back();
+    record.transform = transform;
+    record.type = data.type;
+    record.shader = data.shader;
+    record.mesh = data.mesh.get();
+    record.texture = data.texture;
+    record.color = data.color;
+    record.scale = data.scale;
+#ifdef SP2_USE_RENDER_THREAD
+    if (frame.meshes.empty() || frame.meshes.back() != data.mesh)
+        frame.meshes.push_back(data.mesh);
+#endif
 }
 
 void RenderQueue::render()
 {
-    std::sort(render_list.begin() + render_list_sort_start, render_list.end());
-    render_list_sort_start = 0;
+    sortPendingItems();
+    sort_start = 0;
 #ifdef SP2_USE_RENDER_THREAD
     {
         std::unique_lock<std::mutex> lock(render_mutex);
         if (render_data_ready)
             render_trigger.wait(lock, [this](){ return !render_data_ready; });
-        std::swap(ready_render_list, render_list);
+        std::swap(ready_frame, frame);
         render_data_ready = true;
     }
     render_trigger.notify_one();
 #else
-    render(render_list);
+    render(frame);
+#endif
+}
+
+uint64_t RenderQueue::buildSortKey(const Matrix4x4f& transform, const RenderData& data)
+{
+    //Key layout, from most to least significant: order:16, type:4, shader:12, texture:12, mesh:8, depth:12
+    int order = std::min(std::max(data.order, -0x8000), 0x7fff) + 0x8000;
+    uint64_t key = uint64_t(order) << 48;
+    key |= uint64_t(int(data.type) & 0x0f) << 44;
+    key |= uint64_t(data.shader->sort_id & 0x0fff) << 32;
+    if (data.texture)
+        key |= uint64_t(data.texture->sort_id & 0x0fff) << 20;
+    //Group identical meshes so they can be batched. Transparent items need to stay in depth order instead.
+    if (data.type != RenderData::Type::Transparent)
+        key |= uint64_t((reinterpret_cast<uintptr_t>(data.mesh.get()) >> 4) & 0xff) << 12;
+
+    //View space Z of the origin of the item, mapped to an unsigned integer that sorts the same as the float.
+    const float* c = sort_camera_transform.data;
+    const float* t = transform.data;
+    float z = c[2] * t[12] + c[6] * t[13] + c[10] * t[14] + c[14];
+    uint32_t depth;
+    memcpy(&depth, &z, sizeof(depth));
+    if (depth & 0x80000000)
+        depth = ~depth;
+    else
+        depth |= 0x80000000;
+    depth >>= 20;
+    //Ascending Z is back to front. Blended items need that, opaque items are drawn front to back to reduce overdraw.
+    if (data.type != RenderData::Type::Transparent && data.type != RenderData::Type::Additive)
+        depth = ~depth & 0x0fff;
+    return key | depth;
+}
+
+void RenderQueue::sortPendingItems()
+{
+    uint32_t end = frame.sort_entries.size();
+    uint32_t count = end - sort_start;
+    if (count == 0)
+        return;
+    SortEntry* entries = frame.sort_entries.data() + sort_start;
+    if (count < radix_sort_threshold)
+    {
+        std::stable_sort(entries, entries + count, [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+    }
+    else
+    {
+        //Stable LSD radix sort, 8 bits per pass. Passes where all keys have the same byte are skipped,
+        //which is common as most scenes use a few orders, types and shaders.
+        uint32_t histogram[8][256] = {};
+        for(uint32_t n=0; n<count; n++)
+        {
+            uint64_t key = entries[n].key;
+            for(int pass=0; pass<8; pass++)
+                histogram[pass][(key >> (pass * 8)) & 0xff]++;
+        }
+
+        sort_buffer.resize(count);
+        SortEntry* source = entries;
+        SortEntry* target = sort_buffer.data();
+        for(int pass=0; pass<8; pass++)
+        {
+            uint32_t* counts = histogram[pass];
+            if (counts[(source[0].key >> (pass * 8)) & 0xff] == count)
+                continue;
+            uint32_t offset = 0;
+            for(int n=0; n<256; n++)
+            {
+                uint32_t bucket_size = counts[n];
+                counts[n] = offset;
+                offset += bucket_size;
+            }
+            for(uint32_t n=0; n<count; n++)
+                target[counts[(source[n].key >> (pass * 8)) & 0xff]++] = source[n];
+            std::swap(source, target);
+        }
+        if (source != entries)
+            std::copy(source, source + count, entries);
+    }
+    uint32_t batch_start = frame.batches.size();
+    buildBatches(sort_start, end);
+    frame.commands.emplace_back(batch_start, uint32_t(frame.batches.size()));
+    sort_start = end;
+}
+
+void RenderQueue::buildBatches(uint32_t start, uint32_t end)
+{
+    Batch* batch = nullptr;
+    for(uint32_t n=start; n<end; n++)
+    {
+        const DrawRecord& record = frame.draw_records[frame.sort_entries[n].index];
+        if (!batch || batch->type != record.type || batch->shader != record.shader || batch->mesh != record.mesh || batch->texture != record.texture || batch->scale != record.scale)
+        {
+            frame.batches.emplace_back();
+            batch = &frame.batches.back();
+            batch->type = record.type;
+            batch->shader = record.shader;
+            batch->mesh = record.mesh;
+            batch->texture = record.texture;
+            batch->scale = record.scale;
+            batch->start = n;
+            batch->count = 0;
+        }
+        batch->count++;
+    }
+}
+
+RenderQueue::Statistics RenderQueue::getStatistics()
+{
+#ifdef SP2_USE_RENDER_THREAD
+    std::lock_guard<std::mutex> lock(render_mutex);
 #endif
+    return last_statistics;
 }
 
 #ifdef SP2_USE_RENDER_THREAD
@@ -87,7 +220,7 @@ void RenderQueue::renderThread()
             if (!render_data_ready)
                 render_trigger.wait(lock, [this](){ return render_data_ready; });
         }
-        render(ready_render_list);
+        render(ready_frame);
         {
             std::unique_lock<std::mutex> lock(render_mutex);
             render_data_ready = false;
@@ -97,64 +230,235 @@ void RenderQueue::renderThread()
 }
 #endif
 
-void RenderQueue::render(std::vector<Item>& list)
+void RenderQueue::render(Frame& frame)
 {
-    bool force_camera_matrix_update = false;
-    for(Item& item : list)
+    statistics = Statistics();
+    state = StateCache();
+    force_camera_matrix_update = false;
+    for(Command& command : frame.commands)
     {
-        switch(item.type)
+        switch(command.type)
         {
-        case Item::Type::CameraProjection:
-            camera_projection = item.transform;
+        case Command::Type::CameraProjection:
+            camera_projection = command.transform;
             force_camera_matrix_update = true;
             break;
-        case Item::Type::CameraTransform:
-            camera_transform = item.transform;
+        case Command::Type::CameraTransform:
+            camera_transform = command.transform;
             force_camera_matrix_update = true;
             break;
-        case Item::Type::FunctionCall:
-            item.function();
+        case Command::Type::FunctionCall:
+            command.function();
+            state = StateCache();
+            break;
+        case Command::Type::RenderItems:
+            renderBatches(frame, command.start, command.end);
             break;
-        case Item::Type::RenderItem:
-            switch(item.data.type)
+        }
+    }
+    frame.clear();
+#ifdef SP2_USE_RENDER_THREAD
+    std::lock_guard<std::mutex> lock(render_mutex);
+#endif
+    last_statistics = statistics;
+}
+
+void RenderQueue::renderBatches(Frame& frame, uint32_t start, uint32_t end)
+{
+    for(uint32_t batch_index=start; batch_index<end; batch_index++)
+    {
+        const Batch& batch = frame.batches[batch_index];
+        switch(batch.type)
+        {
+        case RenderData::Type::None:
+        case RenderData::Type::Custom1:
+        case RenderData::Type::Custom2:
+        case RenderData::Type::Custom3:
+        case RenderData::Type::Custom4:
+        case RenderData::Type::Custom5:
+        case RenderData::Type::Custom6:
+        case RenderData::Type::Custom7:
+        case RenderData::Type::Custom8:
+            break;
+        case RenderData::Type::Normal:
+        case RenderData::Type::Transparent:
+            setBlend(StateCache::Blend::Alpha);
+            break;
+        case RenderData::Type::Additive:
+            setBlend(StateCache::Blend::Additive);
+            break;
+        }
+        setDepthMask(batch.type != RenderData::Type::Transparent && batch.type != RenderData::Type::Additive);
+        Shader* shader = batch.shader;
+        if (shader->bind())
+        {
+            statistics.state_changes++;
+            //Uniform values are stored per program, the shader skips the upload if it already has these matrices.
+            force_camera_matrix_update = true;
+        }
+        else
+        {
+            statistics.state_changes_skipped++;
+        }
+        if (force_camera_matrix_update)
+        {
+            setUniform(shader, Shader::Uniform::ProjectionMatrix, camera_projection);
+            setUniform(shader, Shader::Uniform::CameraMatrix, camera_transform);
+            force_camera_matrix_update = false;
+        }
+        setUniform(shader, Shader::Uniform::ObjectScale, batch.scale);
+        if (batch.texture && shader->hasUniform(Shader::Uniform::TextureMap))
+        {
+            //TODO: This assumes we bind only 1 texture.
+            setUniform(shader, Shader::Uniform::TextureMap, 0);
+            if (state.texture != batch.texture)
             {
-            case RenderData::Type::None:
-            case RenderData::Type::Custom1:
-            case RenderData::Type::Custom2:
-            case RenderData::Type::Custom3:
-            case RenderData::Type::Custom4:
-            case RenderData::Type::Custom5:
-            case RenderData::Type::Custom6:
-            case RenderData::Type::Custom7:
-            case RenderData::Type::Custom8:
-                break;
-            case RenderData::Type::Normal:
-            case RenderData::Type::Transparent:
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                break;
-            case RenderData::Type::Additive:
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-                break;
+                glActiveTexture(GL_TEXTURE0);
+                batch.texture->bind();
+                state.texture = batch.texture;
+                statistics.state_changes++;
             }
-            if (item.data.type == RenderData::Type::Transparent || item.data.type == RenderData::Type::Additive)
-                glDepthMask(false);
-            if (item.data.shader->bind() || force_camera_matrix_update)
+            else
             {
-                item.data.shader->setUniform("projection_matrix", camera_projection);
-                item.data.shader->setUniform("camera_matrix", camera_transform);
-                force_camera_matrix_update = false;
+                statistics.state_changes_skipped++;
             }
-            item.data.shader->setUniform("object_matrix", item.transform);
-            item.data.shader->setUniform("object_scale", item.data.scale);
-            item.data.shader->setUniform("color", item.data.color);
-            item.data.shader->setUniform("texture_map", item.data.texture);
-            item.data.mesh->render();
-            if (item.data.type == RenderData::Type::Transparent || item.data.type == RenderData::Type::Additive)
-                glDepthMask(true);
-            break;
         }
+
+        if (batch.count > 1 && shader->instance_matrix_attribute != -1 && isOpenGLInstancingSupported())
+        {
+            renderInstanced(frame, batch);
+            continue;
+        }
+        for(uint32_t n=batch.start; n<batch.start + batch.count; n++)
+        {
+            const DrawRecord& item = frame.draw_records[frame.sort_entries[n].index];
+            if (shader->instance_matrix_attribute != -1)
+            {
+                //Shader reads the per instance attributes, without an attribute array these are constant values.
+                for(int column=0; column<4; column++)
+                    glVertexAttrib4fv(shader->instance_matrix_attribute + column, item.transform.data + column * 4);
+            }
+            else
+            {
+                setUniform(shader, Shader::Uniform::ObjectMatrix, item.transform);
+            }
+            if (shader->instance_color_attribute != -1)
+                glVertexAttrib4fv(shader->instance_color_attribute, &item.color.r);
+            else
+                setUniform(shader, Shader::Uniform::Color, item.color);
+            item.mesh->render();
+            statistics.draws++;
+        }
+    }
+    //Code outside of the queue expects depth writing to be enabled.
+    setDepthMask(true);
+}
+
+void RenderQueue::renderInstanced(Frame& frame, const Batch& batch)
+{
+    Shader* shader = batch.shader;
+    //Per instance: 16 floats for the transform, followed by 4 floats for the color.
+    constexpr int instance_size = 20;
+    instance_data.resize(batch.count * instance_size);
+    float* f = instance_data.data();
+    for(uint32_t n=batch.start; n<batch.start + batch.count; n++)
+    {
+        const DrawRecord& item = frame.draw_records[frame.sort_entries[n].index];
+        memcpy(f, item.transform.data, sizeof(float) * 16);
+        memcpy(f + 16, &item.color.r, sizeof(float) * 4);
+        f += instance_size;
+    }
+    if (shader->instance_color_attribute == -1)
+        setUniform(shader, Shader::Uniform::Color, frame.draw_records[frame.sort_entries[batch.start].index].color);
+
+    if (instance_buffer == 0)
+        glGenBuffers(1, &instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * instance_data.size(), instance_data.data(), GL_STREAM_DRAW);
+    for(int column=0; column<4; column++)
+    {
+        int attribute = shader->instance_matrix_attribute + column;
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribPointer(attribute, 4, GL_FLOAT, false, sizeof(float) * instance_size, reinterpret_cast<void*>(sizeof(float) * 4 * column));
+        glVertexAttribDivisor(attribute, 1);
+    }
+    if (shader->instance_color_attribute != -1)
+    {
+        glEnableVertexAttribArray(shader->instance_color_attribute);
+        glVertexAttribPointer(shader->instance_color_attribute, 4, GL_FLOAT, false, sizeof(float) * instance_size, reinterpret_cast<void*>(sizeof(float) * 16));
+        glVertexAttribDivisor(shader->instance_color_attribute, 1);
+    }
+
+    batch.mesh->renderInstanced(batch.count);
+    statistics.draws++;
+    statistics.instanced_draws++;
+
+    //Back to constant attribute values, so the shader can also be used for single items.
+    for(int column=0; column<4; column++)
+    {
+        glVertexAttribDivisor(shader->instance_matrix_attribute + column, 0);
+        glDisableVertexAttribArray(shader->instance_matrix_attribute + column);
     }
-    list.clear();
+    if (shader->instance_color_attribute != -1)
+    {
+        glVertexAttribDivisor(shader->instance_color_attribute, 0);
+        glDisableVertexAttribArray(shader->instance_color_attribute);
+    }
+}
+
+void RenderQueue::setBlend(StateCache::Blend blend)
+{
+    if (state.blend == blend)
+    {
+        statistics.state_changes_skipped++;
+        return;
+    }
+    switch(blend)
+    {
+    case StateCache::Blend::Unknown:
+        return;
+    case StateCache::Blend::Alpha:
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+    case StateCache::Blend::Additive:
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        break;
+    }
+    state.blend = blend;
+    statistics.state_changes++;
+}
+
+void RenderQueue::setDepthMask(bool enabled)
+{
+    if (state.depth_mask == int(enabled))
+    {
+        statistics.state_changes_skipped++;
+        return;
+    }
+    glDepthMask(enabled);
+    state.depth_mask = enabled;
+    statistics.state_changes++;
+}
+
+template<typename T> void RenderQueue::setUniform(Shader* shader, Shader::Uniform uniform, const T& value)
+{
+    if (!shader->hasUniform(uniform))
+        return;
+    if (shader->setUniform(uniform, value))
+        statistics.uniform_uploads++;
+    else
+        statistics.uniform_uploads_skipped++;
+}
+
+void RenderQueue::Frame::clear()
+{
+    commands.clear();
+    draw_records.clear();
+    sort_entries.clear();
+    batches.clear();
+#ifdef SP2_USE_RENDER_THREAD
+    meshes.clear();
+#endif
 }
 
 }//namespace sp
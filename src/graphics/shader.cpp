@@ -1,17 +1,58 @@
 #include <sp2/graphics/shader.h>
 #include <sp2/graphics/opengl.h>
 #include <sp2/io/resourceProvider.h>
+#include <sp2/io/resourceWatcher.h>
 #include <sp2/logging.h>
 #include <sp2/assert.h>
 #include <sp2/graphics/texture.h>
 
 #include <SDL_messagebox.h>
+#include <string.h>
 
 namespace sp {
 
+static const char* uniform_slot_names[] = {
+    "projection_matrix",
+    "camera_matrix",
+    "object_matrix",
+    "object_scale",
+    "color",
+    "texture_map",
+};
+static_assert(sizeof(uniform_slot_names) / sizeof(uniform_slot_names[0]) == int(Shader::Uniform::Count), "Every uniform slot needs a name");
+
 std::map<string, Shader*> Shader::cached_shaders;
 Shader* Shader::bound_shader;
 
+//Split a shader resource in the vertex and fragment shader code. Returns false if the resource does not exist.
+static bool loadShaderSource(const string& name, string& vertex_shader, string& fragment_shader)
+{
+    io::ResourceStreamPtr stream = io::ResourceProvider::get(name);
+    if (!stream)
+        return false;
+#if defined(ANDROID) || defined(__EMSCRIPTEN__)
+    vertex_shader = "#version 100\n";
+    fragment_shader = "#version 100\nprecision mediump float;\n";
+#else
+    vertex_shader = "#version 110\n";
+    fragment_shader = "#version 110\n";
+#endif
+    int type = -1;
+    while(stream->tell() != stream->getSize())
+    {
+        string line = stream->readLine();
+        if (line == "[VERTEX]")
+            type = 1;
+        else if (line == "[FRAGMENT]")
+            type = 2;
+        else if (type == 1)
+            vertex_shader += line + "\n";
+        else if (type == 2)
+            fragment_shader += line + "\n";
+    }
+    return true;
+}
+
 Shader* Shader::get(const string& name)
 {
     auto it = cached_shaders.find(name);
@@ -21,30 +62,11 @@ Shader* Shader::get(const string& name)
     }
     
     Shader* new_shader;
-    io::ResourceStreamPtr stream = io::ResourceProvider::get(name);
-    if (stream)
+    string vertex_shader;
+    string fragment_shader;
+    if (loadShaderSource(name, vertex_shader, fragment_shader))
     {
         LOG(Info, "Loading shader:", name);
-#if defined(ANDROID) || defined(__EMSCRIPTEN__)
-        string vertex_shader = "#version 100\n";
-        string fragment_shader = "#version 100\nprecision mediump float;\n";
-#else
-        string vertex_shader = "#version 110\n";
-        string fragment_shader = "#version 110\n";
-#endif
-        int type = -1;
-        while(stream->tell() != stream->getSize())
-        {
-            string line = stream->readLine();
-            if (line == "[VERTEX]")
-                type = 1;
-            else if (line == "[FRAGMENT]")
-                type = 2;
-            else if (type == 1)
-                vertex_shader += line + "\n";
-            else if (type == 2)
-                fragment_shader += line + "\n";
-        }
         new_shader = new Shader(name, std::move(vertex_shader), std::move(fragment_shader));
     }
     else
@@ -53,23 +75,31 @@ Shader* Shader::get(const string& name)
         LOG(Warning, "Failed to find shader:", name);
     }
     cached_shaders[name] = new_shader;
+#ifdef DEBUG
+    io::ResourceWatcher::watch(name, [new_shader]()
+    {
+        new_shader->reload();
+    });
+#endif
     return new_shader;
 }
 
 Shader::Shader(const string& name)
-: name(name)
+: name(name), sort_id(next_sort_id++)
 {
     program = 0;
 }
 
 Shader::Shader(const string& name, string&& vertex_shader, string&& fragment_shader)
-: name(name), vertex_shader(std::move(vertex_shader)), fragment_shader(std::move(fragment_shader))
+: name(name), vertex_shader(std::move(vertex_shader)), fragment_shader(std::move(fragment_shader)), sort_id(next_sort_id++)
 {
     program = 0xffffffff;
 }
 
 bool Shader::bind()
 {
+    if (reload_pending)
+        applyReload();
     if (bound_shader == this)
         return false;
 
@@ -114,9 +144,17 @@ bool Shader::bind()
         vertex_attribute = glGetAttribLocation(program, "a_vertex");
         normal_attribute = glGetAttribLocation(program, "a_normal");
         uv_attribute = glGetAttribLocation(program, "a_uv");
+        instance_matrix_attribute = glGetAttribLocation(program, "a_instance_matrix");
+        instance_color_attribute = glGetAttribLocation(program, "a_instance_color");
         
         if (vertex_attribute == -1)
             LOG(Warning, "Shader:", name, "has no attribute for a_vertex, this is odd... (legacy shader with gl_Vertex?)");
+
+        for(int n=0; n<int(Uniform::Count); n++)
+        {
+            uniform_slots[n].location = glGetUniformLocation(program, uniform_slot_names[n]);
+            uniform_slots[n].valid = false;
+        }
     }
 
     glUseProgram(program);
@@ -137,6 +175,41 @@ bool Shader::bind()
     return true;
 }
 
+void Shader::reload()
+{
+    string new_vertex_shader;
+    string new_fragment_shader;
+    if (!loadShaderSource(name, new_vertex_shader, new_fragment_shader))
+        return;
+    LOG(Info, "Reloading shader:", name);
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    reload_vertex_shader = std::move(new_vertex_shader);
+    reload_fragment_shader = std::move(new_fragment_shader);
+    reload_pending = true;
+}
+
+void Shader::applyReload()
+{
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        vertex_shader = std::move(reload_vertex_shader);
+        fragment_shader = std::move(reload_fragment_shader);
+        reload_pending = false;
+    }
+    if (bound_shader == this)
+    {
+        if (vertex_attribute != -1) glDisableVertexAttribArray(vertex_attribute);
+        if (normal_attribute != -1) glDisableVertexAttribArray(normal_attribute);
+        if (uv_attribute != -1) glDisableVertexAttribArray(uv_attribute);
+        unbind();
+    }
+    if (program != 0 && program != 0xffffffff)
+        glDeleteProgram(program);
+    uniform_mapping.clear();
+    //The program is compiled again by the bind that called this.
+    program = 0xffffffff;
+}
+
 unsigned int Shader::compileShader(const char* code, int type)
 {
     int success;
@@ -168,6 +241,7 @@ void Shader::setUniform(const string& s, const Matrix4x4f& matrix)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     glUniformMatrix4fv(location, 1, false, matrix.data);
 }
 
@@ -178,6 +252,7 @@ void Shader::setUniform(const string& s, const Vector2f& v)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     glUniform2fv(location, 1, &v.x);
 }
 
@@ -188,6 +263,7 @@ void Shader::setUniform(const string& s, const Vector3f& v)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     glUniform3fv(location, 1, &v.x);
 }
 
@@ -198,6 +274,7 @@ void Shader::setUniform(const string& s, const Color& c)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     glUniform4fv(location, 1, &c.r);
 }
 
@@ -206,6 +283,7 @@ void Shader::setUniform(const string& s, float v)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     glUniform1f(location, v);
 }
 
@@ -219,6 +297,7 @@ void Shader::setUniform(const string& s, Texture* texture)
     int location = getUniformLocation(s);
     if (location == -1)
         return;
+    invalidateUniformSlot(location);
     //TODO: This assumes we bind only 1 texture.
     glUniform1i(location, 0);
     glActiveTexture(GL_TEXTURE0);
@@ -238,6 +317,66 @@ int Shader::getUniformLocation(const string& s)
     return location;
 }
 
+bool Shader::setUniform(Uniform uniform, const Matrix4x4f& matrix)
+{
+    sp2assert(bound_shader == this, "Shader needs to be bound before uniforms can be set");
+
+    UniformSlot& slot = uniform_slots[int(uniform)];
+    if (slot.location == -1 || !slot.update(matrix.data, sizeof(matrix.data)))
+        return false;
+    glUniformMatrix4fv(slot.location, 1, false, matrix.data);
+    return true;
+}
+
+bool Shader::setUniform(Uniform uniform, const Vector3f& v)
+{
+    sp2assert(bound_shader == this, "Shader needs to be bound before uniforms can be set");
+
+    UniformSlot& slot = uniform_slots[int(uniform)];
+    if (slot.location == -1 || !slot.update(&v.x, sizeof(float) * 3))
+        return false;
+    glUniform3fv(slot.location, 1, &v.x);
+    return true;
+}
+
+bool Shader::setUniform(Uniform uniform, const Color& c)
+{
+    sp2assert(bound_shader == this, "Shader needs to be bound before uniforms can be set");
+
+    UniformSlot& slot = uniform_slots[int(uniform)];
+    if (slot.location == -1 || !slot.update(&c.r, sizeof(float) * 4))
+        return false;
+    glUniform4fv(slot.location, 1, &c.r);
+    return true;
+}
+
+bool Shader::setUniform(Uniform uniform, int v)
+{
+    sp2assert(bound_shader == this, "Shader needs to be bound before uniforms can be set");
+
+    UniformSlot& slot = uniform_slots[int(uniform)];
+    if (slot.location == -1 || !slot.update(&v, sizeof(v)))
+        return false;
+    glUniform1i(slot.location, v);
+    return true;
+}
+
+bool Shader::UniformSlot::update(const void* data, size_t size)
+{
+    if (valid && memcmp(value, data, size) == 0)
+        return false;
+    memcpy(value, data, size);
+    valid = true;
+    return true;
+}
+
+void Shader::invalidateUniformSlot(int location)
+{
+    for(auto& slot : uniform_slots)
+        if (slot.location == location)
+            slot.valid = false;
+}
+
 void Shader::unbind()
 {
     glUseProgram(0);
@@ -3,6 +3,7 @@
 #include <sp2/graphics/textureManager.h>
 #include <sp2/graphics/textureAtlas.h>
 #include <sp2/io/keyValueTreeLoader.h>
+#include <sp2/io/resourceWatcher.h>
 #include <sp2/stringutil/convert.h>
 #include <sp2/logging.h>
 
@@ -19,6 +20,9 @@ SpriteAnimation::SpriteAnimation(const Data& data)
 
 void SpriteAnimation::play(const string& key, float speed)
 {
+#ifdef DEBUG
+    animation_key = key;
+#endif
     auto it = data.animations.find(key);
     if (it == data.animations.end())
     {
@@ -61,25 +65,12 @@ void SpriteAnimation::prepare(RenderData& render_data)
 void SpriteAnimation::update(float delta, RenderData& render_data)
 {
 #ifdef DEBUG
-    if (io::ResourceProvider::getModifyTime(data.resource_name) != data.resource_update_time)
-    {
-        string animation_name;
-        for(auto& it : data.animations)
-            if (&it.second == animation)
-                animation_name = it.first;
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        LOG(Info, "Reloading sprite animation:", data.resource_name);
-        animation = nullptr;
-        (const_cast<Data*>(&data))->load(data.resource_name);
-        
-        revision = data.revision;
-        play(animation_name, speed);
-    }
     if (data.revision != revision)
     {
-        animation = nullptr;
+        //The animations are reloaded, so start the same animation again.
         revision = data.revision;
+        animation = nullptr;
+        play(animation_key, speed);
     }
 #endif
     if (!animation)
@@ -131,6 +122,13 @@ std::unique_ptr<Animation> SpriteAnimation::load(const string& resource_name)
 #endif
     result->load(resource_name);
     cache[resource_name] = result;
+#ifdef DEBUG
+    io::ResourceWatcher::watch(resource_name, [result, resource_name]()
+    {
+        LOG(Info, "Reloading sprite animation:", resource_name);
+        result->load(resource_name);
+    });
+#endif
     return std::unique_ptr<Animation>(new SpriteAnimation(*result));
 }
 
@@ -141,12 +139,7 @@ void SpriteAnimation::Data::load(const string& resource_name)
 #endif
     KeyValueTreePtr tree = io::KeyValueTreeLoader::load(resource_name);
     if (!tree)
-    {
-#ifdef DEBUG
-        this->resource_update_time = io::ResourceProvider::getModifyTime(resource_name);
-#endif
         return;
-    }
 
     float u_offset = 0.5 / 1024;
     float v_offset = 0.5 / 1024;
@@ -290,10 +283,6 @@ void SpriteAnimation::Data::load(const string& resource_name)
     }
     LOG(Info, "Got", animations.size(), "animations, with a total of", total_frames, "frames");
 
-#ifdef DEBUG
-    this->resource_name = resource_name;
-    this->resource_update_time = io::ResourceProvider::getModifyTime(resource_name);
-#endif
 }
 
 void SpriteAnimation::setAtlasManager(AtlasManager* new_atlas_manager)
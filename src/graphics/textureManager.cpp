@@ -1,5 +1,6 @@
 #include <sp2/graphics/textureManager.h>
 #include <sp2/io/lazyLoader.h>
+#include <sp2/io/resourceWatcher.h>
 #include <sp2/graphics/image/hq2x.h>
 #include <sp2/graphics/opengl.h>
 #include <string.h>
@@ -29,6 +30,7 @@ public:
 };
 
 TextureManager::TextureManager()
+: io::LazyLoader<Texture*>("texture")
 {
     fallback_primary_color = sp::Color(255, 255, 0);
     fallback_secondary_color = sp::Color(0, 0, 0, 0);
@@ -36,6 +38,12 @@ TextureManager::TextureManager()
     default_smooth = true;
 }
 
+TextureManager::~TextureManager()
+{
+    for(int id : watch_ids)
+        io::ResourceWatcher::unwatch(id);
+}
+
 void TextureManager::setDefaultSmoothFiltering(bool enabled)
 {
     default_smooth = enabled;
@@ -48,6 +56,12 @@ bool TextureManager::isDefaultSmoothFiltering()
 
 Texture* TextureManager::prepare(const string& name)
 {
+#ifdef DEBUG
+    watch_ids.push_back(io::ResourceWatcher::watch(name, [this, name]()
+    {
+        forceRefresh(name);
+    }));
+#endif
     return new TextureManagerTexture(name);
 }
 
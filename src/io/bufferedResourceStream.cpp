@@ -0,0 +1,110 @@
+#include <sp2/io/bufferedResourceStream.h>
+#include <string.h>
+#include <algorithm>
+
+namespace sp {
+namespace io {
+
+BufferedResourceStream::BufferedResourceStream(ResourceStreamPtr stream, size_t buffer_size)
+: stream(stream)
+{
+    //Small resources, which are most of them, do not need a full sized buffer.
+    int64_t stream_size = stream->getSize();
+    if (stream_size >= 0 && uint64_t(stream_size) < buffer_size)
+        buffer_size = std::max(size_t(stream_size), size_t(1));
+    buffer.resize(buffer_size);
+    buffer_position = stream->tell();
+}
+
+int64_t BufferedResourceStream::read(void* data, int64_t size)
+{
+    int64_t result = 0;
+    while(size > 0)
+    {
+        if (buffer_offset == buffer_used)
+        {
+            //Large reads skip the buffer, so they are not copied twice.
+            if (size_t(size) >= buffer.size())
+            {
+                buffer_position += buffer_used;
+                buffer_offset = buffer_used = 0;
+                int64_t done = stream->read(static_cast<uint8_t*>(data) + result, size);
+                if (done > 0)
+                {
+                    buffer_position += done;
+                    result += done;
+                }
+                return result;
+            }
+            if (!fill())
+                break;
+        }
+        size_t copy = std::min(size_t(size), buffer_used - buffer_offset);
+        memcpy(static_cast<uint8_t*>(data) + result, buffer.data() + buffer_offset, copy);
+        buffer_offset += copy;
+        size -= copy;
+        result += copy;
+    }
+    return result;
+}
+
+int64_t BufferedResourceStream::seek(int64_t position)
+{
+    //Seeking inside the buffer does not touch the wrapped stream.
+    if (position >= buffer_position && position <= buffer_position + int64_t(buffer_used))
+    {
+        buffer_offset = position - buffer_position;
+        return position;
+    }
+    buffer_position = stream->seek(position);
+    buffer_offset = buffer_used = 0;
+    return buffer_position;
+}
+
+int64_t BufferedResourceStream::tell()
+{
+    return buffer_position + buffer_offset;
+}
+
+int64_t BufferedResourceStream::getSize()
+{
+    return stream->getSize();
+}
+
+string BufferedResourceStream::readLine()
+{
+    string ret;
+    while(true)
+    {
+        if (buffer_offset == buffer_used && !fill())
+            return ret;
+        const uint8_t* start = buffer.data() + buffer_offset;
+        size_t available = buffer_used - buffer_offset;
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(start, '\n', available));
+        if (!end)
+        {
+            ret.append(reinterpret_cast<const char*>(start), available);
+            buffer_offset = buffer_used;
+            continue;
+        }
+        ret.append(reinterpret_cast<const char*>(start), end - start);
+        buffer_offset += end - start + 1;
+        if (!ret.empty() && ret.back() == '\r')
+            ret.pop_back();
+        return ret;
+    }
+}
+
+bool BufferedResourceStream::fill()
+{
+    buffer_position += buffer_used;
+    buffer_offset = buffer_used = 0;
+    int64_t done = stream->read(buffer.data(), buffer.size());
+    if (done <= 0)
+        return false;
+    buffer_used = done;
+    return true;
+}
+
+}//namespace io
+}//namespace sp
@@ -1,8 +1,18 @@
 #include <sp2/io/directoryResourceProvider.h>
+#include <sp2/io/resourceWatcher.h>
+#include <sp2/logging.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <SDL.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <thread>
+#endif//__linux__
 
 namespace sp {
 namespace io {
@@ -28,6 +38,13 @@ public:
     {
         return f != nullptr;
     }
+
+    //Opening a directory works on some platforms, but it cannot be read as a resource.
+    bool isDirectory()
+    {
+        struct stat stat_info;
+        return fstat(fileno(f), &stat_info) == 0 && S_ISDIR(stat_info.st_mode);
+    }
     
     virtual int64_t read(void* data, int64_t size) override
     {
@@ -56,15 +73,230 @@ public:
 };
 
 
+#ifdef __linux__
+//Builds the index of a DirectoryResourceProvider, and keeps it up to date with inotify events on a background thread.
+class DirectoryResourceProvider::Watcher
+{
+public:
+    Watcher(DirectoryResourceProvider& provider)
+    : provider(provider)
+    {
+    }
+
+    ~Watcher()
+    {
+        if (thread.joinable())
+        {
+            uint64_t value = 1;
+            if (::write(stop_fd, &value, sizeof(value)) == sizeof(value))
+                thread.join();
+            else
+                thread.detach();
+        }
+        if (inotify_fd >= 0)
+            ::close(inotify_fd);
+        if (stop_fd >= 0)
+            ::close(stop_fd);
+    }
+
+    //Start the thread that indexes all files below the base path and watches them for changes.
+    bool start()
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (inotify_fd < 0 || stop_fd < 0)
+            return false;
+        provider.indexing = true;
+        thread = std::thread(&Watcher::run, this);
+        return true;
+    }
+
+private:
+    static constexpr uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+    DirectoryResourceProvider& provider;
+    int inotify_fd = -1;
+    int stop_fd = -1;
+    std::thread thread;
+    //Relative path of each watched directory, ending in a slash.
+    std::unordered_map<int, string> watch_paths;
+
+    //Watch a directory and add everything in it to the index. Called with the index locked, or before the index is used.
+    bool scan(const string& path, std::map<string, bool>& index)
+    {
+        int wd = inotify_add_watch(inotify_fd, (provider.base_path + "/" + path).c_str(), watch_mask);
+        if (wd < 0)
+        {
+            //A directory that is removed before we got to it is fine, running out of watches is not.
+            return !path.empty() && (errno == ENOENT || errno == ENOTDIR);
+        }
+        watch_paths[wd] = path;
+
+        DIR* dir = opendir((provider.base_path + "/" + path).c_str());
+        if (!dir)
+            return true;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+            string name = path + string(entry->d_name);
+            bool is_directory = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            {
+                struct stat stat_info;
+                is_directory = stat((provider.base_path + "/" + name).c_str(), &stat_info) == 0 && S_ISDIR(stat_info.st_mode);
+            }
+            index[name] = is_directory;
+            if (is_directory && !scan(name + "/", index))
+            {
+                closedir(dir);
+                return false;
+            }
+        }
+        closedir(dir);
+        return true;
+    }
+
+    //Remove a file, or a directory with everything in it, from the index. Called with the index locked.
+    void remove(const string& name)
+    {
+        provider.index.erase(name);
+        //Everything in the directory sorts between "name/" and "name0".
+        provider.index.erase(provider.index.lower_bound(name + "/"), provider.index.lower_bound(name + "0"));
+        string path = name + "/";
+        for(auto it = watch_paths.begin(); it != watch_paths.end(); )
+        {
+            if (it->second.startswith(path))
+            {
+                inotify_rm_watch(inotify_fd, it->first);
+                it = watch_paths.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    //Called with the index locked, returns false if the index cannot be kept up to date anymore.
+    bool handleEvent(const struct inotify_event& event)
+    {
+        if (event.mask & IN_Q_OVERFLOW)
+        {
+            //Events got lost, so index everything again.
+            for(auto& it : watch_paths)
+                inotify_rm_watch(inotify_fd, it.first);
+            watch_paths.clear();
+            provider.index.clear();
+            return scan("", provider.index);
+        }
+        auto it = watch_paths.find(event.wd);
+        if (it == watch_paths.end() || event.len == 0 || event.name[0] == '.')
+            return true;
+        string name = it->second + string(event.name);
+        if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+            remove(name);
+        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            bool is_directory = event.mask & IN_ISDIR;
+            provider.index[name] = is_directory;
+            if (is_directory)
+                return scan(name + "/", provider.index);
+        }
+        //Files are changed when they are written, or when an editor moves a new version over them.
+        if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            ResourceWatcher::notify(name);
+        return true;
+    }
+
+    //Build the index, without holding the lock, as this takes a while for big directories.
+    //Changes that happen during the scan are queued by inotify, and handled after it.
+    bool buildIndex()
+    {
+        std::map<string, bool> index;
+        bool ok = scan("", index);
+        if (!ok)
+            LOG(Warning, "Failed to watch", provider.base_path, "for changes, resources are not indexed.");
+        {
+            std::lock_guard<std::mutex> lock(provider.index_mutex);
+            if (ok)
+                provider.index = std::move(index);
+            provider.indexed = ok;
+            provider.indexing = false;
+        }
+        provider.index_condition.notify_all();
+        return ok;
+    }
+
+    void run()
+    {
+        if (!buildIndex())
+            return;
+
+        alignas(struct inotify_event) char buffer[16 * 1024];
+        struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+        while(true)
+        {
+            if (poll(fds, 2, -1) < 0 && errno != EINTR)
+                break;
+            if (fds[1].revents)
+                return;
+            if (!(fds[0].revents & POLLIN))
+                continue;
+
+            std::lock_guard<std::mutex> lock(provider.index_mutex);
+            ssize_t size;
+            bool ok = true;
+            while((size = ::read(inotify_fd, buffer, sizeof(buffer))) > 0)
+            {
+                for(char* ptr = buffer; ptr < buffer + size; )
+                {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                    ptr += sizeof(struct inotify_event) + event->len;
+                    ok = handleEvent(*event) && ok;
+                }
+            }
+            provider.find_cache.clear();
+            if (!ok)
+            {
+                LOG(Warning, "Failed to watch", provider.base_path, "for changes, resources are not indexed anymore.");
+                provider.indexed = false;
+                provider.index.clear();
+                return;
+            }
+        }
+    }
+};
+#else
+//Without inotify there is no way to keep an index up to date, so every lookup goes to the disk.
+class DirectoryResourceProvider::Watcher
+{
+public:
+    Watcher(DirectoryResourceProvider& provider) {}
+
+    bool start() { return false; }
+};
+#endif//__linux__
+
 DirectoryResourceProvider::DirectoryResourceProvider(const string& base_path, int priority)
 : ResourceProvider(priority), base_path(base_path)
 {
+    watcher.reset(new Watcher(*this));
+    if (!watcher->start())
+        watcher = nullptr;
+}
+
+DirectoryResourceProvider::~DirectoryResourceProvider()
+{
+    //Stop the watcher thread before the index goes away.
+    watcher = nullptr;
 }
 
 ResourceStreamPtr DirectoryResourceProvider::getStream(const string& filename)
 {
     std::shared_ptr<FileResourceStream> stream = std::make_shared<FileResourceStream>(base_path + "/" + filename);
-    if (stream->isOpen())
+    if (stream->isOpen() && !stream->isDirectory())
         return stream;
     return nullptr;
 }
@@ -79,12 +311,38 @@ std::chrono::system_clock::time_point DirectoryResourceProvider::getResourceModi
 
 std::vector<string> DirectoryResourceProvider::findResources(const string& search_pattern)
 {
+    SearchPattern pattern(search_pattern);
+    {
+        std::unique_lock<std::mutex> lock(index_mutex);
+        index_condition.wait(lock, [this]() { return !indexing; });
+        if (indexed)
+        {
+            auto it = find_cache.find(search_pattern);
+            if (it != find_cache.end())
+                return it->second;
+            std::vector<string>& found_files = find_cache[search_pattern];
+            //The index is sorted, so only the names that start with the fixed part of the pattern need to be checked.
+            const string& prefix = pattern.prefix();
+            for(auto file = index.lower_bound(prefix); file != index.end() && file->first.compare(0, prefix.length(), prefix) == 0; ++file)
+            {
+                if (pattern.match(file->first))
+                    found_files.push_back(file->first);
+            }
+            return found_files;
+        }
+    }
     std::vector<string> found_files;
-    findResources(found_files, "", search_pattern);
+    findResources(found_files, "", pattern);
     return found_files;
 }
 
-void DirectoryResourceProvider::findResources(std::vector<string>& found_files, const string& path, const string& search_pattern)
+bool DirectoryResourceProvider::notifiesResourceChanges(const string& filename)
+{
+    std::lock_guard<std::mutex> lock(index_mutex);
+    return indexed;
+}
+
+void DirectoryResourceProvider::findResources(std::vector<string>& found_files, const string& path, const SearchPattern& search_pattern)
 {
     DIR* dir = opendir((base_path + "/" + path).c_str());
     if (!dir)
@@ -96,7 +354,7 @@ void DirectoryResourceProvider::findResources(std::vector<string>& found_files,
         if (entry->d_name[0] == '.')
             continue;
         string name = path + string(entry->d_name);
-        if (searchMatch(name, search_pattern))
+        if (search_pattern.match(name))
             found_files.push_back(name);
         findResources(found_files, path + string(entry->d_name) + "/", search_pattern);
     }
@@ -1,33 +1,91 @@
 #include <sp2/io/http/server.h>
+#include <private/io/http/websocketProtocol.h>
 #include <sp2/io/network/selector.h>
 #include <sp2/stringutil/sha1.h>
 #include <sp2/stringutil/convert.h>
 #include <sp2/logging.h>
 
 #include <string.h>
+#include <sys/stat.h>
 
 namespace sp {
 namespace io {
 namespace http {
-namespace websocket {
-    static constexpr int fin_mask = 0x80;
-    static constexpr int rsv_mask = 0x70;
-    static constexpr int opcode_mask = 0x0f;
-    
-    static constexpr int mask_mask = 0x80;
-    static constexpr int payload_length_mask = 0x7f;
-    static constexpr int payload_length_16bit = 126;
-    static constexpr int payload_length_64bit = 127;
-    
-    static constexpr int opcode_continuation = 0x00;
-    static constexpr int opcode_text = 0x01;
-    static constexpr int opcode_binary = 0x02;
-    static constexpr int opcode_close = 0x08;
-    static constexpr int opcode_ping = 0x09;
-    static constexpr int opcode_pong = 0x0a;
-};
+static const char* getStatusText(int reply_code)
+{
+    switch(reply_code)
+    {
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 404: return "Not Found";
+    case 416: return "Range Not Satisfiable";
+    case 503: return "Service Unavailable";
+    }
+    return "OK";
+}
+
+static string getMimeType(const string& path)
+{
+    static const std::unordered_map<string, string> mimetypes = {
+        {"html", "text/html"}, {"htm", "text/html"}, {"js", "text/javascript"}, {"css", "text/css"},
+        {"txt", "text/plain"}, {"json", "application/json"}, {"svg", "image/svg+xml"}, {"wasm", "application/wasm"},
+        {"png", "image/png"}, {"jpg", "image/jpeg"}, {"jpeg", "image/jpeg"}, {"gif", "image/gif"}, {"ico", "image/x-icon"},
+    };
+    int dot = path.rfind(".");
+    if (dot < 0)
+        return "";
+    auto it = mimetypes.find(path.substr(dot + 1).lower());
+    if (it == mimetypes.end())
+        return "";
+    return it->second;
+}
+
+static bool isCompressible(const string& mimetype)
+{
+    return mimetype.startswith("text/") || mimetype == "application/json" || mimetype == "image/svg+xml" || mimetype == "application/wasm";
+}
+
+static string gzipCompress(const string& data)
+{
+    size_t compressed_size = 0;
+    void* compressed = tdefl_compress_mem_to_heap(data.data(), data.size(), &compressed_size, TDEFL_DEFAULT_MAX_PROBES);
+    if (!compressed)
+        return "";
+    //Gzip wrapper around the raw deflate data: magic, deflate method, no flags or time, unknown OS. Followed by the crc and size.
+    const char header[] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+    string result(header, sizeof(header));
+    result.append(static_cast<const char*>(compressed), compressed_size);
+    mz_free(compressed);
+    uint32_t crc = mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    uint32_t size = data.size();
+    for(int n=0; n<4; n++)
+        result += char((crc >> (n * 8)) & 0xFF);
+    for(int n=0; n<4; n++)
+        result += char((size >> (n * 8)) & 0xFF);
+    return result;
+}
+
+static bool readFile(const string& path, string& data)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    struct stat info;
+    if (fstat(fileno(f), &info) != 0)
+    {
+        fclose(f);
+        return false;
+    }
+    data.resize(info.st_size);
+    size_t size = data.size() > 0 ? fread(&data[0], 1, data.size(), f) : 0;
+    fclose(f);
+    return size == data.size();
+}
 
 Server::Server(int port_nr)
+: websocket_deflater(new websocket::Deflater())
 {
     if (!listen_socket.listen(port_nr))
     {
@@ -45,6 +103,21 @@ Server::~Server()
         listen_socket.close();
     }
     handler_thread.join();
+    //Finish the requests still running on workers, these can reference the connections.
+    worker_pool = nullptr;
+}
+
+void Server::setWorkerCount(int count, int max_pending_requests)
+{
+    std::unique_ptr<threading::WorkerPool> old_pool;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        old_pool = std::move(worker_pool);
+        if (count > 0)
+            worker_pool = std::unique_ptr<threading::WorkerPool>(new threading::WorkerPool(count));
+        max_pending_worker_requests = max_pending_requests;
+    }
+    //The old pool is destroyed without holding the lock, as its jobs need the lock to finish.
 }
 
 void Server::setStaticFilePath(const string& static_file_path)
@@ -56,11 +129,74 @@ void Server::setStaticFilePath(const string& static_file_path)
         this->static_file_path += "/";
 }
 
-void Server::addURLHandler(const string& url, std::function<string(const Request&)> func)
+void Server::setStaticFileCacheSize(size_t bytes)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    static_file_cache_limit = bytes;
+    while(static_file_cache_size > static_file_cache_limit)
+    {
+        static_file_cache_size -= static_file_cache.back().data.size() + static_file_cache.back().gzip_data.size();
+        static_file_cache_index.erase(static_file_cache.back().path);
+        static_file_cache.pop_back();
+    }
+}
+
+Server::CachedFile* Server::getCachedFile(const string& path, size_t size, int64_t modified_time)
+{
+    auto it = static_file_cache_index.find(path);
+    if (it != static_file_cache_index.end())
+    {
+        if (it->second->size == size && it->second->modified_time == modified_time)
+        {
+            static_file_cache.splice(static_file_cache.begin(), static_file_cache, it->second);
+            return &static_file_cache.front();
+        }
+        //The file changed on disk.
+        static_file_cache_size -= it->second->data.size() + it->second->gzip_data.size();
+        static_file_cache.erase(it->second);
+        static_file_cache_index.erase(it);
+    }
+    if (size > max_cached_file_size || size > static_file_cache_limit)
+        return nullptr;
+
+    CachedFile file;
+    file.path = path;
+    file.size = size;
+    file.modified_time = modified_time;
+    if (!readFile(path, file.data) || file.data.size() != size)
+        return nullptr;
+    //Use the precompressed version if it is there and not older, else compress text files.
+    struct stat info;
+    if (stat((path + ".gz").c_str(), &info) == 0 && S_ISREG(info.st_mode) && info.st_mtime >= modified_time)
+    {
+        if (!readFile(path + ".gz", file.gzip_data))
+            file.gzip_data.clear();
+    }
+    else if (isCompressible(getMimeType(path)))
+    {
+        file.gzip_data = gzipCompress(file.data);
+        if (file.gzip_data.size() >= file.data.size())
+            file.gzip_data.clear();
+    }
+
+    static_file_cache_size += file.data.size() + file.gzip_data.size();
+    static_file_cache.push_front(std::move(file));
+    static_file_cache_index[path] = static_file_cache.begin();
+    while(static_file_cache_size > static_file_cache_limit && static_file_cache.size() > 1)
+    {
+        static_file_cache_size -= static_file_cache.back().data.size() + static_file_cache.back().gzip_data.size();
+        static_file_cache_index.erase(static_file_cache.back().path);
+        static_file_cache.pop_back();
+    }
+    return &static_file_cache.front();
+}
+
+void Server::addURLHandler(const string& url, std::function<string(const Request&)> func, HandlerThread thread)
 {
     std::lock_guard<std::recursive_mutex> lock(mutex);
     
-    http_handlers[url] = func;
+    http_handlers[url] = URLHandler{func, thread};
 }
 
 void Server::addSimpleWebsocketHandler(const string& url, std::function<void(const string& data)> func)
@@ -81,12 +217,22 @@ void Server::broadcastToWebsockets(const string& url, const string& data)
 {
     std::lock_guard<std::recursive_mutex> lock(mutex);
     
+    //Build each frame once, and share it between all connections that use it.
+    std::shared_ptr<io::DataBuffer> frame;
+    std::shared_ptr<io::DataBuffer> deflate_frame;
     for(Connection& connection : connections)
     {
         if (connection.remove)
             continue;
-        if (connection.state == Connection::State::Websocket && connection.request.path == url)
-            connection.sendWebsocketTextPacket(data);
+        if (connection.state != Connection::State::Websocket || connection.request.path != url)
+            continue;
+        std::shared_ptr<io::DataBuffer>& target = connection.websocket_deflate ? deflate_frame : frame;
+        if (!target)
+        {
+            target = std::make_shared<io::DataBuffer>();
+            websocket::buildFrame(*target, websocket::opcode_text, data.data(), data.size(), connection.websocket_deflate ? websocket_deflater.get() : nullptr);
+        }
+        connection.sendWebsocketFrame(target);
     }
 }
 
@@ -94,47 +240,85 @@ void Server::handlerThread()
 {
     sp::io::network::Selector selector;
     selector.add(listen_socket);
+    //Only the connections that are ready are handled after a wait, so this does not slow down with a lot of idle connections.
+    std::unordered_map<sp::io::network::SocketBase*, Connection*> socket_connections;
+    std::vector<sp::io::network::SocketBase*> ready;
+    auto last_timeout_check = std::chrono::steady_clock::now();
     while(listen_socket.isListening())
     {
         selector.wait(1000);
 
         std::lock_guard<std::recursive_mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
         if (selector.isReady(listen_socket))
         {
-            connections.emplace_back(*this);
+            connections.emplace_back(*this, next_connection_id++);
             Connection& connection = connections.back();
+            connection_by_id[connection.id] = &connection;
             listen_socket.accept(connection.socket);
-            connection.last_received_data_time = std::chrono::steady_clock::now();
+            //Replies finish at different times on the workers, these should not wait for the acknowledgement of the previous reply.
+            connection.socket.setNoDelay(true);
+            connection.last_received_data_time = now;
             selector.add(connection.socket);
+            socket_connections[&connection.socket] = &connection;
         }
-        for(auto it = connections.begin(); it != connections.end();)
+        ready = selector.getReady();
+        for(auto socket : ready)
         {
-            Connection& connection = *it;
-            if (connection.remove)
-            {
-                it++;
+            auto it = socket_connections.find(socket);
+            if (it == socket_connections.end())
                 continue;
-            }
+            Connection& connection = *it->second;
             if (selector.isReady(connection.socket))
             {
-                connection.last_received_data_time = std::chrono::steady_clock::now();
+                connection.last_received_data_time = now;
                 connection.remove = !connection.processIncommingData();
             }
-            else
-            {
-                if (std::chrono::steady_clock::now() - connection.last_received_data_time > std::chrono::seconds(5))
-                    connection.remove = !connection.handleTimeout();
-            }
-            
             if (connection.remove)
+            {
                 selector.remove(connection.socket);
-            it++;
+                socket_connections.erase(it);
+            }
+        }
+        if (now - last_timeout_check > std::chrono::seconds(1))
+        {
+            last_timeout_check = now;
+            for(Connection& connection : connections)
+            {
+                if (connection.remove || now - connection.last_received_data_time <= std::chrono::seconds(5))
+                    continue;
+                connection.remove = !connection.handleTimeout();
+                if (connection.remove)
+                {
+                    selector.remove(connection.socket);
+                    socket_connections.erase(&connection.socket);
+                }
+            }
         }
     }
 }
 
 void Server::onUpdate(float delta)
 {
+    //Handlers are called without holding the lock, so the handler thread keeps serving other requests meanwhile.
+    MainThreadRequest item;
+    while(main_thread_requests.get(item))
+    {
+        std::function<string(const Request&)> func;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex);
+            auto handler = http_handlers.find(item.request.path);
+            if (handler != http_handlers.end())
+                func = handler->second.func;
+        }
+        string reply = Connection::handlerReply(func ? func(item.request) : "");
+
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        auto it = connection_by_id.find(item.connection_id);
+        if (it != connection_by_id.end())
+            it->second->setReply(item.reply_index, std::move(reply));
+    }
+
     std::lock_guard<std::recursive_mutex> lock(mutex);
 
     for(auto it = connections.begin(); it != connections.end();)
@@ -148,20 +332,11 @@ void Server::onUpdate(float delta)
                 connection.websocket_handler->connection = nullptr;
                 connection.websocket_handler->onDisconnect();
             }
+            connection_by_id.erase(connection.id);
             it = connections.erase(it);
             continue;
         }
-        
-        if (connection.request_pending)
-        {
-            string reply = http_handlers[connection.request.path](connection.request);
-            connection.startHttpReply(200);
-            if (reply.size() > 0)
-                connection.httpChunk(reply);
-            connection.httpChunk("");
 
-            connection.request_pending = false;
-        }
         if (connection.websocket_connected)
         {
             if (advanced_websocket_handlers.find(connection.request.path) != advanced_websocket_handlers.end())
@@ -173,12 +348,18 @@ void Server::onUpdate(float delta)
             }
             connection.websocket_connected = false;
         }
-        for(string& message : connection.websocket_received_pending)
+        for(auto& message : connection.websocket_received_pending)
         {
+            if (message.part)
+            {
+                if (connection.websocket_handler)
+                    connection.websocket_handler->onBinaryMessagePart(message.data, message.last);
+                continue;
+            }
             if (simple_websocket_handlers.find(connection.request.path) != simple_websocket_handlers.end())
-                simple_websocket_handlers[connection.request.path](message);
+                simple_websocket_handlers[connection.request.path](message.data);
             if (connection.websocket_handler)
-                connection.websocket_handler->onMessage(message);
+                connection.websocket_handler->onMessage(message.data);
         }
         connection.websocket_received_pending.clear();
         
@@ -186,8 +367,8 @@ void Server::onUpdate(float delta)
     }
 }
 
-Server::Connection::Connection(Server& server)
-: server(server)
+Server::Connection::Connection(Server& server, uint64_t id)
+: id(id), server(server)
 {
     buffer.reserve(4096);
     state = State::HTTPRequest;
@@ -196,140 +377,128 @@ Server::Connection::Connection(Server& server)
 
 bool Server::Connection::processIncommingData()
 {
-    char receive_buffer[4096];
-    size_t received_size;
-    received_size = socket.receive(receive_buffer, sizeof(receive_buffer));
+    //Receive directly at the end of the buffer, instead of through a temporary buffer.
+    size_t previous_size = buffer.size();
+    buffer.resize(previous_size + 16 * 1024);
+    size_t received_size = socket.receive(&buffer[previous_size], 16 * 1024);
+    buffer.resize(previous_size + received_size);
     if (received_size < 1)
         return false;
-    buffer.resize(buffer.size() + received_size);
-    memcpy(&buffer[buffer.size()] - received_size, receive_buffer, received_size);
-    
-    switch(state)
+
+    //Handle every complete request, a client can send the next requests before it got the first reply (pipelining).
+    Request new_request;
+    bool error = false;
+    while(state == State::HTTPRequest && parseHttpRequest(new_request, error))
+        handleRequest(new_request);
+    if (error)
+        return false;
+    if (state == State::Websocket)
+        return processWebsocketData();
+    return true;
+}
+
+bool Server::Connection::parseHttpRequest(Request& request, bool& error)
+{
+    int headers_end = buffer.find("\r\n\r\n");
+    if (headers_end < 0)
+        return false;
+    std::vector<string> header_data = buffer.substr(0, headers_end).split("\r\n");
+
+    std::vector<string> parts = header_data[0].split();
+    if (parts.size() != 3)
     {
-    case State::HTTPRequest:{
-        int headers_end = buffer.find("\r\n\r\n");
-        if (headers_end)
+        error = true;
+        return false;
+    }
+    request.method = parts[0];
+    request.path = parts[1];
+    request.post_data = "";
+    request.headers.clear();
+    for(unsigned int n=1; n<header_data.size(); n++)
+    {
+        auto header_entry = header_data[n].partition(":");
+        request.headers[header_entry.first.strip().lower()] = header_entry.second.strip();
+    }
+    int post_length = 0;
+    if (request.headers.find("content-length") != request.headers.end())
+    {
+        post_length = stringutil::convert::toInt(request.headers["content-length"]);
+        if (int(buffer.size()) < headers_end + 4 + post_length)
+            return false; //Not enough data yet, continue receiving.
+        request.post_data = buffer.substr(headers_end + 4, headers_end + 4 + post_length);
+    }
+
+    buffer = buffer.substr(headers_end + 4 + post_length);
+    return true;
+}
+
+bool Server::Connection::processWebsocketData()
+{
+    size_t offset = 0;
+    bool keep = true;
+    std::string data;
+    while(keep)
+    {
+        data.clear();
+        auto result = websocket_reader->next(reinterpret_cast<uint8_t*>(&buffer[0]), buffer.size(), offset, data);
+        if (result == websocket::FrameReader::Result::NeedMoreData)
+            break;
+        if (result == websocket::FrameReader::Result::Error)
         {
-            std::vector<string> header_data = buffer.substr(0, headers_end).split("\r\n");
-            
-            std::vector<string> parts = header_data[0].split();
-            if (parts.size() != 3)
-                return false;
-            request.method = parts[0];
-            request.path = parts[1];
-            request.post_data = "";
-            request.headers.clear();
-            for(unsigned int n=1; n<header_data.size(); n++)
-            {
-                auto header_entry = header_data[n].partition(":");
-                request.headers[header_entry.first.strip().lower()] = header_entry.second.strip();
-            }
-            int post_length = 0;
-            if (request.headers.find("content-length") != request.headers.end())
-            {
-                post_length = stringutil::convert::toInt(request.headers["content-length"]);
-                if (int(buffer.size()) < headers_end + 4 + post_length)
-                    break; //Not enough data yet, continue receiving.
-                request.post_data = buffer.substr(headers_end + 4, headers_end + 4 + post_length);
-            }
-            
-            buffer = buffer.substr(headers_end + 4 + post_length);
-            handleRequest(request);
+            LOG(Warning, "Closing websocket due to a protocol error.");
+            return false;
         }
-        }break;
-    case State::Websocket:
-        while(true)
+        if (result == websocket::FrameReader::Result::Control)
         {
-            if (buffer.size() < 2)
-                return true;
-            unsigned int payload_length = buffer[1] & websocket::payload_length_mask;
-            int opcode = buffer[0] & websocket::opcode_mask;
-            bool fin = buffer[0] & websocket::fin_mask;
-            bool mask = buffer[1] & websocket::mask_mask;
-            unsigned int index = 2;
-
-            //Close the connection if any of the RSV bits are set.
-            if (buffer[0] & websocket::rsv_mask)
-            {
-                LOG(Warning, "Closing websocket due to RSV bits, we do not support extensions.");
-                return false;
-            }
-
-            if (payload_length == websocket::payload_length_16bit)
-            {
-                if (buffer.size() < index + 2)
-                    return true;
-                payload_length = uint8_t(buffer[index++]) << 8;
-                payload_length |= uint8_t(buffer[index++]);
-            }else if (payload_length == websocket::payload_length_64bit)
+            switch(websocket_reader->control_opcode)
             {
-                if (buffer.size() < index + 8)
-                    return true;
-                index += 4;
-                payload_length = uint8_t(buffer[index++]) << 24;
-                payload_length |= uint8_t(buffer[index++]) << 16;
-                payload_length |= uint8_t(buffer[index++]) << 8;
-                payload_length |= uint8_t(buffer[index++]);
-            }
-
-            uint8_t mask_values[4] = {0, 0, 0, 0};
-            if (mask)
-            {
-                if (buffer.size() < index + 4)
-                    return true;
-                for(unsigned int n=0; n<4; n++)
-                    mask_values[n] = buffer[index++];
-                if (buffer.size() < index + payload_length)
-                    return true;
-                for(unsigned int n=0; n<payload_length; n++)
-                    buffer[index + n] ^= mask_values[n % 4];
-            }
-            if (buffer.size() < index + payload_length)
-                return true;
-            
-            string message = buffer.substr(index, index + payload_length);
-            buffer = buffer.substr(index + payload_length);
-
-            switch(opcode)
-            {
-            case websocket::opcode_continuation:
-                websocket_received_fragment += message;
-                if (fin)
-                {
-                    websocket_received_pending.push_back(std::move(websocket_received_fragment));
-                    websocket_received_fragment = "";
-                }
-                break;
-            case websocket::opcode_text:
-            case websocket::opcode_binary:
-                if (fin)
-                    websocket_received_pending.push_back(message);
-                else
-                    websocket_received_fragment = message;
-                break;
             case websocket::opcode_close:
-                {
-                    uint8_t reply[] = {websocket::fin_mask | websocket::opcode_close, 0};//close packet
-                    socket.send(reply, sizeof(reply));
-                }
-                return false;
+                sendWebsocketPacket(websocket::opcode_close, "");
+                keep = false;
+                break;
             case websocket::opcode_ping:
-                {
-                    //Note: The standard says that we need to include the payload of the ping packet as payload in the pong packet.
-                    //      We ignore this, as this no client seems to use this.
-                    uint8_t reply[] = {websocket::fin_mask | websocket::opcode_pong, 0};//pong packet
-                    socket.send(reply, sizeof(reply));
-                }
+                sendWebsocketPacket(websocket::opcode_pong, websocket_reader->control_payload);
                 break;
             case websocket::opcode_pong:
                 //There is no real need to track PONG replies. TCP/IP will close the connection if the other side is gone.
                 break;
             }
+            continue;
+        }
+
+        if (!websocket_in_message)
+        {
+            websocket_in_message = true;
+            websocket_streaming = websocket_reader->isBinary() && websocket_handler && websocket_handler->stream_binary_messages;
+        }
+        if (websocket_streaming)
+        {
+            //Add to the part that is not handled yet, if there is one, to keep the amount of calls low.
+            if (!websocket_received_pending.empty() && websocket_received_pending.back().part && !websocket_received_pending.back().last)
+                websocket_received_pending.back().data += data;
+            else
+                websocket_received_pending.push_back({data, true, false});
+            websocket_received_pending.back().last = websocket_reader->message_end;
         }
-        break;
+        else
+        {
+            websocket_message += data;
+            if (websocket_message.size() > websocket::max_message_size)
+            {
+                LOG(Warning, "Closing websocket, received a message over the size limit.");
+                return false;
+            }
+            if (websocket_reader->message_end)
+            {
+                websocket_received_pending.push_back({std::move(websocket_message), false, false});
+                websocket_message = "";
+            }
+        }
+        if (websocket_reader->message_end)
+            websocket_in_message = false;
     }
-    
-    return true;
+    buffer.erase(0, offset);
+    return keep;
 }
 
 bool Server::Connection::handleTimeout()
@@ -337,7 +506,8 @@ bool Server::Connection::handleTimeout()
     switch(state)
     {
     case State::HTTPRequest:{
-        return false;
+        //Keep the connection while a handler is still working on a reply for it.
+        return !replies.empty();
         }break;
     case State::Websocket:{
         uint8_t ping[] = {websocket::fin_mask | websocket::opcode_ping, 0};
@@ -349,10 +519,41 @@ bool Server::Connection::handleTimeout()
 
 void Server::Connection::handleRequest(const Request& request)
 {
-    if (server.http_handlers.find(request.path) != server.http_handlers.end())
+    uint64_t reply_index = reserveReply();
+
+    auto handler = server.http_handlers.find(request.path);
+    if (handler != server.http_handlers.end())
     {
-        //Mark this request to be handled in the main thread.
-        request_pending = true;
+        if (handler->second.thread == HandlerThread::Worker && server.worker_pool)
+        {
+            if (server.pending_worker_requests >= server.max_pending_worker_requests)
+            {
+                setReply(reply_index, errorReply(503, "503 - Service unavailable."));
+                return;
+            }
+            server.pending_worker_requests++;
+            Server* srv = &server;
+            uint64_t connection_id = id;
+            auto func = handler->second.func;
+            server.worker_pool->add([srv, connection_id, reply_index, func, request]()
+            {
+                string reply = handlerReply(func(request));
+
+                std::lock_guard<std::recursive_mutex> lock(srv->mutex);
+                srv->pending_worker_requests--;
+                //The connection could be closed while the handler was running.
+                auto it = srv->connection_by_id.find(connection_id);
+                if (it != srv->connection_by_id.end())
+                    it->second->setReply(reply_index, std::move(reply));
+            });
+            return;
+        }
+
+        //Hand this request over to the main thread.
+        if (!server.main_thread_requests.put(MainThreadRequest{id, reply_index, request}))
+        {
+            setReply(reply_index, errorReply(503, "503 - Service unavailable."));
+        }
         return;
     }
 
@@ -370,19 +571,29 @@ void Server::Connection::handleRequest(const Request& request)
         && request.headers.find("sec-websocket-version")->second.lower() == "13"
         )
         {
+            string reply;
             if (server.simple_websocket_handlers.find(request.path) != server.simple_websocket_handlers.end() || server.advanced_websocket_handlers.find(request.path) != server.advanced_websocket_handlers.end())
             {
-                string reply = "HTTP/1.1 101 Switching Protocols\r\n";
+                reply = "HTTP/1.1 101 Switching Protocols\r\n";
                 reply += "Upgrade: websocket\r\n";
                 reply += "Connection: upgrade\r\n";
                 reply += "Sec-WebSocket-Accept: " + stringutil::SHA1(request.headers.find("sec-websocket-key")->second + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11").base64() + "\r\n";
                 if (request.headers.find("sec-websocket-protocol") != request.headers.end())
                     reply += "Sec-WebSocket-Protocol: chat\r\n";
+                auto extensions = request.headers.find("sec-websocket-extensions");
+                websocket_reader = std::unique_ptr<websocket::FrameReader>(new websocket::FrameReader());
+                if (extensions != request.headers.end() && extensions->second.find("permessage-deflate") > -1)
+                {
+                    //We never use context takeover ourselves, and do not require it from the client.
+                    reply += "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover\r\n";
+                    websocket_deflate = true;
+                    websocket_reader->enableDeflate();
+                }
                 reply += "Expires: 0\r\n";
                 reply += "Cache-Control: max-age=0, no-cache, must-revalidate, proxy-revalidate\r\n";
                 reply += "\r\n";
-                socket.send(reply.c_str(), reply.size());
                 
+                this->request = request;
                 websocket_connected = true;
                 
                 state = State::Websocket;
@@ -390,14 +601,18 @@ void Server::Connection::handleRequest(const Request& request)
             else
             {
                 LOG(Warning, "Tried to open websocket without handler:", request.path);
-                startHttpReply(404);
-                httpChunk("404 - File not found.");
-                httpChunk("");
+                reply = errorReply(404, "404 - File not found.");
             }
+            setReply(reply_index, std::move(reply));
             return;
         }
     }
 
+    handleStaticFile(request, reply_index);
+}
+
+void Server::Connection::handleStaticFile(const Request& request, uint64_t reply_index)
+{
     string full_path;
     
     if (request.path.find("..") == -1)
@@ -406,101 +621,234 @@ void Server::Connection::handleRequest(const Request& request)
         if (request.path.endswith("/"))
             full_path = full_path + "index.html";
     }
-    
-    FILE* f = fopen(full_path.c_str(), "rb");
-    if (f)
+
+    struct stat info;
+    if (full_path.empty() || stat(full_path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        LOG(Warning, "File not found:", request.path);
+        setReply(reply_index, errorReply(404, "404 - File not found."));
+        return;
+    }
+    size_t file_size = info.st_size;
+    string etag = "\"" + string(uint64_t(file_size)) + "-" + string(uint64_t(info.st_mtime)) + "\"";
+    string mimetype = getMimeType(full_path);
+    string headers = "ETag: " + etag + "\r\nAccept-Ranges: bytes\r\n";
+
+    auto header = request.headers.find("if-none-match");
+    if (header != request.headers.end() && header->second.find(etag) > -1)
+    {
+        string reply;
+        startFileReply(reply, 304, "", headers, 0);
+        setReply(reply_index, std::move(reply));
+        return;
+    }
+
+    //Only a single range is supported, requests for multiple ranges get the whole file.
+    size_t range_start = 0;
+    size_t range_end = file_size;
+    bool partial = false;
+    header = request.headers.find("range");
+    if (header != request.headers.end() && header->second.startswith("bytes=") && header->second.find(",") == -1)
     {
-        if (request.path.endswith(".js"))
-            startHttpReply(200, "text/javascript");
-        else if (request.path.endswith(".css"))
-            startHttpReply(200, "text/css");
+        auto range = header->second.substr(6).partition("-");
+        string first = range.first.strip();
+        string last = range.second.strip();
+        if (first.empty())
+        {
+            //Suffix range, the last bytes of the file.
+            size_t length = strtoull(last.c_str(), nullptr, 10);
+            range_start = file_size - std::min(length, file_size);
+        }
         else
-            startHttpReply(200);
-        while(true)
         {
-            char buffer[1024];
-            size_t n = fread(buffer, 1, sizeof(buffer), f);
-            if (n < 1)
-                break;
+            range_start = strtoull(first.c_str(), nullptr, 10);
+            if (!last.empty())
+                range_end = std::min(size_t(strtoull(last.c_str(), nullptr, 10)) + 1, file_size);
+        }
+        if (range_start >= range_end)
+        {
+            string reply;
+            startFileReply(reply, 416, "", "Content-Range: bytes */" + string(uint64_t(file_size)) + "\r\n", 0);
+            setReply(reply_index, std::move(reply));
+            return;
+        }
+        partial = true;
+        headers += "Content-Range: bytes " + string(uint64_t(range_start)) + "-" + string(uint64_t(range_end - 1)) + "/" + string(uint64_t(file_size)) + "\r\n";
+    }
+    header = request.headers.find("accept-encoding");
+    bool accept_gzip = !partial && header != request.headers.end() && header->second.find("gzip") > -1;
 
-            string chunk_len_string = string::hex(n) + "\r\n";
-            socket.send(chunk_len_string.c_str(), chunk_len_string.size());
-            socket.send(buffer, n);
-            socket.send("\r\n", 2);
+    CachedFile* cached = nullptr;
+    if (file_size <= max_cached_file_size)
+        cached = server.getCachedFile(full_path, file_size, info.st_mtime);
+    if (cached)
+    {
+        string reply;
+        if (!cached->gzip_data.empty())
+            headers += "Vary: Accept-Encoding\r\n";
+        if (partial)
+        {
+            startFileReply(reply, 206, mimetype, headers, range_end - range_start);
+            reply.append(cached->data, range_start, range_end - range_start);
         }
-        fclose(f);
+        else if (accept_gzip && !cached->gzip_data.empty())
+        {
+            startFileReply(reply, 200, mimetype, headers + "Content-Encoding: gzip\r\n", cached->gzip_data.size());
+            reply += cached->gzip_data;
+        }
+        else
+        {
+            startFileReply(reply, 200, mimetype, headers, file_size);
+            reply += cached->data;
+        }
+        setReply(reply_index, std::move(reply));
+        return;
     }
-    else
+
+    //Large file, send it straight from disk.
+    string path = full_path;
+    struct stat gzip_info;
+    if (stat((full_path + ".gz").c_str(), &gzip_info) == 0 && S_ISREG(gzip_info.st_mode) && gzip_info.st_mtime >= info.st_mtime)
     {
-        startHttpReply(404);
-        httpChunk("404 - File not found.");
+        headers += "Vary: Accept-Encoding\r\n";
+        if (accept_gzip)
+        {
+            path = full_path + ".gz";
+            headers += "Content-Encoding: gzip\r\n";
+            range_end = gzip_info.st_size;
+        }
+    }
+    Reply reply;
+    reply.file.reset(fopen(path.c_str(), "rb"));
+    if (!reply.file)
+    {
+        LOG(Warning, "Failed to open:", path);
+        setReply(reply_index, errorReply(404, "404 - File not found."));
+        return;
+    }
+    reply.file_offset = range_start;
+    reply.file_size = range_end - range_start;
+    startFileReply(reply.data, partial ? 206 : 200, mimetype, headers, reply.file_size);
+    setReply(reply_index, std::move(reply));
+}
 
-        LOG(Warning, "File not found:", request.path);
+uint64_t Server::Connection::reserveReply()
+{
+    replies.emplace_back();
+    return first_reply_index + replies.size() - 1;
+}
+
+void Server::Connection::setReply(uint64_t index, string&& data)
+{
+    Reply reply;
+    reply.data = std::move(data);
+    setReply(index, std::move(reply));
+}
+
+void Server::Connection::setReply(uint64_t index, Reply&& reply)
+{
+    if (index < first_reply_index || index - first_reply_index >= replies.size())
+        return;
+    replies[index - first_reply_index] = std::move(reply);
+    replies[index - first_reply_index].ready = true;
+
+    //Send every reply that is ready, up to the first one that is still being handled, with as few sends as possible.
+    string output;
+    while(!replies.empty() && replies.front().ready)
+    {
+        Reply& front = replies.front();
+        if (output.empty())
+            output = std::move(front.data);
+        else
+            output += front.data;
+        if (front.file)
+        {
+            socket.send(output.data(), output.size());
+            output.clear();
+            socket.sendFile(front.file.get(), front.file_offset, front.file_size);
+        }
+        replies.pop_front();
+        first_reply_index++;
     }
-    httpChunk("");
+    if (!output.empty())
+        socket.send(output.data(), output.size());
 }
 
-void Server::Connection::startHttpReply(int reply_code, const string& mimetype)
+void Server::Connection::startHttpReply(string& reply, int reply_code, const string& mimetype)
 {
-    string reply = string("HTTP/1.1 ") + string(reply_code) + " OK\r\n";
+    reply += string("HTTP/1.1 ") + string(reply_code) + " " + getStatusText(reply_code) + "\r\n";
     reply += "Connection: Keep-Alive\r\n";
     if (mimetype.length() > 0)
         reply += "Content-Type: " + mimetype + "\r\n";
     reply += "Transfer-Encoding: chunked\r\n";
     reply += "\r\n";
-    socket.send(reply.c_str(), reply.size());
 }
 
-void Server::Connection::httpChunk(const string& data)
+void Server::Connection::startFileReply(string& reply, int reply_code, const string& mimetype, const string& headers, size_t content_length)
+{
+    reply += string("HTTP/1.1 ") + string(reply_code) + " " + getStatusText(reply_code) + "\r\n";
+    reply += "Connection: Keep-Alive\r\n";
+    if (mimetype.length() > 0)
+        reply += "Content-Type: " + mimetype + "\r\n";
+    reply += headers;
+    //A 304 reply has no body, and no length.
+    if (reply_code != 304)
+        reply += "Content-Length: " + string(uint64_t(content_length)) + "\r\n";
+    reply += "\r\n";
+}
+
+void Server::Connection::httpChunk(string& reply, const string& data)
+{
+    reply += string::hex(data.size()) + "\r\n";
+    reply += data;
+    reply += "\r\n";
+}
+
+string Server::Connection::errorReply(int reply_code, const string& message)
+{
+    string reply;
+    startHttpReply(reply, reply_code);
+    httpChunk(reply, message);
+    httpChunk(reply, "");
+    return reply;
+}
+
+string Server::Connection::handlerReply(const string& data)
 {
-    string chunk_len_string = string::hex(data.size()) + "\r\n";
-    socket.send(chunk_len_string.c_str(), chunk_len_string.size());
+    string reply;
+    startHttpReply(reply, 200);
     if (data.size() > 0)
-        socket.send(data.data(), data.size());
-    socket.send("\r\n", 2);
+        httpChunk(reply, data);
+    httpChunk(reply, "");
+    return reply;
 }
 
-void Server::Connection::sendWebsocketTextPacket(const string& data)
+void Server::Connection::sendWebsocketPacket(int opcode, const string& data)
 {
-    if (data.size() < websocket::payload_length_16bit)
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            uint8_t(data.size()),
-        };
-        socket.send(header, sizeof(header));
-    }
-    else if (data.size() < (1 << 16))
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            websocket::payload_length_16bit,
-            uint8_t((data.size() >> 8) & 0xFF),
-            uint8_t(data.size() & 0xFF),
-        };
-        socket.send(header, sizeof(header));
-    }
-    else
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            websocket::payload_length_64bit,
-            0, 0, 0, 0,
-            uint8_t((data.size() >> 24) & 0xFF),
-            uint8_t((data.size() >> 16) & 0xFF),
-            uint8_t((data.size() >> 8) & 0xFF),
-            uint8_t(data.size() & 0xFF),
-        };
-        socket.send(header, sizeof(header));
-    }
-    
-    socket.send(data.data(), data.size());
+    io::DataBuffer frame;
+    websocket::buildFrame(frame, opcode, data.data(), data.size(), websocket_deflate && !(opcode & 0x08) ? server.websocket_deflater.get() : nullptr);
+    socket.send(frame.getData(), frame.getDataSize());
+}
+
+void Server::Connection::sendWebsocketFrame(const std::shared_ptr<const io::DataBuffer>& frame)
+{
+    socket.sendRaw(frame);
 }
 
 void WebsocketHandler::send(const string& message)
 {
-    if (connection)
-        connection->sendWebsocketTextPacket(message);
+    if (!connection)
+        return;
+    std::lock_guard<std::recursive_mutex> lock(connection->server.mutex);
+    connection->sendWebsocketPacket(websocket::opcode_text, message);
+}
+
+void WebsocketHandler::sendBinary(const string& message)
+{
+    if (!connection)
+        return;
+    std::lock_guard<std::recursive_mutex> lock(connection->server.mutex);
+    connection->sendWebsocketPacket(websocket::opcode_binary, message);
 }
 
 }//namespace http
@@ -1,4 +1,5 @@
 #include <sp2/io/http/websocket.h>
+#include <private/io/http/websocketProtocol.h>
 #include <sp2/stringutil/convert.h>
 #include <sp2/stringutil/base64.h>
 #include <sp2/stringutil/sha1.h>
@@ -23,26 +24,6 @@
 namespace sp {
 namespace io {
 namespace http {
-#ifndef EMSCRIPTEN
-namespace websocket {
-    static constexpr int fin_mask = 0x80;
-    static constexpr int rsv_mask = 0x70;
-    static constexpr int opcode_mask = 0x0f;
-    
-    static constexpr int mask_mask = 0x80;
-    static constexpr int payload_length_mask = 0x7f;
-    static constexpr int payload_length_16bit = 126;
-    static constexpr int payload_length_64bit = 127;
-    
-    static constexpr int opcode_continuation = 0x00;
-    static constexpr int opcode_text = 0x01;
-    static constexpr int opcode_binary = 0x02;
-    static constexpr int opcode_close = 0x08;
-    static constexpr int opcode_ping = 0x09;
-    static constexpr int opcode_pong = 0x0a;
-};
-#endif
-
 Websocket::Websocket()
 {
 }
@@ -70,7 +51,10 @@ Websocket& Websocket::operator=(Websocket&& other)
     websock_key = std::move(other.websock_key);
     socket = std::move(other.socket);
     buffer = std::move(other.buffer);
-    received_fragment = std::move(other.received_fragment);
+    buffer_offset = other.buffer_offset;
+    received_message = std::move(other.received_message);
+    reader = std::move(other.reader);
+    deflater = std::move(other.deflater);
     headers = std::move(other.headers);
     other.close();
 #endif
@@ -163,6 +147,7 @@ bool Websocket::connect(const string& hostname, int port, const string& path, Sc
         "Sec-Websocket-Version: 13\r\n"
         "Sec-Websocket-Key: " + websock_key + "\r\n"
         "Sec-WebSocket-Protocol: chat\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover\r\n"
         "Pragma: no-cache\r\n";
     for(auto& it : headers)
         request += it.first + ": " + it.second + "\r\n";
@@ -170,6 +155,7 @@ bool Websocket::connect(const string& hostname, int port, const string& path, Sc
         "Cache-Control: no-cache, no-store, must-revalidate\r\n"
         "\r\n";
     socket.send(request.data(), request.length());
+    reader = std::unique_ptr<websocket::FrameReader>(new websocket::FrameReader());
     state = State::Connecting;
     socket.setBlocking(false);
 #endif
@@ -187,7 +173,10 @@ void Websocket::close()
 #else
     socket.close();
     buffer.clear();
-    received_fragment.clear();
+    buffer_offset = 0;
+    received_message.clear();
+    reader = nullptr;
+    deflater = nullptr;
 #endif
     state = State::Disconnected;
 }
@@ -205,46 +194,21 @@ bool Websocket::isConnecting()
 }
 
 void Websocket::send(const io::DataBuffer& data_buffer)
+{
+    sendMessage(websocket::opcode_binary, data_buffer.getData(), data_buffer.getDataSize());
+}
+
+void Websocket::sendMessage(uint8_t opcode, const void* data, size_t size)
 {
     if (state != State::Operational)
         return;
 
 #ifdef EMSCRIPTEN
-    ::send(socket_handle, data_buffer.getData(), data_buffer.getDataSize(), 0);
+    ::send(socket_handle, data, size, 0);
 #else
-    if (data_buffer.getDataSize() < websocket::payload_length_16bit)
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            uint8_t(data_buffer.getDataSize()),
-        };
-        socket.send(header, sizeof(header));
-    }
-    else if (data_buffer.getDataSize() < (1 << 16))
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            websocket::payload_length_16bit,
-            uint8_t((data_buffer.getDataSize() >> 8) & 0xFF),
-            uint8_t(data_buffer.getDataSize() & 0xFF),
-        };
-        socket.send(header, sizeof(header));
-    }
-    else
-    {
-        uint8_t header[] = {
-            websocket::fin_mask | websocket::opcode_text,
-            websocket::payload_length_64bit,
-            0, 0, 0, 0,
-            uint8_t((data_buffer.getDataSize() >> 24) & 0xFF),
-            uint8_t((data_buffer.getDataSize() >> 16) & 0xFF),
-            uint8_t((data_buffer.getDataSize() >> 8) & 0xFF),
-            uint8_t(data_buffer.getDataSize() & 0xFF),
-        };
-        socket.send(header, sizeof(header));
-    }
-
-    socket.send(data_buffer.getData(), data_buffer.getDataSize());
+    io::DataBuffer frame;
+    websocket::buildFrame(frame, opcode, data, size, deflater.get());
+    socket.send(frame.getData(), frame.getDataSize());
 #endif
 }
 
@@ -271,100 +235,57 @@ bool Websocket::receive(io::DataBuffer& data_buffer)
 #else
         while(true)
         {
-            if (buffer.size() < 2)
-                return false;
-            unsigned int payload_length = buffer[1] & websocket::payload_length_mask;
-            int opcode = buffer[0] & websocket::opcode_mask;
-            bool fin = buffer[0] & websocket::fin_mask;
-            bool mask = buffer[1] & websocket::mask_mask;
-            unsigned int index = 2;
-
-            //Close the connection if any of the RSV bits are set.
-            if (buffer[0] & websocket::rsv_mask)
+            auto result = reader->next(buffer.data(), buffer.size(), buffer_offset, received_message);
+            if (result == websocket::FrameReader::Result::NeedMoreData)
+                break;
+            if (result == websocket::FrameReader::Result::Error)
             {
-                LOG(Warning, "Closing client websocket due to RSV bits, we do not support extensions.");
+                LOG(Warning, "Closing client websocket due to a protocol error.");
                 close();
                 return false;
             }
-
-            if (payload_length == websocket::payload_length_16bit)
-            {
-                if (buffer.size() < index + 2)
-                    return false;
-                payload_length = uint8_t(buffer[index++]) << 8;
-                payload_length |= uint8_t(buffer[index++]);
-            }else if (payload_length == websocket::payload_length_64bit)
-            {
-                if (buffer.size() < index + 8)
-                    return false;
-                index += 4;
-                payload_length = uint8_t(buffer[index++]) << 24;
-                payload_length |= uint8_t(buffer[index++]) << 16;
-                payload_length |= uint8_t(buffer[index++]) << 8;
-                payload_length |= uint8_t(buffer[index++]);
-            }
-
-            uint8_t mask_values[4] = {0, 0, 0, 0};
-            if (mask)
+            if (result == websocket::FrameReader::Result::Control)
             {
-                if (buffer.size() < index + 4)
-                    return false;
-                for(unsigned int n=0; n<4; n++)
-                    mask_values[n] = buffer[index++];
-                if (buffer.size() < index + payload_length)
+                io::DataBuffer frame;
+                switch(reader->control_opcode)
+                {
+                case websocket::opcode_close:
+                    websocket::buildFrame(frame, websocket::opcode_close, nullptr, 0, nullptr);
+                    socket.send(frame.getData(), frame.getDataSize());
+                    close();
                     return false;
-                for(unsigned int n=0; n<payload_length; n++)
-                    buffer[index + n] ^= mask_values[n % 4];
+                case websocket::opcode_ping:
+                    websocket::buildFrame(frame, websocket::opcode_pong, reader->control_payload.data(), reader->control_payload.size(), nullptr);
+                    socket.send(frame.getData(), frame.getDataSize());
+                    break;
+                case websocket::opcode_pong:
+                    //There is no real need to track PONG replies. TCP/IP will close the connection if the other side is gone.
+                    break;
+                }
+                continue;
             }
-            if (buffer.size() < index + payload_length)
-                return false;
-
-            std::vector<uint8_t> message(buffer.begin() + index, buffer.begin() + index + payload_length);
-            buffer.erase(buffer.begin(), buffer.begin() + index + payload_length);
-
-            switch(opcode)
+            if (received_message.size() > websocket::max_message_size)
             {
-            case websocket::opcode_continuation:
-                received_fragment.insert(received_fragment.end(), message.begin(), message.end());
-                if (fin)
-                {
-                    data_buffer = std::move(received_fragment);
-                    received_fragment.clear();
-                    return true;
-                }
-                break;
-            case websocket::opcode_text:
-            case websocket::opcode_binary:
-                if (fin)
-                {
-                    data_buffer = std::move(message);
-                    return true;
-                }
-                else
-                {
-                    received_fragment = message;
-                }
-                break;
-            case websocket::opcode_close:
-                {
-                    uint8_t reply[] = {websocket::fin_mask | websocket::opcode_close, 0};//close packet
-                    socket.send(reply, sizeof(reply));
-                }
+                LOG(Warning, "Closing client websocket, received a message over the size limit.");
                 close();
                 return false;
-            case websocket::opcode_ping:
+            }
+            if (reader->message_end)
+            {
+                const uint8_t* data = reinterpret_cast<const uint8_t*>(received_message.data());
+                data_buffer = std::vector<uint8_t>(data, data + received_message.size());
+                received_message.clear();
+                //Drop the parsed data once it is most of the buffer, instead of after every message.
+                if (buffer_offset > buffer.size() / 2)
                 {
-                    //Note: The standard says that we need to include the payload of the ping packet as payload in the pong packet.
-                    //      We ignore this, as this no client seems to use this.
-                    uint8_t reply[] = {websocket::fin_mask | websocket::opcode_pong, 0};//pong packet
-                    socket.send(reply, sizeof(reply));
+                    buffer.erase(buffer.begin(), buffer.begin() + buffer_offset);
+                    buffer_offset = 0;
                 }
-                break;
-            case websocket::opcode_pong:
-                //There is no real need to track PONG replies. TCP/IP will close the connection if the other side is gone.
-                break;
+                return true;
             }
         }
+        buffer.erase(buffer.begin(), buffer.begin() + buffer_offset);
+        buffer_offset = 0;
 #endif
     }
     return false;
@@ -372,9 +293,7 @@ bool Websocket::receive(io::DataBuffer& data_buffer)
 
 void Websocket::send(const string& message)
 {
-    io::DataBuffer data_buffer;
-    data_buffer.appendRaw(message.data(), message.size());
-    send(data_buffer);
+    sendMessage(websocket::opcode_text, message.data(), message.size());
 }
 
 bool Websocket::receive(string& output)
@@ -404,14 +323,11 @@ void Websocket::updateReceiveBuffer()
         }
     }
 #else
-    char receive_buffer[4096];
-    size_t received_size;
-    received_size = socket.receive(receive_buffer, sizeof(receive_buffer));
-    if (received_size > 0)
-    {
-        buffer.resize(buffer.size() + received_size);
-        memcpy(&buffer[buffer.size()] - received_size, receive_buffer, received_size);
-    }
+    //Receive directly at the end of the buffer.
+    size_t previous_size = buffer.size();
+    buffer.resize(previous_size + 64 * 1024);
+    size_t received_size = socket.receive(&buffer[previous_size], 64 * 1024);
+    buffer.resize(previous_size + received_size);
     if (!socket.isConnected())
         state = State::Disconnected;
 
@@ -461,6 +377,11 @@ void Websocket::updateReceiveBuffer()
                 close();
                 return;
             }
+            if (headers["sec-websocket-extensions"].find("permessage-deflate") > -1)
+            {
+                reader->enableDeflate();
+                deflater = std::unique_ptr<websocket::Deflater>(new websocket::Deflater());
+            }
             state = State::Operational;
         }
     }
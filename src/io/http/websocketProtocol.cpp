@@ -0,0 +1,245 @@
+#include <private/io/http/websocketProtocol.h>
+#include <string.h>
+
+namespace sp {
+namespace io {
+namespace http {
+namespace websocket {
+
+Deflater::Deflater()
+{
+    memset(&stream, 0, sizeof(stream));
+    //Negative window bits give raw deflate data, without a zlib header.
+    mz_deflateInit2(&stream, MZ_DEFAULT_LEVEL, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY);
+}
+
+Deflater::~Deflater()
+{
+    mz_deflateEnd(&stream);
+}
+
+bool Deflater::compress(const void* data, size_t size, std::string& output)
+{
+    output.clear();
+    mz_deflateReset(&stream);
+    stream.next_in = static_cast<const unsigned char*>(data);
+    stream.avail_in = size;
+    while(true)
+    {
+        unsigned char buffer[16 * 1024];
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        int result = mz_deflate(&stream, MZ_SYNC_FLUSH);
+        output.append(reinterpret_cast<const char*>(buffer), sizeof(buffer) - stream.avail_out);
+        if (result != MZ_OK && result != MZ_BUF_ERROR)
+            return false;
+        if (stream.avail_in == 0 && stream.avail_out != 0)
+            break;
+    }
+    //The sync flush ends with an empty block, which the receiver adds back itself.
+    if (output.size() < 4 || output.compare(output.size() - 4, 4, "\x00\x00\xff\xff", 4) != 0)
+        return false;
+    output.resize(output.size() - 4);
+    return output.size() < size;
+}
+
+Inflater::Inflater()
+{
+    memset(&stream, 0, sizeof(stream));
+    mz_inflateInit2(&stream, -MZ_DEFAULT_WINDOW_BITS);
+}
+
+Inflater::~Inflater()
+{
+    mz_inflateEnd(&stream);
+}
+
+bool Inflater::add(const uint8_t* data, size_t size, std::string& output)
+{
+    stream.next_in = data;
+    stream.avail_in = size;
+    while(true)
+    {
+        unsigned char buffer[16 * 1024];
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        int result = mz_inflate(&stream, MZ_NO_FLUSH);
+        output.append(reinterpret_cast<const char*>(buffer), sizeof(buffer) - stream.avail_out);
+        //A block with the final bit set ends the stream, the next message starts a new one.
+        if (result == MZ_STREAM_END)
+            mz_inflateReset(&stream);
+        else if (result != MZ_OK && result != MZ_BUF_ERROR)
+            return false;
+        if ((stream.avail_in == 0 && stream.avail_out != 0) || result == MZ_BUF_ERROR)
+            break;
+    }
+    return true;
+}
+
+bool Inflater::finishMessage(std::string& output)
+{
+    static const uint8_t tail[] = {0x00, 0x00, 0xff, 0xff};
+    return add(tail, sizeof(tail), output);
+}
+
+FrameReader::Result FrameReader::next(uint8_t* buffer, size_t size, size_t& offset, std::string& output)
+{
+    if (!in_frame)
+    {
+        if (size - offset < 2)
+            return Result::NeedMoreData;
+        uint8_t* header = buffer + offset;
+        size_t header_size = 2;
+        uint64_t payload_length = header[1] & payload_length_mask;
+        if (payload_length == payload_length_16bit)
+            header_size += 2;
+        else if (payload_length == payload_length_64bit)
+            header_size += 8;
+        if (header[1] & mask_mask)
+            header_size += 4;
+        if (size - offset < header_size)
+            return Result::NeedMoreData;
+
+        frame_opcode = header[0] & opcode_mask;
+        frame_fin = header[0] & fin_mask;
+        bool compressed = header[0] & rsv1_mask;
+        //Only RSV1 is used, by permessage-deflate, and only on the first frame of a data message.
+        if ((header[0] & rsv_mask & ~rsv1_mask) || (compressed && (!deflate || (frame_opcode != opcode_text && frame_opcode != opcode_binary))))
+            return Result::Error;
+
+        size_t index = 2;
+        if (payload_length == payload_length_16bit)
+        {
+            payload_length = uint64_t(header[2]) << 8 | uint64_t(header[3]);
+            index += 2;
+        }
+        else if (payload_length == payload_length_64bit)
+        {
+            payload_length = 0;
+            for(int n=0; n<8; n++)
+                payload_length = payload_length << 8 | uint64_t(header[index++]);
+        }
+        if (header[1] & mask_mask)
+        {
+            for(int n=0; n<4; n++)
+                frame_mask[n] = header[index++];
+        }
+        else
+        {
+            memset(frame_mask, 0, sizeof(frame_mask));
+        }
+        frame_mask_offset = 0;
+        frame_remaining = payload_length;
+
+        if (frame_opcode & 0x08)
+        {
+            //Control frames cannot be fragmented, and are small.
+            if (!frame_fin || payload_length > 125)
+                return Result::Error;
+        }
+        else if (frame_opcode == opcode_continuation)
+        {
+            if (!in_message)
+                return Result::Error;
+        }
+        else
+        {
+            if (in_message)
+                return Result::Error;
+            in_message = true;
+            message_opcode = frame_opcode;
+            message_compressed = compressed;
+        }
+        offset += header_size;
+        in_frame = true;
+    }
+
+    if (frame_opcode & 0x08)
+    {
+        if (size - offset < frame_remaining)
+            return Result::NeedMoreData;
+        for(size_t n=0; n<frame_remaining; n++)
+            buffer[offset + n] ^= frame_mask[n % 4];
+        control_opcode = frame_opcode;
+        control_payload.assign(reinterpret_cast<const char*>(buffer + offset), frame_remaining);
+        offset += frame_remaining;
+        in_frame = false;
+        return Result::Control;
+    }
+
+    size_t available = size - offset;
+    if (available > frame_remaining)
+        available = frame_remaining;
+    if (available == 0 && frame_remaining > 0)
+        return Result::NeedMoreData;
+    uint8_t* data = buffer + offset;
+    for(size_t n=0; n<available; n++)
+        data[n] ^= frame_mask[(frame_mask_offset + n) % 4];
+    frame_mask_offset = (frame_mask_offset + available) % 4;
+    if (message_compressed)
+    {
+        if (!inflater.add(data, available, output))
+            return Result::Error;
+    }
+    else
+    {
+        output.append(reinterpret_cast<const char*>(data), available);
+    }
+    offset += available;
+    frame_remaining -= available;
+
+    message_end = false;
+    if (frame_remaining == 0)
+    {
+        in_frame = false;
+        if (frame_fin)
+        {
+            if (message_compressed && !inflater.finishMessage(output))
+                return Result::Error;
+            in_message = false;
+            message_end = true;
+        }
+    }
+    return Result::Data;
+}
+
+void buildFrame(io::DataBuffer& frame, int opcode, const void* data, size_t size, Deflater* deflater)
+{
+    std::string compressed;
+    bool use_compression = deflater && size >= min_compress_size && deflater->compress(data, size, compressed);
+    if (use_compression)
+    {
+        data = compressed.data();
+        size = compressed.size();
+    }
+
+    uint8_t header[10];
+    size_t header_size = 2;
+    header[0] = fin_mask | opcode | (use_compression ? rsv1_mask : 0);
+    if (size < payload_length_16bit)
+    {
+        header[1] = size;
+    }
+    else if (size < (1 << 16))
+    {
+        header[1] = payload_length_16bit;
+        header[2] = (size >> 8) & 0xFF;
+        header[3] = size & 0xFF;
+        header_size = 4;
+    }
+    else
+    {
+        header[1] = payload_length_64bit;
+        for(int n=0; n<8; n++)
+            header[2 + n] = (uint64_t(size) >> ((7 - n) * 8)) & 0xFF;
+        header_size = 10;
+    }
+    frame.appendRaw(header, header_size);
+    if (size > 0)
+        frame.appendRaw(data, size);
+}
+
+}//namespace websocket
+}//namespace http
+}//namespace io
+}//namespace sp
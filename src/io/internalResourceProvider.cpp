@@ -43,6 +43,11 @@ public:
     {
         return resource.size();
     }
+
+    virtual const uint8_t* getContiguousView() override
+    {
+        return reinterpret_cast<const uint8_t*>(resource.data());
+    }
 };
 
 
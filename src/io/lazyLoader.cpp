@@ -1,31 +1,244 @@
 #include <sp2/io/lazyLoader.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 namespace sp {
 namespace io {
 
-std::thread* LazyLoaderManager::thread;
-sp::threading::Queue<std::function<void()>> LazyLoaderManager::queue;
+class LazyLoaderJob
+{
+public:
+    uint64_t id;
+    int group;
+    string type;
+    //The loader and name identify the resource, only one job per resource runs at the same time.
+    const void* owner;
+    string name;
+    //Runs on a loader thread.
+    std::function<void()> func;
+    //Runs on the main thread, after func is done.
+    std::function<void(uint64_t id)> done;
+};
+
+class LazyLoaderState
+{
+public:
+    ~LazyLoaderState()
+    {
+        LazyLoaderManager::shutdown();
+    }
+
+    std::mutex mutex;
+    std::condition_variable job_condition;
+    std::condition_variable done_condition;
+    std::deque<LazyLoaderJob> visible_jobs;
+    std::deque<LazyLoaderJob> prefetch_jobs;
+    std::vector<LazyLoaderJob> finished_jobs;
+    std::unordered_map<int, int> pending_per_group;
+    std::unordered_map<string, LazyLoaderManager::Stats> stats;
+    //Resources that are being loaded right now.
+    std::vector<std::pair<const void*, string>> running;
+    std::vector<std::thread> threads;
+    int thread_count = 0;
+    int current_group = 0;
+    uint64_t next_job_id = 1;
+    bool stopping = false;
+
+    bool isRunning(const LazyLoaderJob& job)
+    {
+        for(auto& entry : running)
+            if (entry.first == job.owner && entry.second == job.name)
+                return true;
+        return false;
+    }
+
+    //Take the first job of which the resource is not loading already, visible jobs first.
+    bool takeJob(LazyLoaderJob& result)
+    {
+        for(auto queue : {&visible_jobs, &prefetch_jobs})
+        {
+            for(auto it = queue->begin(); it != queue->end(); ++it)
+            {
+                if (!isRunning(*it))
+                {
+                    result = std::move(*it);
+                    queue->erase(it);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+static LazyLoaderState state;
+
+void LazyLoaderManager::setThreadCount(int count)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.thread_count = std::max(1, count);
+}
+
+void LazyLoaderManager::setGroup(int group)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.current_group = group;
+}
+
+int LazyLoaderManager::getPendingCount(int group)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto it = state.pending_per_group.find(group);
+    if (it == state.pending_per_group.end())
+        return 0;
+    return it->second;
+}
+
+void LazyLoaderManager::waitForGroup(int group)
+{
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        while(state.pending_per_group[group] > 0)
+            state.done_condition.wait(lock);
+    }
+    update();
+}
+
+std::unordered_map<string, LazyLoaderManager::Stats> LazyLoaderManager::getStats()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.stats;
+}
+
+void LazyLoaderManager::shutdown()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stopping = true;
+        threads.swap(state.threads);
+        state.job_condition.notify_all();
+    }
+    //Running loads are finished first, loads that did not start yet stay in the queue.
+    for(auto& thread : threads)
+        thread.join();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.stopping = false;
+}
 
-void LazyLoaderManager::addWork(std::function<void()> f)
+uint64_t LazyLoaderManager::addWork(const void* owner, const string& name, const string& type, Priority priority, std::function<void()> func, std::function<void(uint64_t id)> done)
 {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    uint64_t id = state.next_job_id++;
 #ifdef __EMSCRIPTEN__
     //emscripten has very limited threading support, so do not lazy load with emscripten.
-    f();
+    lock.unlock();
+    func();
+    //The completion still goes through update, so it is always called after the load is registered.
+    lock.lock();
+    state.finished_jobs.push_back({id, state.current_group, type, owner, name, nullptr, done});
 #else
-    queue.put(f);
+    LazyLoaderJob job{id, state.current_group, type, owner, name, func, done};
+    if (priority == Priority::Visible)
+        state.visible_jobs.push_back(std::move(job));
+    else
+        state.prefetch_jobs.push_back(std::move(job));
+    state.pending_per_group[state.current_group]++;
+    state.job_condition.notify_one();
+
+    if (state.thread_count < 1)
+        state.thread_count = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+    //Threads are started on demand, and keep running till shutdown.
+    while(int(state.threads.size()) < state.thread_count)
+        state.threads.emplace_back(&LazyLoaderManager::workerThread);
+#endif
+    return id;
+}
 
-    if (!thread)
+bool LazyLoaderManager::cancel(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for(auto queue : {&state.visible_jobs, &state.prefetch_jobs})
     {
-        thread = new std::thread([]()
+        for(auto it = queue->begin(); it != queue->end(); ++it)
         {
-            while(true)
+            if (it->id == id)
             {
-                std::function<void()> workFunction = queue.get();
-                workFunction();
+                state.pending_per_group[it->group]--;
+                queue->erase(it);
+                state.done_condition.notify_all();
+                return true;
             }
-        });
+        }
+    }
+    return false;
+}
+
+void LazyLoaderManager::setPriority(uint64_t id, Priority priority)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::deque<LazyLoaderJob>& from = priority == Priority::Visible ? state.prefetch_jobs : state.visible_jobs;
+    std::deque<LazyLoaderJob>& to = priority == Priority::Visible ? state.visible_jobs : state.prefetch_jobs;
+    for(auto it = from.begin(); it != from.end(); ++it)
+    {
+        if (it->id == id)
+        {
+            to.push_back(std::move(*it));
+            from.erase(it);
+            return;
+        }
+    }
+}
+
+void LazyLoaderManager::update()
+{
+    std::vector<LazyLoaderJob> jobs;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.finished_jobs.empty())
+            return;
+        jobs.swap(state.finished_jobs);
+    }
+    for(auto& job : jobs)
+    {
+        if (job.done)
+            job.done(job.id);
+    }
+}
+
+void LazyLoaderManager::workerThread()
+{
+    std::unique_lock<std::mutex> lock(state.mutex);
+    LazyLoaderJob job;
+    while(true)
+    {
+        while(!state.stopping && !state.takeJob(job))
+            state.job_condition.wait(lock);
+        if (state.stopping)
+            return;
+        state.running.emplace_back(job.owner, job.name);
+
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        job.func();
+        job.func = nullptr;
+        double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        lock.lock();
+
+        Stats& s = state.stats[job.type];
+        s.count++;
+        s.total_time += time;
+        s.max_time = std::max(s.max_time, time);
+        state.pending_per_group[job.group]--;
+        state.running.erase(std::find(state.running.begin(), state.running.end(), std::make_pair(job.owner, job.name)));
+        state.finished_jobs.push_back(std::move(job));
+        state.done_condition.notify_all();
+        //A newer load of the same resource can start now.
+        state.job_condition.notify_all();
     }
-#endif
 }
 
 }//namespace io
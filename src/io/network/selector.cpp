@@ -2,6 +2,7 @@
 #include <sp2/io/network/selector.h>
 #include <algorithm>
 #include <vector>
+#include <unordered_map>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -17,6 +18,11 @@
 #include <errno.h>
 #include <poll.h>
 #endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <string.h>
+#define SP2_SELECTOR_EPOLL
+#endif
 
 
 namespace sp {
@@ -27,17 +33,147 @@ namespace network {
 class Selector::SelectorData
 {
 public:
+    class Entry
+    {
+    public:
+        SocketBase* socket;
+        bool write_interest;
+        bool readable;
+        bool writable;
+#ifndef SP2_SELECTOR_EPOLL
+        size_t index;
+#endif
+    };
+
+    Trigger trigger;
+    std::unordered_map<int, Entry> entries;
+    //Handle of each added socket, as a socket can close itself before it is removed, which resets its handle.
+    std::unordered_map<SocketBase*, int> handles;
+    std::vector<SocketBase*> ready;
+#ifdef SP2_SELECTOR_EPOLL
+    int epoll_handle;
+    std::vector<struct epoll_event> events;
+#else
     std::vector<struct pollfd> fds;
+#endif
+
+    SelectorData(Trigger trigger)
+    : trigger(trigger)
+    {
+#ifdef SP2_SELECTOR_EPOLL
+        epoll_handle = ::epoll_create1(EPOLL_CLOEXEC);
+#endif
+    }
+
+    ~SelectorData()
+    {
+#ifdef SP2_SELECTOR_EPOLL
+        if (epoll_handle != -1)
+            ::close(epoll_handle);
+#endif
+    }
+
+    void add(SocketBase& socket, bool write_interest)
+    {
+        //The socket was closed and opened again without being removed.
+        auto handle = handles.find(&socket);
+        if (handle != handles.end() && handle->second != socket.handle)
+            remove(handle->second);
+        auto it = entries.find(socket.handle);
+        if (it != entries.end())
+        {
+            //Same handle as a socket that was closed without being removed.
+            handles.erase(it->second.socket);
+            handles[&socket] = socket.handle;
+            it->second.socket = &socket;
+            update(socket.handle, it->second, write_interest);
+            return;
+        }
+        handles[&socket] = socket.handle;
+        Entry& entry = entries[socket.handle];
+        entry.socket = &socket;
+        entry.write_interest = write_interest;
+        entry.readable = false;
+        entry.writable = false;
+#ifdef SP2_SELECTOR_EPOLL
+        struct epoll_event event = makeEvent(socket.handle, write_interest);
+        if (::epoll_ctl(epoll_handle, EPOLL_CTL_ADD, socket.handle, &event) != 0 && errno == EEXIST)
+            ::epoll_ctl(epoll_handle, EPOLL_CTL_MOD, socket.handle, &event);
+#else
+        struct pollfd pfd;
+        pfd.fd = socket.handle;
+        pfd.events = POLLIN | (write_interest ? POLLOUT : 0);
+        pfd.revents = 0;
+        entry.index = fds.size();
+        fds.push_back(pfd);
+#endif
+    }
+
+    void update(int handle, Entry& entry, bool write_interest)
+    {
+        entry.write_interest = write_interest;
+#ifdef SP2_SELECTOR_EPOLL
+        struct epoll_event event = makeEvent(handle, write_interest);
+        if (::epoll_ctl(epoll_handle, EPOLL_CTL_MOD, handle, &event) != 0 && errno == ENOENT)
+            ::epoll_ctl(epoll_handle, EPOLL_CTL_ADD, handle, &event);
+#else
+        fds[entry.index].events = POLLIN | (write_interest ? POLLOUT : 0);
+#endif
+    }
+
+    void remove(int handle)
+    {
+        auto it = entries.find(handle);
+        if (it == entries.end())
+            return;
+#ifdef SP2_SELECTOR_EPOLL
+        struct epoll_event event;
+        ::epoll_ctl(epoll_handle, EPOLL_CTL_DEL, handle, &event);
+#else
+        //Move the last entry into the removed slot, so removing does not need to shift the whole list.
+        size_t index = it->second.index;
+        if (index != fds.size() - 1)
+        {
+            fds[index] = fds.back();
+            entries[int(fds[index].fd)].index = index;
+        }
+        fds.pop_back();
+#endif
+        ready.erase(std::remove(ready.begin(), ready.end(), it->second.socket), ready.end());
+        handles.erase(it->second.socket);
+        entries.erase(it);
+    }
+
+    void copyFrom(const SelectorData& other)
+    {
+        for(const auto& it : other.entries)
+        {
+            if (it.second.socket->handle != -1)
+                add(*it.second.socket, it.second.write_interest);
+        }
+    }
+
+#ifdef SP2_SELECTOR_EPOLL
+    struct epoll_event makeEvent(int handle, bool write_interest)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | (write_interest ? EPOLLOUT : 0) | (trigger == Trigger::Edge ? EPOLLET : 0);
+        event.data.fd = handle;
+        return event;
+    }
+#endif
 };
 
-Selector::Selector()
-: data(new SelectorData())
+Selector::Selector(Trigger trigger)
+: data(new SelectorData(trigger))
 {
 }
 
 Selector::Selector(const Selector& other)
-: data(new SelectorData(*other.data))
+: data(new SelectorData(other.data->trigger))
 {
+    data->copyFrom(*other.data);
 }
 
 Selector::~Selector()
@@ -47,50 +183,97 @@ Selector::~Selector()
 
 Selector& Selector::operator =(const Selector& other)
 {
-    *data = *other.data;
+    if (this != &other)
+    {
+        delete data;
+        data = new SelectorData(other.data->trigger);
+        data->copyFrom(*other.data);
+    }
     return *this;
 }
 
 void Selector::add(SocketBase& socket)
 {
     if (socket.handle != -1)
-    {
-        struct pollfd fds;
-        fds.fd = socket.handle;
-        fds.events = POLLIN;
-        fds.revents = 0;
-        data->fds.push_back(fds);
-    }
+        data->add(socket, false);
 }
 
 void Selector::remove(SocketBase& socket)
 {
-    if (socket.handle != -1)
-    {
-        data->fds.erase(std::remove_if(data->fds.begin(), data->fds.end(), [&socket](const struct pollfd& pfd)
-        {
-            return int(pfd.fd) == socket.handle;
-        }), data->fds.end());
-    }
+    auto it = data->handles.find(&socket);
+    if (it != data->handles.end())
+        data->remove(it->second);
+}
+
+void Selector::setWriteInterest(SocketBase& socket, bool enabled)
+{
+    auto it = data->entries.find(socket.handle);
+    if (it != data->entries.end() && it->second.write_interest != enabled)
+        data->update(socket.handle, it->second, enabled);
 }
 
 void Selector::wait(int timeout_ms)
 {
+    for(auto socket : data->ready)
+    {
+        auto it = data->entries.find(socket->handle);
+        if (it != data->entries.end())
+        {
+            it->second.readable = false;
+            it->second.writable = false;
+        }
+    }
+    data->ready.clear();
+
+#ifdef SP2_SELECTOR_EPOLL
+    data->events.resize(std::max(size_t(16), std::min(data->entries.size(), size_t(1024))));
+    int count = ::epoll_wait(data->epoll_handle, data->events.data(), data->events.size(), timeout_ms);
+    for(int n=0; n<count; n++)
+    {
+        auto it = data->entries.find(data->events[n].data.fd);
+        if (it == data->entries.end())
+            continue;
+        //Errors and hangups are reported as readable, so the following read notices them.
+        it->second.readable = data->events[n].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+        it->second.writable = data->events[n].events & EPOLLOUT;
+        data->ready.push_back(it->second.socket);
+    }
+#else
 #ifdef _WIN32
     WSAPoll(data->fds.data(), data->fds.size(), timeout_ms);
 #else
     poll(data->fds.data(), data->fds.size(), timeout_ms);
+#endif
+    for(const auto& pfd : data->fds)
+    {
+        //Sockets that closed themselves are invalid till they are removed.
+        if (!pfd.revents || (pfd.revents & POLLNVAL))
+            continue;
+        auto it = data->entries.find(int(pfd.fd));
+        if (it == data->entries.end())
+            continue;
+        it->second.readable = pfd.revents & (POLLIN | POLLERR | POLLHUP);
+        it->second.writable = pfd.revents & POLLOUT;
+        data->ready.push_back(it->second.socket);
+    }
 #endif
 }
 
+const std::vector<SocketBase*>& Selector::getReady() const
+{
+    return data->ready;
+}
+
 bool Selector::isReady(SocketBase& socket)
 {
-    for(const auto& pfd : data->fds)
-    {
-        if (int(pfd.fd) == socket.handle)
-            return pfd.revents & POLLIN;
-    }
-    return false;
+    auto it = data->entries.find(socket.handle);
+    return it != data->entries.end() && it->second.readable;
+}
+
+bool Selector::isWritable(SocketBase& socket)
+{
+    auto it = data->entries.find(socket.handle);
+    return it != data->entries.end() && it->second.writable;
 }
 
 }//namespace network
@@ -1,6 +1,8 @@
 #include <sp2/io/network/tcpSocket.h>
 #include <sp2/logging.h>
 
+#include <algorithm>
+
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -8,8 +10,13 @@ static constexpr int flags = 0;
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <string.h>
 static constexpr int flags = MSG_NOSIGNAL;
@@ -120,6 +127,12 @@ namespace sp {
 namespace io {
 namespace network {
 
+//Shared packets smaller then this are copied into the send buffer, as a copy is cheaper then an extra entry in the send call.
+static constexpr size_t shared_reference_threshold = 1024;
+//Amount of separate pieces of data written with a single send call.
+static constexpr size_t max_send_chunks = 64;
+static constexpr size_t receive_buffer_size = 64 * 1024;
+static constexpr size_t packet_header_size = sizeof(uint32_t);
 
 TcpSocket::TcpSocket()
 : ssl_handle(nullptr)
@@ -143,14 +156,25 @@ TcpSocket& TcpSocket::operator=(TcpSocket&& socket)
     handle = socket.handle;
     ssl_handle = socket.ssl_handle;
     send_queue = std::move(socket.send_queue);
+    send_buffer = std::move(socket.send_buffer);
+    send_batching = socket.send_batching;
     blocking = socket.blocking;
     receive_buffer = std::move(socket.receive_buffer);
-    received_size = socket.received_size;
+    receive_start = socket.receive_start;
+    receive_end = socket.receive_end;
+    large_packet = std::move(socket.large_packet);
+    large_packet_received = socket.large_packet_received;
+    large_packet_pending = socket.large_packet_pending;
+    max_packet_size = socket.max_packet_size;
 
     socket.handle = -1;
     socket.send_queue.clear();
+    socket.send_buffer.clear();
     socket.receive_buffer.clear();
-    socket.received_size = 0;
+    socket.receive_start = 0;
+    socket.receive_end = 0;
+    socket.large_packet.clear();
+    socket.large_packet_pending = false;
     socket.ssl_handle = nullptr;
 
     return *this;
@@ -235,6 +259,11 @@ void TcpSocket::close()
 #endif
         handle = -1;
         send_queue.clear();
+        send_buffer.clear();
+        receive_start = 0;
+        receive_end = 0;
+        large_packet.clear();
+        large_packet_pending = false;
         if (ssl_handle)
             SSL_free(static_cast<SSL*>(ssl_handle));
         ssl_handle = nullptr;
@@ -246,154 +275,323 @@ bool TcpSocket::isConnected()
     return handle != -1;
 }
 
-void TcpSocket::send(const void* data, size_t size)
+void TcpSocket::setNoDelay(bool enabled)
 {
     if (!isConnected())
         return;
-    if (sendSendQueue())
-    {
-        send_queue += std::string(static_cast<const char*>(data), size);
+    int optval = enabled ? 1 : 0;
+    ::setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&optval), sizeof(int));
+}
+
+void TcpSocket::send(const void* data, size_t size)
+{
+    if (!isConnected())
         return;
-    }
+    queueCopy(data, size);
+    if (!send_batching)
+        flush();
+}
 
-    for(size_t done = 0; done < size; )
+void TcpSocket::sendFile(FILE* file, size_t offset, size_t size)
+{
+    if (!isConnected())
+        return;
+    //Data that is queued before the file needs to go out first.
+    if (!send_batching)
+        flush();
+#ifdef __linux__
+    if (!ssl_handle && send_queue.empty())
     {
-        int result;
-        if (ssl_handle)
-            result = SSL_write(static_cast<SSL*>(ssl_handle), static_cast<const char*>(data) + done, size - done);
-        else
-            result = ::send(handle, static_cast<const char*>(data) + done, size - done, flags);
-        if (result < 0)
+        off_t position = offset;
+        while(isConnected() && size > 0)
         {
-            if (!isLastErrorNonBlocking())
+            ssize_t result = ::sendfile(handle, fileno(file), &position, size);
+            send_call_count++;
+            if (result < 0 && !isLastErrorNonBlocking())
+            {
                 close();
-            else
-                send_queue += std::string(static_cast<const char*>(data) + done, size - done);
-            return;
+                return;
+            }
+            //When the socket would block, the rest is queued as normal data below.
+            if (result <= 0)
+                break;
+            size -= result;
         }
-        done += result;
+        offset = position;
+    }
+#endif
+    if (size == 0 || fseek(file, offset, SEEK_SET) != 0)
+        return;
+    while(isConnected() && size > 0)
+    {
+        char buffer[64 * 1024];
+        size_t result = fread(buffer, 1, std::min(size, sizeof(buffer)), file);
+        if (result < 1)
+            break;
+        queueCopy(buffer, result);
+        size -= result;
+        if (!send_batching)
+            flush();
     }
 }
 
 size_t TcpSocket::receive(void* data, size_t size)
 {
-    sendSendQueue();
+    if (!send_batching)
+        flush();
     
     if (!isConnected())
         return 0;
-    
-    int result;
-    if (ssl_handle)
-        result = SSL_read(static_cast<SSL*>(ssl_handle), static_cast<char*>(data), size);
-    else
-        result = ::recv(handle, static_cast<char*>(data), size, flags);
-    if (result < 0)
+
+    //Data that was read ahead for packets goes first.
+    if (receive_start < receive_end)
     {
-        result = 0;
-        if (!isLastErrorNonBlocking())
-            close();
+        size_t result = std::min(size, receive_end - receive_start);
+        memcpy(data, &receive_buffer[receive_start], result);
+        receive_start += result;
+        return result;
     }
-    return result;
+    return readSocket(data, size);
 }
 
 void TcpSocket::send(const io::DataBuffer& buffer)
 {
+    if (!isConnected())
+        return;
+    //The size prefix and data end up after each other in the send buffer, and go out with a single send call.
     io::DataBuffer packet_size(uint32_t(buffer.getDataSize()));
-    send(packet_size.getData(), packet_size.getDataSize());
-    send(buffer.getData(), buffer.getDataSize());
+    queueCopy(packet_size.getData(), packet_size.getDataSize());
+    queueCopy(buffer.getData(), buffer.getDataSize());
+    if (!send_batching)
+        flush();
+}
+
+void TcpSocket::send(const std::shared_ptr<const io::DataBuffer>& buffer)
+{
+    if (!isConnected())
+        return;
+    io::DataBuffer packet_size(uint32_t(buffer->getDataSize()));
+    queueCopy(packet_size.getData(), packet_size.getDataSize());
+    queueShared(buffer);
+    if (!send_batching)
+        flush();
+}
+
+void TcpSocket::sendRaw(const std::shared_ptr<const io::DataBuffer>& buffer)
+{
+    if (!isConnected())
+        return;
+    queueShared(buffer);
+    if (!send_batching)
+        flush();
 }
 
 bool TcpSocket::receive(io::DataBuffer& buffer)
 {
     if (!isConnected())
-        return 0;
-    
-    if (receive_buffer.size() == 0)
+        return false;
+
+    while(true)
     {
-        uint8_t size_buffer[sizeof(uint32_t)];
-        size_t idx = 0;
-        while(idx < sizeof(uint32_t))
+        if (large_packet_pending)
         {
-            //TOFIX: This blocks if we receive less then 4 bytes. Allows denial of service attack.
-            int result;
-            if (ssl_handle)
-                result = SSL_read(static_cast<SSL*>(ssl_handle), reinterpret_cast<char*>(&size_buffer[idx]), sizeof(uint32_t) - idx);
-            else
-                result = ::recv(handle, reinterpret_cast<char*>(&size_buffer[idx]), sizeof(uint32_t) - idx, flags);
-            if (result < 0)
+            if (large_packet_received == large_packet.size())
             {
-                result = 0;
-                if (!isLastErrorNonBlocking())
-                {
-                    close();
-                    return false;
-                }
+                buffer = std::move(large_packet);
+                large_packet = std::vector<uint8_t>();
+                large_packet_pending = false;
+                return true;
             }
-            if (result == 0 && idx == 0)
+            size_t result = readSocket(&large_packet[large_packet_received], large_packet.size() - large_packet_received);
+            if (result < 1)
                 return false;
-            idx += result;
+            large_packet_received += result;
+            continue;
         }
-        uint32_t size = *reinterpret_cast<uint32_t*>(size_buffer);
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        size = __builtin_bswap32(size);
-#endif
-        receive_buffer.resize(size);
-        received_size = 0;
-    }
 
-    while(true)
-    {
-        int result;
-        if (ssl_handle)
-            result = SSL_read(static_cast<SSL*>(ssl_handle), reinterpret_cast<char*>(&receive_buffer[received_size]), receive_buffer.size() - received_size);
-        else
-            result = ::recv(handle, reinterpret_cast<char*>(&receive_buffer[received_size]), receive_buffer.size() - received_size, flags);
-        if (result < 0)
+        size_t available = receive_end - receive_start;
+        size_t needed = packet_header_size;
+        if (available >= packet_header_size)
         {
-            result = 0;
-            if (!isLastErrorNonBlocking())
+            const uint8_t* header = &receive_buffer[receive_start];
+            uint32_t size = uint32_t(header[0]) << 24 | uint32_t(header[1]) << 16 | uint32_t(header[2]) << 8 | uint32_t(header[3]);
+            if (size > max_packet_size)
             {
+                LOG(Warning, "Closing connection, received a packet of", size, "bytes, which is over the limit.");
                 close();
                 return false;
             }
+            if (available >= packet_header_size + size)
+            {
+                const uint8_t* data = header + packet_header_size;
+                buffer = std::vector<uint8_t>(data, data + size);
+                receive_start += packet_header_size + size;
+                return true;
+            }
+            if (packet_header_size + size > receive_buffer_size)
+            {
+                large_packet.resize(size);
+                large_packet_received = available - packet_header_size;
+                memcpy(large_packet.data(), header + packet_header_size, large_packet_received);
+                large_packet_pending = true;
+                receive_start = receive_end = 0;
+                continue;
+            }
+            needed += size;
+        }
+
+        //Not a complete packet yet. Move the partial packet to the front if needed, and receive as much as fits.
+        if (receive_buffer.size() != receive_buffer_size)
+            receive_buffer.resize(receive_buffer_size);
+        if (receive_start == receive_end)
+        {
+            receive_start = receive_end = 0;
         }
-        received_size += result;
-        if (received_size == receive_buffer.size())
+        else if (receive_start + needed > receive_buffer_size || receive_end == receive_buffer_size)
         {
-            buffer = std::move(receive_buffer);
-            received_size = 0;
-            return true;
+            memmove(receive_buffer.data(), &receive_buffer[receive_start], available);
+            receive_start = 0;
+            receive_end = available;
         }
+        size_t result = readSocket(&receive_buffer[receive_end], receive_buffer_size - receive_end);
         if (result < 1)
-            break;
+            return false;
+        receive_end += result;
     }
-    
-    return false;
 }
 
-bool TcpSocket::sendSendQueue()
+size_t TcpSocket::readSocket(void* data, size_t size)
 {
-    if (send_queue.size() < 1)
-        return false;
-    
     int result;
-    do
+    if (ssl_handle)
+        result = SSL_read(static_cast<SSL*>(ssl_handle), static_cast<char*>(data), size);
+    else
+        result = ::recv(handle, static_cast<char*>(data), size, flags);
+    if (result < 0)
+    {
+        if (!isLastErrorNonBlocking())
+            close();
+        return 0;
+    }
+    //A zero size read means the other side closed the connection.
+    if (result == 0 && size > 0)
+        close();
+    return result;
+}
+
+bool TcpSocket::flush()
+{
+    while(isConnected() && !send_queue.empty())
     {
+        int result;
         if (ssl_handle)
-            result = SSL_write(static_cast<SSL*>(ssl_handle), static_cast<const char*>(send_queue.data()), send_queue.size());
+        {
+            //SSL has no scatter/gather write, so write chunk by chunk.
+            const SendChunk& chunk = send_queue.front();
+            const uint8_t* data = chunk.shared ? static_cast<const uint8_t*>(chunk.shared->getData()) : send_buffer.data();
+            result = SSL_write(static_cast<SSL*>(ssl_handle), data + chunk.start, chunk.size);
+        }
         else
-            result = ::send(handle, static_cast<const char*>(send_queue.data()), send_queue.size(), flags);
+        {
+            size_t count = std::min(send_queue.size(), max_send_chunks);
+#ifdef _WIN32
+            WSABUF buffers[max_send_chunks];
+            for(size_t n=0; n<count; n++)
+            {
+                const SendChunk& chunk = send_queue[n];
+                const uint8_t* data = chunk.shared ? static_cast<const uint8_t*>(chunk.shared->getData()) : send_buffer.data();
+                buffers[n].buf = const_cast<char*>(reinterpret_cast<const char*>(data + chunk.start));
+                buffers[n].len = chunk.size;
+            }
+            DWORD sent = 0;
+            result = ::WSASend(handle, buffers, count, &sent, 0, nullptr, nullptr) == 0 ? int(sent) : -1;
+#else
+            struct iovec buffers[max_send_chunks];
+            for(size_t n=0; n<count; n++)
+            {
+                const SendChunk& chunk = send_queue[n];
+                const uint8_t* data = chunk.shared ? static_cast<const uint8_t*>(chunk.shared->getData()) : send_buffer.data();
+                buffers[n].iov_base = const_cast<uint8_t*>(data + chunk.start);
+                buffers[n].iov_len = chunk.size;
+            }
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = buffers;
+            message.msg_iovlen = count;
+            result = ::sendmsg(handle, &message, flags);
+#endif
+        }
+        send_call_count++;
         if (result < 0)
         {
-            result = 0;
             if (!isLastErrorNonBlocking())
                 close();
+            break;
         }
-        if (result > 0)
-            send_queue = send_queue.substr(result);
-    } while(result > 0 && send_queue.size() > 0);
-    
-    return send_queue.size() > 0;
+        if (result == 0)
+            break;
+        consumeSendQueue(result);
+    }
+    return !send_queue.empty();
+}
+
+void TcpSocket::queueCopy(const void* data, size_t size)
+{
+    if (size == 0)
+        return;
+    size_t start = send_buffer.size();
+    send_buffer.insert(send_buffer.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    //Extend the last chunk when it ends where this data starts, so small packets are written as one piece.
+    if (!send_queue.empty() && !send_queue.back().shared && send_queue.back().start + send_queue.back().size == start)
+        send_queue.back().size += size;
+    else
+        send_queue.push_back({nullptr, start, size});
+}
+
+void TcpSocket::queueShared(const std::shared_ptr<const io::DataBuffer>& buffer)
+{
+    if (buffer->getDataSize() < shared_reference_threshold)
+        queueCopy(buffer->getData(), buffer->getDataSize());
+    else
+        send_queue.push_back({buffer, 0, buffer->getDataSize()});
+}
+
+void TcpSocket::consumeSendQueue(size_t size)
+{
+    while(size > 0 && !send_queue.empty())
+    {
+        SendChunk& chunk = send_queue.front();
+        size_t done = std::min(size, chunk.size);
+        chunk.start += done;
+        chunk.size -= done;
+        size -= done;
+        if (chunk.size == 0)
+            send_queue.pop_front();
+    }
+
+    //The send buffer is used as a ring: reset it when everything is send, and move the remaining data to the front when most of it is send.
+    size_t unsent_start = send_buffer.size();
+    for(const auto& chunk : send_queue)
+    {
+        if (!chunk.shared)
+        {
+            unsent_start = chunk.start;
+            break;
+        }
+    }
+    if (unsent_start == send_buffer.size())
+    {
+        send_buffer.clear();
+    }
+    else if (unsent_start > 64 * 1024 && unsent_start > send_buffer.size() / 2)
+    {
+        send_buffer.erase(send_buffer.begin(), send_buffer.begin() + unsent_start);
+        for(auto& chunk : send_queue)
+        {
+            if (!chunk.shared)
+                chunk.start -= unsent_start;
+        }
+    }
 }
 
 }//namespace network
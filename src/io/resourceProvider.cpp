@@ -1,8 +1,10 @@
 #include <sp2/io/resourceProvider.h>
 #include <sp2/io/directoryResourceProvider.h>
 #include <sp2/io/zipResourceProvider.h>
+#include <sp2/io/bufferedResourceStream.h>
 #include <sp2/io/filesystem.h>
 #include <sp2/attributes.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -130,29 +132,52 @@ ResourceProvider::ResourceProvider(int priority)
     });
 }
 
-bool ResourceProvider::searchMatch(const string& name, const string& search_pattern)
+ResourceProvider::SearchPattern::SearchPattern(const string& search_pattern)
+: parts(search_pattern.split("*"))
 {
-    std::vector<string> parts = search_pattern.split("*");
-    int pos = 0;
-    if (parts[0].length() > 0)
-    {
-        if (name.find(parts[0]) != 0)
-            return false;
-    }
-    for(unsigned int n=1; n<parts.size(); n++)
+}
+
+bool ResourceProvider::SearchPattern::match(const string& name) const
+{
+    if (parts.size() == 1)
+        return name == parts[0];
+    if (name.compare(0, parts[0].length(), parts[0]) != 0)
+        return false;
+    size_t pos = parts[0].length();
+    for(unsigned int n=1; n<parts.size() - 1; n++)
     {
-        if (parts[n] == "" && n == parts.size() - 1)
-            return true;
-        int offset = name.find(parts[n], pos);
-        if (offset < 0)
+        size_t offset = name.find(parts[n], pos);
+        if (offset == string::npos)
             return false;
         pos = offset + parts[n].length();
     }
-    return pos == int(name.length());
+    //The last part has to be at the end of the name.
+    const string& last = parts.back();
+    return name.length() >= pos + last.length() && name.compare(name.length() - last.length(), last.length(), last) == 0;
+}
+
+bool ResourceProvider::searchMatch(const string& name, const string& search_pattern)
+{
+    return SearchPattern(search_pattern).match(name);
 }
 
 string ResourceStream::readLine()
 {
+    const uint8_t* view = getContiguousView();
+    if (view)
+    {
+        int64_t start = tell();
+        int64_t size = getSize();
+        if (start >= size)
+            return "";
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(view + start, '\n', size - start));
+        int64_t length = end ? end - (view + start) : size - start;
+        seek(start + length + (end ? 1 : 0));
+        if (end && length > 0 && view[start + length - 1] == '\r')
+            length--;
+        return string(reinterpret_cast<const char*>(view + start), length);
+    }
+
     string ret;
     char c;
     while(true)
@@ -165,16 +190,23 @@ string ResourceStream::readLine()
                 ret.pop_back();
             return ret;
         }
-        ret += string(c);
+        ret.push_back(c);
     }
 }
 
 string ResourceStream::readAll()
 {
-    unsigned int size = getSize();
+    int64_t start = tell();
+    int64_t size = std::max(int64_t(0), getSize() - start);
+    const uint8_t* view = getContiguousView();
+    if (view)
+    {
+        seek(start + size);
+        return string(reinterpret_cast<const char*>(view + start), size);
+    }
     string result;
     result.resize(size);
-    read(&result[0], size);
+    result.resize(std::max(int64_t(0), read(&result[0], size)));
     return result;
 }
 
@@ -204,6 +236,8 @@ ResourceStreamPtr ResourceProvider::get(string filename)
         ResourceStreamPtr stream = rp->getStream(filename);
         if (stream)
         {
+            if (!stream->getContiguousView())
+                stream = std::make_shared<BufferedResourceStream>(stream);
             for(auto item : flags.split(","))
             {
                 if (!item.empty())
@@ -229,6 +263,16 @@ std::chrono::system_clock::time_point ResourceProvider::getModifyTime(const stri
     return std::chrono::system_clock::time_point();
 }
 
+bool ResourceProvider::notifiesChanges(const string& filename)
+{
+    for(P<ResourceProvider> rp : providers)
+    {
+        if (rp->getResourceModifyTime(filename) != std::chrono::system_clock::time_point())
+            return rp->notifiesResourceChanges(filename);
+    }
+    return false;
+}
+
 std::vector<string> ResourceProvider::find(const string& search_pattern)
 {
     std::vector<string> found_files;
@@ -0,0 +1,168 @@
+#include <sp2/io/resourceWatcher.h>
+#include <sp2/io/resourceProvider.h>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace sp {
+namespace io {
+
+class ResourceWatcherState
+{
+public:
+    class Watch
+    {
+    public:
+        string resource_name;
+        std::function<void()> callback;
+    };
+
+    std::mutex mutex;
+    std::map<int, Watch> watches;
+    std::unordered_multimap<string, int> watches_per_resource;
+    //Time of the last change of each resource that changed, till its callbacks are called.
+    std::unordered_map<string, std::chrono::steady_clock::time_point> changes;
+    std::chrono::milliseconds coalesce_delay{100};
+    //Last seen modify time of watched resources of which the provider does not report changes.
+    std::unordered_map<string, std::chrono::system_clock::time_point> poll_times;
+    std::chrono::milliseconds poll_interval{1000};
+    std::chrono::steady_clock::time_point next_poll;
+    int next_id = 1;
+};
+//Created on first use, as resources can be watched from global constructors.
+static ResourceWatcherState& getState()
+{
+    static ResourceWatcherState* state = new ResourceWatcherState();
+    return *state;
+}
+
+int ResourceWatcher::watch(const string& resource_name, std::function<void()> callback)
+{
+    ResourceWatcherState& state = getState();
+    string name = resource_name;
+    if (name.find("#") > -1)
+        name = name.substr(0, name.find("#"));
+    std::lock_guard<std::mutex> lock(state.mutex);
+    int id = state.next_id++;
+    state.watches[id] = {name, callback};
+    state.watches_per_resource.emplace(name, id);
+    return id;
+}
+
+void ResourceWatcher::unwatch(int id)
+{
+    ResourceWatcherState& state = getState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto it = state.watches.find(id);
+    if (it == state.watches.end())
+        return;
+    auto range = state.watches_per_resource.equal_range(it->second.resource_name);
+    for(auto r = range.first; r != range.second; ++r)
+    {
+        if (r->second == id)
+        {
+            state.watches_per_resource.erase(r);
+            break;
+        }
+    }
+    state.watches.erase(it);
+}
+
+void ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds delay)
+{
+    ResourceWatcherState& state = getState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.coalesce_delay = delay;
+}
+
+void ResourceWatcher::setPollInterval(std::chrono::milliseconds interval)
+{
+    ResourceWatcherState& state = getState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.poll_interval = interval;
+    state.next_poll = std::chrono::steady_clock::now();
+}
+
+void ResourceWatcher::notify(const string& resource_name)
+{
+    ResourceWatcherState& state = getState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.watches_per_resource.find(resource_name) == state.watches_per_resource.end())
+        return;
+    state.changes[resource_name] = std::chrono::steady_clock::now();
+}
+
+static void poll(ResourceWatcherState& state)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<string> names;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (now < state.next_poll)
+            return;
+        state.next_poll = now + state.poll_interval;
+        //Equal names are next to each other in the multimap.
+        for(auto& it : state.watches_per_resource)
+        {
+            if (names.empty() || names.back() != it.first)
+                names.push_back(it.first);
+        }
+    }
+    //Providers are asked without the lock, as they can call notify while holding their own locks.
+    std::unordered_map<string, std::chrono::system_clock::time_point> poll_times;
+    for(auto& name : names)
+    {
+        if (!ResourceProvider::notifiesChanges(name))
+            poll_times[name] = ResourceProvider::getModifyTime(name);
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for(auto& it : poll_times)
+    {
+        auto previous = state.poll_times.find(it.first);
+        if (previous != state.poll_times.end() && previous->second != it.second && state.watches_per_resource.find(it.first) != state.watches_per_resource.end())
+            state.changes[it.first] = now;
+    }
+    state.poll_times = std::move(poll_times);
+}
+
+void ResourceWatcher::update()
+{
+    ResourceWatcherState& state = getState();
+    poll(state);
+    std::vector<int> ids;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.changes.empty())
+            return;
+        auto done_before = std::chrono::steady_clock::now() - state.coalesce_delay;
+        for(auto it = state.changes.begin(); it != state.changes.end(); )
+        {
+            if (it->second > done_before)
+            {
+                ++it;
+                continue;
+            }
+            auto range = state.watches_per_resource.equal_range(it->first);
+            for(auto r = range.first; r != range.second; ++r)
+                ids.push_back(r->second);
+            it = state.changes.erase(it);
+        }
+    }
+    //Callbacks can watch and unwatch, so look each one up again right before calling it.
+    for(int id : ids)
+    {
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            auto it = state.watches.find(id);
+            if (it == state.watches.end())
+                continue;
+            callback = it->second.callback;
+        }
+        callback();
+    }
+}
+
+}//namespace io
+}//namespace sp
@@ -5,6 +5,15 @@
 #include <string.h>
 #include "miniz.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 namespace sp {
 namespace io {
@@ -58,37 +67,113 @@ struct ZipLocalHeader
 } SP2_PACKED;
 static_assert(sizeof(ZipLocalHeader) == 30, "");
 
-class ZipStoredResourceStream : public ResourceStream
+class ZipMapping : NonCopyable
 {
-private:
-    FILE* f;
-    uint64_t offset;
-    uint64_t size;
+public:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
 
-    uint64_t current_offset;
+    ~ZipMapping()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_handle)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+#else
+        if (data)
+            munmap(const_cast<uint8_t*>(data), size);
+#endif
+    }
 
-public:
-    ZipStoredResourceStream(const string& zip_filename, uint64_t offset, uint64_t size)
-    : offset(offset), size(size), current_offset(0)
+    bool open(const string& filename)
     {
-        f = fopen(zip_filename.c_str(), "rb");
-        fseek(f, offset, SEEK_SET);
+#ifdef _WIN32
+        file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+            return false;
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_handle)
+            return false;
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (!data)
+            return false;
+        size = file_size.QuadPart;
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat s;
+        if (fstat(fd, &s) < 0 || s.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        //The mapping stays valid after closing the file.
+        ::close(fd);
+        if (ptr == MAP_FAILED)
+            return false;
+        data = static_cast<const uint8_t*>(ptr);
+        size = s.st_size;
+#endif
+        return true;
     }
-    ~ZipStoredResourceStream()
+
+    //Copy a header from the mapping, returns false if it does not fit in the file.
+    template<typename T> bool read(uint64_t offset, T& result) const
     {
-        if (f)
-            fclose(f);
+        if (offset + sizeof(T) > size)
+            return false;
+        memcpy(&result, data + offset, sizeof(T));
+        return true;
     }
 
-    virtual int64_t read(void* data, int64_t size) override
+    //Tell the OS which part of the file is going to be read in order, so it reads ahead further.
+    void adviseSequential(uint64_t offset, uint64_t length) const
+    {
+#if !defined(_WIN32) && defined(POSIX_MADV_SEQUENTIAL)
+        uint64_t page_size = sysconf(_SC_PAGESIZE);
+        uint64_t start = offset - offset % page_size;
+        posix_madvise(const_cast<uint8_t*>(data + start), offset + length - start, POSIX_MADV_SEQUENTIAL);
+#endif
+    }
+private:
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+#endif
+};
+
+//Stream over memory that is kept alive by the owner, used for stored files in the mapping and for cached files.
+class ZipMemoryResourceStream : public ResourceStream
+{
+private:
+    std::shared_ptr<const void> owner;
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t current_offset = 0;
+
+public:
+    ZipMemoryResourceStream(std::shared_ptr<const void> owner, const uint8_t* data, uint64_t size)
+    : owner(owner), data(data), size(size)
     {
+    }
+
+    virtual int64_t read(void* buffer, int64_t size) override
+    {
+        if (size < 0)
+            return 0;
         if (current_offset + size > this->size)
             size = this->size - current_offset;
-        int64_t result = fread(data, 1, size, f);
-        if (result < 0)
-            result = 0;
-        current_offset += result;
-        return result;
+        memcpy(buffer, data + current_offset, size);
+        current_offset += size;
+        return size;
     }
 
     virtual int64_t seek(int64_t position) override
@@ -97,7 +182,6 @@ public:
             position = 0;
         if (position > int64_t(size))
             position = size;
-        fseek(f, offset + position, SEEK_SET);
         current_offset = position;
         return current_offset;
     }
@@ -111,116 +195,131 @@ public:
     {
         return size;
     }
+
+    virtual const uint8_t* getContiguousView() override
+    {
+        return data;
+    }
 };
 
+//Inflates a file from the mapping. Seeking backwards continues from the nearest checkpoint, instead of inflating from the start.
 class ZipDeflateResourceStream : public ResourceStream
 {
 private:
-    FILE* f;
-    uint64_t offset;
+    //A checkpoint is stored every this many bytes of output, each takes about 43KB.
+    static constexpr uint64_t checkpoint_interval = 4 * 1024 * 1024;
+    static constexpr size_t dict_size = TINFL_LZ_DICT_SIZE;
+
+    class State
+    {
+    public:
+        tinfl_decompressor decompressor;
+        uint8_t dict[dict_size];
+        size_t dict_offset;
+        uint64_t input_offset;
+        //Amount of bytes inflated, the output that is not read yet is at the end of this.
+        uint64_t output_offset;
+        bool done;
+    };
+
+    std::shared_ptr<ZipMapping> mapping;
+    const uint8_t* input;
+    uint64_t input_size;
     uint64_t uncompressed_size;
 
-    mz_stream stream;
-    uint8_t input_buffer[16 * 1024];
-    uint8_t output_buffer[16 * 1024];
-    int64_t uncompressed_offset;
-public:
-    ZipDeflateResourceStream(const string& zip_filename, uint64_t offset, uint64_t uncompressed_size)
-    : offset(offset), uncompressed_size(uncompressed_size)
+    State state;
+    //Inflated data in the dictionary that is not read yet.
+    size_t pending_start = 0;
+    size_t pending_size = 0;
+    std::vector<std::unique_ptr<State>> checkpoints;
+
+    void reset()
+    {
+        tinfl_init(&state.decompressor);
+        state.dict_offset = 0;
+        state.input_offset = 0;
+        state.output_offset = 0;
+        state.done = false;
+        pending_start = 0;
+        pending_size = 0;
+    }
+
+    //Inflate the next part into the dictionary. Returns false at the end of the data or on an error.
+    bool inflateMore()
     {
-        f = fopen(zip_filename.c_str(), "rb");
-        fseek(f, offset, SEEK_SET);
-        
-        stream.zalloc = NULL;
-        stream.zfree = NULL;
-        stream.opaque = NULL;
-        stream.avail_in = 0;
-        stream.next_in = NULL;
-        mz_inflateInit2(&stream, -15);
-        
-        stream.avail_out = sizeof(output_buffer);
-        stream.next_out = output_buffer;
-        
-        uncompressed_offset = 0;
+        if (state.done)
+            return false;
+        if (state.output_offset == (checkpoints.size() + 1) * checkpoint_interval)
+            checkpoints.emplace_back(new State(state));
+
+        size_t in_size = input_size - state.input_offset;
+        size_t out_size = dict_size - state.dict_offset;
+        //Stop at the next checkpoint, so the state there can be stored.
+        uint64_t next_checkpoint = (state.output_offset / checkpoint_interval + 1) * checkpoint_interval;
+        if (next_checkpoint - state.output_offset < out_size)
+            out_size = next_checkpoint - state.output_offset;
+        tinfl_status status = tinfl_decompress(&state.decompressor, input + state.input_offset, &in_size, state.dict, state.dict + state.dict_offset, &out_size, 0);
+        state.input_offset += in_size;
+        pending_start = state.dict_offset;
+        pending_size = out_size;
+        state.dict_offset = (state.dict_offset + out_size) & (dict_size - 1);
+        state.output_offset += out_size;
+        if (status != TINFL_STATUS_HAS_MORE_OUTPUT)
+            state.done = true;
+        return out_size > 0;
     }
-    virtual ~ZipDeflateResourceStream()
+
+public:
+    ZipDeflateResourceStream(std::shared_ptr<ZipMapping> mapping, uint64_t offset, uint64_t compressed_size, uint64_t uncompressed_size)
+    : mapping(mapping), input(mapping->data + offset), input_size(compressed_size), uncompressed_size(uncompressed_size)
     {
-        mz_inflateEnd(&stream);
-        if (f)
-            fclose(f);
+        reset();
     }
-    
+
     virtual int64_t read(void* data, int64_t size) override
     {
-        int available = stream.next_out - output_buffer;
-        int copy = std::min(int(size), available);
-        if (copy)
+        int64_t result = 0;
+        while(size > 0)
         {
-            uncompressed_offset += copy;
-            if (data)
-                memcpy(data, output_buffer, copy);
-            stream.avail_out += copy;
-            memmove(output_buffer, output_buffer + copy, available - copy);
-            stream.next_out -= copy;
-            if (copy == size)
-                return size;
+            if (pending_size == 0 && !inflateMore())
+                break;
+            size_t copy = std::min(uint64_t(size), uint64_t(pending_size));
             if (data)
-                data = static_cast<uint8_t*>(data) + copy;
+                memcpy(static_cast<uint8_t*>(data) + result, state.dict + pending_start, copy);
+            pending_start += copy;
+            pending_size -= copy;
             size -= copy;
+            result += copy;
         }
-        //Not enough data in output_buffer, inflate some more data.
-        if (stream.avail_in == 0)
-        {
-            stream.avail_in = fread(input_buffer, 1, sizeof(input_buffer), f);
-            if (stream.avail_in <= 0)
-            {
-                stream.avail_in = 0;
-                return copy;
-            }
-            stream.next_in = input_buffer;
-        }
-        int result = mz_inflate(&stream, MZ_NO_FLUSH);
-        if ( (result != MZ_OK && result != MZ_STREAM_END) || (stream.next_out == output_buffer) )
-        {
-            //Stream decode error, no data available while we expect it.
-            return copy;
-        }
-        return copy + read(data, size);
+        return result;
     }
 
     virtual int64_t seek(int64_t position) override
     {
-        if (position > uncompressed_offset)
+        position = std::max(int64_t(0), std::min(position, int64_t(uncompressed_size)));
+        int64_t current = tell();
+        if (position == current)
+            return current;
+        //Continue from the last checkpoint before the position, if it is further then where we are now, or when seeking backwards.
+        size_t index = position / checkpoint_interval;
+        if (index > 0 && index <= checkpoints.size() && (position < current || int64_t(checkpoints[index - 1]->output_offset) > current))
         {
-            //Seeking forwards, just read data into nothing to get there.
-            read(nullptr, position - uncompressed_offset);
+            state = *checkpoints[index - 1];
+            pending_size = 0;
         }
-        else if (position < uncompressed_offset)
+        else if (position < current)
         {
-            //When we seek backwards, the only thing we can do is restart from the beginning.
-            mz_inflateEnd(&stream);
-
-            fseek(f, offset, SEEK_SET);
-            stream.zalloc = NULL;
-            stream.zfree = NULL;
-            stream.opaque = NULL;
-            stream.avail_in = 0;
-            stream.next_in = NULL;
-            mz_inflateInit2(&stream, -15);
-        
-            stream.avail_out = sizeof(output_buffer);
-            stream.next_out = output_buffer;
-            uncompressed_offset = 0;
-            return seek(position);
+            reset();
         }
+        read(nullptr, position - tell());
         return tell();
     }
-    
+
     virtual int64_t tell() override
     {
-        return uncompressed_offset;
+        return state.output_offset - pending_size;
     }
-    
+
     virtual int64_t getSize() override
     {
         return uncompressed_size;
@@ -231,110 +330,176 @@ public:
 ZipResourceProvider::ZipResourceProvider(const string& zip_filename, int priority)
 : ResourceProvider(priority), zip_filename(zip_filename)
 {
-    FILE* f = fopen(zip_filename.c_str(), "rb");
-    if (!f)
+    mapping = std::make_shared<ZipMapping>();
+    if (!mapping->open(zip_filename))
     {
         LOG(Warning, "Zip file not found:", zip_filename);
+        mapping = nullptr;
         return;
     }
-    fseek(f, -22, SEEK_END);
     ZipEOCD eocd;
-    if (fread(&eocd, 22, 1, f) != 1)
+    if (mapping->size < 22 || !mapping->read(mapping->size - 22, eocd))
     {
-        fclose(f);
         LOG(Warning, "Corrupt zip file, failed to read EOCD:", zip_filename);
+        mapping = nullptr;
         return;
     }
     if (eocd.signature != 0x06054b50 || eocd.disk_nr != 0 || eocd.central_directory_disk != 0 || eocd.central_directory_records_on_this_disk != eocd.central_directory_records_total || eocd.comment_length != 0)
     {
-        fclose(f);
         LOG(Warning, "Corrupt zip file, failed to parse EOCD:", zip_filename, "(zip might contain global comment, which is not supported)");
+        mapping = nullptr;
         return;
     }
 
-    fseek(f, eocd.central_directory_offset, SEEK_SET);
-    while(eocd.central_directory_size > 0)
+    //A zip appended to another file, like the executable of a SP2_SINGLE_EXECUTABLE build, can have offsets relative to the start of the zip.
+    //The central directory is right before the EOCD, so the difference with the stored offset is where the zip starts.
+    uint64_t eocd_position = mapping->size - 22;
+    if (uint64_t(eocd.central_directory_offset) + eocd.central_directory_size > eocd_position)
+    {
+        LOG(Warning, "Corrupt zip file, central directory outside of the zip:", zip_filename);
+        mapping = nullptr;
+        return;
+    }
+    uint64_t base_offset = eocd_position - eocd.central_directory_size - eocd.central_directory_offset;
+    uint64_t position = base_offset + eocd.central_directory_offset;
+    uint64_t end = position + eocd.central_directory_size;
+    contents.reserve(eocd.central_directory_records_total);
+    while(position < end)
     {
         ZipCentralDirectory central_directory;
-        if (fread(&central_directory, 46, 1, f) != 1)
+        if (!mapping->read(position, central_directory))
         {
-            fclose(f);
             LOG(Warning, "Corrupt zip file, failed to read central directory record:", zip_filename);
             contents.clear();
             return;
         }
-        eocd.central_directory_size -= 46;
+        position += 46;
         if (central_directory.signature != 0x02014b50 || central_directory.disk_nr != 0)
         {
-            fclose(f);
             LOG(Warning, "Corrupt zip file, failed to parse central directory record:", zip_filename);
             contents.clear();
             return;
         }
         if (central_directory.method != 0 && central_directory.method != 8)
         {
-            fclose(f);
             LOG(Warning, "Zip file contains compressed files not using STORE or DEFLATE compression. Only STORE or DEFLATE is supported:", zip_filename, "Method:", central_directory.method);
             contents.clear();
             return;
         }
-        eocd.central_directory_size -= central_directory.filename_length;
-        eocd.central_directory_size -= central_directory.extra_field_length;
-        eocd.central_directory_size -= central_directory.comment_length;
-
-        string filename;
-        filename.resize(central_directory.filename_length);
-        if (fread(&filename[0], central_directory.filename_length, 1, f) != 1)
+        if (position + central_directory.filename_length > mapping->size)
         {
-            fclose(f);
             LOG(Warning, "Corrupt zip file, failed to read filename in central directory record:", zip_filename);
             contents.clear();
             return;
         }
+        string filename(reinterpret_cast<const char*>(mapping->data + position), central_directory.filename_length);
+        //Stored files are exposed with the uncompressed size, which is only checked against the zip size as the compressed size.
+        if (central_directory.method == 0 && central_directory.compressed_size != central_directory.uncompressed_size)
+        {
+            LOG(Warning, "Corrupt zip file, stored file with different compressed and uncompressed size:", zip_filename, filename);
+            contents.clear();
+            return;
+        }
 
         //TODO: Read extra field data for ZIP64 support.
-        fseek(f, central_directory.extra_field_length, SEEK_CUR);
-        fseek(f, central_directory.comment_length, SEEK_CUR);
+        position += central_directory.filename_length + central_directory.extra_field_length + central_directory.comment_length;
 
-        contents[filename].method = central_directory.method;
-        contents[filename].offset = central_directory.offset_local_file_header;
-        contents[filename].compressed_size = central_directory.compressed_size;
-        contents[filename].uncompressed_size = central_directory.uncompressed_size;
+        ZipInfo& info = contents[filename];
+        info.method = central_directory.method;
+        info.offset = base_offset + central_directory.offset_local_file_header;
+        info.compressed_size = central_directory.compressed_size;
+        info.uncompressed_size = central_directory.uncompressed_size;
     }
     for(auto& it : contents)
     {
         ZipLocalHeader local_header;
-        fseek(f, it.second.offset, SEEK_SET);
-        if (fread(&local_header, 30, 1, f) != 1)
+        if (!mapping->read(it.second.offset, local_header))
         {
-            fclose(f);
             LOG(Warning, "Corrupt zip file, failed to read local header:", zip_filename, it.first, "@", it.second.offset);
             contents.clear();
             return;
         }
         if (local_header.signature != 0x04034b50)
         {
-            fclose(f);
             LOG(Warning, "Corrupt zip file, failed to parse local header:", zip_filename, it.first, "@", it.second.offset);
             contents.clear();
             return;
         }
         it.second.offset += 30 + local_header.filename_length + local_header.extra_field_length;
+        if (it.second.offset + it.second.compressed_size > mapping->size)
+        {
+            LOG(Warning, "Corrupt zip file, file data outside of the zip:", zip_filename, it.first);
+            contents.clear();
+            return;
+        }
+    }
+}
+
+void ZipResourceProvider::setCacheSize(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_limit = bytes;
+    while(cache_size > cache_limit)
+    {
+        cache_size -= cache.back().data->size();
+        cache_index.erase(cache.back().name);
+        cache.pop_back();
     }
-    fclose(f);
 }
 
 ResourceStreamPtr ZipResourceProvider::getStream(const string& filename)
 {
     auto it = contents.find(filename);
-    if (it != contents.end())
+    if (it == contents.end())
+        return nullptr;
+    const ZipInfo& info = it->second;
+    if (info.method == 0)
+    {
+        mapping->adviseSequential(info.offset, info.uncompressed_size);
+        return std::make_shared<ZipMemoryResourceStream>(mapping, mapping->data + info.offset, info.uncompressed_size);
+    }
+    if (info.uncompressed_size <= max_cached_file_size)
+    {
+        auto data = getCachedFile(filename, info);
+        if (data)
+            return std::make_shared<ZipMemoryResourceStream>(data, data->data(), data->size());
+    }
+    mapping->adviseSequential(info.offset, info.compressed_size);
+    return std::make_shared<ZipDeflateResourceStream>(mapping, info.offset, info.compressed_size, info.uncompressed_size);
+}
+
+std::shared_ptr<const std::vector<uint8_t>> ZipResourceProvider::getCachedFile(const string& filename, const ZipInfo& info)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache_limit == 0)
+        return nullptr;
+    auto it = cache_index.find(filename);
+    if (it != cache_index.end())
     {
-        if (it->second.method == 0)
-            return std::make_shared<ZipStoredResourceStream>(zip_filename, it->second.offset, it->second.uncompressed_size);
-        else
-            return std::make_shared<ZipDeflateResourceStream>(zip_filename, it->second.offset, it->second.uncompressed_size);
+        cache.splice(cache.begin(), cache, it->second);
+        return it->second->data;
     }
-    return nullptr;
+
+    auto data = std::make_shared<std::vector<uint8_t>>(info.uncompressed_size);
+    if (info.uncompressed_size > 0)
+    {
+        size_t result = tinfl_decompress_mem_to_mem(data->data(), data->size(), mapping->data + info.offset, info.compressed_size, 0);
+        if (result != info.uncompressed_size)
+        {
+            LOG(Warning, "Failed to inflate", filename, "from", zip_filename);
+            return nullptr;
+        }
+    }
+    cache.push_front({filename, data});
+    cache_index[filename] = cache.begin();
+    cache_size += data->size();
+    while(cache_size > cache_limit && cache.size() > 1)
+    {
+        cache_size -= cache.back().data->size();
+        cache_index.erase(cache.back().name);
+        cache.pop_back();
+    }
+    return data;
 }
 
 std::chrono::system_clock::time_point ZipResourceProvider::getResourceModifyTime(const string& filename)
@@ -345,6 +510,12 @@ std::chrono::system_clock::time_point ZipResourceProvider::getResourceModifyTime
 std::vector<string> ZipResourceProvider::findResources(const string& search_pattern)
 {
     std::vector<string> found_files;
+    SearchPattern pattern(search_pattern);
+    for(auto& it : contents)
+    {
+        if (pattern.match(it.first))
+            found_files.push_back(it.first);
+    }
     return found_files;
 }
 
@@ -15,22 +15,22 @@ P<Node> Base::getNode(uint64_t id)
     auto it = node_by_id.find(id);
     if (it == node_by_id.end())
         return nullptr;
-    return it->second;
+    return *it->second;
 }
 
 void Base::addNode(P<Node> node)
 {
     sp2assert(node->multiplayer.getId() > 0, "Nodes need to be given an ID before added to a multiplayer node registry.");
-    node_by_id[node->multiplayer.getId()] = node;
+    node_by_id[node->multiplayer.getId()] = node->getHandle();
 }
 
-std::unordered_map<uint64_t, P<Node>>::iterator Base::nodeBegin()
+std::unordered_map<uint64_t, Handle<Node>>::iterator Base::nodeBegin()
 {
     cleanDeletedNodes();
     return node_by_id.begin();
 }
 
-std::unordered_map<uint64_t, P<Node>>::iterator Base::nodeEnd()
+std::unordered_map<uint64_t, Handle<Node>>::iterator Base::nodeEnd()
 {
     return node_by_id.end();
 }
@@ -1,5 +1,6 @@
 #include <sp2/multiplayer/client.h>
 #include <sp2/multiplayer/registry.h>
+#include <sp2/multiplayer/snapshot.h>
 #include <sp2/io/http/request.h>
 #include <sp2/logging.h>
 #include <sp2/assert.h>
@@ -36,6 +37,32 @@ bool Client::connect(const string& hostname, int port_nr)
     return true;
 }
 
+bool Client::connectUdp(const string& hostname, int port_nr)
+{
+    if (state != State::Disconnected)
+        return false;
+
+    LOG(Info, "Multiplayer client connecting with udp:", hostname, port_nr);
+    io::network::Address address(hostname);
+    if (!udp_socket.bind(0))
+        return false;
+    udp_socket.setBlocking(false);
+    //The connection only exists on the server after the connect request with the cookie of the server, see PacketIDs::udp_connect_magic.
+    //After that, the server replies with the authentication request over the connection.
+    udp_send = [this, address, port_nr](const io::DataBuffer& datagram)
+    {
+        udp_socket.send(datagram, address, port_nr);
+    };
+    udp = std::unique_ptr<UdpConnection>(new UdpConnection(udp_send));
+    udp_start_time = std::chrono::steady_clock::now();
+    udp_connected = false;
+    udp_cookie = "";
+    udp_last_connect_request = -1000.0f;
+
+    state = State::Connecting;
+    return true;
+}
+
 bool Client::connectBySwitchboard(const string& hostname, int port_nr, const string& key)
 {
     if (state != State::Disconnected)
@@ -83,8 +110,40 @@ uint32_t Client::getClientId()
 void Client::onUpdate(float delta)
 {
     io::DataBuffer packet;
+    float udp_now = std::chrono::duration<float>(std::chrono::steady_clock::now() - udp_start_time).count();
 
-    while(socket.receive(packet) || websocket.receive(packet))
+    if (udp)
+    {
+        io::network::Address address;
+        int port = 0;
+        while(udp_socket.receive(packet, address, port))
+        {
+            if (!udp_connected)
+            {
+                uint32_t magic = 0;
+                if (packet.available() >= sizeof(magic))
+                    packet.read(magic);
+                if (magic == PacketIDs::udp_connect_magic)
+                {
+                    packet.read(udp_cookie);
+                    udp_last_connect_request = -1000.0f;
+                    continue;
+                }
+            }
+            if (udp->onDatagram(packet.getData(), packet.getDataSize(), udp_now))
+                udp_connected = true;
+        }
+        if (!udp_connected && udp_now - udp_last_connect_request > 0.25f)
+        {
+            io::DataBuffer request(PacketIDs::udp_connect_magic, udp_cookie);
+            while(request.getDataSize() < PacketIDs::udp_connect_request_size)
+                request.write(uint8_t(0));
+            udp_send(request);
+            udp_last_connect_request = udp_now;
+        }
+    }
+
+    while(socket.receive(packet) || websocket.receive(packet) || (udp && udp->receive(packet)))
     {
         uint8_t command_id;
         packet.read(command_id);
@@ -95,9 +154,13 @@ void Client::onUpdate(float delta)
             }break;
         case PacketIDs::set_client_id:{
             if (state == State::Connecting)
-                state = State::Running;
+                state = State::Synchronizing;
             packet.read(client_id);
             }break;
+        case PacketIDs::synchronized:{
+            if (state == State::Synchronizing)
+                state = State::Running;
+            }break;
 
         case PacketIDs::change_game_speed:{
             float new_gamespeed;
@@ -105,49 +168,82 @@ void Client::onUpdate(float delta)
             sp::Engine::getInstance()->setGameSpeed(new_gamespeed);
             }break;
 
-        case PacketIDs::create_object:{
-            uint64_t id = 0;
-            string class_name;
-            uint64_t parent = 0;
-            packet.read(id, class_name, parent);
-            auto it = multiplayer::ClassEntry::name_to_create_mapping.find(class_name);
-            if (it == multiplayer::ClassEntry::name_to_create_mapping.end())
+        case PacketIDs::class_table:{
+            uint64_t count = 0;
+            packet.readVarint(count);
+            class_names.clear();
+            class_create_functions.clear();
+            for(uint64_t n=0; n<count && packet.available() > 0; n++)
             {
-                LOG(Error, "Got class", class_name, "but no way to create it.");
+                string class_name;
+                packet.read(class_name);
+                auto it = multiplayer::ClassEntry::name_to_create_mapping.find(class_name);
+                class_names.push_back(class_name);
+                class_create_functions.push_back(it != multiplayer::ClassEntry::name_to_create_mapping.end() ? it->second : nullptr);
             }
-            else
+            }break;
+
+        case PacketIDs::create_object:{
+            while(packet.available() > 0)
             {
-                P<Node> parent_node = getNode(parent);
-                if (!parent_node)
+                uint64_t id = 0;
+                uint64_t class_id = 0;
+                uint64_t parent = 0;
+                packet.readVarint(id);
+                packet.readVarint(class_id);
+                packet.readVarint(parent);
+                if (class_id >= class_create_functions.size())
+                {
+                    LOG(Error, "Got unknown class id", class_id);
+                }
+                else if (!class_create_functions[class_id])
                 {
-                    LOG(Error, "Cannot find parent to create multiplayer object for", class_name, parent);
+                    LOG(Error, "Got class", class_names[class_id], "but no way to create it.");
                 }
                 else
                 {
-                    P<Node> new_node = it->second(parent_node);
-                    new_node->multiplayer.id = id;
-                    addNode(new_node);
+                    P<Node> parent_node = getNode(parent);
+                    if (!parent_node)
+                    {
+                        LOG(Error, "Cannot find parent to create multiplayer object for", class_names[class_id], parent);
+                    }
+                    else
+                    {
+                        P<Node> new_node = class_create_functions[class_id](parent_node);
+                        new_node->multiplayer.id = id;
+                        addNode(new_node);
+                    }
                 }
             }
             }break;
         case PacketIDs::update_object:{
             uint64_t id = 0;
-            packet.read(id);
+            packet.readVarint(id);
             P<Node> node = getNode(id);
             if (node)
             {
-                uint16_t idx = 0;
-                while(packet.available() >= sizeof(idx))
+                uint64_t idx = 0;
+                while(packet.available() > 0)
                 {
-                    packet.read(idx);
+                    packet.readVarint(idx);
                     if (idx < node->multiplayer.replication_links.size())
                         node->multiplayer.replication_links[idx]->receive(*this, packet);
                 }
             }
             }break;
+        case PacketIDs::snapshot:{
+            SnapshotReader reader(packet);
+            uint64_t id = 0;
+            while(reader.next(id))
+            {
+                P<Node> node = getNode(id);
+                if (node)
+                    reader.apply(*this, node->multiplayer.replication_links);
+            }
+            }break;
         case PacketIDs::delete_object:{
             uint64_t id = 0;
-            packet.read(id);
+            packet.readVarint(id);
             P<Node> node = getNode(id);
             node.destroy();
             }break;
@@ -155,7 +251,8 @@ void Client::onUpdate(float delta)
         case PacketIDs::setup_scene:{
             uint64_t id = 0;
             string scene_name;
-            packet.read(id, scene_name);
+            packet.readVarint(id);
+            packet.read(scene_name);
             sp::P<Scene> scene = Scene::get(scene_name);
             if (scene)
             {
@@ -199,10 +296,14 @@ void Client::onUpdate(float delta)
         it->second->multiplayer.server_prepared_calls.clear();
         it->second->multiplayer.client_prepared_calls.clear();
     }
-    if (!socket.isConnected() && !websocket.isConnected() && !websocket.isConnecting() && state != State::Disconnected)
+    if (udp && udp_connected)
+        udp->update(udp_now);
+    if (!socket.isConnected() && !websocket.isConnected() && !websocket.isConnecting() && (!udp || udp->isTimedOut(udp_now)) && state != State::Disconnected)
     {
         LOG(Info, "Multiplayer client disconnect");
         state = State::Disconnected;
+        udp = nullptr;
+        udp_socket.close();
         for(auto it = nodeBegin(); it != nodeEnd(); ++it)
         {
             if (it->second->getParent())
@@ -217,6 +318,8 @@ void Client::send(const io::DataBuffer& packet)
 {
     socket.send(packet);
     websocket.send(packet);
+    if (udp)
+        udp->send(packet, UdpConnection::Channel::Reliable);
 }
 
 
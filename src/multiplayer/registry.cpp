@@ -1,11 +1,15 @@
 #include <sp2/multiplayer/registry.h>
 
+#include <algorithm>
+
 namespace sp {
 namespace multiplayer {
 
 ClassEntry* ClassEntry::list_start;
 std::unordered_map<std::type_index, string> ClassEntry::type_to_name_mapping;
 std::unordered_map<string, ClassEntry::create_object_function_t> ClassEntry::name_to_create_mapping;
+std::vector<string> ClassEntry::class_names;
+std::unordered_map<std::type_index, uint32_t> ClassEntry::type_to_id_mapping;
    
 ClassEntry::ClassEntry(const string& class_name, std::type_index type_index, create_object_function_t create_function)
 : class_name(class_name), type_index(type_index), create_function(create_function)
@@ -21,6 +25,13 @@ void ClassEntry::fillMappings()
         type_to_name_mapping[ce->type_index] = ce->class_name;
         name_to_create_mapping[ce->class_name] = ce->create_function;
     }
+    class_names.clear();
+    for(auto& it : name_to_create_mapping)
+        class_names.push_back(it.first);
+    std::sort(class_names.begin(), class_names.end());
+    type_to_id_mapping.clear();
+    for(auto& it : type_to_name_mapping)
+        type_to_id_mapping[it.first] = std::lower_bound(class_names.begin(), class_names.end(), it.second) - class_names.begin();
 }
 
 }//namespace multiplayer
@@ -0,0 +1,87 @@
+#include <sp2/multiplayer/relevance.h>
+#include <sp2/scene/node.h>
+#include <sp2/scene/scene.h>
+
+#include <cmath>
+#include <limits>
+#include <cstdlib>
+
+
+namespace sp {
+namespace multiplayer {
+
+PredicateRelevance::PredicateRelevance(std::function<bool(uint32_t client_id, Node& node)> predicate)
+: predicate(predicate)
+{
+}
+
+bool PredicateRelevance::isRelevant(uint32_t client_id, Node& node)
+{
+    return predicate(client_id, node);
+}
+
+void SceneRelevance::setClientScenes(uint32_t client_id, const std::unordered_set<string>& scene_names)
+{
+    client_scenes[client_id] = scene_names;
+}
+
+bool SceneRelevance::isRelevant(uint32_t client_id, Node& node)
+{
+    auto it = client_scenes.find(client_id);
+    if (it == client_scenes.end())
+        return false;
+    return it->second.find(node.getScene()->getName()) != it->second.end();
+}
+
+GridRelevance::GridRelevance(double cell_size, int view_distance)
+: cell_size(cell_size), view_distance(view_distance)
+{
+}
+
+void GridRelevance::setClientNode(uint32_t client_id, P<Node> node)
+{
+    clients[client_id].node = node;
+}
+
+void GridRelevance::update()
+{
+    for(auto& it : clients)
+    {
+        if (it.second.node)
+            it.second.cell = toCell(it.second.node->getGlobalPosition3D());
+    }
+}
+
+bool GridRelevance::isRelevant(uint32_t client_id, Node& node)
+{
+    auto it = clients.find(client_id);
+    if (it == clients.end() || !it->second.node)
+        return true;
+    const ClientView& view = it->second;
+    if (*view.node == &node || view.node->getScene() != node.getScene())
+        return true;
+    Vector3i cell = toCell(node.getGlobalPosition3D());
+    return std::abs(cell.x - view.cell.x) <= view_distance
+        && std::abs(cell.y - view.cell.y) <= view_distance
+        && std::abs(cell.z - view.cell.z) <= view_distance;
+}
+
+double GridRelevance::getPriority(uint32_t client_id, Node& node)
+{
+    auto it = clients.find(client_id);
+    if (it == clients.end() || !it->second.node)
+        return 0.0;
+    P<Node> client_node = it->second.node;
+    //Nodes of other scenes come after all the nodes around the client node.
+    if (client_node->getScene() != node.getScene())
+        return std::numeric_limits<double>::max();
+    return (node.getGlobalPosition3D() - client_node->getGlobalPosition3D()).length();
+}
+
+Vector3i GridRelevance::toCell(const Vector3d& position) const
+{
+    return Vector3i(std::floor(position.x / cell_size), std::floor(position.y / cell_size), std::floor(position.z / cell_size));
+}
+
+}//namespace multiplayer
+}//namespace sp
@@ -1,10 +1,15 @@
 #include <sp2/multiplayer/replication.h>
 #include <sp2/scene/node.h>
 
+#include <algorithm>
+#include <cmath>
+
 
 namespace sp {
 namespace multiplayer {
 
+static constexpr double sqrt2 = 1.4142135623730951;
+
 ReplicationDeadReckoning::ReplicationDeadReckoning(Node& node, const DeadReckoningConfig& config)
 : node(node), config(config)
 {
@@ -64,9 +69,64 @@ void ReplicationDeadReckoning::receive(Base& registry, io::DataBuffer& packet)
     packet.read(pos.x, pos.y, pos.z, velocity.x, velocity.y, velocity.z);
     packet.read(rotation.x, rotation.y, rotation.z, rotation.w);
     packet.read(angular_velocity.x, angular_velocity.y, angular_velocity.z);
-    
-    pos += velocity * double(registry.getNetworkDelay());
-    node.setPosition(pos);
+    apply(registry, pos, velocity, rotation, angular_velocity);
+}
+
+void ReplicationDeadReckoning::sendSnapshot(Base& registry, io::DataBuffer& packet)
+{
+    Vector3f pos(node.getPosition3D());
+    Vector3f velocity(node.getLinearVelocity3D());
+    Vector3f angular_velocity(node.getAngularVelocity3D());
+    packet.write(pos, velocity, angular_velocity);
+
+    //Smallest three encoding: The largest component is left out and calculated from the other three on the receiving side.
+    //As q and -q are the same rotation, the sign is flipped to make the largest component positive.
+    Quaterniond rotation = node.getRotation3D();
+    double c[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+    int largest = 0;
+    for(int n=1; n<4; n++)
+        if (std::abs(c[n]) > std::abs(c[largest]))
+            largest = n;
+    double sign = c[largest] < 0.0 ? -1.0 : 1.0;
+    packet.write(uint8_t(largest));
+    for(int n=0; n<4; n++)
+    {
+        if (n == largest)
+            continue;
+        //The other components are always in the range -1/sqrt(2) to 1/sqrt(2)
+        packet.write(int16_t(std::round(std::clamp(c[n] * sign * sqrt2, -1.0, 1.0) * 32767.0)));
+    }
+}
+
+void ReplicationDeadReckoning::receiveSnapshot(Base& registry, io::DataBuffer& packet)
+{
+    Vector3f pos;
+    Vector3f velocity;
+    Vector3f angular_velocity;
+    packet.read(pos, velocity, angular_velocity);
+
+    uint8_t largest = 0;
+    packet.read(largest);
+    largest &= 3;
+    double c[4];
+    double sum = 0.0;
+    for(int n=0; n<4; n++)
+    {
+        if (n == largest)
+            continue;
+        int16_t value = 0;
+        packet.read(value);
+        c[n] = double(value) / 32767.0 / sqrt2;
+        sum += c[n] * c[n];
+    }
+    c[largest] = std::sqrt(std::max(0.0, 1.0 - sum));
+    apply(registry, Vector3d(pos), Vector3d(velocity), Quaterniond(c[0], c[1], c[2], c[3]), Vector3d(angular_velocity));
+}
+
+void ReplicationDeadReckoning::apply(Base& registry, Vector3d position, Vector3d velocity, Quaterniond rotation, Vector3d angular_velocity)
+{
+    position += velocity * double(registry.getNetworkDelay());
+    node.setPosition(position);
     node.setLinearVelocity(velocity);
     node.setRotation(rotation);
     node.setAngularVelocity(angular_velocity);
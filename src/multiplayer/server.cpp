@@ -5,8 +5,10 @@
 #include <sp2/scene/scene.h>
 #include <sp2/engine.h>
 #include <sp2/assert.h>
+#include <sp2/stringutil/sha1.h>
 
 #include <json11/json11.hpp>
+#include <random>
 
 
 namespace sp {
@@ -16,21 +18,35 @@ namespace multiplayer {
 constexpr uint8_t PacketIDs::request_authentication;
 constexpr uint8_t PacketIDs::set_client_id;
 constexpr uint8_t PacketIDs::change_game_speed;
+constexpr uint8_t PacketIDs::class_table;
+constexpr uint8_t PacketIDs::synchronized;
 constexpr uint8_t PacketIDs::create_object;
 constexpr uint8_t PacketIDs::update_object;
 constexpr uint8_t PacketIDs::delete_object;
+constexpr uint8_t PacketIDs::snapshot;
 constexpr uint8_t PacketIDs::setup_scene;
 constexpr uint8_t PacketIDs::call_on_server;
 constexpr uint8_t PacketIDs::call_on_client;
 constexpr uint8_t PacketIDs::alive;
 constexpr uint64_t PacketIDs::magic_sp2_value;
+constexpr uint32_t PacketIDs::udp_connect_magic;
+constexpr size_t PacketIDs::udp_connect_request_size;
+
+//Udp clients that have a valid cookie, but did not authenticate yet.
+static constexpr int max_pending_udp_clients = 16;
+//A cookie is valid for one to two of these periods, in seconds.
+static constexpr float udp_cookie_period = 10.0f;
 
 
 Server::Server(const string& game_name, uint32_t game_version)
-: game_name(game_name), game_version(game_version)
+: game_name(game_name), game_version(game_version), start_time(std::chrono::steady_clock::now())
 {
     next_client_id = 1;
     next_object_id = 1;
+
+    std::random_device random_device;
+    for(int n=0; n<4; n++)
+        udp_cookie_secret += string(uint32_t(random_device()));
 }
 
 Server::~Server()
@@ -49,6 +65,17 @@ bool Server::listen(int port_nr)
     return true;
 }
 
+bool Server::listenUdp(int port_nr)
+{
+    if (!udp_socket.bind(port_nr))
+    {
+        LOG(Error, "Failed to listen on udp port: ", port_nr);
+        return false;
+    }
+    udp_socket.setBlocking(false);
+    return true;
+}
+
 bool Server::listenOnSwitchboard(const string& hostname, int port, const string& server_name, bool list_as_public_server)
 {
     json11::Json::array address;
@@ -118,22 +145,11 @@ void Server::recursiveAddNewNodes(P<Node> node)
     }
 }
 
-void Server::recursiveSendCreate(ClientInfo& client, P<Node> node)
-{
-    if (node->multiplayer.enabled)
-    {
-        io::DataBuffer send_packet;
-        buildCreatePacket(send_packet, node);
-        client.send(send_packet);
-
-        for(P<Node> child : node->getChildren())
-            recursiveSendCreate(client, child);
-    }
-}
-
 void Server::onUpdate(float delta)
 {
     std::chrono::duration<float> now = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now().time_since_epoch());
+    //Time since the start of the server for udp connections, as the time since epoch does not fit a float with enough precision.
+    float udp_now = std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
 
     for(P<Scene> scene : Scene::all())
     {
@@ -142,47 +158,139 @@ void Server::onUpdate(float delta)
 
     //When creating new objects, we first send out packets for all objects to be created.
     //And then we send out variable value updates. This because else we could update a pointer variable to an object that does not exist yet.
+    //Without a relevance policy, all new nodes of this tick go out in a single create packet.
+    io::DataBuffer create_packet;
     for(P<Node> node : new_nodes)
     {
-        io::DataBuffer packet;
-        buildCreatePacket(packet, node);
-        
-        sendToAllConnectedClients(packet);
+        if (relevance_policy)
+        {
+            io::DataBuffer packet;
+            buildCreatePacket(packet, node);
+            for(auto& client : clients)
+            {
+                if (client.state == ClientInfo::State::Connected && isRelevant(client, node))
+                {
+                    client.send(packet);
+                    client.known_nodes.insert(node->multiplayer.getId());
+                }
+            }
+        }
+        else if (node->getParent())
+        {
+            if (create_packet.getDataSize() == 0)
+                create_packet.write(PacketIDs::create_object);
+            writeCreateEntry(create_packet, node);
+        }
+        else
+        {
+            if (create_packet.getDataSize() > 0)
+            {
+                sendToAllConnectedClients(create_packet);
+                create_packet.clear();
+            }
+            io::DataBuffer packet;
+            buildCreatePacket(packet, node);
+            sendToAllConnectedClients(packet);
+        }
+        //Clients that are catching up get the node with the rest of the catch up, once they have its parent.
+        if (node->getParent())
+        {
+            for(auto& client : clients)
+            {
+                if (client.state == ClientInfo::State::CatchingUp && client.known_nodes.find(node->getParent()->multiplayer.getId()) != client.known_nodes.end())
+                    queueCatchUp(client, node);
+            }
+        }
         
         addNode(node);
     }
+    if (create_packet.getDataSize() > 0)
+        sendToAllConnectedClients(create_packet);
+    //In snapshot mode, the initial state of new objects and the changes of all objects are collected in a single frame.
+    snapshot_writer.begin(PacketIDs::snapshot);
     for(P<Node> node : new_nodes)
     {
         if (node->multiplayer.replication_links.size() > 0)
         {
-            io::DataBuffer packet(PacketIDs::update_object, node->multiplayer.getId());
+            if (snapshot_replication)
+            {
+                snapshot_writer.addInitial(*this, node->multiplayer.getId(), node->multiplayer.replication_links);
+                continue;
+            }
+            io::DataBuffer packet(PacketIDs::update_object);
+            packet.writeVarint(node->multiplayer.getId());
             for(unsigned int n=0; n<node->multiplayer.replication_links.size(); n++)
             {
                 ReplicationLinkBase* replication_link = node->multiplayer.replication_links[n];
-                packet.write(uint16_t(n));
+                packet.writeVarint(n);
                 replication_link->initialSend(*this, packet);
             }
-            sendToAllConnectedClients(packet);
+            sendToRelevantClients(node->multiplayer.getId(), packet);
         }
     }
     new_nodes.clear();
+    updateRelevance();
+    for(auto& client : clients)
+    {
+        if (client.state == ClientInfo::State::CatchingUp)
+            sendCatchUp(client);
+    }
     
+    if (snapshot_replication)
+    {
+        for(auto it = nodeBegin(); it != nodeEnd(); ++it)
+            snapshot_writer.addChanged(*this, it->first, it->second->multiplayer.replication_links, delta);
+        for(auto& client : clients)
+        {
+            if (client.state != ClientInfo::State::WaitingForAuthentication && client.udp)
+                resendLostFrames(client);
+        }
+        //Send the frame before the calls, so calls on clients see the members of this tick, same as with a packet per object.
+        if (snapshot_writer.getEntryCount() > 0)
+        {
+            std::shared_ptr<std::vector<uint64_t>> frame_ids;
+            if (!udp_clients.empty())
+            {
+                frame_ids = std::make_shared<std::vector<uint64_t>>();
+                snapshot_writer.getEntryIds(*frame_ids);
+            }
+            std::shared_ptr<io::DataBuffer> frame;
+            if (!relevance_policy)
+            {
+                frame = std::make_shared<io::DataBuffer>();
+                frame->write(snapshot_writer.getPacket());
+            }
+            for(auto& client : clients)
+            {
+                if (client.state == ClientInfo::State::WaitingForAuthentication)
+                    continue;
+                if (!relevance_policy && client.state == ClientInfo::State::Connected)
+                    sendSnapshotFrame(client, frame, frame_ids);
+                else if (snapshot_writer.buildFiltered(client_frame, client.known_nodes))
+                    sendSnapshotFrame(client, std::make_shared<io::DataBuffer>(std::move(client_frame)), frame_ids);
+            }
+        }
+    }
     for(auto it = nodeBegin(); it != nodeEnd(); ++it)
     {
-        io::DataBuffer packet;
-        packet.write(PacketIDs::update_object, it->second->multiplayer.getId());
-        unsigned int zero_data_size = packet.getDataSize();
-        for(unsigned int n=0; n<it->second->multiplayer.replication_links.size(); n++)
+        if (!snapshot_replication)
         {
-            ReplicationLinkBase* replication_link = it->second->multiplayer.replication_links[n];
-            if (replication_link->isChanged(delta))
+            io::DataBuffer packet;
+            packet.write(PacketIDs::update_object);
+            packet.writeVarint(it->second->multiplayer.getId());
+            unsigned int zero_data_size = packet.getDataSize();
+            for(unsigned int n=0; n<it->second->multiplayer.replication_links.size(); n++)
             {
-                packet.write(uint16_t(n));
-                replication_link->send(*this, packet);
+                ReplicationLinkBase* replication_link = it->second->multiplayer.replication_links[n];
+                if (replication_link->isChanged(delta))
+                {
+                    packet.writeVarint(n);
+                    replication_link->send(*this, packet);
+                }
             }
+            if (packet.getDataSize() != zero_data_size)
+                sendToRelevantClients(it->first, packet);
         }
-        if (packet.getDataSize() != zero_data_size)
-            sendToAllConnectedClients(packet);
 
         for(auto& prepared_call : it->second->multiplayer.server_prepared_calls)
         {
@@ -194,7 +302,7 @@ void Server::onUpdate(float delta)
         for(auto& prepared_call : it->second->multiplayer.client_prepared_calls)
         {
             io::DataBuffer send_packet(PacketIDs::call_on_client, it->first, prepared_call);
-            sendToAllConnectedClients(send_packet);
+            sendToRelevantClients(it->first, send_packet);
         }
         it->second->multiplayer.client_prepared_calls.clear();
     }
@@ -205,6 +313,8 @@ void Server::onUpdate(float delta)
     {
         LOG(Info, "Accepted new connection on server");
         new_connection_socket.setBlocking(false);
+        //Packets are collected during the tick, and written with a single call at the end of the tick.
+        new_connection_socket.setSendBatching(true);
 
         clients.emplace_back();
         ClientInfo& client = clients.back();
@@ -217,6 +327,8 @@ void Server::onUpdate(float delta)
         client.send(packet);
     }
     
+    receiveUdp(udp_now);
+    
     if (switchboard_connection.isConnecting() || switchboard_connection.isConnected())
     {
         string msg;
@@ -249,7 +361,7 @@ void Server::onUpdate(float delta)
     for(auto client = clients.begin(); client != clients.end(); )
     {
         io::DataBuffer packet;
-        while(client->socket.receive(packet) || client->websocket.receive(packet))
+        while(client->receive(packet))
         {
             uint8_t packet_id = 0;
             packet.read(packet_id);
@@ -286,26 +398,26 @@ void Server::onUpdate(float delta)
                             client->send(client_id_packet);
                             io::DataBuffer gamespeed_packet(PacketIDs::change_game_speed, Engine::getInstance()->getGameSpeed());
                             client->send(gamespeed_packet);
+                            io::DataBuffer class_table_packet(PacketIDs::class_table);
+                            class_table_packet.writeVarint(ClassEntry::class_names.size());
+                            for(const string& name : ClassEntry::class_names)
+                                class_table_packet.write(name);
+                            client->send(class_table_packet);
 
+                            //The scenes are linked directly, the nodes in them are send over the next ticks, see sendCatchUp.
                             for(P<Scene> scene : Scene::all())
                             {
-                                recursiveSendCreate(*client, scene->getRoot());
-                            }
-                            for(auto it = nodeBegin(); it != nodeEnd(); ++it)
-                            {
-                                if (it->second->multiplayer.replication_links.size() > 0)
-                                {
-                                    io::DataBuffer send_packet(PacketIDs::update_object, it->first);
-                                    for(unsigned int n=0; n<it->second->multiplayer.replication_links.size(); n++)
-                                    {
-                                        ReplicationLinkBase* replication_link = it->second->multiplayer.replication_links[n];
-                                        send_packet.write(uint16_t(n));
-                                        replication_link->send(*this, send_packet);
-                                    }
-                                    client->send(send_packet);
-                                }
+                                P<Node> root = scene->getRoot();
+                                if (!root->multiplayer.enabled || root->multiplayer.getId() == 0)
+                                    continue;
+                                io::DataBuffer scene_packet;
+                                buildCreatePacket(scene_packet, root);
+                                client->send(scene_packet);
+                                client->known_nodes.insert(root->multiplayer.getId());
+                                for(P<Node> child : root->getChildren())
+                                    queueCatchUp(*client, child);
                             }
-                            client->state = ClientInfo::State::Connected;
+                            client->state = ClientInfo::State::CatchingUp;
                         }
                     }
                     break;
@@ -347,9 +459,11 @@ void Server::onUpdate(float delta)
                 break;
             }
         }
-        if (!client->socket.isConnected() && !client->websocket.isConnected())
+        if (!client->socket.isConnected() && !client->websocket.isConnected() && (!client->udp || client->udp->isTimedOut(udp_now)))
         {
             LOG(Info, "Client connection closed on server");
+            if (!client->udp_peer.empty())
+                udp_clients.erase(client->udp_peer);
             client = clients.erase(client);
         }
         else
@@ -369,31 +483,50 @@ void Server::onUpdate(float delta)
             client.send(ping_packet);
         }
     }
+
+    for(auto& client : clients)
+    {
+        client.socket.flush();
+        if (client.udp)
+            client.udp->update(udp_now);
+    }
 }
 
 void Server::buildCreatePacket(io::DataBuffer& packet, P<Node> node)
 {
-    P<Node> parent = node->getParent();
-
-    if (parent)
+    if (node->getParent())
     {
-        auto ptr = *node;
-        auto e = multiplayer::ClassEntry::type_to_name_mapping.find(typeid(*ptr));
-        sp2assert(e != multiplayer::ClassEntry::type_to_name_mapping.end(), (string("No multiplayer class registry for ") + typeid(*ptr).name()).c_str());
-
-        packet.write(PacketIDs::create_object, node->multiplayer.getId(), e->second, parent->multiplayer.getId());
+        packet.write(PacketIDs::create_object);
+        writeCreateEntry(packet, node);
     }
     else
     {
         //This node is the root node of a scene, so setup our scene information.
         P<Scene> scene = node->getScene();
-        packet.write(PacketIDs::setup_scene, node->multiplayer.getId(), scene->getName());
+        packet.write(PacketIDs::setup_scene);
+        packet.writeVarint(node->multiplayer.getId());
+        packet.write(scene->getName());
     }
 }
 
+void Server::writeCreateEntry(io::DataBuffer& packet, P<Node> node)
+{
+    auto ptr = *node;
+    auto e = multiplayer::ClassEntry::type_to_id_mapping.find(typeid(*ptr));
+    sp2assert(e != multiplayer::ClassEntry::type_to_id_mapping.end(), (string("No multiplayer class registry for ") + typeid(*ptr).name()).c_str());
+
+    packet.writeVarint(node->multiplayer.getId());
+    packet.writeVarint(e->second);
+    packet.writeVarint(node->getParent()->multiplayer.getId());
+}
+
 void Server::onDeleted(uint64_t id)
 {
-    sendToAllConnectedClients(io::DataBuffer(PacketIDs::delete_object, id));
+    io::DataBuffer packet(PacketIDs::delete_object);
+    packet.writeVarint(id);
+    sendToRelevantClients(id, packet);
+    for(auto& client : clients)
+        client.known_nodes.erase(id);
 }
 
 void Server::addNewObject(P<Node> node)
@@ -403,13 +536,289 @@ void Server::addNewObject(P<Node> node)
     new_nodes.add(node);
 }
 
+void Server::sendToRelevantClients(uint64_t id, const io::DataBuffer& packet)
+{
+    if (!relevance_policy)
+        sendToAllConnectedClients(packet);
+    for(auto& client : clients)
+    {
+        if (client.state == ClientInfo::State::WaitingForAuthentication || (!relevance_policy && client.state == ClientInfo::State::Connected))
+            continue;
+        if (client.known_nodes.find(id) != client.known_nodes.end())
+            client.send(packet);
+    }
+}
+
+bool Server::isKnown(ClientInfo& client, uint64_t id)
+{
+    if (!relevance_policy && client.state == ClientInfo::State::Connected)
+        return true;
+    return client.known_nodes.find(id) != client.known_nodes.end();
+}
+
+bool Server::isRelevant(ClientInfo& client, P<Node> node)
+{
+    //Scene roots are linked on every client, other nodes need their parent to exist on the client.
+    P<Node> parent = node->getParent();
+    if (!parent)
+        return true;
+    if (client.known_nodes.find(parent->multiplayer.getId()) == client.known_nodes.end())
+        return false;
+    return relevance_policy->isRelevant(client.client_id, **node);
+}
+
+void Server::updateRelevance()
+{
+    if (!relevance_policy)
+        return;
+    relevance_policy->update();
+    relevance_tick++;
+    for(P<Scene> scene : Scene::all())
+    {
+        //Depth first order, so a parent that becomes relevant is created before its children in the same tick.
+        const std::vector<Node*>& nodes = scene->getNodesDepthFirst();
+        for(size_t index=0; index<nodes.size(); index++)
+        {
+            if ((index + relevance_tick) % relevance_interval != 0)
+                continue;
+            P<Node> node = nodes[index];
+            if (!node || !node->multiplayer.enabled || node->multiplayer.getId() == 0 || !node->getParent())
+                continue;
+            for(auto& client : clients)
+            {
+                if (client.state != ClientInfo::State::Connected)
+                    continue;
+                bool known = client.known_nodes.find(node->multiplayer.getId()) != client.known_nodes.end();
+                bool relevant = isRelevant(client, node);
+                if (relevant && !known)
+                {
+                    sendCreateWithState(client, node);
+                }
+                else if (!relevant && known)
+                {
+                    //Deleting a node on the client also deletes all its children.
+                    io::DataBuffer packet(PacketIDs::delete_object);
+                    packet.writeVarint(node->multiplayer.getId());
+                    client.send(packet);
+                    forgetNode(client, node);
+                }
+            }
+        }
+    }
+}
+
+void Server::sendCreateWithState(ClientInfo& client, P<Node> node)
+{
+    io::DataBuffer packet;
+    buildCreatePacket(packet, node);
+    client.send(packet);
+    client.known_nodes.insert(node->multiplayer.getId());
+    if (node->multiplayer.replication_links.size() > 0)
+    {
+        io::DataBuffer state_packet(PacketIDs::update_object);
+        state_packet.writeVarint(node->multiplayer.getId());
+        for(unsigned int n=0; n<node->multiplayer.replication_links.size(); n++)
+        {
+            state_packet.writeVarint(n);
+            node->multiplayer.replication_links[n]->send(*this, state_packet);
+        }
+        client.send(state_packet);
+    }
+}
+
+void Server::queueCatchUp(ClientInfo& client, P<Node> node)
+{
+    //Nodes that did not get an id yet are queued when they are processed as new node.
+    if (!node->multiplayer.enabled || node->multiplayer.getId() == 0)
+        return;
+    double priority = relevance_policy ? relevance_policy->getPriority(client.client_id, **node) : 0.0;
+    client.catch_up_queue.push({priority, client.next_catch_up_order++, node->multiplayer.getId()});
+}
+
+void Server::sendCatchUp(ClientInfo& client)
+{
+    io::DataBuffer create_packet;
+    SnapshotWriter writer;
+    writer.begin(PacketIDs::snapshot);
+    size_t size = 0;
+    while(!client.catch_up_queue.empty() && size < catch_up_budget)
+    {
+        uint64_t id = client.catch_up_queue.top().id;
+        client.catch_up_queue.pop();
+        P<Node> node = getNode(id);
+        if (!node || client.known_nodes.find(id) != client.known_nodes.end())
+            continue;
+        if (relevance_policy && !isRelevant(client, node))
+            continue;
+
+        if (create_packet.getDataSize() == 0)
+            create_packet.write(PacketIDs::create_object);
+        writeCreateEntry(create_packet, node);
+        if (node->multiplayer.replication_links.size() > 0)
+            writer.addFull(*this, id, node->multiplayer.replication_links);
+        client.known_nodes.insert(id);
+        //Children are only queued now, as they cannot be created on the client before their parent.
+        for(P<Node> child : node->getChildren())
+            queueCatchUp(client, child);
+        size = create_packet.getDataSize() + writer.getPacket().getDataSize();
+    }
+    //All creates go out before the state, as the state can refer to other nodes.
+    if (create_packet.getDataSize() > 0)
+        client.send(create_packet);
+    if (writer.getEntryCount() > 0)
+        client.send(writer.getPacket());
+
+    if (client.catch_up_queue.empty())
+    {
+        LOG(Info, "Client", client.client_id, "caught up");
+        client.state = ClientInfo::State::Connected;
+        if (!relevance_policy)
+            client.known_nodes.clear();
+        client.send(io::DataBuffer(PacketIDs::synchronized));
+    }
+}
+
+void Server::forgetNode(ClientInfo& client, P<Node> node)
+{
+    client.known_nodes.erase(node->multiplayer.getId());
+    for(P<Node> child : node->getChildren())
+        forgetNode(client, child);
+}
+
+void Server::sendSnapshotFrame(ClientInfo& client, const std::shared_ptr<const io::DataBuffer>& frame, const std::shared_ptr<const std::vector<uint64_t>>& ids)
+{
+    if (!client.udp)
+    {
+        client.send(frame);
+        return;
+    }
+    uint32_t tag = client.next_frame_tag++;
+    client.udp->send(*frame, UdpConnection::Channel::Unreliable, tag);
+    client.udp_frames.push_back({tag, ids});
+    //Loss is detected well within a second, so older frames do not need to be remembered.
+    while(client.udp_frames.size() > 256)
+        client.udp_frames.pop_front();
+}
+
+void Server::resendLostFrames(ClientInfo& client)
+{
+    std::unordered_set<uint64_t> resend;
+    uint32_t tag;
+    while(client.udp->getLostTag(tag))
+    {
+        for(const auto& frame : client.udp_frames)
+        {
+            if (frame.tag == tag)
+            {
+                resend.insert(frame.ids->begin(), frame.ids->end());
+                break;
+            }
+        }
+    }
+    if (resend.empty())
+        return;
+
+    //The current state replaces all the changes of the lost frame, so there is no need to know which members changed.
+    SnapshotWriter writer;
+    writer.begin(PacketIDs::snapshot);
+    for(uint64_t id : resend)
+    {
+        if (!isKnown(client, id))
+            continue;
+        P<Node> node = getNode(id);
+        if (node)
+            writer.addFull(*this, id, node->multiplayer.replication_links);
+    }
+    if (writer.getEntryCount() > 0)
+    {
+        auto ids = std::make_shared<std::vector<uint64_t>>();
+        writer.getEntryIds(*ids);
+        auto frame = std::make_shared<io::DataBuffer>();
+        frame->write(writer.getPacket());
+        sendSnapshotFrame(client, frame, ids);
+    }
+}
+
+void Server::receiveUdp(float now)
+{
+    io::DataBuffer datagram;
+    io::network::Address address;
+    int port = 0;
+    while(udp_socket.receive(datagram, address, port))
+    {
+        auto human_readable = address.getHumanReadable();
+        if (human_readable.empty())
+            continue;
+        string peer = human_readable.front() + ":" + string(port);
+        auto it = udp_clients.find(peer);
+        if (it != udp_clients.end())
+        {
+            if (it->second->udp)
+                it->second->udp->onDatagram(datagram.getData(), datagram.getDataSize(), now);
+            continue;
+        }
+
+        //Unknown peers only get a reply to a connect request, and only get a client after echoing the cookie of that reply.
+        uint32_t magic = 0;
+        string cookie;
+        if (datagram.getDataSize() < PacketIDs::udp_connect_request_size)
+            continue;
+        datagram.read(magic);
+        if (magic != PacketIDs::udp_connect_magic)
+            continue;
+        datagram.read(cookie);
+        int period = int(now / udp_cookie_period);
+        if (cookie != getUdpCookie(peer, period) && cookie != getUdpCookie(peer, period - 1))
+        {
+            udp_socket.send(io::DataBuffer(PacketIDs::udp_connect_magic, getUdpCookie(peer, period)), address, port);
+            continue;
+        }
+        int pending = 0;
+        for(auto& client : clients)
+        {
+            if (client.udp && client.state == ClientInfo::State::WaitingForAuthentication)
+                pending++;
+        }
+        if (pending >= max_pending_udp_clients)
+        {
+            LOG(Warning, "Too many udp clients waiting for authentication, ignoring connect request from", peer);
+            continue;
+        }
+
+        auto connection = std::unique_ptr<UdpConnection>(new UdpConnection([this, address, port](const io::DataBuffer& data)
+        {
+            udp_socket.send(data, address, port);
+        }));
+        LOG(Info, "Accepted new udp connection on server");
+
+        clients.emplace_back();
+        ClientInfo& client = clients.back();
+        client.udp = std::move(connection);
+        client.udp_peer = peer;
+        client.client_id = next_client_id;
+        client.current_ping_delay = 0.0;
+        next_client_id ++;
+        client.state = ClientInfo::State::WaitingForAuthentication;
+        udp_clients[peer] = &client;
+        io::DataBuffer packet(PacketIDs::request_authentication, PacketIDs::magic_sp2_value);
+        client.send(packet);
+    }
+}
+
+string Server::getUdpCookie(const string& peer, int period)
+{
+    return stringutil::SHA1(udp_cookie_secret + "/" + peer + "/" + string(period)).base64();
+}
+
 void Server::sendToAllConnectedClients(const io::DataBuffer& packet)
 {
+    auto shared = std::make_shared<io::DataBuffer>();
+    shared->write(packet);
     for(auto& client : clients)
     {
         if (client.state != ClientInfo::State::Connected)
             continue;
-        client.send(packet);
+        client.send(shared);
     }
 }
 
@@ -0,0 +1,125 @@
+#include <sp2/multiplayer/snapshot.h>
+
+
+namespace sp {
+namespace multiplayer {
+
+void SnapshotWriter::begin(uint8_t packet_id)
+{
+    packet.clear();
+    packet.write(packet_id);
+    entries.clear();
+}
+
+bool SnapshotWriter::addChanged(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links, float delta)
+{
+    payload.clear();
+    mask.assign((links.size() + 7) / 8, 0);
+    bool changed = false;
+    for(unsigned int n=0; n<links.size(); n++)
+    {
+        if (links[n]->isChanged(delta))
+        {
+            mask[n / 8] |= 1 << (n % 8);
+            links[n]->sendSnapshot(registry, payload);
+            changed = true;
+        }
+    }
+    if (!changed)
+        return false;
+    addEntry(id, false);
+    return true;
+}
+
+void SnapshotWriter::addInitial(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links)
+{
+    payload.clear();
+    mask.assign((links.size() + 7) / 8, 0xff);
+    for(auto link : links)
+        link->initialSend(registry, payload);
+    addEntry(id, true);
+}
+
+void SnapshotWriter::addFull(Base& registry, uint64_t id, const std::vector<ReplicationLinkBase*>& links)
+{
+    payload.clear();
+    mask.assign((links.size() + 7) / 8, 0xff);
+    for(auto link : links)
+        link->send(registry, payload);
+    addEntry(id, true);
+}
+
+void SnapshotWriter::getEntryIds(std::vector<uint64_t>& ids) const
+{
+    ids.clear();
+    for(const auto& entry : entries)
+        ids.push_back(entry.id);
+}
+
+bool SnapshotWriter::buildFiltered(io::DataBuffer& target, const std::unordered_set<uint64_t>& ids) const
+{
+    target.clear();
+    const uint8_t* data = static_cast<const uint8_t*>(packet.getData());
+    target.appendRaw(data, 1);
+    bool any = false;
+    for(const auto& entry : entries)
+    {
+        if (ids.find(entry.id) == ids.end())
+            continue;
+        target.appendRaw(data + entry.start, entry.size);
+        any = true;
+    }
+    return any;
+}
+
+void SnapshotWriter::addEntry(uint64_t id, bool initial)
+{
+    size_t start = packet.getDataSize();
+    packet.writeVarint(id);
+    packet.writeVarint(uint64_t(mask.size() + payload.getDataSize()) << 1 | (initial ? 1 : 0));
+    packet.appendRaw(mask.data(), mask.size());
+    packet.write(payload);
+    entries.push_back({id, start, packet.getDataSize() - start});
+}
+
+SnapshotReader::SnapshotReader(io::DataBuffer& packet)
+: packet(packet), entry_end(packet.available())
+{
+}
+
+bool SnapshotReader::next(uint64_t& id)
+{
+    //Skip whatever is left of the previous entry, also when apply() read too little or nothing at all.
+    if (packet.available() > entry_end)
+        packet.skip(packet.available() - entry_end);
+    if (packet.available() == 0)
+        return false;
+    uint64_t size = 0;
+    packet.readVarint(id);
+    packet.readVarint(size);
+    initial = size & 1;
+    size >>= 1;
+    entry_end = size < packet.available() ? packet.available() - size : 0;
+    return true;
+}
+
+void SnapshotReader::apply(Base& registry, const std::vector<ReplicationLinkBase*>& links)
+{
+    size_t mask_size = (links.size() + 7) / 8;
+    std::vector<uint8_t> mask(mask_size, 0);
+    for(auto& m : mask)
+        packet.read(m);
+    for(unsigned int n=0; n<links.size() && packet.available() > entry_end; n++)
+    {
+        if (!(mask[n / 8] & (1 << (n % 8))))
+            continue;
+        //Full state is written with initialSend or send, which use the normal encoding.
+        if (initial)
+            links[n]->receive(registry, packet);
+        else
+            links[n]->receiveSnapshot(registry, packet);
+    }
+}
+
+}//namespace multiplayer
+}//namespace sp
@@ -0,0 +1,618 @@
+#include <sp2/multiplayer/udpConnection.h>
+#include <sp2/assert.h>
+#include <sp2/logging.h>
+
+#include <algorithm>
+
+
+namespace sp {
+namespace multiplayer {
+
+static constexpr uint16_t datagram_magic = 0x5332;
+static constexpr uint8_t datagram_flag_ack = 0x01;
+static constexpr uint8_t datagram_flag_dropped = 0x02;
+static constexpr uint8_t fragment_flag_reliable = 0x01;
+static constexpr uint8_t fragment_flag_split = 0x02;
+static constexpr size_t max_dropped_per_datagram = 8;
+//Datagram header is magic, sequence, flags, ack, ack bits and dropped ids. A fragment header is at most flags, id, barrier, index, count and size.
+static constexpr size_t datagram_header_size = 2 + 2 + 1 + 2 + 8 + 1 + 2 * max_dropped_per_datagram;
+static constexpr size_t fragment_header_size = 1 + 2 + 2 + 3 + 3 + 3;
+static constexpr size_t fragment_payload_size = UdpConnection::max_datagram_size - datagram_header_size - fragment_header_size;
+static constexpr size_t sent_datagram_history = 1024;
+static constexpr float keepalive_interval = 0.25f;
+static constexpr float min_send_rate = 16 * 1024;
+static constexpr float max_send_rate = 8 * 1024 * 1024;
+static constexpr size_t max_fragment_count = (UdpConnection::max_message_size + fragment_payload_size - 1) / fragment_payload_size;
+//Limits for incomplete messages on the receiving side. The sending side keeps reliable messages within these.
+static constexpr uint16_t reliable_window = 1024;
+static constexpr size_t max_split_assemblies = 16;
+static constexpr size_t max_held_unreliable_size = 4 * UdpConnection::max_message_size;
+
+//Sequence numbers wrap around, a is newer then b if it is less then half the range ahead of b.
+static inline bool isNewer(uint16_t a, uint16_t b)
+{
+    return a != b && uint16_t(a - b) < 0x8000;
+}
+
+static inline uint32_t reliableKey(uint16_t id, uint16_t index)
+{
+    return uint32_t(id) << 16 | index;
+}
+
+constexpr size_t UdpConnection::max_datagram_size;
+constexpr size_t UdpConnection::max_message_size;
+constexpr float UdpConnection::timeout;
+
+UdpConnection::UdpConnection(std::function<void(const io::DataBuffer& datagram)> output)
+: output(output), sent_datagrams(sent_datagram_history), simulate_random(1)
+{
+}
+
+void UdpConnection::send(const io::DataBuffer& message, Channel channel, uint32_t tag)
+{
+    if (channel == Channel::Reliable)
+    {
+        queueFragments(message, true, next_reliable_id++, tag);
+    }
+    else
+    {
+        if (tag)
+        {
+            unreliable_tags.emplace_back(next_unreliable_id, tag);
+            if (unreliable_tags.size() > sent_datagram_history)
+                unreliable_tags.pop_front();
+        }
+        queueFragments(message, false, next_unreliable_id++, tag);
+    }
+}
+
+bool UdpConnection::receive(io::DataBuffer& message)
+{
+    if (received_messages.empty())
+        return false;
+    message = std::move(received_messages.front());
+    received_messages.pop_front();
+    return true;
+}
+
+bool UdpConnection::getLostTag(uint32_t& tag)
+{
+    if (lost_tags.empty())
+        return false;
+    tag = lost_tags.front();
+    lost_tags.pop_front();
+    return true;
+}
+
+void UdpConnection::setSimulation(float loss, float latency, float jitter)
+{
+    simulate_loss = loss;
+    simulate_latency = latency;
+    simulate_jitter = jitter;
+}
+
+bool UdpConnection::onDatagram(const void* data, size_t size, float now)
+{
+    if (closed)
+        return false;
+    io::DataBuffer datagram;
+    datagram = std::vector<uint8_t>(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    if (datagram.available() < 5)
+        return false;
+    uint16_t magic = 0;
+    uint16_t sequence = 0;
+    uint8_t flags = 0;
+    datagram.read(magic, sequence, flags);
+    if (magic != datagram_magic)
+        return false;
+    if (flags & datagram_flag_ack)
+    {
+        if (datagram.available() < 10)
+            return false;
+        uint16_t ack = 0;
+        uint64_t ack_bits = 0;
+        datagram.read(ack, ack_bits);
+        processAck(ack, ack_bits, now);
+    }
+    if (flags & datagram_flag_dropped)
+    {
+        uint8_t count = 0;
+        if (datagram.available() < 1)
+            return false;
+        datagram.read(count);
+        if (count > max_dropped_per_datagram || datagram.available() < size_t(count) * 2)
+            return false;
+        for(int n=0; n<count; n++)
+        {
+            uint16_t id = 0;
+            datagram.read(id);
+            onDropped(id);
+        }
+    }
+
+    //Every valid datagram is acknowledged, even if it contains outdated unreliable fragments.
+    //Those are dropped and reported back separately, as acknowledging the datagram should not be reported as packet loss.
+    while(datagram.available() > 0)
+    {
+        if (!receiveFragment(datagram))
+            return false;
+    }
+    last_receive_time = now;
+
+    if (!received_any)
+    {
+        received_any = true;
+        remote_sequence = sequence;
+        remote_ack_bits = 0;
+    }
+    else if (isNewer(sequence, remote_sequence))
+    {
+        //Bit n of the ack bits is for sequence number remote_sequence - 1 - n.
+        uint16_t shift = sequence - remote_sequence;
+        if (shift < 64)
+            remote_ack_bits = (remote_ack_bits << shift) | (uint64_t(1) << (shift - 1));
+        else if (shift == 64)
+            remote_ack_bits = uint64_t(1) << 63;
+        else
+            remote_ack_bits = 0;
+        remote_sequence = sequence;
+    }
+    else
+    {
+        uint16_t distance = remote_sequence - sequence;
+        if (distance >= 1 && distance <= 64)
+            remote_ack_bits |= uint64_t(1) << (distance - 1);
+    }
+    ack_pending = true;
+    return true;
+}
+
+void UdpConnection::update(float now)
+{
+    if (closed)
+        return;
+    if (last_receive_time < 0.0f)
+        last_receive_time = now;
+    float delta = last_update_time < 0.0f ? 0.0f : std::max(0.0f, now - last_update_time);
+    last_update_time = now;
+
+    //Datagrams that are not acknowledged in time are considered lost.
+    float resend_delay = getResendDelay();
+    for(auto& record : sent_datagrams)
+    {
+        if (record.pending && now - record.send_time > resend_delay)
+            onLost(record, now);
+    }
+
+    //Slowly increase the send rate, by about one datagram per round trip, while there was no recent loss.
+    if (now - last_rate_decrease_time > round_trip_time)
+        send_rate = std::min(max_send_rate, send_rate + max_datagram_size * delta / std::max(round_trip_time, 0.01f));
+    send_budget = std::min(send_budget + send_rate * delta, std::max(send_rate * 0.1f, float(max_datagram_size * 4)));
+
+    while(send_budget > 0.0f && sendDatagram(now, false))
+    {
+    }
+    if (ack_pending || now - last_send_time > keepalive_interval)
+        sendDatagram(now, true);
+
+    for(auto it = delayed_datagrams.begin(); it != delayed_datagrams.end(); )
+    {
+        if (it->time <= now)
+        {
+            output(it->datagram);
+            it = delayed_datagrams.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+float UdpConnection::getResendDelay() const
+{
+    return std::max(0.1f, round_trip_time * 2.0f + 0.05f);
+}
+
+void UdpConnection::queueFragments(const io::DataBuffer& message, bool reliable, uint16_t id, uint32_t tag)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(message.getData());
+    size_t size = message.getDataSize();
+    size_t count = std::max(size_t(1), (size + fragment_payload_size - 1) / fragment_payload_size);
+    sp2assert(size <= max_message_size, "Message too large to send over a udp connection");
+    for(size_t index=0; index<count; index++)
+    {
+        Fragment fragment;
+        fragment.reliable = reliable;
+        fragment.id = id;
+        fragment.index = uint16_t(index);
+        fragment.count = uint16_t(count);
+        fragment.reliable_barrier = next_reliable_id;
+        fragment.tag = tag;
+        size_t start = index * fragment_payload_size;
+        size_t end = std::min(size, start + fragment_payload_size);
+        fragment.data.assign(data + start, data + end);
+        fragment.last_send_time = -1.0f;
+        if (reliable)
+        {
+            uint32_t key = reliableKey(id, fragment.index);
+            reliable_in_flight[key] = std::move(fragment);
+            reliable_order.push_back(key);
+        }
+        else
+        {
+            unreliable_queue.push_back(std::move(fragment));
+        }
+    }
+}
+
+static void writeFragment(io::DataBuffer& datagram, const std::vector<uint8_t>& data, bool reliable, uint16_t id, uint16_t reliable_barrier, uint16_t index, uint16_t count)
+{
+    uint8_t flags = (reliable ? fragment_flag_reliable : 0) | (count > 1 ? fragment_flag_split : 0);
+    datagram.write(flags, id);
+    if (!reliable)
+        datagram.write(reliable_barrier);
+    if (count > 1)
+    {
+        datagram.writeVarint(index);
+        datagram.writeVarint(count);
+    }
+    datagram.writeVarint(data.size());
+    datagram.appendRaw(data.data(), data.size());
+}
+
+bool UdpConnection::sendDatagram(float now, bool force)
+{
+    io::DataBuffer datagram;
+    uint8_t flags = (received_any ? datagram_flag_ack : 0) | (dropped_unreliable.empty() ? 0 : datagram_flag_dropped);
+    datagram.write(datagram_magic, next_sequence, flags);
+    if (received_any)
+        datagram.write(remote_sequence, remote_ack_bits);
+    //Dropped ids are not resend when this datagram gets lost, at worst the tag of a dropped message is not reported.
+    uint8_t dropped_count = uint8_t(std::min(dropped_unreliable.size(), max_dropped_per_datagram));
+    if (dropped_count > 0)
+    {
+        datagram.write(dropped_count);
+        for(int n=0; n<dropped_count; n++)
+            datagram.write(dropped_unreliable[n]);
+    }
+
+    SentDatagram& record = sent_datagrams[next_sequence % sent_datagram_history];
+    if (record.pending)
+        onLost(record, now);
+    record.reliable_keys.clear();
+    record.tags.clear();
+
+    bool has_messages = false;
+    float resend_delay = getResendDelay();
+    //Forget the keys of fragments that are acknowledged already.
+    while(!reliable_order.empty() && reliable_in_flight.find(reliable_order.front()) == reliable_in_flight.end())
+        reliable_order.pop_front();
+    for(auto key : reliable_order)
+    {
+        if (datagram.getDataSize() + fragment_header_size + fragment_payload_size > max_datagram_size)
+            break;
+        auto it = reliable_in_flight.find(key);
+        if (it == reliable_in_flight.end())
+            continue;
+        Fragment& fragment = it->second;
+        if (fragment.last_send_time >= 0.0f && now - fragment.last_send_time < resend_delay)
+            continue;
+        if (fragment.id == next_start_reliable_id && !canStartReliable(fragment))
+            break;
+        if (datagram.getDataSize() + fragment_header_size + fragment.data.size() > max_datagram_size)
+            continue;
+        writeFragment(datagram, fragment.data, true, fragment.id, 0, fragment.index, fragment.count);
+        fragment.last_send_time = now;
+        record.reliable_keys.push_back(key);
+        has_messages = true;
+    }
+    while(!unreliable_queue.empty())
+    {
+        Fragment& fragment = unreliable_queue.front();
+        if (datagram.getDataSize() + fragment_header_size + fragment.data.size() > max_datagram_size)
+            break;
+        writeFragment(datagram, fragment.data, false, fragment.id, fragment.reliable_barrier, fragment.index, fragment.count);
+        if (fragment.tag && (record.tags.empty() || record.tags.back() != fragment.tag))
+            record.tags.push_back(fragment.tag);
+        unreliable_queue.pop_front();
+        has_messages = true;
+    }
+
+    if (!has_messages && !force)
+        return false;
+    dropped_unreliable.erase(dropped_unreliable.begin(), dropped_unreliable.begin() + dropped_count);
+
+    record.sequence = next_sequence;
+    record.pending = true;
+    record.send_time = now;
+    next_sequence++;
+    transmit(datagram, now);
+    send_budget -= datagram.getDataSize();
+    last_send_time = now;
+    ack_pending = false;
+    return has_messages;
+}
+
+bool UdpConnection::canStartReliable(const Fragment& fragment)
+{
+    //The peer keeps every message from the oldest one that is not acknowledged, so the window starts there.
+    uint16_t oldest = uint16_t(reliable_order.front() >> 16);
+    while(!started_split_reliable.empty() && isNewer(oldest, started_split_reliable.front()))
+        started_split_reliable.pop_front();
+    if (uint16_t(fragment.id - oldest) >= reliable_window)
+        return false;
+    if (fragment.count > 1)
+    {
+        if (started_split_reliable.size() >= max_split_assemblies)
+            return false;
+        started_split_reliable.push_back(fragment.id);
+    }
+    next_start_reliable_id++;
+    return true;
+}
+
+void UdpConnection::transmit(const io::DataBuffer& datagram, float now)
+{
+    if (simulate_loss > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(simulate_random) < simulate_loss)
+        return;
+    if (simulate_latency > 0.0f || simulate_jitter > 0.0f)
+    {
+        delayed_datagrams.emplace_back();
+        delayed_datagrams.back().time = now + simulate_latency + std::uniform_real_distribution<float>(0.0f, simulate_jitter)(simulate_random);
+        delayed_datagrams.back().datagram.write(datagram);
+        return;
+    }
+    output(datagram);
+}
+
+void UdpConnection::processAck(uint16_t ack, uint64_t ack_bits, float now)
+{
+    for(int n=0; n<65; n++)
+    {
+        if (n > 0 && !(ack_bits & (uint64_t(1) << (n - 1))))
+            continue;
+        uint16_t sequence = ack - n;
+        SentDatagram& record = sent_datagrams[sequence % sent_datagram_history];
+        if (record.pending && record.sequence == sequence)
+            onAcked(record, now);
+    }
+}
+
+void UdpConnection::onAcked(SentDatagram& record, float now)
+{
+    record.pending = false;
+    float sample = now - record.send_time;
+    if (!has_round_trip_sample)
+    {
+        round_trip_time = sample;
+        has_round_trip_sample = true;
+    }
+    else
+    {
+        round_trip_time += (sample - round_trip_time) * 0.1f;
+    }
+    packet_loss += (0.0f - packet_loss) * 0.05f;
+    for(auto key : record.reliable_keys)
+        reliable_in_flight.erase(key);
+}
+
+void UdpConnection::onLost(SentDatagram& record, float now)
+{
+    record.pending = false;
+    packet_loss += (1.0f - packet_loss) * 0.05f;
+    for(auto tag : record.tags)
+        lost_tags.push_back(tag);
+    //Resend reliable fragments on the next datagram, instead of waiting for the resend delay again.
+    for(auto key : record.reliable_keys)
+    {
+        auto it = reliable_in_flight.find(key);
+        if (it != reliable_in_flight.end())
+            it->second.last_send_time = -1.0f;
+    }
+    //Only decrease once per round trip, as a burst of loss is a single congestion event.
+    if (now - last_rate_decrease_time > round_trip_time)
+    {
+        send_rate = std::max(min_send_rate, send_rate * 0.5f);
+        last_rate_decrease_time = now;
+    }
+}
+
+void UdpConnection::onDropped(uint16_t id)
+{
+    for(auto it = unreliable_tags.begin(); it != unreliable_tags.end(); ++it)
+    {
+        if (it->first == id)
+        {
+            lost_tags.push_back(it->second);
+            unreliable_tags.erase(it);
+            return;
+        }
+    }
+}
+
+bool UdpConnection::receiveFragment(io::DataBuffer& datagram)
+{
+    uint8_t flags = 0;
+    uint16_t id = 0;
+    uint16_t reliable_barrier = 0;
+    uint64_t index = 0;
+    uint64_t count = 1;
+    uint64_t size = 0;
+    if (datagram.available() < 3)
+        return false;
+    datagram.read(flags, id);
+    bool reliable = flags & fragment_flag_reliable;
+    if (!reliable)
+        datagram.read(reliable_barrier);
+    if (flags & fragment_flag_split)
+    {
+        datagram.readVarint(index);
+        datagram.readVarint(count);
+    }
+    datagram.readVarint(size);
+    if (size > datagram.available() || count == 0 || index >= count)
+        return false;
+    if (count > max_fragment_count)
+    {
+        close();
+        return false;
+    }
+    std::vector<uint8_t> data(size);
+    datagram.readRaw(data.data(), size);
+
+    if (reliable)
+    {
+        //Already delivered, the acknowledgement of an earlier copy got lost.
+        if (!isNewer(id, next_deliver_reliable_id) && id != next_deliver_reliable_id)
+            return true;
+        auto it = reliable_assembly.find(id);
+        if (it == reliable_assembly.end())
+        {
+            if (uint16_t(id - next_deliver_reliable_id) >= reliable_window || (count > 1 && reliable_split_assemblies >= max_split_assemblies))
+            {
+                close();
+                return false;
+            }
+            if (count > 1)
+                reliable_split_assemblies++;
+            it = reliable_assembly.emplace(id, Assembly()).first;
+        }
+        it->second.add(uint16_t(index), uint16_t(count), std::move(data));
+        while(true)
+        {
+            it = reliable_assembly.find(next_deliver_reliable_id);
+            if (it == reliable_assembly.end() || !it->second.isComplete())
+                break;
+            if (it->second.parts.size() > 1)
+                reliable_split_assemblies--;
+            received_messages.push_back(it->second.combine());
+            reliable_assembly.erase(it);
+            next_deliver_reliable_id++;
+        }
+        deliverHeldUnreliable();
+        return true;
+    }
+
+    if (delivered_unreliable && !isNewer(id, last_unreliable_id))
+    {
+        dropUnreliable(id);
+        return true;
+    }
+    for(auto& held : held_unreliable)
+    {
+        if (held.id == id)
+            return true;
+    }
+    if (count == 1)
+    {
+        holdUnreliable(id, reliable_barrier, std::move(data));
+        return true;
+    }
+    if (unreliable_assembly.size() >= max_split_assemblies && unreliable_assembly.find(id) == unreliable_assembly.end())
+    {
+        //Too many incomplete messages, drop the oldest one, as if it got lost.
+        auto oldest = unreliable_assembly.begin();
+        for(auto it = unreliable_assembly.begin(); it != unreliable_assembly.end(); ++it)
+        {
+            if (isNewer(oldest->first, it->first))
+                oldest = it;
+        }
+        dropUnreliable(oldest->first);
+        unreliable_assembly.erase(oldest);
+    }
+    Assembly& assembly = unreliable_assembly[id];
+    if (assembly.add(uint16_t(index), uint16_t(count), std::move(data)) && assembly.isComplete())
+    {
+        std::vector<uint8_t> message = assembly.combine();
+        unreliable_assembly.erase(id);
+        holdUnreliable(id, reliable_barrier, std::move(message));
+    }
+    return true;
+}
+
+void UdpConnection::holdUnreliable(uint16_t id, uint16_t reliable_barrier, std::vector<uint8_t>&& data)
+{
+    auto it = held_unreliable.begin();
+    while(it != held_unreliable.end() && isNewer(id, it->id))
+        ++it;
+    held_unreliable_size += data.size();
+    held_unreliable.insert(it, HeldMessage{id, reliable_barrier, std::move(data)});
+    deliverHeldUnreliable();
+    //Messages waiting for a long time on reliable messages are dropped, instead of holding on to them forever.
+    while(held_unreliable_size > max_held_unreliable_size || held_unreliable.size() > sent_datagram_history)
+    {
+        held_unreliable_size -= held_unreliable.front().data.size();
+        dropUnreliable(held_unreliable.front().id);
+        held_unreliable.pop_front();
+    }
+}
+
+void UdpConnection::dropUnreliable(uint16_t id)
+{
+    if (dropped_unreliable.empty() || dropped_unreliable.back() != id)
+        dropped_unreliable.push_back(id);
+    if (dropped_unreliable.size() > sent_datagram_history)
+        dropped_unreliable.pop_front();
+    ack_pending = true;
+}
+
+void UdpConnection::close()
+{
+    LOG(Warning, "Udp peer exceeded the receive limits, closing connection");
+    closed = true;
+    reliable_in_flight.clear();
+    reliable_order.clear();
+    unreliable_queue.clear();
+    reliable_assembly.clear();
+    unreliable_assembly.clear();
+    held_unreliable.clear();
+    held_unreliable_size = 0;
+}
+
+void UdpConnection::deliverHeldUnreliable()
+{
+    while(!held_unreliable.empty() && !isNewer(held_unreliable.front().reliable_barrier, next_deliver_reliable_id))
+    {
+        HeldMessage& held = held_unreliable.front();
+        held_unreliable_size -= held.data.size();
+        received_messages.push_back(std::move(held.data));
+        last_unreliable_id = held.id;
+        delivered_unreliable = true;
+        held_unreliable.pop_front();
+        //Fragments of older messages can never be delivered anymore.
+        for(auto it = unreliable_assembly.begin(); it != unreliable_assembly.end(); )
+        {
+            if (isNewer(it->first, last_unreliable_id))
+                ++it;
+            else
+                it = unreliable_assembly.erase(it);
+        }
+    }
+}
+
+bool UdpConnection::Assembly::add(uint16_t index, uint16_t count, std::vector<uint8_t>&& data)
+{
+    if (parts.empty())
+    {
+        parts.resize(count);
+        have.resize(count, false);
+    }
+    if (index >= parts.size() || have[index])
+        return false;
+    parts[index] = std::move(data);
+    have[index] = true;
+    received++;
+    return true;
+}
+
+std::vector<uint8_t> UdpConnection::Assembly::combine()
+{
+    std::vector<uint8_t> result;
+    for(auto& part : parts)
+        result.insert(result.end(), part.begin(), part.end());
+    return result;
+}
+
+}//namespace multiplayer
+}//namespace sp
@@ -1,8 +1,124 @@
 #include <sp2/pointerList.h>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 
 namespace sp {
 
-static _PListEntry* free_list;
+//Free list per thread, so independent scenes can add and remove nodes while being updated in parallel.
+// Entries are allocated in slabs and never returned to the system. When a thread exits, its free entries
+// go to a shared list, which is used before allocating a new slab.
+static constexpr int slab_size = 256;
+
+namespace {
+class ThreadFreeList
+{
+public:
+    _PListEntry* start;
+    //Only modified by the owning thread, but read by getPListStatistics from any thread.
+    std::atomic<size_t> count;
+    bool registered;
+    ThreadFreeList* next_list;
+    ThreadFreeList* prev_list;
+};
+class ThreadFreeListRelease
+{
+public:
+    ~ThreadFreeListRelease();
+};
+}//namespace
+
+static std::mutex global_mutex;
+static _PListEntry* shared_free_list;
+static size_t shared_free_count;
+static size_t slab_count;
+static size_t peak_live_entry_count;
+static ThreadFreeList* thread_free_lists;
+
+//The free list itself is trivially destructible, so it can still be used after the thread exit handlers run,
+// which happens for the main thread when static PLists are destroyed.
+static thread_local ThreadFreeList free_list;
+static thread_local ThreadFreeListRelease free_list_release;
+
+//Requires the global_mutex to be locked.
+static size_t countLiveEntries()
+{
+    size_t free_count = shared_free_count;
+    for(ThreadFreeList* list = thread_free_lists; list; list = list->next_list)
+        free_count += list->count.load(std::memory_order_relaxed);
+    return slab_count * slab_size - free_count;
+}
+
+//Requires the global_mutex to be locked.
+static void registerFreeList()
+{
+    if (free_list.registered)
+        return;
+    //Use the release object, so it gets constructed and destroyed when this thread exits.
+    (void)&free_list_release;
+    free_list.registered = true;
+    free_list.next_list = thread_free_lists;
+    free_list.prev_list = nullptr;
+    if (thread_free_lists)
+        thread_free_lists->prev_list = &free_list;
+    thread_free_lists = &free_list;
+}
+
+ThreadFreeListRelease::~ThreadFreeListRelease()
+{
+    std::lock_guard<std::mutex> lock(global_mutex);
+    if (free_list.start)
+    {
+        _PListEntry* end = free_list.start;
+        while(end->list_next)
+            end = end->list_next;
+        end->list_next = shared_free_list;
+        shared_free_list = free_list.start;
+        shared_free_count += free_list.count.load(std::memory_order_relaxed);
+    }
+    free_list.start = nullptr;
+    free_list.count.store(0, std::memory_order_relaxed);
+    if (free_list.next_list)
+        free_list.next_list->prev_list = free_list.prev_list;
+    if (free_list.prev_list)
+        free_list.prev_list->next_list = free_list.next_list;
+    else
+        thread_free_lists = free_list.next_list;
+    //Stays registered, entries freed after this are kept by this thread.
+}
+
+static void refillFreeList()
+{
+    std::lock_guard<std::mutex> lock(global_mutex);
+    registerFreeList();
+    //The free list of this thread is empty and an entry is about to be used, so this is the moment to track the peak.
+    peak_live_entry_count = std::max(peak_live_entry_count, countLiveEntries() + 1);
+    if (shared_free_list)
+    {
+        free_list.start = shared_free_list;
+        free_list.count.store(shared_free_count, std::memory_order_relaxed);
+        shared_free_list = nullptr;
+        shared_free_count = 0;
+        return;
+    }
+    _PListEntry* slab = new _PListEntry[slab_size];
+    for(int n=0; n<slab_size; n++)
+        slab[n].list_next = n + 1 < slab_size ? &slab[n + 1] : nullptr;
+    free_list.start = slab;
+    free_list.count.store(slab_size, std::memory_order_relaxed);
+    slab_count++;
+}
+
+PListStatistics getPListStatistics()
+{
+    std::lock_guard<std::mutex> lock(global_mutex);
+    PListStatistics result;
+    result.live_entries = countLiveEntries();
+    result.peak_live_entries = std::max(peak_live_entry_count, result.live_entries);
+    result.slabs = slab_count;
+    result.allocated_entries = slab_count * slab_size;
+    return result;
+}
 
 _PListBase::~_PListBase()
 {
@@ -65,21 +181,23 @@ _PListEntry* _PListBase::removeEntry(_PListEntry* e)
 
 void _PListEntry::free()
 {
-    list_next = free_list;
-    free_list = this;
+    if (!free_list.registered)
+    {
+        std::lock_guard<std::mutex> lock(global_mutex);
+        registerFreeList();
+    }
+    list_next = free_list.start;
+    free_list.start = this;
+    free_list.count.store(free_list.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
 
 _PListEntry* _PListEntry::create()
 {
-    _PListEntry* result = free_list;
-    if (result)
-    {
-        free_list = free_list->list_next;
-    }
-    else
-    {
-        result = new _PListEntry();
-    }
+    if (!free_list.start)
+        refillFreeList();
+    _PListEntry* result = free_list.start;
+    free_list.start = result->list_next;
+    free_list.count.store(free_list.count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
     return result;
 }
 
@@ -89,6 +207,8 @@ void _PListBase::insert(AutoPointerObject* item)
     new_entry->object = item;
     new_entry->object_prev = nullptr;
     new_entry->object_next = new_entry->object->pointer_list_entry_list_start;
+    if (new_entry->object_next)
+        new_entry->object_next->object_prev = new_entry;
     new_entry->object->pointer_list_entry_list_start = new_entry;
     
     new_entry->list = this;
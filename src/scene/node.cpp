@@ -5,6 +5,7 @@
 #include <sp2/assert.h>
 #include <sp2/multiplayer/server.h>
 #include <sp2/multiplayer/registry.h>
+#include <sp2/graphics/meshdata.h>
 #include <cmath>
 #include <typeindex>
 
@@ -13,29 +14,34 @@ namespace sp {
 REGISTER_MULTIPLAYER_CLASS(Node);
 
 Node::Node(P<Node> parent)
-: multiplayer(this), parent(parent)
+: multiplayer(this), handle_registration(this), parent(parent)
 {
     sp2assert(parent != nullptr, "Tried to create Node without a parent.");
     
     scene = parent->scene;
     parent->children.add(this);
+    scene->flat_nodes_dirty = true;
     
     local_transform = Matrix4x4f::identity();
-    updateGlobalTransform();
+    global_transform_dirty = true;
+    scene->queueVisibilityUpdate(this);
 }
 
 Node::Node(Scene* scene)
-: multiplayer(this), scene(scene)
+: multiplayer(this), handle_registration(this), scene(scene)
 {
     collision_body = nullptr;
     parent = nullptr;
     
     global_transform = Matrix4x4f::identity();
     local_transform = Matrix4x4f::identity();
+    scene->queueVisibilityUpdate(this);
 }
 
 Node::~Node()
 {
+    if (scene)
+        scene->removeFromFlatNodes(this);
     for(P<Node> child : children)
         child.destroy();
     if (collision_body)
@@ -68,17 +74,23 @@ void Node::setParent(P<Node> new_parent)
     parent = new_parent;
     parent->children.add(this);
 
+    scene->flat_nodes_dirty = true;
     if (new_parent->scene != scene)
     {
-        scene = new_parent->scene;
+        scene->removeFromFlatNodes(this);
         for(P<Node> child : children)
         {
             sp2assert(child->children.size() == 0, "Implementation incomplete...");
+            scene->removeFromFlatNodes(*child);
             child->scene = new_parent->scene;
+            child->scene->queueVisibilityUpdate(*child);
         }
+        scene = new_parent->scene;
+        scene->flat_nodes_dirty = true;
+        scene->queueVisibilityUpdate(this);
     }
     
-    updateGlobalTransform();
+    markGlobalTransformDirty();
 }
 
 void Node::setPosition(sp::Vector2d position)
@@ -155,12 +167,12 @@ double Node::getRotation2D() const
 
 Vector2d Node::getGlobalPosition2D() const
 {
-    return Vector2d(global_transform * Vector2f(0, 0));
+    return Vector2d(getGlobalTransform() * Vector2f(0, 0));
 }
 
 double Node::getGlobalRotation2D() const
 {
-    return global_transform.applyDirection(Vector2f(1, 0)).angle();
+    return getGlobalTransform().applyDirection(Vector2f(1, 0)).angle();
 }
 
 Vector2d Node::getLocalPoint2D(Vector2d v) const
@@ -170,7 +182,7 @@ Vector2d Node::getLocalPoint2D(Vector2d v) const
 
 Vector2d Node::getGlobalPoint2D(Vector2d v) const
 {
-    return Vector2d(global_transform * Vector2f(v));
+    return Vector2d(getGlobalTransform() * Vector2f(v));
 }
 
 sp::Vector2d Node::getLinearVelocity2D() const
@@ -205,7 +217,7 @@ Quaterniond Node::getRotation3D() const
 
 Vector3d Node::getGlobalPosition3D() const
 {
-    return Vector3d(global_transform * Vector3f(0, 0, 0));
+    return Vector3d(getGlobalTransform() * Vector3f(0, 0, 0));
 }
 
 Quaterniond Node::getGlobalRotation3D() const
@@ -222,7 +234,7 @@ Quaterniond Node::getGlobalRotation3D() const
 
 Vector3d Node::getGlobalPoint3D(Vector3d v) const
 {
-    return Vector3d(global_transform * Vector3f(v));
+    return Vector3d(getGlobalTransform() * Vector3f(v));
 }
 
 Vector3d Node::getLinearVelocity3D() const
@@ -308,18 +320,49 @@ bool Node::animationIsFinished() const
 void Node::updateLocalTransform()
 {
     local_transform = Matrix4x4f::translate(Vector3f(translation)) * Matrix4x4f::fromQuaternion(Quaternionf(rotation));
-    updateGlobalTransform();
+    markGlobalTransformDirty();
 }
 
-void Node::updateGlobalTransform()
+void Node::updateGlobalTransform() const
 {
-    if (parent && parent != scene->getRoot())
-        global_transform = parent->global_transform * local_transform;
+    //Children of the root node use their local transform as global transform.
+    if (parent && parent->parent)
+        global_transform = parent->getGlobalTransform() * local_transform;
     else
         global_transform = local_transform;
+    global_transform_dirty = false;
+}
 
+void Node::markGlobalTransformDirty()
+{
+    //If this node is already dirty, all the children are as well, as a child can never be resolved before its parent.
+    //Dirty nodes are always queued for a visibility update, as the update resolves the global transform.
+    if (global_transform_dirty)
+        return;
+    global_transform_dirty = true;
+    scene->queueVisibilityUpdate(this);
     for(P<Node> n : children)
-        n->updateGlobalTransform();
+        n->markGlobalTransformDirty();
+}
+
+void Node::markRenderDataDirty()
+{
+    scene->queueVisibilityUpdate(this);
+}
+
+AABB3f Node::getRenderBounds()
+{
+    if (!render_data.mesh)
+        return AABB3f();
+    const AABB3f& mesh_bounds = render_data.mesh->getBounds();
+    if (mesh_bounds.isEmpty())
+        return mesh_bounds;
+    //Scale can be negative, so both corners need to be included instead of just scaling min and max.
+    const Vector3f& scale = render_data.scale;
+    AABB3f bounds;
+    bounds.growToInclude(Vector3f(mesh_bounds.min.x * scale.x, mesh_bounds.min.y * scale.y, mesh_bounds.min.z * scale.z));
+    bounds.growToInclude(Vector3f(mesh_bounds.max.x * scale.x, mesh_bounds.max.y * scale.y, mesh_bounds.max.z * scale.z));
+    return bounds;
 }
 
 void Node::modifyPositionByPhysics(sp::Vector2d position, double rotation)
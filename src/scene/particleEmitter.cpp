@@ -5,6 +5,7 @@
 #include <sp2/stringutil/convert.h>
 #include <sp2/tween.h>
 #include <sp2/random.h>
+#include <cmath>
 
 namespace sp {
 
@@ -194,6 +195,7 @@ void ParticleEmitter::onUpdate(float delta)
     MeshData::Indices indices;
     vertices.reserve(particles.size() * 4);
     indices.reserve(particles.size() * 6);
+    max_particle_size = 0.0f;
 
     for(auto it = particles.begin(); it != particles.end(); )
     {
@@ -207,6 +209,7 @@ void ParticleEmitter::onUpdate(float delta)
 
         float size = particle.size;
         Color color = particle.color;
+        max_particle_size = std::max(max_particle_size, std::abs(size));
 
         indices.emplace_back(vertices.size() + 0);
         indices.emplace_back(vertices.size() + 1);
@@ -249,6 +252,18 @@ void ParticleEmitter::onUpdate(float delta)
         render_data.mesh = MeshData::create(std::move(vertices), std::move(indices), MeshData::Type::Dynamic);
     else
         render_data.mesh->update(std::move(vertices), std::move(indices));
+    markRenderDataDirty();
+}
+
+AABB3f ParticleEmitter::getRenderBounds()
+{
+    if (origin == Origin::Global)
+        return AABB3f::infinite();
+    //The mesh only contains the particle centers, the sprites are expanded by the shader.
+    AABB3f bounds = Node::getRenderBounds();
+    if (bounds.isEmpty())
+        return bounds;
+    return bounds.expanded(max_particle_size * std::max(std::abs(render_data.scale.x), std::max(std::abs(render_data.scale.y), std::abs(render_data.scale.z))));
 }
 
 }//namespace sp
@@ -2,8 +2,10 @@
 #include <sp2/scene/node.h>
 #include <sp2/scene/camera.h>
 #include <sp2/engine.h>
+#include <sp2/graphics/meshdata.h>
 #include <sp2/logging.h>
 #include <sp2/assert.h>
+#include <algorithm>
 
 
 namespace sp {
@@ -12,7 +14,7 @@ std::unordered_map<string, P<Scene>> Scene::scene_mapping;
 PList<Scene> Scene::scenes;
 
 Scene::Scene(const string& scene_name, int priority)
-: scene_name(scene_name), priority(priority)
+: handle_registration(this), scene_name(scene_name), priority(priority)
 {
     root = new Node(this);
     enabled = true;
@@ -55,8 +57,23 @@ void Scene::setDefaultCamera(P<Camera> camera)
 
 void Scene::update(float delta)
 {
-    if (root)
-        updateNode(delta, *root);
+    updateFlatNodes();
+    flat_nodes_iterating++;
+    for(size_t index=0; index<flat_nodes.size(); index++)
+    {
+        Node* node = flat_nodes[index];
+        if (!node)
+            continue;
+        node->onUpdate(delta);
+        if (flat_nodes[index] && node->animation)
+        {
+            MeshData* mesh = node->render_data.mesh.get();
+            node->animation->update(delta, node->render_data);
+            if (node->render_data.mesh.get() != mesh)
+                node->markRenderDataDirty();
+        }
+    }
+    flat_nodes_iterating--;
     onUpdate(delta);
 }
 
@@ -84,8 +101,15 @@ void Scene::onPointerUp(Ray3d ray, int id)
 
 void Scene::fixedUpdate()
 {
-    if (root)
-        fixedUpdateNode(*root);
+    updateFlatNodes();
+    flat_nodes_iterating++;
+    for(size_t index=0; index<flat_nodes.size(); index++)
+    {
+        Node* node = flat_nodes[index];
+        if (node)
+            node->onFixedUpdate();
+    }
+    flat_nodes_iterating--;
     onFixedUpdate();
     if (collision_backend)
     {
@@ -100,34 +124,144 @@ void Scene::postFixedUpdate(float delta)
         collision_backend->postUpdate(delta);
 }
 
-void Scene::updateNode(float delta, P<Node> node)
+const std::vector<Node*>& Scene::getNodesDepthFirst()
 {
-    node->onUpdate(delta);
-    if (node && node->animation)
-        node->animation->update(delta, node->render_data);
-    if (node)
+    updateFlatNodes();
+    return flat_nodes;
+}
+
+void Scene::updateGlobalTransforms()
+{
+    updateFlatNodes();
+    for(Node* node : flat_nodes)
     {
-        for(P<Node> child : node->children)
-        {
-            updateNode(delta, child);
-            if (!node)
-                break;
-        }
+        if (node && node->global_transform_dirty)
+            node->updateGlobalTransform();
     }
 }
 
-void Scene::fixedUpdateNode(P<Node> node)
+void Scene::updateVisibility()
 {
-    node->onFixedUpdate();
-    if (node)
+    if (!visibility_used)
     {
-        for(P<Node> child : node->children)
-        {
-            fixedUpdateNode(child);
-            if (!node)
-                break;
-        }
+        visibility_used = true;
+        if (root)
+            queueVisibilityUpdates(*root);
+    }
+    for(size_t index=0; index<visibility_updates.size(); index++)
+    {
+        Node* node = visibility_updates[index];
+        if (!node)
+            continue;
+        node->visibility_update_index = -1;
+        updateNodeVisibility(node);
+    }
+    visibility_updates.clear();
+}
+
+void Scene::queueVisibilityUpdate(Node* node)
+{
+    if (!visibility_used || node->visibility_update_index >= 0)
+        return;
+    node->visibility_update_index = int(visibility_updates.size());
+    visibility_updates.push_back(node);
+}
+
+void Scene::queueVisibilityUpdates(Node* node)
+{
+    queueVisibilityUpdate(node);
+    for(P<Node> child : node->children)
+        queueVisibilityUpdates(*child);
+}
+
+void Scene::updateNodeVisibility(Node* node)
+{
+    if (node->render_data.type == RenderData::Type::None || !node->render_data.mesh)
+    {
+        removeFromVisibility(node);
+        return;
+    }
+    AABB3f bounds = node->getRenderBounds();
+    if (bounds.isInfinite())
+    {
+        if (node->visibility_proxy == unbounded_visibility_proxy)
+            return;
+        removeFromVisibility(node);
+        node->visibility_proxy = unbounded_visibility_proxy;
+        unbounded_nodes.push_back(node);
+        return;
+    }
+    if (node->visibility_proxy == unbounded_visibility_proxy)
+        removeFromVisibility(node);
+    bounds = bounds.transformed(node->getGlobalTransform());
+    if (node->visibility_proxy >= 0)
+        visibility_tree.update(node->visibility_proxy, bounds);
+    else
+        node->visibility_proxy = visibility_tree.add(node, bounds);
+}
+
+void Scene::removeFromVisibility(Node* node)
+{
+    if (node->visibility_proxy >= 0)
+        visibility_tree.remove(node->visibility_proxy);
+    else if (node->visibility_proxy == unbounded_visibility_proxy)
+        unbounded_nodes.erase(std::remove(unbounded_nodes.begin(), unbounded_nodes.end(), node), unbounded_nodes.end());
+    node->visibility_proxy = -1;
+}
+
+void Scene::queryVisibleNodes(const Frustumf& frustum, std::vector<Node*>& result) const
+{
+    result.clear();
+    visibility_tree.query(frustum, result);
+    result.insert(result.end(), unbounded_nodes.begin(), unbounded_nodes.end());
+    //Keep the depth first submit order, which is used as tie breaker when render items have the same order.
+    std::sort(result.begin(), result.end(), [](const Node* a, const Node* b)
+    {
+        return a->flat_index < b->flat_index;
+    });
+}
+
+void Scene::updateFlatNodes()
+{
+    //Never rebuild while someone is iterating the list, nodes created during iteration will be picked up next time.
+    if (!flat_nodes_dirty || flat_nodes_iterating > 0)
+        return;
+    flat_nodes.clear();
+    if (root)
+        addToFlatNodes(*root);
+    flat_nodes_dirty = false;
+
+    size_t count = 0;
+    for(Node* node : visibility_updates)
+    {
+        if (!node)
+            continue;
+        node->visibility_update_index = int(count);
+        visibility_updates[count++] = node;
+    }
+    visibility_updates.resize(count);
+}
+
+void Scene::addToFlatNodes(Node* node)
+{
+    node->flat_index = flat_nodes.size();
+    flat_nodes.push_back(node);
+    for(P<Node> child : node->children)
+        addToFlatNodes(*child);
+}
+
+void Scene::removeFromFlatNodes(Node* node)
+{
+    if (node->flat_index >= 0 && node->flat_index < int(flat_nodes.size()) && flat_nodes[node->flat_index] == node)
+        flat_nodes[node->flat_index] = nullptr;
+    node->flat_index = -1;
+    removeFromVisibility(node);
+    if (node->visibility_update_index >= 0)
+    {
+        visibility_updates[node->visibility_update_index] = nullptr;
+        node->visibility_update_index = -1;
     }
+    flat_nodes_dirty = true;
 }
 
 void Scene::queryCollision(sp::Vector2d position, double range, std::function<bool(P<Node> object)> callback_function)
@@ -189,6 +189,7 @@ void Tilemap::updateMesh()
         render_data.mesh = MeshData::create(std::move(vertices), std::move(indices));
     else
         render_data.mesh->update(std::move(vertices), std::move(indices));
+    markRenderDataDirty();
 }
 
 class TilemapCollisionBuilder
@@ -0,0 +1,264 @@
+#include <sp2/scene/visibilityTree.h>
+#include <sp2/assert.h>
+
+namespace sp {
+
+//Insertion cost of a box, the 3D equivalent of the perimeter. Unlike the surface area this also works for flat 2D boxes.
+static inline float cost(const AABB3f& bounds)
+{
+    Vector3f size = bounds.size();
+    return size.x + size.y + size.z;
+}
+
+static inline AABB3f fatten(const AABB3f& bounds)
+{
+    Vector3f size = bounds.size();
+    return bounds.expanded(std::max(std::max(size.x, size.y), size.z) * 0.1f + 0.01f);
+}
+
+int VisibilityTree::add(Node* node, const AABB3f& bounds)
+{
+    int leaf = allocate();
+    tree_nodes[leaf].bounds = fatten(bounds);
+    tree_nodes[leaf].node = node;
+    tree_nodes[leaf].height = 0;
+    insertLeaf(leaf);
+    proxy_count++;
+    return leaf;
+}
+
+void VisibilityTree::remove(int proxy)
+{
+    sp2assert(proxy >= 0 && proxy < int(tree_nodes.size()) && tree_nodes[proxy].isLeaf(), "Invalid visibility proxy");
+    removeLeaf(proxy);
+    release(proxy);
+    proxy_count--;
+}
+
+bool VisibilityTree::update(int proxy, const AABB3f& bounds)
+{
+    if (tree_nodes[proxy].bounds.contains(bounds))
+        return false;
+    removeLeaf(proxy);
+    tree_nodes[proxy].bounds = fatten(bounds);
+    insertLeaf(proxy);
+    return true;
+}
+
+void VisibilityTree::query(const Frustumf& frustum, std::vector<Node*>& result) const
+{
+    if (root == -1)
+        return;
+    int stack[128];
+    int stack_size = 0;
+    stack[stack_size++] = root;
+    while(stack_size > 0)
+    {
+        int index = stack[--stack_size];
+        const TreeNode& tree_node = tree_nodes[index];
+        switch(frustum.check(tree_node.bounds))
+        {
+        case Frustumf::Result::Outside:
+            break;
+        case Frustumf::Result::Inside:
+            //Everything below this node is visible, no need to test the children.
+            collect(index, result);
+            break;
+        case Frustumf::Result::Intersects:
+            if (tree_node.isLeaf())
+            {
+                result.push_back(tree_node.node);
+            }
+            else
+            {
+                sp2assert(stack_size + 2 <= 128, "Visibility tree too deep");
+                stack[stack_size++] = tree_node.child[0];
+                stack[stack_size++] = tree_node.child[1];
+            }
+            break;
+        }
+    }
+}
+
+void VisibilityTree::collect(int index, std::vector<Node*>& result) const
+{
+    const TreeNode& tree_node = tree_nodes[index];
+    if (tree_node.isLeaf())
+    {
+        result.push_back(tree_node.node);
+        return;
+    }
+    collect(tree_node.child[0], result);
+    collect(tree_node.child[1], result);
+}
+
+int VisibilityTree::allocate()
+{
+    int index;
+    if (free_list != -1)
+    {
+        index = free_list;
+        free_list = tree_nodes[index].parent;
+    }
+    else
+    {
+        index = tree_nodes.size();
+        tree_nodes.emplace_back();
+    }
+    TreeNode& tree_node = tree_nodes[index];
+    tree_node.parent = -1;
+    tree_node.child[0] = -1;
+    tree_node.child[1] = -1;
+    tree_node.height = 0;
+    tree_node.node = nullptr;
+    return index;
+}
+
+void VisibilityTree::release(int index)
+{
+    tree_nodes[index].parent = free_list;
+    tree_nodes[index].height = -1;
+    free_list = index;
+}
+
+void VisibilityTree::insertLeaf(int leaf)
+{
+    if (root == -1)
+    {
+        root = leaf;
+        tree_nodes[leaf].parent = -1;
+        return;
+    }
+
+    //Walk down the tree, picking the child that grows the least, till creating a new parent here is cheaper.
+    AABB3f leaf_bounds = tree_nodes[leaf].bounds;
+    int index = root;
+    while(!tree_nodes[index].isLeaf())
+    {
+        const TreeNode& tree_node = tree_nodes[index];
+        float combined_cost = cost(tree_node.bounds.merged(leaf_bounds));
+        float new_parent_cost = 2.0f * combined_cost;
+        float inheritance_cost = 2.0f * (combined_cost - cost(tree_node.bounds));
+
+        float child_cost[2];
+        for(int n=0; n<2; n++)
+        {
+            const TreeNode& child = tree_nodes[tree_node.child[n]];
+            child_cost[n] = cost(child.bounds.merged(leaf_bounds)) + inheritance_cost;
+            if (!child.isLeaf())
+                child_cost[n] -= cost(child.bounds);
+        }
+        if (new_parent_cost < child_cost[0] && new_parent_cost < child_cost[1])
+            break;
+        index = child_cost[0] < child_cost[1] ? tree_node.child[0] : tree_node.child[1];
+    }
+
+    int sibling = index;
+    int old_parent = tree_nodes[sibling].parent;
+    int new_parent = allocate();
+    tree_nodes[new_parent].parent = old_parent;
+    tree_nodes[new_parent].bounds = tree_nodes[sibling].bounds.merged(leaf_bounds);
+    tree_nodes[new_parent].height = tree_nodes[sibling].height + 1;
+    tree_nodes[new_parent].child[0] = sibling;
+    tree_nodes[new_parent].child[1] = leaf;
+    tree_nodes[sibling].parent = new_parent;
+    tree_nodes[leaf].parent = new_parent;
+    if (old_parent != -1)
+        replaceChild(old_parent, sibling, new_parent);
+    else
+        root = new_parent;
+
+    refit(tree_nodes[leaf].parent);
+}
+
+void VisibilityTree::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = -1;
+        return;
+    }
+    int parent = tree_nodes[leaf].parent;
+    int grand_parent = tree_nodes[parent].parent;
+    int sibling = tree_nodes[parent].child[0] == leaf ? tree_nodes[parent].child[1] : tree_nodes[parent].child[0];
+
+    tree_nodes[sibling].parent = grand_parent;
+    if (grand_parent != -1)
+    {
+        replaceChild(grand_parent, parent, sibling);
+        release(parent);
+        refit(grand_parent);
+    }
+    else
+    {
+        root = sibling;
+        release(parent);
+    }
+}
+
+void VisibilityTree::refit(int index)
+{
+    while(index != -1)
+    {
+        index = balance(index);
+        TreeNode& tree_node = tree_nodes[index];
+        const TreeNode& a = tree_nodes[tree_node.child[0]];
+        const TreeNode& b = tree_nodes[tree_node.child[1]];
+        tree_node.height = 1 + std::max(a.height, b.height);
+        tree_node.bounds = a.bounds.merged(b.bounds);
+        index = tree_node.parent;
+    }
+}
+
+//Rotate the higher child up if the children of this node differ more then 1 in height.
+int VisibilityTree::balance(int a)
+{
+    if (tree_nodes[a].isLeaf() || tree_nodes[a].height < 2)
+        return a;
+
+    int b = tree_nodes[a].child[0];
+    int c = tree_nodes[a].child[1];
+    int difference = tree_nodes[c].height - tree_nodes[b].height;
+    if (difference > -2 && difference < 2)
+        return a;
+
+    //Rotate child "up" in the place of a. "other" is the child of a that stays.
+    int up_side = difference > 1 ? 1 : 0;
+    int up = tree_nodes[a].child[up_side];
+    int other = tree_nodes[a].child[1 - up_side];
+    int f = tree_nodes[up].child[0];
+    int g = tree_nodes[up].child[1];
+
+    tree_nodes[up].child[0] = a;
+    tree_nodes[up].parent = tree_nodes[a].parent;
+    tree_nodes[a].parent = up;
+    if (tree_nodes[up].parent != -1)
+        replaceChild(tree_nodes[up].parent, a, up);
+    else
+        root = up;
+
+    //The higher grandchild stays with "up", the lower one moves to a.
+    int keep = f;
+    int move = g;
+    if (tree_nodes[g].height > tree_nodes[f].height)
+        std::swap(keep, move);
+    tree_nodes[up].child[1] = keep;
+    tree_nodes[a].child[up_side] = move;
+    tree_nodes[move].parent = a;
+
+    tree_nodes[a].bounds = tree_nodes[other].bounds.merged(tree_nodes[move].bounds);
+    tree_nodes[a].height = 1 + std::max(tree_nodes[other].height, tree_nodes[move].height);
+    tree_nodes[up].bounds = tree_nodes[a].bounds.merged(tree_nodes[keep].bounds);
+    tree_nodes[up].height = 1 + std::max(tree_nodes[a].height, tree_nodes[keep].height);
+    return up;
+}
+
+void VisibilityTree::replaceChild(int parent, int old_child, int new_child)
+{
+    if (tree_nodes[parent].child[0] == old_child)
+        tree_nodes[parent].child[0] = new_child;
+    else
+        tree_nodes[parent].child[1] = new_child;
+}
+
+}//namespace sp
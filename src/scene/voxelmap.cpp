@@ -244,6 +244,7 @@ void Voxelmap::updateMesh()
         render_data.mesh = MeshData::create(std::move(vertices), std::move(indices));
     else
         render_data.mesh->update(std::move(vertices), std::move(indices));
+    markRenderDataDirty();
 }
 
 void Voxelmap::trace(const sp::Ray3d& ray, std::function<bool(sp::Vector3i, Face)> callback)
@@ -1,5 +1,7 @@
 #include <sp2/script/environment.h>
 #include <sp2/script/luaBindings.h>
+#include <sp2/io/resourceWatcher.h>
+#include <sp2/logging.h>
 #include <sp2/assert.h>
 #include <lua/lstate.h>
 
@@ -53,6 +55,8 @@ Environment::Environment(const SandboxConfig& sandbox_config)
 
 Environment::~Environment()
 {
+    setAutoReload(false);
+
     //Remove our environment from the registry.
     //REGISTRY[this] = nil
     lua_pushnil(lua);
@@ -144,6 +148,16 @@ void Environment::setGlobal(const string& name, const string& value)
 
 Result<Variant> Environment::load(const string& resource_name)
 {
+    if (auto_reload && auto_reload_watches.find(resource_name) == auto_reload_watches.end())
+    {
+        auto_reload_watches[resource_name] = io::ResourceWatcher::watch(resource_name, [this, resource_name]()
+        {
+            LOG(Info, "Reloading script:", resource_name);
+            auto result = _load(io::ResourceProvider::get(resource_name), resource_name);
+            if (result.isErr())
+                LOG(Warning, "Failed to reload script:", resource_name, result.error());
+        });
+    }
     io::ResourceStreamPtr stream = io::ResourceProvider::get(resource_name);
     if (!stream)
     {
@@ -152,6 +166,17 @@ Result<Variant> Environment::load(const string& resource_name)
     return _load(stream, resource_name);
 }
 
+void Environment::setAutoReload(bool enabled)
+{
+    auto_reload = enabled;
+    if (!enabled)
+    {
+        for(auto& it : auto_reload_watches)
+            io::ResourceWatcher::unwatch(it.second);
+        auto_reload_watches.clear();
+    }
+}
+
 Result<Variant> Environment::load(io::ResourceStreamPtr resource)
 {
     return _load(resource, "=[resource]");
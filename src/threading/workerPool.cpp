@@ -0,0 +1,66 @@
+#include <sp2/threading/workerPool.h>
+
+namespace sp {
+namespace threading {
+
+WorkerPool::WorkerPool(int thread_count)
+{
+    for(int n=0; n<thread_count; n++)
+        threads.emplace_back(&WorkerPool::workerThread, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        job_condition.notify_all();
+    }
+    for(auto& thread : threads)
+        thread.join();
+}
+
+void WorkerPool::add(std::function<void()> job)
+{
+    if (threads.empty())
+    {
+        job();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(std::move(job));
+    pending_jobs++;
+    job_condition.notify_one();
+}
+
+void WorkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(pending_jobs > 0)
+        done_condition.wait(lock);
+}
+
+void WorkerPool::workerThread()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+        while(jobs.empty() && !stopping)
+            job_condition.wait(lock);
+        if (jobs.empty())
+            return;
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        pending_jobs--;
+        if (pending_jobs == 0)
+            done_condition.notify_all();
+    }
+}
+
+}//namespace threading
+}//namespace sp
@@ -237,6 +237,11 @@ Vector2i Window::getSize()
     return size;
 }
 
+RenderQueue::Statistics Window::getRenderStatistics()
+{
+    return queue.getStatistics();
+}
+
 int Window::getMonitorCount()
 {
     return SDL_GetNumVideoDisplays();
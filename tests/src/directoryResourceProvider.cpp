@@ -0,0 +1,138 @@
+#include <sp2/io/directoryResourceProvider.h>
+#include <sp2/io/filesystem.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "doctest.h"
+
+static void writeTestFile(const sp::string& filename)
+{
+    FILE* f = fopen(filename.c_str(), "wb");
+    REQUIRE(f);
+    fputs(filename.c_str(), f);
+    fclose(f);
+}
+
+//Changes on disk reach the index through a background thread, so wait for them a while.
+template<typename F> static bool waitFor(F f)
+{
+    for(int n=0; n<200 && !f(); n++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return f();
+}
+
+TEST_CASE("DirectoryResourceProvider")
+{
+    sp::io::makeDirectory("resource_index_test/sub");
+    writeTestFile("resource_index_test/a.txt");
+    writeTestFile("resource_index_test/b.png");
+    writeTestFile("resource_index_test/sub/c.txt");
+
+    {
+        sp::P<sp::io::DirectoryResourceProvider> provider = new sp::io::DirectoryResourceProvider("resource_index_test");
+        CHECK(provider->getStream("a.txt"));
+        CHECK(provider->getStream("sub/c.txt"));
+        CHECK(!provider->getStream("missing.txt"));
+        CHECK(!provider->getStream("sub"));
+        CHECK(provider->getResourceModifyTime("a.txt") != std::chrono::system_clock::time_point());
+        CHECK(provider->getResourceModifyTime("missing.txt") == std::chrono::system_clock::time_point());
+
+        auto found = provider->findResources("*.txt");
+        std::sort(found.begin(), found.end());
+        CHECK(found == std::vector<sp::string>{"a.txt", "sub/c.txt"});
+        CHECK(provider->findResources("sub/*") == std::vector<sp::string>{"sub/c.txt"});
+        CHECK(provider->findResources("b.png") == std::vector<sp::string>{"b.png"});
+
+        //New files and directories are picked up, and removed ones are gone.
+        sp::io::makeDirectory("resource_index_test/new");
+        writeTestFile("resource_index_test/new/d.txt");
+        writeTestFile("resource_index_test/e.txt");
+        remove("resource_index_test/a.txt");
+        //Single files do not wait for the index to catch up.
+        CHECK(provider->getStream("e.txt"));
+        CHECK(!provider->getStream("a.txt"));
+        CHECK(provider->getResourceModifyTime("e.txt") != std::chrono::system_clock::time_point());
+        CHECK(waitFor([&provider]() { return provider->findResources("*.txt").size() == 3; }));
+        CHECK(provider->getStream("new/d.txt"));
+        CHECK(provider->getStream("e.txt"));
+        CHECK(!provider->getStream("a.txt"));
+
+        provider.destroy();
+    }
+    remove("resource_index_test/new/d.txt");
+    remove("resource_index_test/new");
+    remove("resource_index_test/e.txt");
+    remove("resource_index_test/b.png");
+    remove("resource_index_test/sub/c.txt");
+    remove("resource_index_test/sub");
+    remove("resource_index_test");
+}
+
+TEST_CASE("DirectoryResourceProvider benchmark" * doctest::skip())
+{
+    //100 directories of 1000 files each, the directory is kept between runs.
+    const int directory_count = 100;
+    const int file_count = 1000;
+    if (!sp::io::isDirectory("resource_index_benchmark"))
+    {
+        for(int d=0; d<directory_count; d++)
+        {
+            sp::string path = "resource_index_benchmark/dir" + sp::string(d);
+            sp::io::makeDirectory(path);
+            for(int n=0; n<file_count; n++)
+            {
+                FILE* f = fopen((path + "/file" + sp::string(n) + (n % 2 ? ".png" : ".txt")).c_str(), "wb");
+                REQUIRE(f);
+                fclose(f);
+            }
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sp::P<sp::io::DirectoryResourceProvider> provider = new sp::io::DirectoryResourceProvider("resource_index_benchmark");
+    auto created = std::chrono::steady_clock::now();
+    //The index is built in the background, searches wait for it.
+    size_t indexed = provider->findResources("dir0/file0.txt").size();
+    auto index_done = std::chrono::steady_clock::now();
+    int found = 0;
+    for(int n=0; n<10000; n++)
+    {
+        if (provider->getStream("dir" + sp::string(n % directory_count) + "/file" + sp::string(n % file_count) + (n % 2 ? ".png" : ".txt")))
+            found++;
+    }
+    auto hits = std::chrono::steady_clock::now();
+    for(int n=0; n<10000; n++)
+    {
+        if (provider->getStream("dir" + sp::string(n % directory_count) + "/missing" + sp::string(n)))
+            found++;
+        if (provider->getResourceModifyTime("missing" + sp::string(n)) != std::chrono::system_clock::time_point())
+            found++;
+    }
+    auto misses = std::chrono::steady_clock::now();
+    size_t results = 0;
+    for(int n=0; n<directory_count; n++)
+        results += provider->findResources("dir" + sp::string(n) + "/*.png").size();
+    auto finds = std::chrono::steady_clock::now();
+    for(int n=0; n<10; n++)
+        results += provider->findResources("*.txt").size();
+    auto full_finds = std::chrono::steady_clock::now();
+    CHECK(indexed == 1);
+    CHECK(found == 10000);
+    //Half of the files are png, half are txt.
+    CHECK(results == 11 * directory_count * file_count / 2);
+
+    double create_time = std::chrono::duration<double, std::milli>(created - start).count();
+    double index_time = std::chrono::duration<double, std::milli>(index_done - created).count();
+    double hit_time = std::chrono::duration<double, std::milli>(hits - index_done).count();
+    double miss_time = std::chrono::duration<double, std::milli>(misses - hits).count();
+    double find_time = std::chrono::duration<double, std::milli>(finds - misses).count();
+    double full_find_time = std::chrono::duration<double, std::milli>(full_finds - finds).count();
+    MESSAGE(create_time << "ms to create the provider");
+    MESSAGE(index_time << "ms till the first findResources, which waits for the index");
+    MESSAGE(hit_time << "ms for 10000 getStream calls");
+    MESSAGE(miss_time << "ms for 10000 missing getStream and getResourceModifyTime calls");
+    MESSAGE(find_time << "ms for " << directory_count << " findResources in a directory");
+    MESSAGE(full_find_time << "ms for 10 findResources over all files");
+    provider.destroy();
+}
@@ -0,0 +1,113 @@
+#include <sp2/engine.h>
+#include <sp2/scene/scene.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "doctest.h"
+
+namespace {
+
+class EngineTestLog
+{
+public:
+    std::mutex mutex;
+    std::vector<sp::string> updates;
+    std::atomic<bool> serial_running{false};
+    std::atomic<int> overlaps{0};
+    std::thread::id main_thread = std::this_thread::get_id();
+    std::atomic<int> independent_on_main{0};
+
+    void add(const sp::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        updates.push_back(name);
+    }
+};
+
+class SerialTestScene : public sp::Scene
+{
+public:
+    SerialTestScene(EngineTestLog& log, const sp::string& name, int priority) : sp::Scene(name, priority), log(log) {}
+
+    virtual void onUpdate(float delta) override
+    {
+        log.serial_running = true;
+        log.add(getName());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (destroy_target)
+            destroy_target.destroy();
+        log.serial_running = false;
+    }
+
+    sp::P<sp::Scene> destroy_target;
+private:
+    EngineTestLog& log;
+};
+
+class IndependentTestScene : public sp::Scene
+{
+public:
+    IndependentTestScene(EngineTestLog& log, const sp::string& name) : sp::Scene(name), log(log)
+    {
+        setIndependent(true);
+    }
+
+    virtual void onUpdate(float delta) override
+    {
+        if (log.serial_running)
+            log.overlaps++;
+        if (std::this_thread::get_id() == log.main_thread)
+            log.independent_on_main++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        //Only touches its own state, so it is safe to run next to other independent scenes.
+        update_count++;
+        log.add(getName());
+        if (log.serial_running)
+            log.overlaps++;
+    }
+
+    int update_count = 0;
+private:
+    EngineTestLog& log;
+};
+
+}
+
+TEST_CASE("Engine independent scene updates")
+{
+    sp::P<sp::Engine> engine = new sp::Engine();
+    engine->setSceneUpdateThreads(2);
+    EngineTestLog log;
+    sp::P<SerialTestScene> serial_a = new SerialTestScene(log, "serial_a", 10);
+    sp::P<IndependentTestScene> independent_b = new IndependentTestScene(log, "independent_b");
+    sp::P<IndependentTestScene> independent_c = new IndependentTestScene(log, "independent_c");
+    sp::P<SerialTestScene> serial_d = new SerialTestScene(log, "serial_d", -10);
+
+    //No fixed updates happen with a small delta, so every update call updates each scene once.
+    engine->update(0.001f);
+    REQUIRE(log.updates.size() == 4);
+    //Serial scenes first in priority order, then the independent scenes in any order.
+    CHECK(log.updates[0] == "serial_a");
+    CHECK(log.updates[1] == "serial_d");
+    CHECK(log.updates[2].startswith("independent_"));
+    CHECK(log.updates[3].startswith("independent_"));
+    CHECK(independent_b->update_count == 1);
+    CHECK(independent_c->update_count == 1);
+
+    //A serial scene destroying an independent scene never races with that scene's update.
+    log.updates.clear();
+    serial_d->destroy_target = independent_c;
+    engine->update(0.001f);
+    CHECK(!independent_c);
+    CHECK(log.updates == std::vector<sp::string>{"serial_a", "serial_d", "independent_b"});
+    CHECK(independent_b->update_count == 2);
+
+    CHECK(log.overlaps == 0);
+    CHECK(log.independent_on_main == 0);
+
+    serial_a.destroy();
+    independent_b.destroy();
+    serial_d.destroy();
+    engine->setSceneUpdateThreads(0);
+    engine.destroy();
+}
@@ -0,0 +1,117 @@
+#include <sp2/handle.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "doctest.h"
+
+namespace {
+class HandleTestObject
+{
+public:
+    typedef HandleTestObject HandleRoot;
+
+    HandleTestObject(int value=0) : value(value), handle_registration(this) {}
+    virtual ~HandleTestObject() {}
+
+    int value;
+
+    sp::HandleRegistration<HandleTestObject> handle_registration;
+};
+class HandleTestSubObject : public HandleTestObject
+{
+};
+}
+
+TEST_CASE("Handle")
+{
+    sp::Handle<HandleTestObject> empty;
+    CHECK(!empty);
+    CHECK(*empty == nullptr);
+
+    HandleTestObject* object = new HandleTestObject();
+    sp::Handle<HandleTestObject> handle = object;
+    sp::Handle<HandleTestObject> copy = handle;
+    CHECK(bool(copy));
+    CHECK(*copy == object);
+    CHECK(copy == handle);
+
+    delete object;
+    CHECK(!handle);
+    CHECK(!copy);
+
+    //Slot is reused, but the old handle should not see the new object.
+    HandleTestObject* reuse = new HandleTestObject();
+    sp::Handle<HandleTestObject> reuse_handle = reuse;
+    CHECK(!handle);
+    CHECK(*reuse_handle == reuse);
+    CHECK(reuse_handle != handle);
+    reuse_handle.destroy();
+    CHECK(!reuse_handle);
+
+    HandleTestSubObject* sub = new HandleTestSubObject();
+    sp::Handle<HandleTestSubObject> sub_handle = sub;
+    sp::Handle<HandleTestObject> base_handle = sub_handle;
+    CHECK(*sub_handle == sub);
+    CHECK(*base_handle == sub);
+    delete sub;
+    CHECK(!sub_handle);
+    CHECK(!base_handle);
+}
+
+TEST_CASE("Handle concurrent")
+{
+    //Handles are looked up from worker threads while objects are created and destroyed on the main thread.
+    //Live handles should always resolve to their object, dead handles never, even when their slot is reused.
+    std::vector<HandleTestObject*> objects;
+    std::vector<sp::Handle<HandleTestObject>> live;
+    std::vector<sp::Handle<HandleTestObject>> dead;
+    for(int n=0; n<2000; n++)
+    {
+        objects.push_back(new HandleTestObject(n));
+        if (n % 2)
+            live.push_back(objects.back());
+        else
+            dead.push_back(objects.back());
+    }
+    for(int n=0; n<2000; n+=2)
+        delete objects[n];
+
+    std::atomic<bool> done{false};
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++)
+    {
+        threads.emplace_back([&live, &dead, &done, &wrong]()
+        {
+            while(!done)
+            {
+                for(int n=0; n<int(live.size()); n++)
+                {
+                    HandleTestObject* object = *live[n];
+                    if (!object || object->value != n * 2 + 1)
+                        wrong++;
+                }
+                for(auto& handle : dead)
+                {
+                    if (handle)
+                        wrong++;
+                }
+            }
+        });
+    }
+    //Reuse the free slots and grow into new chunks.
+    for(int round=0; round<20; round++)
+    {
+        std::vector<HandleTestObject*> extra;
+        for(int n=0; n<10000; n++)
+            extra.push_back(new HandleTestObject(-1));
+        for(auto object : extra)
+            delete object;
+    }
+    done = true;
+    for(auto& thread : threads)
+        thread.join();
+    CHECK(wrong == 0);
+    for(int n=1; n<2000; n+=2)
+        delete objects[n];
+}
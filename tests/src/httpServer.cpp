@@ -0,0 +1,459 @@
+#include <sp2/io/http/server.h>
+#include <sp2/io/http/websocket.h>
+#include <sp2/io/network/tcpSocket.h>
+#include <sp2/stringutil/convert.h>
+#include "doctest.h"
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+namespace {
+class Response
+{
+public:
+    int status = 0;
+    std::unordered_map<sp::string, sp::string> headers;
+    sp::string body;
+};
+
+//Minimal HTTP client, which reads chunked and content-length replies from a non-blocking socket.
+class TestClient
+{
+public:
+    sp::io::network::TcpSocket socket;
+    sp::string buffer;
+
+    bool connect(int port)
+    {
+        if (!socket.connect(sp::io::network::Address("127.0.0.1"), port))
+            return false;
+        socket.setBlocking(false);
+        return true;
+    }
+
+    void request(const sp::string& data)
+    {
+        socket.send(data.data(), data.size());
+    }
+
+    bool receive(Response& response)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while(!parse(response))
+        {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5) || !socket.isConnected())
+                return false;
+            char data[64 * 1024];
+            size_t size = socket.receive(data, sizeof(data));
+            if (size > 0)
+                buffer.append(data, size);
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+
+private:
+    bool parse(Response& response)
+    {
+        int headers_end = buffer.find("\r\n\r\n");
+        if (headers_end < 0)
+            return false;
+        std::vector<sp::string> lines = buffer.substr(0, headers_end).split("\r\n");
+        response = Response();
+        response.status = sp::stringutil::convert::toInt(lines[0].split()[1]);
+        for(unsigned int n=1; n<lines.size(); n++)
+        {
+            auto entry = lines[n].partition(":");
+            response.headers[entry.first.strip().lower()] = entry.second.strip();
+        }
+        size_t position = headers_end + 4;
+        if (response.headers["transfer-encoding"] == "chunked")
+        {
+            while(true)
+            {
+                int line_end = buffer.find("\r\n", position);
+                if (line_end < 0)
+                    return false;
+                size_t chunk_size = strtoul(buffer.substr(position, line_end).c_str(), nullptr, 16);
+                if (buffer.size() < line_end + 2 + chunk_size + 2)
+                    return false;
+                response.body += buffer.substr(line_end + 2, line_end + 2 + chunk_size);
+                position = line_end + 2 + chunk_size + 2;
+                if (chunk_size == 0)
+                    break;
+            }
+        }
+        else if (response.headers.find("content-length") != response.headers.end())
+        {
+            size_t length = sp::stringutil::convert::toInt(response.headers["content-length"]);
+            if (buffer.size() < position + length)
+                return false;
+            response.body = buffer.substr(position, position + length);
+            position += length;
+        }
+        buffer = buffer.substr(position);
+        return true;
+    }
+};
+
+class StreamHandler : public sp::io::http::WebsocketHandler
+{
+public:
+    bool connected = false;
+    int messages = 0;
+    int parts = 0;
+    int last_parts = 0;
+    bool last = false;
+    sp::string data;
+
+    StreamHandler() { setStreamBinaryMessages(true); }
+
+    virtual void onConnect() override { connected = true; }
+    virtual void onMessage(const sp::string& message) override { messages++; }
+    virtual void onBinaryMessagePart(const sp::string& part, bool last) override
+    {
+        parts++;
+        data += part;
+        this->last = last;
+        if (last)
+            last_parts++;
+    }
+    virtual void onDisconnect() override {}
+};
+
+void writeFile(const char* filename, const sp::string& data)
+{
+    FILE* f = fopen(filename, "wb");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+}
+
+TEST_CASE("http Server pipelining")
+{
+#ifndef EMSCRIPTEN
+    sp::P<sp::io::http::Server> server = new sp::io::http::Server(32625);
+    server->setWorkerCount(2);
+    server->addURLHandler("/slow", [](const sp::io::http::Server::Request&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return sp::string("slow");
+    }, sp::io::http::Server::HandlerThread::Worker);
+    server->addURLHandler("/fast", [](const sp::io::http::Server::Request&) {
+        return sp::string("fast");
+    }, sp::io::http::Server::HandlerThread::Worker);
+
+    TestClient client;
+    REQUIRE(client.connect(32625));
+    //Both requests are send at once, the second one finishes first, but is answered second.
+    client.request("GET /slow HTTP/1.1\r\n\r\nGET /fast HTTP/1.1\r\n\r\n");
+    Response response;
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 200);
+    CHECK(response.body == "slow");
+    REQUIRE(client.receive(response));
+    CHECK(response.body == "fast");
+
+    //The connection is kept alive for the next request.
+    client.request("GET /fast HTTP/1.1\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.body == "fast");
+    server.destroy();
+#endif
+}
+
+TEST_CASE("http Server static files")
+{
+#ifndef EMSCRIPTEN
+    sp::string page;
+    for(int n=0; n<200; n++)
+        page += "<p>Line " + sp::string(n) + "</p>\n";
+    sp::string large;
+    for(int n=0; n<300000; n++)
+        large += char(n * 7 + n / 251);
+    writeFile("http_test_page.html", page);
+    writeFile("http_test_large.bin", large);
+    writeFile("http_test_app.js", "var x = 1;");
+    writeFile("http_test_app.js.gz", "precompressed");
+
+    sp::P<sp::io::http::Server> server = new sp::io::http::Server(32627);
+    server->setStaticFilePath(".");
+    TestClient client;
+    REQUIRE(client.connect(32627));
+    Response response;
+
+    client.request("GET /http_test_page.html HTTP/1.1\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 200);
+    CHECK(response.body == page);
+    CHECK(response.headers["content-type"] == "text/html");
+    sp::string etag = response.headers["etag"];
+    CHECK(etag != "");
+
+    //Unchanged file, nothing to send.
+    client.request("GET /http_test_page.html HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 304);
+    CHECK(response.body == "");
+
+    //Compressed on the fly, as there is no precompressed version.
+    client.request("GET /http_test_page.html HTTP/1.1\r\nAccept-Encoding: gzip, deflate\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 200);
+    CHECK(response.headers["content-encoding"] == "gzip");
+    CHECK(response.body.size() < page.size());
+    CHECK(uint8_t(response.body[0]) == 0x1f);
+    CHECK(uint8_t(response.body[1]) == 0x8b);
+
+    client.request("GET /http_test_app.js HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.headers["content-encoding"] == "gzip");
+    CHECK(response.body == "precompressed");
+    client.request("GET /http_test_app.js HTTP/1.1\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.headers["content-type"] == "text/javascript");
+    CHECK(response.body == "var x = 1;");
+
+    client.request("GET /http_test_large.bin HTTP/1.1\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 200);
+    CHECK(response.body == large);
+
+    client.request("GET /http_test_large.bin HTTP/1.1\r\nRange: bytes=1000-1999\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 206);
+    CHECK(response.headers["content-range"] == "bytes 1000-1999/300000");
+    CHECK(response.body == large.substr(1000, 2000));
+
+    client.request("GET /http_test_large.bin HTTP/1.1\r\nRange: bytes=-100\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 206);
+    CHECK(response.body == large.substr(300000 - 100));
+
+    client.request("GET /http_test_large.bin HTTP/1.1\r\nRange: bytes=400000-\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 416);
+
+    client.request("GET /http_test_missing.html HTTP/1.1\r\n\r\n");
+    REQUIRE(client.receive(response));
+    CHECK(response.status == 404);
+
+    server.destroy();
+    remove("http_test_page.html");
+    remove("http_test_large.bin");
+    remove("http_test_app.js");
+    remove("http_test_app.js.gz");
+#endif
+}
+
+TEST_CASE("http Server websockets")
+{
+#ifndef EMSCRIPTEN
+    sp::P<sp::io::http::Server> server = new sp::io::http::Server(32629);
+    sp::Updatable* updatable = *server;
+    std::vector<sp::string> received;
+    server->addSimpleWebsocketHandler("/echo", [&received](const sp::string& message) { received.push_back(message); });
+    sp::P<StreamHandler> stream_handler;
+    server->addAdvancedWebsocketHandler("/stream", [&stream_handler]() { stream_handler = new StreamHandler(); return stream_handler; });
+
+    auto update = [&](std::function<bool()> done)
+    {
+        for(int n=0; n<500; n++)
+        {
+            if (done())
+                return true;
+            updatable->onUpdate(0.01f);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    };
+
+    //Compressed messages in both directions, larger then the receive buffers.
+    sp::io::http::Websocket client;
+    REQUIRE(client.connect("ws://127.0.0.1:32629/echo"));
+    REQUIRE(update([&]() { return client.isConnected(); }));
+    sp::string text;
+    for(int n=0; n<10000; n++)
+        text += "message " + sp::string(n) + "\n";
+    client.send(text);
+    client.send("short");
+    REQUIRE(update([&]() { return received.size() == 2; }));
+    CHECK(received[0] == text);
+    CHECK(received[1] == "short");
+
+    server->broadcastToWebsockets("/echo", text);
+    sp::string reply;
+    CHECK(update([&]() { return client.receive(reply); }));
+    CHECK(reply == text);
+
+    //Binary messages are streamed to the handler in parts.
+    sp::io::http::Websocket stream_client;
+    REQUIRE(stream_client.connect("ws://127.0.0.1:32629/stream"));
+    REQUIRE(update([&]() { return stream_client.isConnected() && stream_handler && stream_handler->connected; }));
+    sp::io::DataBuffer binary;
+    uint32_t random = 1;
+    for(int n=0; n<1000000; n++)
+    {
+        random = random * 1103515245 + 12345;
+        uint8_t value = random >> 16;
+        binary.appendRaw(&value, 1);
+    }
+    stream_client.send(binary);
+    REQUIRE(update([&]() { return stream_handler->last; }));
+    //How many parts there are depends on how the data arrives, so only check that it is reassembled and ended once.
+    CHECK(stream_handler->messages == 0);
+    CHECK(stream_handler->last_parts == 1);
+    CHECK(stream_handler->data.size() == binary.getDataSize());
+    CHECK(memcmp(stream_handler->data.data(), binary.getData(), binary.getDataSize()) == 0);
+    //Strings are send as text messages, which are not streamed.
+    int binary_parts = stream_handler->parts;
+    stream_client.send(sp::string("text"));
+    REQUIRE(update([&]() { return stream_handler->messages > 0; }));
+    CHECK(stream_handler->messages == 1);
+    CHECK(stream_handler->parts == binary_parts);
+
+    //Broadcast frames are compressed when the client offers permessage-deflate.
+    TestClient raw;
+    REQUIRE(raw.connect(32629));
+    raw.request("GET /echo HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Extensions: permessage-deflate\r\n\r\n");
+    Response response;
+    REQUIRE(raw.receive(response));
+    CHECK(response.status == 101);
+    CHECK(response.headers["sec-websocket-extensions"].find("permessage-deflate") == 0);
+    server->broadcastToWebsockets("/echo", text);
+    //The compressed message fits in a frame with a 16 bit length.
+    auto frameReceived = [&raw]()
+    {
+        char data[4096];
+        size_t size = raw.socket.receive(data, sizeof(data));
+        raw.buffer.append(data, size);
+        if (raw.buffer.size() < 4)
+            return false;
+        size_t payload_size = uint8_t(raw.buffer[2]) << 8 | uint8_t(raw.buffer[3]);
+        return raw.buffer.size() >= 4 + payload_size;
+    };
+    REQUIRE(update(frameReceived));
+    CHECK((raw.buffer[0] & 0x40) != 0);
+    CHECK(raw.buffer.size() < text.size() / 4);
+
+    server.destroy();
+#endif
+}
+
+TEST_CASE("http Server load" * doctest::skip())
+{
+    constexpr int client_count = 32;
+    constexpr int requests_per_client = 200;
+    //Every request takes some time in the handler, like a database lookup would.
+    auto handler = [](const sp::io::http::Server::Request&) {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+        return sp::string("ok");
+    };
+
+    for(int worker_count : {1, 4, 16})
+    {
+        sp::P<sp::io::http::Server> server = new sp::io::http::Server(32626);
+        server->setWorkerCount(worker_count, client_count * 4);
+        server->addURLHandler("/api", handler, sp::io::http::Server::HandlerThread::Worker);
+
+        std::vector<std::thread> clients;
+        int failures = 0;
+        std::mutex failures_mutex;
+        auto start = std::chrono::steady_clock::now();
+        for(int n=0; n<client_count; n++)
+        {
+            clients.emplace_back([&]()
+            {
+                TestClient client;
+                int failed = 0;
+                if (!client.connect(32626))
+                {
+                    failed = requests_per_client;
+                }
+                else
+                {
+                    //Keep-alive connection with 4 requests pipelined at a time.
+                    sp::string requests;
+                    for(int r=0; r<4; r++)
+                        requests += "GET /api HTTP/1.1\r\n\r\n";
+                    for(int r=0; r<requests_per_client; r+=4)
+                    {
+                        client.request(requests);
+                        for(int i=0; i<4; i++)
+                        {
+                            Response response;
+                            if (!client.receive(response) || response.status != 200)
+                                failed++;
+                        }
+                    }
+                }
+                std::lock_guard<std::mutex> lock(failures_mutex);
+                failures += failed;
+            });
+        }
+        for(auto& client : clients)
+            client.join();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        server.destroy();
+
+        MESSAGE(worker_count << " workers: " << int(client_count * requests_per_client / duration.count()) << " requests/sec, " << failures << " failed");
+    }
+}
+
+TEST_CASE("http Server static file load" * doctest::skip())
+{
+    sp::string small;
+    for(int n=0; n<200; n++)
+        small += "<p>Line " + sp::string(n) + "</p>\n";
+    writeFile("http_test_small.html", small);
+    writeFile("http_test_asset.bin", sp::string(std::string(4 * 1024 * 1024, 'x')));
+
+    sp::P<sp::io::http::Server> server = new sp::io::http::Server(32628);
+    server->setStaticFilePath(".");
+
+    auto run = [](const char* request, int client_count, int requests_per_client, size_t& bytes) -> double
+    {
+        std::vector<std::thread> clients;
+        std::mutex mutex;
+        auto start = std::chrono::steady_clock::now();
+        for(int n=0; n<client_count; n++)
+        {
+            clients.emplace_back([&]()
+            {
+                TestClient client;
+                if (!client.connect(32628))
+                    return;
+                size_t received = 0;
+                for(int r=0; r<requests_per_client; r++)
+                {
+                    client.request(request);
+                    Response response;
+                    if (!client.receive(response))
+                        break;
+                    received += response.body.size();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                bytes += received;
+            });
+        }
+        for(auto& client : clients)
+            client.join();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        return duration.count();
+    };
+
+    size_t bytes = 0;
+    double duration = run("GET /http_test_small.html HTTP/1.1\r\n\r\n", 16, 500, bytes);
+    MESSAGE("Small file: " << int(16 * 500 / duration) << " requests/sec");
+    bytes = 0;
+    duration = run("GET /http_test_asset.bin HTTP/1.1\r\n\r\n", 4, 50, bytes);
+    MESSAGE("4MB file: " << int(bytes / duration / 1024 / 1024) << " MB/sec");
+    bytes = 0;
+    duration = run("GET /http_test_small.html HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n", 16, 500, bytes);
+    MESSAGE("Small file with gzip: " << int(16 * 500 / duration) << " requests/sec, " << (bytes / (16 * 500)) << " bytes per reply");
+
+    server.destroy();
+    remove("http_test_small.html");
+    remove("http_test_asset.bin");
+}
@@ -0,0 +1,161 @@
+#include <sp2/io/lazyLoader.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string.h>
+#include "doctest.h"
+
+namespace {
+
+class TestStream : public sp::io::ResourceStream
+{
+public:
+    TestStream(const sp::string& data) : data(data) {}
+
+    virtual int64_t read(void* buffer, int64_t size) override
+    {
+        size = std::min<int64_t>(size, int64_t(data.size()) - position);
+        memcpy(buffer, data.data() + position, size);
+        position += size;
+        return size;
+    }
+    virtual int64_t seek(int64_t p) override { position = std::min<int64_t>(p, data.size()); return position; }
+    virtual int64_t tell() override { return position; }
+    virtual int64_t getSize() override { return data.size(); }
+private:
+    sp::string data;
+    int64_t position = 0;
+};
+
+class TestProvider : public sp::io::ResourceProvider
+{
+public:
+    TestProvider() : sp::io::ResourceProvider(100) {}
+
+    virtual sp::io::ResourceStreamPtr getStream(const sp::string& filename) override
+    {
+        if (!filename.startswith("lazy_"))
+            return nullptr;
+        //Every load of this resource gets new contents, to see which load wins.
+        if (filename == "lazy_version")
+            return std::make_shared<TestStream>(filename + sp::string(++version));
+        return std::make_shared<TestStream>(filename);
+    }
+    virtual std::vector<sp::string> findResources(const sp::string& search_pattern) override { return {}; }
+
+    int version = 0;
+};
+
+class TestLoader : public sp::io::LazyLoader<sp::string*>
+{
+public:
+    TestLoader() : sp::io::LazyLoader<sp::string*>("test") {}
+
+    void reload(const sp::string& name)
+    {
+        addToWorkqueue(get(name), name);
+    }
+
+    std::atomic<bool> gate{false};
+    std::atomic<bool> gate_started{false};
+    std::mutex mutex;
+    std::vector<sp::string> order;
+protected:
+    virtual sp::string* prepare(const sp::string& name) override
+    {
+        return new sp::string();
+    }
+    virtual void backgroundLoader(sp::string* ptr, sp::io::ResourceStreamPtr stream) override
+    {
+        sp::string data = stream->readAll();
+        bool gated = data == "lazy_gate" || data == "lazy_version1";
+        if (gated)
+            gate_started = true;
+        while(gated && !gate)
+            std::this_thread::yield();
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back(data);
+        *ptr = data;
+    }
+};
+
+}
+
+TEST_CASE("LazyLoader")
+{
+    sp::P<TestProvider> provider = new TestProvider();
+    sp::io::LazyLoaderManager::setThreadCount(1);
+    sp::io::LazyLoaderManager::setGroup(1);
+    TestLoader loader;
+
+    //Block the single loader thread, so the rest of the loads wait in the queues.
+    loader.get("lazy_gate");
+    while(!loader.gate_started)
+        std::this_thread::yield();
+    loader.prefetch("lazy_prefetch");
+    loader.get("lazy_visible");
+    loader.prefetch("lazy_cancelled");
+    loader.cancel("lazy_cancelled");
+    //Getting a prefetched resource moves it in front of the other prefetch loads.
+    loader.prefetch("lazy_promoted");
+    loader.get("lazy_promoted");
+
+    sp::string* callback_result = nullptr;
+    loader.onLoaded("lazy_prefetch", [&callback_result](sp::string* s) { callback_result = s; });
+    CHECK(sp::io::LazyLoaderManager::getPendingCount(1) == 4);
+    CHECK(callback_result == nullptr);
+
+    loader.gate = true;
+    sp::io::LazyLoaderManager::waitForGroup(1);
+    CHECK(sp::io::LazyLoaderManager::getPendingCount(1) == 0);
+    REQUIRE(loader.order.size() == 4);
+    CHECK(loader.order[0] == "lazy_gate");
+    CHECK(loader.order[1] == "lazy_visible");
+    CHECK(loader.order[2] == "lazy_promoted");
+    CHECK(loader.order[3] == "lazy_prefetch");
+    REQUIRE(callback_result != nullptr);
+    CHECK(*callback_result == "lazy_prefetch");
+
+    //A cancelled load starts again on the next get.
+    sp::string* cancelled = loader.get("lazy_cancelled");
+    sp::io::LazyLoaderManager::waitForGroup(1);
+    CHECK(*cancelled == "lazy_cancelled");
+    CHECK(sp::io::LazyLoaderManager::getStats()["test"].count == 5);
+
+    sp::io::LazyLoaderManager::setGroup(0);
+    provider.destroy();
+}
+
+TEST_CASE("LazyLoader reload while loading")
+{
+    sp::P<TestProvider> provider = new TestProvider();
+    sp::io::LazyLoaderManager::setThreadCount(2);
+    TestLoader loader;
+
+    //The first load blocks, the reload should wait for it instead of running on the other thread, else the stale first load would win.
+    sp::string* result = loader.get("lazy_version");
+    while(!loader.gate_started)
+        std::this_thread::yield();
+    sp::string* callback_result = nullptr;
+    loader.onLoaded("lazy_version", [&callback_result](sp::string* s) { callback_result = s; });
+    loader.reload("lazy_version");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(loader.order.empty());
+    CHECK(callback_result == nullptr);
+
+    loader.gate = true;
+    sp::io::LazyLoaderManager::waitForGroup(0);
+    CHECK(loader.order == std::vector<sp::string>{"lazy_version1", "lazy_version2"});
+    CHECK(*result == "lazy_version2");
+    CHECK(callback_result == result);
+
+    //Threads are joined on shutdown, and started again by the next load.
+    sp::io::LazyLoaderManager::shutdown();
+    loader.reload("lazy_version");
+    sp::io::LazyLoaderManager::waitForGroup(0);
+    CHECK(*result == "lazy_version3");
+
+    sp::io::LazyLoaderManager::shutdown();
+    sp::io::LazyLoaderManager::setThreadCount(1);
+    provider.destroy();
+}
@@ -0,0 +1,333 @@
+#include <sp2/multiplayer/server.h>
+#include <sp2/multiplayer/client.h>
+#include <sp2/multiplayer/registry.h>
+#include <private/multiplayer/packetIDs.h>
+#include <sp2/io/network/udpSocket.h>
+#include <sp2/scene/scene.h>
+#include <sp2/engine.h>
+#include <chrono>
+#include <thread>
+#include "doctest.h"
+
+class MultiplayerTestUnit : public sp::Node
+{
+public:
+    MultiplayerTestUnit(sp::P<sp::Node> parent)
+    : sp::Node(parent)
+    {
+        multiplayer.enable();
+        multiplayer.replicate(health);
+        multiplayer.replicate(name);
+        multiplayer.replicate(target);
+    }
+
+    int health = 0;
+    sp::string name;
+    sp::P<sp::Node> target;
+};
+REGISTER_MULTIPLAYER_CLASS(MultiplayerTestUnit);
+
+class MultiplayerTestBuilding : public sp::Node
+{
+public:
+    MultiplayerTestBuilding(sp::P<sp::Node> parent)
+    : sp::Node(parent)
+    {
+        multiplayer.enable();
+        multiplayer.replicate(level);
+    }
+
+    float level = 0.0f;
+};
+REGISTER_MULTIPLAYER_CLASS(MultiplayerTestBuilding);
+
+namespace {
+
+//Server and client in the same process, connected over tcp on the loopback interface.
+//They share the scenes, so the client creates its copy of each node next to the node of the server, with the same id.
+class MultiplayerLoopback
+{
+public:
+    MultiplayerLoopback(const sp::string& scene_name, int port)
+    {
+        engine = new sp::Engine();
+        //Fills the class table of the registered classes.
+        engine->initialize();
+        scene = new sp::Scene(scene_name);
+        scene->getRoot()->multiplayer.enable();
+        server = new sp::multiplayer::Server("loopback", 1);
+        listening = server->listen(port);
+        client = new sp::multiplayer::Client("loopback", 1);
+        this->port = port;
+    }
+
+    ~MultiplayerLoopback()
+    {
+        client.destroy();
+        server.destroy();
+        scene.destroy();
+        engine.destroy();
+    }
+
+    bool connect()
+    {
+        return client->connect("127.0.0.1", port);
+    }
+
+    void update()
+    {
+        static_cast<sp::Updatable*>(*server)->onUpdate(0.01f);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        static_cast<sp::Updatable*>(*client)->onUpdate(0.01f);
+    }
+
+    template<typename F> bool updateUntil(F f)
+    {
+        for(int n=0; n<1000 && !f(); n++)
+            update();
+        return f();
+    }
+
+    //The copy of a server node on the client, if it has the same class and the copy of the same parent.
+    template<typename T> T* getCopy(sp::P<T> node)
+    {
+        sp::P<sp::Node> copy = client->getNode(node->multiplayer.getId());
+        if (!copy || copy == node)
+            return nullptr;
+        sp::P<sp::Node> parent_copy = client->getNode(node->getParent()->multiplayer.getId());
+        if (copy->getParent() != parent_copy)
+            return nullptr;
+        return dynamic_cast<T*>(*copy);
+    }
+
+    sp::P<sp::Engine> engine;
+    sp::P<sp::Scene> scene;
+    sp::P<sp::multiplayer::Server> server;
+    sp::P<sp::multiplayer::Client> client;
+    bool listening;
+    int port;
+};
+
+class RawUdpPeer
+{
+public:
+    RawUdpPeer(int server_port)
+    : server_port(server_port)
+    {
+        socket.bind(0);
+        socket.setBlocking(false);
+    }
+
+    void connectRequest(const sp::string& cookie, bool padded=true)
+    {
+        sp::io::DataBuffer request(sp::multiplayer::PacketIDs::udp_connect_magic, cookie);
+        while(padded && request.getDataSize() < sp::multiplayer::PacketIDs::udp_connect_request_size)
+            request.write(uint8_t(0));
+        socket.send(request, sp::io::network::Address("127.0.0.1"), server_port);
+    }
+
+    //Receive everything, returns the cookie of the last connect reply, and counts the other datagrams.
+    void receive()
+    {
+        sp::io::DataBuffer datagram;
+        sp::io::network::Address address;
+        int port = 0;
+        while(socket.receive(datagram, address, port))
+        {
+            uint32_t magic = 0;
+            datagram.read(magic);
+            if (magic == sp::multiplayer::PacketIDs::udp_connect_magic)
+            {
+                datagram.read(cookie);
+                reply_size = datagram.getDataSize();
+            }
+            else
+                connection_datagrams++;
+        }
+    }
+
+    sp::io::network::UdpSocket socket;
+    int server_port;
+    sp::string cookie;
+    size_t reply_size = 0;
+    int connection_datagrams = 0;
+};
+
+}
+
+TEST_CASE("Server udp connect cookie")
+{
+#ifndef EMSCRIPTEN
+    sp::P<sp::multiplayer::Server> server = new sp::multiplayer::Server("test", 1);
+    REQUIRE(server->listenUdp(32620));
+    auto update = [&server]()
+    {
+        for(int n=0; n<5; n++)
+        {
+            static_cast<sp::Updatable*>(*server)->onUpdate(0.01f);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    };
+
+    //Datagrams from unknown peers are ignored, only a connect request gets a reply, with a cookie.
+    RawUdpPeer peer(32620);
+    peer.socket.send(sp::io::DataBuffer(uint16_t(0x5332), uint16_t(0), uint8_t(0)), sp::io::network::Address("127.0.0.1"), 32620);
+    update();
+    peer.receive();
+    CHECK(peer.cookie == "");
+    CHECK(peer.connection_datagrams == 0);
+    //A request that is not padded is ignored, as the reply would be larger then the request.
+    peer.connectRequest("", false);
+    update();
+    peer.receive();
+    CHECK(peer.cookie == "");
+    peer.connectRequest("");
+    update();
+    peer.receive();
+    CHECK(peer.cookie != "");
+    CHECK(peer.reply_size <= sp::multiplayer::PacketIDs::udp_connect_request_size);
+    CHECK(peer.connection_datagrams == 0);
+
+    //A wrong cookie gets the cookie again, the right one creates the connection, which asks for authentication.
+    sp::string cookie = peer.cookie;
+    peer.cookie = "";
+    peer.connectRequest("wrong");
+    update();
+    peer.receive();
+    CHECK(peer.cookie == cookie);
+    CHECK(peer.connection_datagrams == 0);
+    peer.connectRequest(cookie);
+    update();
+    peer.receive();
+    CHECK(peer.connection_datagrams > 0);
+
+    //The amount of clients waiting for authentication is limited.
+    std::vector<std::unique_ptr<RawUdpPeer>> peers;
+    for(int n=0; n<16; n++)
+    {
+        peers.emplace_back(new RawUdpPeer(32620));
+        peers.back()->connectRequest("");
+    }
+    update();
+    for(auto& p : peers)
+    {
+        p->receive();
+        p->connectRequest(p->cookie);
+    }
+    update();
+    int accepted = 0;
+    for(auto& p : peers)
+    {
+        p->receive();
+        if (p->connection_datagrams > 0)
+            accepted++;
+    }
+    CHECK(accepted == 15);
+
+    server.destroy();
+#endif
+}
+
+TEST_CASE("Multiplayer loopback replication")
+{
+#ifndef EMSCRIPTEN
+    MultiplayerLoopback loopback("MULTIPLAYER_LOOPBACK_TEST", 32621);
+    REQUIRE(loopback.listening);
+    sp::P<MultiplayerTestBuilding> building = new MultiplayerTestBuilding(loopback.scene->getRoot());
+    building->level = 2.5f;
+
+    REQUIRE(loopback.connect());
+    REQUIRE(loopback.updateUntil([&loopback]() { return loopback.client->getState() == sp::multiplayer::Client::Running; }));
+    REQUIRE(loopback.getCopy(building));
+    CHECK(loopback.getCopy(building)->level == 2.5f);
+
+    //Nodes created while connected, of different classes, with children and links to other nodes.
+    sp::P<MultiplayerTestUnit> unit = new MultiplayerTestUnit(building);
+    unit->health = 100;
+    unit->name = "unit";
+    unit->target = building;
+    sp::P<MultiplayerTestBuilding> second_building = new MultiplayerTestBuilding(loopback.scene->getRoot());
+    sp::P<MultiplayerTestUnit> second_unit = new MultiplayerTestUnit(second_building);
+    second_unit->target = unit;
+    sp::P<sp::Node> plain_node = new sp::Node(second_building);
+    plain_node->multiplayer.enable();
+    REQUIRE(loopback.updateUntil([&]() { return loopback.getCopy(second_unit) && loopback.getCopy(plain_node); }));
+    REQUIRE(loopback.getCopy(unit));
+    CHECK(loopback.getCopy(unit)->health == 100);
+    CHECK(loopback.getCopy(unit)->name == "unit");
+    CHECK(loopback.getCopy(unit)->target == loopback.client->getNode(building->multiplayer.getId()));
+    CHECK(loopback.getCopy(second_unit)->target == loopback.client->getNode(unit->multiplayer.getId()));
+    CHECK(loopback.getCopy(second_building));
+
+    //Updates.
+    unit->health = 50;
+    unit->name = "renamed";
+    second_building->level = 7.0f;
+    REQUIRE(loopback.updateUntil([&]() { return loopback.getCopy(unit)->health == 50 && loopback.getCopy(second_building)->level == 7.0f; }));
+    CHECK(loopback.getCopy(unit)->name == "renamed");
+
+    //Deletes, deleting a node on the server also deletes the copies of its children.
+    uint64_t second_building_id = second_building->multiplayer.getId();
+    uint64_t second_unit_id = second_unit->multiplayer.getId();
+    uint64_t plain_node_id = plain_node->multiplayer.getId();
+    second_building.destroy();
+    REQUIRE(loopback.updateUntil([&]() { return !loopback.client->getNode(second_building_id); }));
+    CHECK(!loopback.client->getNode(second_unit_id));
+    CHECK(!loopback.client->getNode(plain_node_id));
+    uint64_t unit_id = unit->multiplayer.getId();
+    unit.destroy();
+    REQUIRE(loopback.updateUntil([&]() { return !loopback.client->getNode(unit_id); }));
+    CHECK(loopback.getCopy(building));
+#endif
+}
+
+TEST_CASE("Multiplayer catch up")
+{
+#ifndef EMSCRIPTEN
+    MultiplayerLoopback loopback("MULTIPLAYER_CATCH_UP_TEST", 32622);
+    REQUIRE(loopback.listening);
+    //Much more than the budget of a single tick.
+    loopback.server->setCatchUpBudget(512);
+    std::vector<sp::P<MultiplayerTestBuilding>> buildings;
+    std::vector<sp::P<MultiplayerTestUnit>> units;
+    for(int n=0; n<50; n++)
+    {
+        buildings.push_back(new MultiplayerTestBuilding(loopback.scene->getRoot()));
+        buildings.back()->level = float(n);
+        for(int m=0; m<10; m++)
+        {
+            units.push_back(new MultiplayerTestUnit(buildings.back()));
+            units.back()->health = n * 10 + m;
+            units.back()->target = buildings.front();
+        }
+    }
+    //The server gives the nodes their ids on its first update.
+    loopback.update();
+
+    REQUIRE(loopback.connect());
+    int synchronizing_updates = 0;
+    REQUIRE(loopback.updateUntil([&]()
+    {
+        if (loopback.client->getState() == sp::multiplayer::Client::Synchronizing)
+            synchronizing_updates++;
+        return loopback.client->getState() == sp::multiplayer::Client::Running;
+    }));
+    CHECK(synchronizing_updates > 5);
+
+    //A node is only created on the client when its parent is already there, so every copy with the right parent means parents came first.
+    int missing = 0;
+    for(auto building : buildings)
+    {
+        auto copy = loopback.getCopy(building);
+        if (!copy || copy->level != building->level)
+            missing++;
+    }
+    for(auto unit : units)
+    {
+        auto copy = loopback.getCopy(unit);
+        if (!copy || copy->health != unit->health || copy->target != loopback.client->getNode(buildings.front()->multiplayer.getId()))
+            missing++;
+    }
+    CHECK(missing == 0);
+#endif
+}
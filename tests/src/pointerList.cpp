@@ -0,0 +1,127 @@
+#include <sp2/pointerList.h>
+#include "doctest.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+class TestObject : public sp::AutoPointerObject
+{
+};
+}
+
+TEST_CASE("PList")
+{
+    size_t live_at_start = sp::getPListStatistics().live_entries;
+    sp::PList<TestObject> list;
+    std::vector<TestObject*> objects;
+    for(int n=0; n<2000; n++)
+    {
+        objects.push_back(new TestObject());
+        list.add(objects.back());
+    }
+    CHECK(list.size() == 2000);
+    CHECK(sp::getPListStatistics().live_entries == live_at_start + 2000);
+    CHECK(sp::getPListStatistics().allocated_entries >= live_at_start + 2000);
+
+    int count = 0;
+    for(sp::P<TestObject> obj : list)
+    {
+        if (count % 2 == 0)
+            obj.destroy();
+        count++;
+    }
+    CHECK(count == 2000);
+    CHECK(list.size() == 1000);
+
+    //Each thread has its own free entries, which are given back when the thread exits.
+    auto add_in_thread = []()
+    {
+        std::thread thread([]()
+        {
+            TestObject obj;
+            sp::PList<TestObject> thread_list;
+            for(int n=0; n<500; n++)
+                thread_list.add(&obj);
+        });
+        thread.join();
+    };
+    add_in_thread();
+    CHECK(sp::getPListStatistics().live_entries == live_at_start + 1000);
+    //The next thread uses the entries of the previous one, instead of allocating new ones.
+    size_t allocated = sp::getPListStatistics().allocated_entries;
+    add_in_thread();
+    CHECK(sp::getPListStatistics().allocated_entries == allocated);
+    CHECK(sp::getPListStatistics().live_entries == live_at_start + 1000);
+
+    //An object in multiple lists, removed from the list it was added to first.
+    {
+        sp::P<TestObject> obj = new TestObject();
+        sp::PList<TestObject> first, second, third;
+        first.add(obj);
+        second.add(obj);
+        third.add(obj);
+        first.remove(obj);
+        obj.destroy();
+        CHECK(first.empty());
+        CHECK(second.empty());
+        CHECK(third.empty());
+    }
+
+    for(sp::P<TestObject> obj : list)
+        obj.destroy();
+    CHECK(list.empty());
+    CHECK(sp::getPListStatistics().live_entries == live_at_start);
+    //The peak is only sampled when a thread needs more free entries.
+    CHECK(sp::getPListStatistics().peak_live_entries > live_at_start + 1000);
+}
+
+TEST_CASE("PList benchmark" * doctest::skip())
+{
+    constexpr int object_count = 10000;
+    constexpr int iterations = 100;
+    std::vector<TestObject*> objects;
+    for(int n=0; n<object_count; n++)
+        objects.push_back(new TestObject());
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i=0; i<iterations; i++)
+    {
+        std::vector<sp::P<TestObject>> pointers;
+        pointers.reserve(object_count);
+        for(auto obj : objects)
+            pointers.emplace_back(obj);
+        std::vector<sp::P<TestObject>> copies = pointers;
+    }
+    std::chrono::duration<double> p_time = std::chrono::steady_clock::now() - start;
+
+    std::chrono::duration<double> add_time{0}, iterate_time{0}, remove_time{0};
+    int iterated = 0;
+    for(int i=0; i<iterations; i++)
+    {
+        sp::PList<TestObject> list;
+        start = std::chrono::steady_clock::now();
+        for(auto obj : objects)
+            list.add(obj);
+        auto added = std::chrono::steady_clock::now();
+        for(sp::P<TestObject> obj : list)
+            if (obj)
+                iterated++;
+        auto done_iterating = std::chrono::steady_clock::now();
+        list.clear();
+        auto removed = std::chrono::steady_clock::now();
+        add_time += added - start;
+        iterate_time += done_iterating - added;
+        remove_time += removed - done_iterating;
+    }
+    CHECK(iterated == object_count * iterations);
+
+    double scale = 1000000000.0 / (object_count * iterations);
+    MESSAGE("P<T> copy+destroy: " << (p_time.count() * scale / 2) << "ns per pointer");
+    MESSAGE("PList add: " << (add_time.count() * scale) << "ns, iterate: " << (iterate_time.count() * scale) << "ns, remove: " << (remove_time.count() * scale) << "ns per entry");
+    auto statistics = sp::getPListStatistics();
+    MESSAGE("PList entries: live " << statistics.live_entries << " peak " << statistics.peak_live_entries << " slabs " << statistics.slabs);
+
+    for(auto obj : objects)
+        delete obj;
+}
@@ -0,0 +1,35 @@
+#include <sp2/multiplayer/relevance.h>
+#include <sp2/scene/scene.h>
+#include <sp2/scene/node.h>
+#include "doctest.h"
+
+TEST_CASE("GridRelevance")
+{
+    sp::P<sp::Scene> scene = new sp::Scene("GRID_RELEVANCE_TEST");
+    sp::P<sp::Node> avatar = new sp::Node(scene->getRoot());
+    sp::P<sp::Node> close_node = new sp::Node(scene->getRoot());
+    sp::P<sp::Node> distant_node = new sp::Node(scene->getRoot());
+    avatar->setPosition(sp::Vector2d(5, 5));
+    close_node->setPosition(sp::Vector2d(5, -5));
+    distant_node->setPosition(sp::Vector2d(35, 5));
+
+    sp::multiplayer::GridRelevance relevance(10.0);
+    relevance.update();
+    //Without a client node, everything is relevant.
+    CHECK(relevance.isRelevant(1, **distant_node));
+
+    relevance.setClientNode(1, avatar);
+    relevance.update();
+    CHECK(relevance.isRelevant(1, **avatar));
+    CHECK(relevance.isRelevant(1, **close_node));
+    CHECK(!relevance.isRelevant(1, **distant_node));
+    //Joining clients get the closest nodes first.
+    CHECK(relevance.getPriority(1, **close_node) < relevance.getPriority(1, **distant_node));
+
+    avatar->setPosition(sp::Vector2d(25, 5));
+    relevance.update();
+    CHECK(!relevance.isRelevant(1, **close_node));
+    CHECK(relevance.isRelevant(1, **distant_node));
+
+    scene.destroy();
+}
@@ -0,0 +1,122 @@
+#include <sp2/graphics/scene/renderqueue.h>
+#include <sp2/graphics/meshdata.h>
+#include <sp2/graphics/shader.h>
+#include <sp2/graphics/texture.h>
+#include "doctest.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace {
+class HeadlessTexture : public sp::Texture
+{
+public:
+    HeadlessTexture() : sp::Texture(Type::Static, "headless") {}
+
+    virtual void bind() override {}
+};
+}
+
+TEST_CASE("RenderQueue batching")
+{
+    sp::Shader* shader = sp::Shader::get("batching_test.shader");
+    HeadlessTexture texture;
+    std::shared_ptr<sp::MeshData> quad = sp::MeshData::createQuad(sp::Vector2f(1, 1));
+    std::shared_ptr<sp::MeshData> circle = sp::MeshData::createCircle(1, 8);
+
+    sp::RenderQueue queue;
+    queue.setCamera(sp::Matrix4x4f::identity(), sp::Matrix4x4f::identity());
+    sp::RenderData data;
+    data.type = sp::RenderData::Type::Normal;
+    data.shader = shader;
+    data.texture = &texture;
+    for(int n=0; n<10; n++)
+    {
+        data.mesh = n < 4 ? circle : quad;
+        data.color = sp::Color(n * 0.1, 1, 1);
+        queue.add(sp::Matrix4x4f::translate(n, n, 0), data);
+    }
+    data.scale = sp::Vector3f(2, 2, 2);
+    queue.add(sp::Matrix4x4f::identity(), data);
+    data.scale = sp::Vector3f(1, 1, 1);
+    data.order = 1;
+    queue.add(sp::Matrix4x4f::identity(), data);
+    queue.setCamera(sp::Matrix4x4f::identity(), sp::Matrix4x4f::identity());
+
+    //Different colors and transforms end up in the same batch, a different mesh, scale or order does not.
+    const auto& batches = queue.getBatches();
+    REQUIRE(batches.size() == 4);
+    int quad_count = 0, scaled_quad_count = 0, circle_count = 0;
+    uint32_t next_start = 0;
+    for(int n=0; n<3; n++)
+    {
+        CHECK(batches[n].start == next_start);
+        next_start += batches[n].count;
+        if (batches[n].mesh == circle.get())
+            circle_count = batches[n].count;
+        else if (batches[n].scale == sp::Vector3f(2, 2, 2))
+            scaled_quad_count = batches[n].count;
+        else
+            quad_count = batches[n].count;
+    }
+    CHECK(quad_count == 6);
+    CHECK(scaled_quad_count == 1);
+    CHECK(circle_count == 4);
+    CHECK(batches[3].start == 11);
+    CHECK(batches[3].count == 1);
+}
+
+//Fills a RenderQueue without ever calling render(), so no GL context is needed.
+TEST_CASE("RenderQueue benchmark" * doctest::skip())
+{
+    constexpr int item_count = 100000;
+    constexpr int iterations = 20;
+
+    std::vector<sp::Shader*> shaders;
+    for(int n=0; n<8; n++)
+        shaders.push_back(sp::Shader::get("benchmark_" + sp::string(n) + ".shader"));
+    std::vector<HeadlessTexture> textures(32);
+    std::shared_ptr<sp::MeshData> mesh = sp::MeshData::createQuad(sp::Vector2f(1, 1));
+
+    std::vector<sp::Matrix4x4f> transforms;
+    std::vector<sp::RenderData> render_data;
+    for(int n=0; n<item_count; n++)
+    {
+        transforms.push_back(sp::Matrix4x4f::translate((n * 7919) % 1000, (n * 541) % 1000, (n * 31) % 100));
+        sp::RenderData data;
+        data.type = n % 10 == 0 ? sp::RenderData::Type::Transparent : sp::RenderData::Type::Normal;
+        data.order = (n % 3) - 1;
+        data.shader = shaders[(n * 13) % shaders.size()];
+        data.texture = &textures[(n * 17) % textures.size()];
+        data.mesh = mesh;
+        render_data.push_back(data);
+    }
+
+    std::chrono::duration<double> queue_time{0};
+    for(int i=0; i<iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sp::RenderQueue queue;
+        queue.setCamera(sp::Matrix4x4f::identity(), sp::Matrix4x4f::identity());
+        for(int n=0; n<item_count; n++)
+            queue.add(transforms[n], render_data[n]);
+        //Changing the camera sorts the items that are added so far.
+        queue.setCamera(sp::Matrix4x4f::identity(), sp::Matrix4x4f::identity());
+        queue_time += std::chrono::steady_clock::now() - start;
+    }
+
+    //Reference: what the queue did before, copying RenderData into each item and comparison sorting those.
+    std::chrono::duration<double> reference_time{0};
+    for(int i=0; i<iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<sp::Matrix4x4f, sp::RenderData>> items;
+        for(int n=0; n<item_count; n++)
+            items.emplace_back(transforms[n], render_data[n]);
+        std::sort(items.begin(), items.end(), [](const std::pair<sp::Matrix4x4f, sp::RenderData>& a, const std::pair<sp::Matrix4x4f, sp::RenderData>& b) { return a.second < b.second; });
+        reference_time += std::chrono::steady_clock::now() - start;
+    }
+
+    MESSAGE("RenderQueue submit+sort of " << item_count << " items: " << (queue_time.count() * 1000.0 / iterations) << "ms");
+    MESSAGE("RenderData copy+std::sort of " << item_count << " items: " << (reference_time.count() * 1000.0 / iterations) << "ms");
+}
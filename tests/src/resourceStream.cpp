@@ -0,0 +1,148 @@
+#include <sp2/io/bufferedResourceStream.h>
+#include <sp2/io/directoryResourceProvider.h>
+#include <sp2/io/keyValueTreeLoader.h>
+#include <sp2/graphics/mesh/obj.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "doctest.h"
+
+namespace {
+
+//Stream without a contiguous view, that counts the reads done on it.
+class CountingStream : public sp::io::ResourceStream
+{
+public:
+    CountingStream(const sp::string& data) : data(data) {}
+
+    virtual int64_t read(void* buffer, int64_t size) override
+    {
+        read_count++;
+        last_read_size = size;
+        size = std::min<int64_t>(size, int64_t(data.size()) - position);
+        memcpy(buffer, data.data() + position, size);
+        position += size;
+        return size;
+    }
+    virtual int64_t seek(int64_t p) override { position = std::min<int64_t>(p, data.size()); return position; }
+    virtual int64_t tell() override { return position; }
+    virtual int64_t getSize() override { return data.size(); }
+
+    int read_count = 0;
+    int64_t last_read_size = 0;
+private:
+    sp::string data;
+    int64_t position = 0;
+};
+
+}
+
+TEST_CASE("BufferedResourceStream")
+{
+    sp::string data = "first\r\nsecond\n\nlast";
+    for(int n=0; n<100; n++)
+        data += "\n" + sp::string(n) + sp::string(sp::string("x") * 1000);
+    auto source = std::make_shared<CountingStream>(data);
+    sp::io::BufferedResourceStream stream(source, 4096);
+
+    CHECK(stream.getSize() == int64_t(data.size()));
+    CHECK(stream.readLine() == "first");
+    CHECK(stream.readLine() == "second");
+    CHECK(stream.readLine() == "");
+    CHECK(stream.readLine() == "last");
+    CHECK(stream.tell() == 20);
+    CHECK(source->read_count == 1);
+    for(int n=0; n<100; n++)
+        CHECK(stream.readLine() == sp::string(n) + sp::string(sp::string("x") * 1000));
+    CHECK(stream.tell() == stream.getSize());
+    CHECK(stream.readLine() == "");
+
+    //Seeking inside the buffer does not read again, seeking outside of it does.
+    int reads = source->read_count;
+    char buffer[10];
+    stream.seek(stream.getSize() - 100);
+    CHECK(stream.read(buffer, 10) == 10);
+    CHECK(source->read_count == reads + 1);
+    stream.seek(stream.getSize() - 10);
+    CHECK(stream.read(buffer, 10) == 10);
+    CHECK(memcmp(buffer, data.data() + data.size() - 10, 10) == 0);
+    CHECK(source->read_count == reads + 1);
+    stream.seek(7);
+    CHECK(stream.readLine() == "second");
+    CHECK(source->read_count == reads + 2);
+
+    stream.seek(2);
+    CHECK(stream.readAll() == data.substr(2));
+
+    //The buffer of a small stream is not larger than the stream.
+    auto small_source = std::make_shared<CountingStream>("a\nb");
+    sp::io::BufferedResourceStream small_stream(small_source);
+    CHECK(small_stream.readLine() == "a");
+    CHECK(small_stream.readLine() == "b");
+    CHECK(small_source->last_read_size == 3);
+}
+
+TEST_CASE("BufferedResourceStream benchmark" * doctest::skip())
+{
+    FILE* f = fopen("resource_stream_benchmark.obj", "wb");
+    REQUIRE(f);
+    //About 50MB of vertices, normals, uvs and faces.
+    for(int n=0; n<400000; n++)
+    {
+        fprintf(f, "v %f %f %f\n", n * 0.001f, n * 0.002f, n * 0.003f);
+        fprintf(f, "vn %f %f %f\n", 0.577f, 0.577f, 0.577f);
+        fprintf(f, "vt %f %f\n", (n % 100) * 0.01f, (n % 77) * 0.013f);
+        if (n > 2)
+            fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", n - 2, n - 2, n - 2, n - 1, n - 1, n - 1, n, n, n);
+    }
+    int64_t obj_size = ftell(f);
+    fclose(f);
+    f = fopen("resource_stream_benchmark.txt", "wb");
+    REQUIRE(f);
+    for(int n=0; n<100000; n++)
+        fprintf(f, "[node%d] {\n    name: Node %d\n    value: %d\n    {\n        position: %d, %d\n    }\n}\n", n, n, n * 3, n, -n);
+    int64_t tree_size = ftell(f);
+    fclose(f);
+
+    sp::P<sp::io::DirectoryResourceProvider> provider = new sp::io::DirectoryResourceProvider(".", 1000);
+
+    auto start = std::chrono::steady_clock::now();
+    int lines = 0;
+    auto unbuffered = provider->getStream("resource_stream_benchmark.obj");
+    while(unbuffered->tell() < unbuffered->getSize())
+    {
+        unbuffered->readLine();
+        lines++;
+    }
+    auto unbuffered_done = std::chrono::steady_clock::now();
+    auto buffered = sp::io::ResourceProvider::get("resource_stream_benchmark.obj");
+    while(buffered->tell() < buffered->getSize())
+    {
+        buffered->readLine();
+        lines--;
+    }
+    CHECK(lines == 0);
+    auto buffered_done = std::chrono::steady_clock::now();
+    auto mesh = sp::obj_loader.get("resource_stream_benchmark.obj");
+    CHECK(mesh);
+    auto obj_done = std::chrono::steady_clock::now();
+    auto tree = sp::io::KeyValueTreeLoader::load("resource_stream_benchmark.txt");
+    REQUIRE(tree);
+    CHECK(tree->root_nodes.size() == 100000);
+    auto tree_done = std::chrono::steady_clock::now();
+
+    double unbuffered_time = std::chrono::duration<double>(unbuffered_done - start).count();
+    double buffered_time = std::chrono::duration<double>(buffered_done - unbuffered_done).count();
+    double obj_time = std::chrono::duration<double>(obj_done - buffered_done).count();
+    double tree_time = std::chrono::duration<double>(tree_done - obj_done).count();
+    double obj_mb = obj_size / 1024.0 / 1024.0;
+    double tree_mb = tree_size / 1024.0 / 1024.0;
+    MESSAGE("readLine unbuffered: " << obj_mb / unbuffered_time << "MB/s");
+    MESSAGE("readLine buffered: " << obj_mb / buffered_time << "MB/s");
+    MESSAGE("ObjLoader: " << obj_mb << "MB in " << obj_time << "s");
+    MESSAGE("KeyValueTreeLoader: " << tree_mb << "MB in " << tree_time << "s");
+
+    provider.destroy();
+    remove("resource_stream_benchmark.obj");
+    remove("resource_stream_benchmark.txt");
+}
@@ -0,0 +1,114 @@
+#include <sp2/io/resourceWatcher.h>
+#include <sp2/io/directoryResourceProvider.h>
+#include <sp2/io/filesystem.h>
+#include <sp2/script/environment.h>
+#include <stdio.h>
+#include <thread>
+#include "doctest.h"
+
+//Run updates till the condition is true, changes from the disk arrive through a background thread.
+template<typename F> static bool updateUntil(F f)
+{
+    for(int n=0; n<200 && !f(); n++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        sp::io::ResourceWatcher::update();
+    }
+    return f();
+}
+
+TEST_CASE("ResourceWatcher")
+{
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(50));
+    int calls = 0;
+    int id = sp::io::ResourceWatcher::watch("watched.txt#flag", [&calls]() { calls++; });
+
+    //A burst of changes results in a single call, after the changes stopped.
+    sp::io::ResourceWatcher::notify("watched.txt");
+    sp::io::ResourceWatcher::notify("other.txt");
+    sp::io::ResourceWatcher::notify("watched.txt");
+    sp::io::ResourceWatcher::update();
+    CHECK(calls == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    sp::io::ResourceWatcher::update();
+    CHECK(calls == 1);
+    sp::io::ResourceWatcher::update();
+    CHECK(calls == 1);
+
+    sp::io::ResourceWatcher::unwatch(id);
+    sp::io::ResourceWatcher::notify("watched.txt");
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    sp::io::ResourceWatcher::update();
+    CHECK(calls == 1);
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(100));
+}
+
+namespace {
+//A provider that cannot report changes itself, with a modify time set by the test.
+class PolledTestResourceProvider : public sp::io::ResourceProvider
+{
+public:
+    PolledTestResourceProvider() : sp::io::ResourceProvider(1000) {}
+
+    virtual sp::io::ResourceStreamPtr getStream(const sp::string& filename) override { return nullptr; }
+    virtual std::chrono::system_clock::time_point getResourceModifyTime(const sp::string& filename) override
+    {
+        if (filename == "polled.txt")
+            return modify_time;
+        return std::chrono::system_clock::time_point();
+    }
+    virtual std::vector<sp::string> findResources(const sp::string& search_pattern) override { return {}; }
+
+    std::chrono::system_clock::time_point modify_time = std::chrono::system_clock::time_point() + std::chrono::seconds(1);
+};
+}
+
+TEST_CASE("ResourceWatcher polling")
+{
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(10));
+    sp::io::ResourceWatcher::setPollInterval(std::chrono::milliseconds(20));
+    sp::P<PolledTestResourceProvider> provider = new PolledTestResourceProvider();
+    int calls = 0;
+    int id = sp::io::ResourceWatcher::watch("polled.txt", [&calls]() { calls++; });
+
+    //Without a change of the modify time, nothing is reported.
+    CHECK(!updateUntil([&calls]() { return calls > 0; }));
+    provider->modify_time += std::chrono::seconds(1);
+    CHECK(updateUntil([&calls]() { return calls > 0; }));
+    CHECK(calls == 1);
+
+    sp::io::ResourceWatcher::unwatch(id);
+    provider.destroy();
+    sp::io::ResourceWatcher::setPollInterval(std::chrono::milliseconds(1000));
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(100));
+}
+
+TEST_CASE("ResourceWatcher DirectoryResourceProvider")
+{
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(10));
+    sp::io::makeDirectory("resource_watcher_test");
+    sp::io::saveFileContents("resource_watcher_test/script.lua", "value = 1");
+    {
+        sp::P<sp::io::DirectoryResourceProvider> provider = new sp::io::DirectoryResourceProvider("resource_watcher_test", 1000);
+        //Changes are seen once the background index is built, searches wait for that.
+        provider->findResources("*");
+        int calls = 0;
+        int id = sp::io::ResourceWatcher::watch("script.lua", [&calls]() { calls++; });
+
+        sp::P<sp::script::Environment> environment = new sp::script::Environment();
+        environment->setAutoReload(true);
+        CHECK(environment->load("script.lua").isOk());
+        CHECK(environment->run("return value").value().getInteger() == 1);
+
+        sp::io::saveFileContents("resource_watcher_test/script.lua", "value = 2");
+        CHECK(updateUntil([&calls]() { return calls > 0; }));
+        CHECK(environment->run("return value").value().getInteger() == 2);
+
+        sp::io::ResourceWatcher::unwatch(id);
+        environment.destroy();
+        provider.destroy();
+    }
+    remove("resource_watcher_test/script.lua");
+    remove("resource_watcher_test");
+    sp::io::ResourceWatcher::setCoalesceDelay(std::chrono::milliseconds(100));
+}
@@ -0,0 +1,187 @@
+#include <sp2/multiplayer/snapshot.h>
+#include "doctest.h"
+
+#include <chrono>
+
+namespace {
+class TestRegistry : public sp::multiplayer::Base
+{
+public:
+    virtual uint32_t getClientId() override { return 0; }
+};
+
+class TestObject
+{
+public:
+    float health = 100.0f;
+    int32_t state = 0;
+    sp::Vector2d position;
+    double heading = 0.0;
+
+    std::vector<sp::multiplayer::ReplicationLinkBase*> links;
+
+    TestObject()
+    {
+        links.push_back(new sp::multiplayer::ReplicationLink<float>(health));
+        links.push_back(new sp::multiplayer::ReplicationLink<int32_t>(state));
+        links.push_back(new sp::multiplayer::ReplicationLink<sp::Vector2d>(position));
+        links.push_back(new sp::multiplayer::ReplicationLink<double>(heading));
+    }
+
+    ~TestObject()
+    {
+        for(auto link : links)
+            delete link;
+    }
+};
+}
+
+TEST_CASE("Varint")
+{
+    sp::io::DataBuffer buffer;
+    uint64_t values[] = {0, 1, 127, 128, 300, 16383, 16384, 0xffffffff, 0xffffffffffffffff};
+    for(auto v : values)
+        buffer.writeVarint(v);
+    CHECK(buffer.getDataSize() == 1 + 1 + 1 + 2 + 2 + 2 + 3 + 5 + 10);
+    for(auto v : values)
+    {
+        uint64_t result = 0;
+        buffer.readVarint(result);
+        CHECK(result == v);
+    }
+    CHECK(buffer.available() == 0);
+}
+
+TEST_CASE("Snapshot")
+{
+    TestRegistry registry;
+    TestObject server[3];
+    TestObject client[3];
+
+    sp::multiplayer::SnapshotWriter writer;
+    writer.begin(0x13);
+    writer.addInitial(registry, 1, server[0].links);
+    server[1].state = 5;
+    server[2].position = sp::Vector2d(1, 2);
+    server[2].heading = 3.5;
+    for(int n=1; n<3; n++)
+        writer.addChanged(registry, 1000 + n, server[n].links, 0.1f);
+    CHECK(writer.getEntryCount() == 3);
+    //Nothing changed since the last call, so nothing is added.
+    CHECK(!writer.addChanged(registry, 1001, server[1].links, 0.1f));
+
+    sp::io::DataBuffer packet;
+    packet.write(writer.getPacket());
+    uint8_t packet_id = 0;
+    packet.read(packet_id);
+    CHECK(packet_id == 0x13);
+    sp::multiplayer::SnapshotReader reader(packet);
+    uint64_t id = 0;
+    std::vector<uint64_t> ids;
+    while(reader.next(id))
+    {
+        ids.push_back(id);
+        //Entry for 1001 is skipped, as if the client does not know this object.
+        if (id == 1)
+            reader.apply(registry, client[0].links);
+        if (id == 1002)
+            reader.apply(registry, client[2].links);
+    }
+    CHECK(ids == std::vector<uint64_t>{1, 1001, 1002});
+    CHECK(client[0].health == 100.0f);
+    CHECK(client[1].state == 0);
+    CHECK(client[2].position == sp::Vector2d(1, 2));
+    CHECK(client[2].heading == 3.5);
+    CHECK(client[2].state == 0);
+}
+
+TEST_CASE("Snapshot filtered")
+{
+    TestRegistry registry;
+    TestObject objects[3];
+    sp::multiplayer::SnapshotWriter writer;
+    writer.begin(0x13);
+    for(int n=0; n<3; n++)
+        writer.addInitial(registry, n + 1, objects[n].links);
+
+    sp::io::DataBuffer frame;
+    CHECK(!writer.buildFiltered(frame, {}));
+    CHECK(writer.buildFiltered(frame, {1, 3}));
+    uint8_t packet_id = 0;
+    frame.read(packet_id);
+    CHECK(packet_id == 0x13);
+    sp::multiplayer::SnapshotReader reader(frame);
+    uint64_t id = 0;
+    std::vector<uint64_t> ids;
+    while(reader.next(id))
+        ids.push_back(id);
+    CHECK(ids == std::vector<uint64_t>{1, 3});
+}
+
+TEST_CASE("Snapshot benchmark" * doctest::skip())
+{
+    constexpr int object_count = 2000;
+    constexpr int client_count = 8;
+    constexpr int ticks = 100;
+    TestRegistry registry;
+    std::vector<TestObject> objects(object_count);
+
+    //Every tick, half of the objects change one or two members.
+    auto change = [&objects](int tick)
+    {
+        for(int n=tick % 2; n<object_count; n+=2)
+        {
+            objects[n].position.x += 0.5;
+            if (n % 3 == 0)
+                objects[n].health -= 1.0f;
+        }
+    };
+
+    //Original format: a packet per object with a uint8 packet id, uint64 object id and uint16 link index per member.
+    //Every packet is send to every client as a uint32 size and the data.
+    size_t per_node_bytes = 0;
+    size_t per_node_sends = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int tick=0; tick<ticks; tick++)
+    {
+        change(tick);
+        for(int n=0; n<object_count; n++)
+        {
+            sp::io::DataBuffer packet;
+            packet.write(uint8_t(0x11), uint64_t(n + 1));
+            unsigned int zero_data_size = packet.getDataSize();
+            for(unsigned int index=0; index<objects[n].links.size(); index++)
+            {
+                if (objects[n].links[index]->isChanged(0.1f))
+                {
+                    packet.write(uint16_t(index));
+                    objects[n].links[index]->send(registry, packet);
+                }
+            }
+            if (packet.getDataSize() != zero_data_size)
+            {
+                per_node_bytes += (packet.getDataSize() + sizeof(uint32_t)) * client_count;
+                per_node_sends += client_count;
+            }
+        }
+    }
+    std::chrono::duration<double> per_node_time = std::chrono::steady_clock::now() - start;
+
+    size_t snapshot_bytes = 0;
+    size_t snapshot_sends = 0;
+    sp::multiplayer::SnapshotWriter writer;
+    start = std::chrono::steady_clock::now();
+    for(int tick=0; tick<ticks; tick++)
+    {
+        change(tick);
+        writer.begin(0x13);
+        for(int n=0; n<object_count; n++)
+            writer.addChanged(registry, n + 1, objects[n].links, 0.1f);
+        snapshot_bytes += (writer.getPacket().getDataSize() + sizeof(uint32_t)) * client_count;
+        snapshot_sends += client_count;
+    }
+    std::chrono::duration<double> snapshot_time = std::chrono::steady_clock::now() - start;
+
+    MESSAGE("Per object packets: " << (per_node_bytes / ticks) << " bytes and " << (per_node_sends / ticks) << " sends per tick, " << (per_node_time.count() * 1000.0 / ticks) << "ms per tick");
+    MESSAGE("Snapshot frames:    " << (snapshot_bytes / ticks) << " bytes and " << (snapshot_sends / ticks) << " sends per tick, " << (snapshot_time.count() * 1000.0 / ticks) << "ms per tick");
+}
@@ -1,9 +1,12 @@
 #include <sp2/io/network/tcpSocket.h>
+#include <sp2/io/network/tcpListener.h>
+#include <sp2/io/network/selector.h>
 #include <sp2/io/http/websocket.h>
 #include "doctest.h"
 
 #include <chrono>
 #include <thread>
+#include <memory>
 
 TEST_CASE("TcpSocket")
 {
@@ -34,3 +37,228 @@ TEST_CASE("WebSocket")
     CHECK(socket.isConnected() == true);
 #endif
 }
+
+TEST_CASE("TcpSocket send batching")
+{
+    sp::io::network::TcpListener listener;
+    REQUIRE(listener.listen(32621));
+    sp::io::network::TcpSocket receiver;
+    REQUIRE(receiver.connect(sp::io::network::Address("127.0.0.1"), 32621));
+    sp::io::network::TcpSocket sender;
+    REQUIRE(listener.accept(sender));
+
+    sender.setSendBatching(true);
+    auto shared = std::make_shared<sp::io::DataBuffer>(sp::string(std::string(5000, 'x')));
+    for(int n=0; n<100; n++)
+    {
+        sender.send(sp::io::DataBuffer(int32_t(n)));
+        if (n % 10 == 0)
+            sender.send(shared);
+    }
+    //Nothing is send until the flush, which writes everything at once.
+    CHECK(sender.getSendCallCount() == 0);
+    CHECK(!sender.flush());
+    CHECK(sender.getSendCallCount() <= 2);
+
+    bool in_order = true;
+    for(int n=0; n<100; n++)
+    {
+        sp::io::DataBuffer packet;
+        int32_t value = -1;
+        REQUIRE(receiver.receive(packet));
+        packet.read(value);
+        in_order = in_order && value == n;
+        if (n % 10 == 0)
+        {
+            sp::string data;
+            REQUIRE(receiver.receive(packet));
+            packet.read(data);
+            in_order = in_order && data.length() == 5000;
+        }
+    }
+    CHECK(in_order);
+}
+
+TEST_CASE("TcpSocket receive framing")
+{
+    sp::io::network::TcpListener listener;
+    REQUIRE(listener.listen(32623));
+    sp::io::network::TcpSocket sender;
+    REQUIRE(sender.connect(sp::io::network::Address("127.0.0.1"), 32623));
+    sp::io::network::TcpSocket receiver;
+    REQUIRE(listener.accept(receiver));
+    receiver.setBlocking(false);
+    receiver.setMaxPacketSize(128 * 1024);
+    auto waitForData = []() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); };
+
+    //A partial size header does not block.
+    sp::io::DataBuffer packet;
+    uint8_t header[] = {0, 0, 0, 4, 1, 2};
+    sender.send(header, 2);
+    waitForData();
+    CHECK(!receiver.receive(packet));
+    sender.send(header + 2, 4);
+    waitForData();
+    CHECK(!receiver.receive(packet));
+    uint8_t rest[] = {3, 4};
+    sender.send(rest, 2);
+    waitForData();
+    REQUIRE(receiver.receive(packet));
+    CHECK(packet.getDataSize() == 4);
+
+    //Multiple packets in one go, and a packet larger then the receive buffer.
+    sender.setSendBatching(true);
+    for(int n=0; n<100; n++)
+        sender.send(sp::io::DataBuffer(int32_t(n)));
+    sender.send(sp::io::DataBuffer(sp::string(std::string(100000, 'x'))));
+    sender.send(sp::io::DataBuffer(int32_t(100)));
+    sender.flush();
+    int count = 0;
+    bool large_received = false;
+    for(int retry=0; retry<100 && count < 101; retry++)
+    {
+        while(receiver.receive(packet))
+        {
+            if (packet.getDataSize() == 4)
+            {
+                int32_t value = -1;
+                packet.read(value);
+                CHECK(value == count);
+                count++;
+            }
+            else
+            {
+                sp::string data;
+                packet.read(data);
+                large_received = data.length() == 100000 && count == 100;
+            }
+        }
+        waitForData();
+    }
+    CHECK(count == 101);
+    CHECK(large_received);
+
+    //A packet over the limit closes the connection.
+    sender.send(sp::io::DataBuffer(sp::string(std::string(150000, 'x'))));
+    sender.flush();
+    waitForData();
+    CHECK(!receiver.receive(packet));
+    CHECK(!receiver.isConnected());
+}
+
+TEST_CASE("Selector")
+{
+    constexpr int count = 50;
+    sp::io::network::TcpListener listener;
+    REQUIRE(listener.listen(32624));
+    std::vector<sp::io::network::TcpSocket> clients(count);
+    std::vector<sp::io::network::TcpSocket> servers(count);
+    sp::io::network::Selector level;
+    sp::io::network::Selector edge(sp::io::network::Selector::Trigger::Edge);
+    for(int n=0; n<count; n++)
+    {
+        REQUIRE(clients[n].connect(sp::io::network::Address("127.0.0.1"), 32624));
+        REQUIRE(listener.accept(servers[n]));
+        level.add(servers[n]);
+        edge.add(servers[n]);
+    }
+
+    level.wait(0);
+    CHECK(level.getReady().empty());
+    uint8_t data[] = {1, 2, 3};
+    clients[3].send(data, sizeof(data));
+    clients[17].send(data, sizeof(data));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    level.wait(100);
+    CHECK(level.getReady().size() == 2);
+    CHECK(level.isReady(servers[3]));
+    CHECK(level.isReady(servers[17]));
+    CHECK(!level.isReady(servers[4]));
+
+    //Level triggered keeps reporting unread data, edge triggered only reports new data.
+    level.wait(0);
+    CHECK(level.getReady().size() == 2);
+    edge.wait(0);
+    CHECK(edge.isReady(servers[3]));
+#ifdef __linux__
+    edge.wait(0);
+    CHECK(edge.getReady().empty());
+#endif
+
+    level.remove(servers[3]);
+    level.wait(0);
+    CHECK(level.getReady().size() == 1);
+    CHECK(!level.isReady(servers[3]));
+
+    level.setWriteInterest(servers[5], true);
+    level.wait(0);
+    CHECK(level.isWritable(servers[5]));
+    CHECK(!level.isReady(servers[5]));
+    CHECK(!level.isWritable(servers[6]));
+    level.setWriteInterest(servers[5], false);
+
+    //A socket that closed itself on a closed connection can still be removed.
+    clients[17].close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint8_t buffer[16];
+    while(servers[17].receive(buffer, sizeof(buffer)) > 0)
+    {
+    }
+    CHECK(!servers[17].isConnected());
+    level.remove(servers[17]);
+    edge.remove(servers[17]);
+    level.wait(0);
+    CHECK(level.getReady().empty());
+    edge.wait(0);
+    for(auto socket : edge.getReady())
+        CHECK(socket != &servers[17]);
+}
+
+TEST_CASE("TcpSocket send benchmark" * doctest::skip())
+{
+    constexpr int ticks = 20;
+    constexpr int packets_per_tick = 5000;
+
+    //Original: the size prefix and the data with two separate sends. Unbatched: a single send per packet. Batched: a single flush per tick.
+    for(int mode=0; mode<3; mode++)
+    {
+        sp::io::network::TcpListener listener;
+        REQUIRE(listener.listen(32622));
+        sp::io::network::TcpSocket receiver;
+        REQUIRE(receiver.connect(sp::io::network::Address("127.0.0.1"), 32622));
+        sp::io::network::TcpSocket sender;
+        REQUIRE(listener.accept(sender));
+        sender.setSendBatching(mode == 2);
+
+        std::thread reader([&receiver]()
+        {
+            sp::io::DataBuffer packet;
+            for(int n=0; n<ticks * packets_per_tick; n++)
+                receiver.receive(packet);
+        });
+        auto start = std::chrono::steady_clock::now();
+        for(int tick=0; tick<ticks; tick++)
+        {
+            for(int n=0; n<packets_per_tick; n++)
+            {
+                sp::io::DataBuffer packet(uint8_t(0x11), uint64_t(n), uint16_t(0), float(tick));
+                if (mode == 0)
+                {
+                    sp::io::DataBuffer packet_size(uint32_t(packet.getDataSize()));
+                    sender.send(packet_size.getData(), packet_size.getDataSize());
+                    sender.send(packet.getData(), packet.getDataSize());
+                }
+                else
+                {
+                    sender.send(packet);
+                }
+            }
+            sender.flush();
+        }
+        reader.join();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+        const char* names[] = {"Original", "Unbatched", "Batched"};
+        MESSAGE(names[mode] << ": " << int(ticks * packets_per_tick / duration.count()) << " packets/sec, " << (sender.getSendCallCount() / ticks) << " send calls per tick");
+    }
+}
@@ -0,0 +1,259 @@
+#include <sp2/multiplayer/udpConnection.h>
+#include <sp2/io/network/udpSocket.h>
+#include "doctest.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+using sp::multiplayer::UdpConnection;
+
+class Peer
+{
+public:
+    sp::io::network::UdpSocket socket;
+    int remote_port;
+    UdpConnection connection;
+
+    Peer(int local_port, int remote_port)
+    : remote_port(remote_port), connection([this](const sp::io::DataBuffer& datagram) { socket.send(datagram, sp::io::network::Address("127.0.0.1"), this->remote_port); })
+    {
+        socket.bind(local_port);
+        socket.setBlocking(false);
+    }
+
+    void update(float now)
+    {
+        sp::io::DataBuffer datagram;
+        sp::io::network::Address address;
+        int port;
+        while(socket.receive(datagram, address, port))
+            connection.onDatagram(datagram.getData(), datagram.getDataSize(), now);
+        connection.update(now);
+    }
+};
+}
+
+TEST_CASE("UdpConnection")
+{
+#ifndef EMSCRIPTEN
+    //Two connections over loopback, with a bad network simulated on both sides.
+    Peer a(32611, 32612);
+    Peer b(32612, 32611);
+    a.connection.setSimulation(0.2f, 0.04f, 0.02f);
+    b.connection.setSimulation(0.2f, 0.04f, 0.02f);
+
+    constexpr int reliable_count = 50;
+    constexpr int unreliable_count = 200;
+    int reliable_received = 0;
+    bool reliable_in_order = true;
+    int unreliable_received = 0;
+    int unreliable_lost = 0;
+    int last_unreliable = -1;
+    bool unreliable_in_order = true;
+    bool unreliable_after_reliable = true;
+
+    float now = 0.0f;
+    for(int tick=0; tick<1000; tick++)
+    {
+        if (tick < reliable_count)
+        {
+            //Some reliable messages need multiple datagrams.
+            sp::io::DataBuffer message(uint8_t(1), int32_t(tick), sp::string(std::string(tick * 100, 'x')));
+            a.connection.send(message, UdpConnection::Channel::Reliable);
+        }
+        if (tick < unreliable_count)
+        {
+            sp::io::DataBuffer message(uint8_t(0), int32_t(tick), int32_t(std::min(tick + 1, reliable_count)));
+            a.connection.send(message, UdpConnection::Channel::Unreliable, tick + 1);
+        }
+
+        a.update(now);
+        b.update(now);
+        sp::io::DataBuffer message;
+        while(b.connection.receive(message))
+        {
+            uint8_t type = 0;
+            int32_t index = 0;
+            message.read(type, index);
+            if (type == 1)
+            {
+                sp::string data;
+                message.read(data);
+                if (index != reliable_received || data.length() != size_t(index * 100))
+                    reliable_in_order = false;
+                reliable_received++;
+            }
+            else
+            {
+                int32_t reliable_send = 0;
+                message.read(reliable_send);
+                if (index <= last_unreliable)
+                    unreliable_in_order = false;
+                if (reliable_received < reliable_send)
+                    unreliable_after_reliable = false;
+                last_unreliable = index;
+                unreliable_received++;
+            }
+        }
+        uint32_t tag;
+        while(a.connection.getLostTag(tag))
+            unreliable_lost++;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        now += 0.01f;
+    }
+
+    CHECK(reliable_received == reliable_count);
+    CHECK(reliable_in_order);
+    CHECK(a.connection.getPendingReliableCount() == 0);
+    CHECK(unreliable_in_order);
+    CHECK(unreliable_after_reliable);
+    CHECK(unreliable_received > unreliable_count / 3);
+    CHECK(unreliable_received < unreliable_count);
+    //Every message that did not arrive is reported as lost.
+    CHECK(unreliable_received + unreliable_lost >= unreliable_count);
+    CHECK(a.connection.getRoundTripTime() > 0.08f);
+    CHECK(a.connection.getRoundTripTime() < 0.3f);
+    CHECK(a.connection.getPacketLoss() > 0.05f);
+    CHECK(!a.connection.isTimedOut(now));
+#endif
+}
+
+TEST_CASE("UdpConnection outdated unreliable message")
+{
+    //Connections wired directly together, so datagrams can be reordered by hand.
+    std::vector<sp::io::DataBuffer> a_out;
+    std::vector<sp::io::DataBuffer> b_out;
+    UdpConnection a([&a_out](const sp::io::DataBuffer& datagram) { a_out.emplace_back(); a_out.back().write(datagram); });
+    UdpConnection b([&b_out](const sp::io::DataBuffer& datagram) { b_out.emplace_back(); b_out.back().write(datagram); });
+
+    a.send(sp::io::DataBuffer(int32_t(1)), UdpConnection::Channel::Unreliable, 1);
+    a.update(0.0f);
+    a.send(sp::io::DataBuffer(int32_t(2)), UdpConnection::Channel::Unreliable, 2);
+    a.update(0.01f);
+    REQUIRE(a_out.size() == 2);
+    float send_rate = a.getSendRate();
+
+    //The second message arrives first, so the first one is outdated and dropped.
+    CHECK(b.onDatagram(a_out[1].getData(), a_out[1].getDataSize(), 0.05f));
+    CHECK(b.onDatagram(a_out[0].getData(), a_out[0].getDataSize(), 0.05f));
+    sp::io::DataBuffer message;
+    int32_t value = 0;
+    REQUIRE(b.receive(message));
+    message.read(value);
+    CHECK(value == 2);
+    CHECK(!b.receive(message));
+
+    //Both datagrams are acknowledged, so nothing counts as packet loss, but the tag of the dropped message is reported.
+    b.update(0.05f);
+    for(auto& datagram : b_out)
+        CHECK(a.onDatagram(datagram.getData(), datagram.getDataSize(), 0.1f));
+    a.update(1.0f);
+    uint32_t tag = 0;
+    REQUIRE(a.getLostTag(tag));
+    CHECK(tag == 1);
+    CHECK(!a.getLostTag(tag));
+    CHECK(a.getPacketLoss() == 0.0f);
+    CHECK(a.getSendRate() >= send_rate);
+}
+
+//A datagram with a single split fragment, as a misbehaving peer could send it.
+static sp::io::DataBuffer buildFragmentDatagram(uint16_t sequence, bool reliable, uint16_t id, uint64_t index, uint64_t count)
+{
+    sp::io::DataBuffer datagram(uint16_t(0x5332), sequence, uint8_t(0));
+    datagram.write(uint8_t(reliable ? 0x03 : 0x02), id);
+    if (!reliable)
+        datagram.write(uint16_t(0));
+    std::vector<uint8_t> data(100);
+    datagram.writeVarint(index);
+    datagram.writeVarint(count);
+    datagram.writeVarint(data.size());
+    datagram.appendRaw(data.data(), data.size());
+    return datagram;
+}
+
+TEST_CASE("UdpConnection receive limits")
+{
+    UdpConnection a([](const sp::io::DataBuffer&) {});
+    uint16_t sequence = 0;
+    //Incomplete reliable messages are kept, up to a limited number of split messages.
+    for(uint16_t id=1; id<=16; id++)
+    {
+        auto datagram = buildFragmentDatagram(sequence++, true, id, 0, 2);
+        CHECK(a.onDatagram(datagram.getData(), datagram.getDataSize(), 0.0f));
+    }
+    //Too many incomplete unreliable messages only drops the oldest ones.
+    for(uint16_t id=1; id<=32; id++)
+    {
+        auto datagram = buildFragmentDatagram(sequence++, false, id, 0, 2);
+        CHECK(a.onDatagram(datagram.getData(), datagram.getDataSize(), 0.0f));
+    }
+    CHECK(!a.isClosed());
+    auto overflow = buildFragmentDatagram(sequence++, true, 17, 0, 2);
+    CHECK(!a.onDatagram(overflow.getData(), overflow.getDataSize(), 0.0f));
+    CHECK(a.isClosed());
+    CHECK(a.isTimedOut(0.0f));
+    //Nothing is accepted anymore after the connection is closed.
+    auto valid = buildFragmentDatagram(sequence++, true, 0, 0, 1);
+    CHECK(!a.onDatagram(valid.getData(), valid.getDataSize(), 0.0f));
+
+    //A message larger then the maximum message size.
+    UdpConnection b([](const sp::io::DataBuffer&) {});
+    auto too_large = buildFragmentDatagram(0, false, 0, 0, UdpConnection::max_message_size);
+    CHECK(!b.onDatagram(too_large.getData(), too_large.getDataSize(), 0.0f));
+    CHECK(b.isClosed());
+
+    //A reliable message far ahead of the messages that are delivered.
+    UdpConnection c([](const sp::io::DataBuffer&) {});
+    auto far_ahead = buildFragmentDatagram(0, true, 0x4000, 0, 1);
+    CHECK(!c.onDatagram(far_ahead.getData(), far_ahead.getDataSize(), 0.0f));
+    CHECK(c.isClosed());
+}
+
+TEST_CASE("UdpConnection reliable send window")
+{
+    //The sending side stays within the receive limits, even when nothing is acknowledged for a while.
+    std::vector<sp::io::DataBuffer> a_out;
+    std::vector<sp::io::DataBuffer> b_out;
+    UdpConnection a([&a_out](const sp::io::DataBuffer& datagram) { a_out.emplace_back(); a_out.back().write(datagram); });
+    UdpConnection b([&b_out](const sp::io::DataBuffer& datagram) { b_out.emplace_back(); b_out.back().write(datagram); });
+
+    constexpr int message_count = 40;
+    for(int n=0; n<message_count; n++)
+        a.send(sp::io::DataBuffer(int32_t(n), sp::string(std::string(2000, 'x'))), UdpConnection::Channel::Reliable);
+
+    int received = 0;
+    bool in_order = true;
+    float now = 0.0f;
+    for(int tick=0; tick<500 && received < message_count; tick++)
+    {
+        a.update(now);
+        //The acknowledgements of the peer get lost at first, so the sending side has to wait on the window.
+        for(auto& datagram : a_out)
+            CHECK(b.onDatagram(datagram.getData(), datagram.getDataSize(), now));
+        a_out.clear();
+        b.update(now);
+        if (tick >= 50)
+        {
+            for(auto& datagram : b_out)
+                CHECK(a.onDatagram(datagram.getData(), datagram.getDataSize(), now));
+        }
+        b_out.clear();
+        sp::io::DataBuffer message;
+        while(b.receive(message))
+        {
+            int32_t index = -1;
+            message.read(index);
+            if (index != received)
+                in_order = false;
+            received++;
+        }
+        if (tick == 49)
+            CHECK(received == 16);
+        now += 0.01f;
+    }
+    CHECK(received == message_count);
+    CHECK(in_order);
+    CHECK(!b.isClosed());
+}
@@ -0,0 +1,177 @@
+#include <sp2/scene/visibilityTree.h>
+#include <sp2/scene/scene.h>
+#include <sp2/scene/node.h>
+#include <sp2/graphics/meshdata.h>
+#include <sp2/math/matrix4x4.h>
+#include "doctest.h"
+
+#include <algorithm>
+#include <cstdint>
+
+TEST_CASE("Frustum")
+{
+    sp::Frustumf frustum(sp::Matrix4x4f::ortho(-10, 10, -10, 10, -10, 10));
+
+    CHECK(frustum.check(sp::AABB3f(sp::Vector3f(-1, -1, -1), sp::Vector3f(1, 1, 1))) == sp::Frustumf::Result::Inside);
+    CHECK(frustum.check(sp::AABB3f(sp::Vector3f(9, -1, -1), sp::Vector3f(11, 1, 1))) == sp::Frustumf::Result::Intersects);
+    CHECK(frustum.check(sp::AABB3f(sp::Vector3f(20, -1, -1), sp::Vector3f(22, 1, 1))) == sp::Frustumf::Result::Outside);
+    CHECK(frustum.check(sp::AABB3f(sp::Vector3f(-1, -22, -1), sp::Vector3f(1, -20, 1))) == sp::Frustumf::Result::Outside);
+    CHECK(frustum.check(sp::AABB3f::infinite()) == sp::Frustumf::Result::Intersects);
+}
+
+TEST_CASE("VisibilityTree")
+{
+    //The tree never dereferences nodes, so fake pointers are good enough to identify the results.
+    std::vector<sp::Node*> nodes;
+    for(int n=0; n<1000; n++)
+        nodes.push_back(reinterpret_cast<sp::Node*>(std::intptr_t(n + 1) * 16));
+
+    sp::VisibilityTree tree;
+    std::vector<int> proxies;
+    for(int n=0; n<1000; n++)
+    {
+        sp::Vector3f position(float(n % 100) * 4.0f, float(n / 100) * 4.0f, 0.0f);
+        proxies.push_back(tree.add(nodes[n], sp::AABB3f(position - sp::Vector3f(1, 1, 1), position + sp::Vector3f(1, 1, 1))));
+    }
+    CHECK(tree.size() == 1000);
+    CHECK(tree.getHeight() < 20);
+
+    //Camera at 20,20 that covers x 0..40 and y 0..40, which is 11 columns and all 10 rows.
+    sp::Frustumf frustum(sp::Matrix4x4f::ortho(-20, 20, -20, 20, -10, 10) * sp::Matrix4x4f::translate(-20, -20, 0));
+    std::vector<sp::Node*> result;
+    tree.query(frustum, result);
+    CHECK(result.size() == 110);
+    CHECK(std::find(result.begin(), result.end(), nodes[0]) != result.end());
+    CHECK(std::find(result.begin(), result.end(), nodes[50]) == result.end());
+
+    //Small movements stay inside the enlarged bounds and do not change the tree.
+    CHECK(!tree.update(proxies[0], sp::AABB3f(sp::Vector3f(-0.9f, -1, -1), sp::Vector3f(1.1f, 1, 1))));
+    CHECK(tree.update(proxies[50], sp::AABB3f(sp::Vector3f(19, 19, -1), sp::Vector3f(21, 21, 1))));
+    result.clear();
+    tree.query(frustum, result);
+    CHECK(result.size() == 111);
+    CHECK(std::find(result.begin(), result.end(), nodes[50]) != result.end());
+
+    for(int n=0; n<1000; n+=2)
+        tree.remove(proxies[n]);
+    CHECK(tree.size() == 500);
+    result.clear();
+    tree.query(frustum, result);
+    CHECK(std::find(result.begin(), result.end(), nodes[0]) == result.end());
+    CHECK(std::find(result.begin(), result.end(), nodes[1]) != result.end());
+    for(int n=1; n<1000; n+=2)
+        tree.remove(proxies[n]);
+    CHECK(tree.size() == 0);
+    CHECK(tree.getHeight() == 0);
+}
+
+namespace {
+class VisibilityTestNode : public sp::Node
+{
+public:
+    VisibilityTestNode(sp::P<sp::Node> parent) : sp::Node(parent) {}
+
+    virtual sp::AABB3f getRenderBounds() override
+    {
+        bounds_calls++;
+        return sp::Node::getRenderBounds();
+    }
+
+    int bounds_calls = 0;
+};
+}
+
+TEST_CASE("Scene visibility")
+{
+    sp::P<sp::Scene> scene = new sp::Scene("visibility_test");
+    auto mesh = sp::MeshData::createQuad(sp::Vector2f(2, 2));
+    std::vector<sp::P<VisibilityTestNode>> nodes;
+    for(int n=0; n<100; n++)
+    {
+        VisibilityTestNode* node = new VisibilityTestNode(scene->getRoot());
+        node->setPosition(sp::Vector2d(n * 4, 0));
+        node->render_data.type = sp::RenderData::Type::Normal;
+        node->render_data.mesh = mesh;
+        nodes.push_back(node);
+    }
+    //Without a mesh, a node is never in the visibility tree.
+    new VisibilityTestNode(scene->getRoot());
+
+    sp::Frustumf frustum(sp::Matrix4x4f::ortho(-20, 20, -20, 20, -10, 10) * sp::Matrix4x4f::translate(-20, 0, 0));
+    std::vector<sp::Node*> result;
+    scene->updateVisibility();
+    CHECK(scene->getVisibilityNodeCount() == 100);
+    scene->queryVisibleNodes(frustum, result);
+    CHECK(result.size() == 11);
+
+    //Without changes, nothing is looked at again.
+    for(auto node : nodes)
+        node->bounds_calls = 0;
+    scene->updateVisibility();
+    for(auto node : nodes)
+        CHECK(node->bounds_calls == 0);
+
+    //Moving a node, or changing its render data, updates only that node.
+    nodes[50]->setPosition(sp::Vector2d(10, 0));
+    nodes[0]->render_data.mesh = nullptr;
+    nodes[0]->markRenderDataDirty();
+    scene->updateVisibility();
+    CHECK(nodes[50]->bounds_calls == 1);
+    CHECK(nodes[1]->bounds_calls == 0);
+    CHECK(scene->getVisibilityNodeCount() == 99);
+    scene->queryVisibleNodes(frustum, result);
+    CHECK(result.size() == 11);
+    CHECK(std::find(result.begin(), result.end(), *nodes[50]) != result.end());
+    CHECK(std::find(result.begin(), result.end(), *nodes[0]) == result.end());
+
+    //Destroying queued nodes removes them from the queue.
+    nodes[2]->setPosition(sp::Vector2d(-100, 0));
+    nodes[2].destroy();
+    scene->updateVisibility();
+    CHECK(scene->getVisibilityNodeCount() == 98);
+
+    scene.destroy();
+}
+
+TEST_CASE("Scene visibility without culling")
+{
+    //Without a culling pass no changes are tracked, so nodes created and destroyed every frame are not kept around.
+    sp::P<sp::Scene> scene = new sp::Scene("visibility_unused_test");
+    auto mesh = sp::MeshData::createQuad(sp::Vector2f(2, 2));
+    std::vector<sp::P<VisibilityTestNode>> nodes;
+    for(int frame=0; frame<10; frame++)
+    {
+        for(auto node : nodes)
+            node.destroy();
+        nodes.clear();
+        for(int n=0; n<100; n++)
+        {
+            VisibilityTestNode* node = new VisibilityTestNode(scene->getRoot());
+            node->setPosition(sp::Vector2d(n * 4, 0));
+            node->render_data.type = sp::RenderData::Type::Normal;
+            node->render_data.mesh = mesh;
+            nodes.push_back(node);
+        }
+        scene->getNodesDepthFirst();
+    }
+    //The first culling pass still finds every node.
+    scene->updateVisibility();
+    CHECK(scene->getVisibilityNodeCount() == 100);
+    for(auto node : nodes)
+        CHECK(node->bounds_calls == 1);
+
+    //Nodes destroyed while queued are compacted away, the remaining ones are still updated.
+    for(int n=0; n<50; n++)
+    {
+        nodes[n]->setPosition(sp::Vector2d(n * 4, 10));
+        nodes[n].destroy();
+    }
+    nodes[99]->setPosition(sp::Vector2d(0, 10));
+    scene->getNodesDepthFirst();
+    scene->updateVisibility();
+    CHECK(scene->getVisibilityNodeCount() == 50);
+    CHECK(nodes[99]->bounds_calls == 2);
+    CHECK(nodes[98]->bounds_calls == 1);
+
+    scene.destroy();
+}
@@ -0,0 +1,231 @@
+#include <sp2/io/zipResourceProvider.h>
+#include <stdio.h>
+#include <chrono>
+#include "miniz.h"
+#include "doctest.h"
+
+static std::vector<uint8_t> zipTestData(size_t size, uint32_t seed, bool compressible)
+{
+    std::vector<uint8_t> data(size);
+    for(size_t n=0; n<size; n++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[n] = compressible ? "abcdefgh \n"[(seed >> 16) % 10] : uint8_t(seed >> 16);
+    }
+    return data;
+}
+
+//The archive APIs of miniz are disabled, so write the zip structures directly.
+class ZipTestWriter
+{
+public:
+    //Data can be put in front of the zip, offsets in the zip are then relative to the start of the zip, like a zip appended to an executable.
+    ZipTestWriter(const char* filename, size_t prefix_size=0)
+    : prefix_size(uint32_t(prefix_size))
+    {
+        f = fopen(filename, "wb");
+        for(size_t n=0; n<prefix_size; n++)
+            fputc(0x90, f);
+    }
+
+    //A corrupt zip is written when the uncompressed size is claimed to be larger then the data.
+    bool add(const sp::string& name, const std::vector<uint8_t>& data, bool compress, uint32_t claimed_extra_size=0)
+    {
+        std::vector<uint8_t> compressed;
+        if (compress)
+        {
+            size_t compressed_size = 0;
+            void* ptr = tdefl_compress_mem_to_heap(data.data(), data.size(), &compressed_size, 1);
+            if (!ptr)
+                return false;
+            compressed.assign(static_cast<uint8_t*>(ptr), static_cast<uint8_t*>(ptr) + compressed_size);
+            mz_free(ptr);
+        }
+        const std::vector<uint8_t>& body = compress ? compressed : data;
+        uint32_t crc = uint32_t(mz_crc32(MZ_CRC32_INIT, data.data(), data.size()));
+
+        uint32_t offset = uint32_t(ftell(f)) - prefix_size;
+        write32(0x04034b50); write16(20); write16(0); write16(compress ? 8 : 0); write32(0);
+        write32(crc); write32(uint32_t(body.size())); write32(uint32_t(data.size()) + claimed_extra_size);
+        write16(uint16_t(name.size())); write16(0);
+        fwrite(name.data(), 1, name.size(), f);
+        fwrite(body.data(), 1, body.size(), f);
+
+        std::vector<uint8_t> entry;
+        auto add16 = [&entry](uint16_t v) { entry.push_back(v); entry.push_back(v >> 8); };
+        auto add32 = [&add16](uint32_t v) { add16(uint16_t(v)); add16(uint16_t(v >> 16)); };
+        add32(0x02014b50); add16(20); add16(20); add16(0); add16(compress ? 8 : 0); add32(0);
+        add32(crc); add32(uint32_t(body.size())); add32(uint32_t(data.size()) + claimed_extra_size);
+        add16(uint16_t(name.size())); add16(0); add16(0); add16(0); add16(0); add32(0); add32(offset);
+        entry.insert(entry.end(), name.begin(), name.end());
+        central_directory.insert(central_directory.end(), entry.begin(), entry.end());
+        entry_count++;
+        return true;
+    }
+
+    void finish()
+    {
+        uint32_t offset = uint32_t(ftell(f)) - prefix_size;
+        fwrite(central_directory.data(), 1, central_directory.size(), f);
+        write32(0x06054b50); write16(0); write16(0); write16(entry_count); write16(entry_count);
+        write32(uint32_t(central_directory.size())); write32(offset); write16(0);
+        fclose(f);
+    }
+private:
+    void write16(uint16_t v) { uint8_t b[2] = {uint8_t(v), uint8_t(v >> 8)}; fwrite(b, 1, 2, f); }
+    void write32(uint32_t v) { write16(uint16_t(v)); write16(uint16_t(v >> 16)); }
+
+    FILE* f;
+    uint32_t prefix_size;
+    std::vector<uint8_t> central_directory;
+    uint16_t entry_count = 0;
+};
+
+static std::vector<uint8_t> zipTestRead(sp::io::ResourceStreamPtr stream, int64_t size)
+{
+    std::vector<uint8_t> data(size);
+    data.resize(stream->read(data.data(), size));
+    return data;
+}
+
+TEST_CASE("ZipResourceProvider")
+{
+    auto stored = zipTestData(100 * 1024, 1, false);
+    auto small = zipTestData(20 * 1024, 2, true);
+    auto large = zipTestData(10 * 1024 * 1024, 3, true);
+
+    ZipTestWriter writer("zip_test.zip");
+    CHECK(writer.add("stored.bin", stored, false));
+    CHECK(writer.add("small.txt", small, true));
+    CHECK(writer.add("large.txt", large, true));
+    writer.finish();
+
+    {
+        sp::P<sp::io::ZipResourceProvider> provider = new sp::io::ZipResourceProvider("zip_test.zip");
+        CHECK(provider->getStream("missing.txt") == nullptr);
+
+        auto stream = provider->getStream("stored.bin");
+        REQUIRE(stream);
+        CHECK(stream->getSize() == int64_t(stored.size()));
+        CHECK(zipTestRead(stream, stored.size() + 10) == stored);
+        stream->seek(1000);
+        CHECK(zipTestRead(stream, 10) == std::vector<uint8_t>(stored.begin() + 1000, stored.begin() + 1010));
+
+        stream = provider->getStream("small.txt");
+        REQUIRE(stream);
+        CHECK(zipTestRead(stream, small.size()) == small);
+
+        stream = provider->getStream("large.txt");
+        REQUIRE(stream);
+        CHECK(stream->getSize() == int64_t(large.size()));
+        CHECK(zipTestRead(stream, large.size()) == large);
+        //Seeking backwards and forwards goes through the checkpoints made while reading.
+        for(int64_t position : {int64_t(9 * 1024 * 1024 + 123), int64_t(1024 * 1024), int64_t(5 * 1024 * 1024 - 1), int64_t(8 * 1024 * 1024), int64_t(10)})
+        {
+            CHECK(stream->seek(position) == position);
+            CHECK(zipTestRead(stream, 1000) == std::vector<uint8_t>(large.begin() + position, large.begin() + position + 1000));
+            CHECK(stream->tell() == position + 1000);
+        }
+
+        provider.destroy();
+    }
+    remove("zip_test.zip");
+}
+
+TEST_CASE("ZipResourceProvider appended to a file")
+{
+    auto stored = zipTestData(1000, 4, false);
+    auto deflated = zipTestData(50 * 1024, 5, true);
+
+    ZipTestWriter writer("zip_test_appended.bin", 12345);
+    CHECK(writer.add("stored.bin", stored, false));
+    CHECK(writer.add("deflated.txt", deflated, true));
+    writer.finish();
+
+    {
+        sp::P<sp::io::ZipResourceProvider> provider = new sp::io::ZipResourceProvider("zip_test_appended.bin");
+        auto stream = provider->getStream("stored.bin");
+        REQUIRE(stream);
+        CHECK(zipTestRead(stream, stored.size()) == stored);
+        stream = provider->getStream("deflated.txt");
+        REQUIRE(stream);
+        CHECK(zipTestRead(stream, deflated.size()) == deflated);
+        provider.destroy();
+    }
+    remove("zip_test_appended.bin");
+}
+
+TEST_CASE("ZipResourceProvider stored file with wrong size")
+{
+    //A stored file claiming to be larger then its data would expose memory after the end of the zip.
+    auto stored = zipTestData(1000, 6, false);
+
+    ZipTestWriter writer("zip_test_corrupt.zip");
+    CHECK(writer.add("good.bin", stored, false));
+    CHECK(writer.add("bad.bin", stored, false, 1024 * 1024));
+    writer.finish();
+
+    {
+        sp::P<sp::io::ZipResourceProvider> provider = new sp::io::ZipResourceProvider("zip_test_corrupt.zip");
+        CHECK(provider->getStream("bad.bin") == nullptr);
+        CHECK(provider->getStream("good.bin") == nullptr);
+        provider.destroy();
+    }
+    remove("zip_test_corrupt.zip");
+}
+
+TEST_CASE("ZipResourceProvider benchmark" * doctest::skip())
+{
+    //Resource pack of 500MB, half of the files stored and half deflated.
+    const int file_count = 2000;
+    const size_t file_size = 256 * 1024;
+    FILE* f = fopen("zip_benchmark.zip", "rb");
+    if (f)
+    {
+        fclose(f);
+    }
+    else
+    {
+        ZipTestWriter writer("zip_benchmark.zip");
+        for(int n=0; n<file_count; n++)
+        {
+            auto data = zipTestData(file_size, n, n % 2);
+            REQUIRE(writer.add(sp::string("file") + sp::string(n) + ".bin", data, n % 2));
+        }
+        writer.finish();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sp::P<sp::io::ZipResourceProvider> provider = new sp::io::ZipResourceProvider("zip_benchmark.zip");
+    auto opened = std::chrono::steady_clock::now();
+    std::vector<uint8_t> buffer(file_size);
+    size_t total = 0;
+    for(int n=0; n<file_count; n++)
+    {
+        auto stream = provider->getStream(sp::string("file") + sp::string(n) + ".bin");
+        REQUIRE(stream);
+        //Read in small blocks, like most loaders do.
+        int64_t result;
+        while((result = stream->read(buffer.data(), 4096)) > 0)
+            total += result;
+    }
+    auto read_all = std::chrono::steady_clock::now();
+    //Read the first 1KB of each deflated file, with a backwards seek from the end.
+    for(int n=1; n<file_count; n+=2)
+    {
+        auto stream = provider->getStream(sp::string("file") + sp::string(n) + ".bin");
+        stream->seek(file_size - 1024);
+        stream->seek(0);
+        stream->read(buffer.data(), 1024);
+    }
+    auto seeks = std::chrono::steady_clock::now();
+    CHECK(total == file_count * file_size);
+
+    double open_time = std::chrono::duration<double, std::milli>(opened - start).count();
+    double read_time = std::chrono::duration<double, std::milli>(read_all - opened).count();
+    double seek_time = std::chrono::duration<double, std::milli>(seeks - read_all).count();
+    MESSAGE(open_time << "ms to open");
+    MESSAGE(read_time << "ms to read " << total / 1024 / 1024 << "MB");
+    MESSAGE(seek_time << "ms to seek back in " << file_count / 2 << " deflated files");
+    provider.destroy();
+}